@@ -0,0 +1,360 @@
+#include "include/game.h"
+#include "include/game_board.h"
+#include "include/globals.h"
+#include "include/state.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Compares shots per second of the bitboard game with the byte array
+// boards server_game_t used before. Every shot is registered and checked
+// for a win like handle_player_shot_request does.
+//
+// Then both players of one game shoot from their own threads, first with the
+// separately locked checks handle_players_shot made before and then with
+// game_apply_shot that decides the whole shot under one lock.
+
+#define GAMES 200000
+#define CONTENDED_GAMES 20000
+
+typedef struct {
+    pthread_mutex_t lock;
+    uint8_t state;
+    server_client_t* first;
+    uint8_t first_game_state[GAME_WIDTH * GAME_HEIGHT];
+    uint8_t second_game_state[GAME_WIDTH * GAME_HEIGHT];
+} legacy_game_t;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint8_t legacy_started(legacy_game_t* game) {
+    pthread_mutex_lock(&game->lock);
+    uint8_t out = game->state == GAME_STATE_STARTED;
+    pthread_mutex_unlock(&game->lock);
+    return out;
+}
+
+static uint8_t legacy_register_shot(legacy_game_t* game, server_client_t* client, Coordinate target) {
+    if (!legacy_started(game)) {
+        return GAME_FIELD_INVALID;
+    }
+
+    pthread_mutex_lock(&game->lock);
+
+    uint8_t* target_board = game->first == client ? game->second_game_state : game->first_game_state;
+    uint8_t index = target.x + target.y * GAME_WIDTH;
+    uint8_t out = target_board[index];
+    if (out == GAME_FIELD_EMPTY) {
+        target_board[index] = GAME_FIELD_MISS;
+    } else if (out == GAME_FIELD_SHIP) {
+        target_board[index] = GAME_FIELD_HIT;
+    }
+
+    pthread_mutex_unlock(&game->lock);
+    return out;
+}
+
+static uint8_t legacy_check_win(legacy_game_t* game, server_client_t* client) {
+    if (!legacy_started(game)) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&game->lock);
+
+    uint8_t* opponents_board = game->first == client ? game->second_game_state : game->first_game_state;
+    uint8_t opponents_ships = 0;
+    for (uint16_t i = 0; i < GAME_WIDTH * GAME_HEIGHT; i++) {
+        if (opponents_board[i] == GAME_FIELD_SHIP) {
+            opponents_ships++;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&game->lock);
+    return opponents_ships == 0;
+}
+
+// Standard fleet placed on the first rows, sinking it takes a full sweep of the board
+static void fill_fields(uint8_t* fields) {
+    memset(fields, GAME_FIELD_EMPTY, GAME_WIDTH * GAME_HEIGHT);
+    uint8_t ships[][3] = {
+        { 0, 0, 4 }, { 0, 2, 3 }, { 4, 2, 3 }, { 0, 4, 2 }, { 3, 4, 2 },
+        { 6, 4, 2 }, { 0, 6, 1 }, { 2, 6, 1 }, { 4, 6, 1 }, { 6, 7, 1 },
+    };
+
+    for (uint8_t s = 0; s < sizeof(ships) / sizeof(ships[0]); s++) {
+        for (uint8_t i = 0; i < ships[s][2]; i++) {
+            fields[ships[s][0] + i + ships[s][1] * GAME_WIDTH] = GAME_FIELD_SHIP;
+        }
+    }
+}
+
+// Checks of the shot the way handle_players_shot made them, each under its own lock.
+// They don't assert the game is started, the other player can finish it in between.
+static uint8_t legacy_started_game(server_game_t* game) {
+    pthread_mutex_lock(&game->lock);
+    uint8_t out = game->state == GAME_STATE_STARTED;
+    pthread_mutex_unlock(&game->lock);
+    return out;
+}
+
+static uint8_t legacy_is_my_turn(server_game_t* game, server_client_t* client) {
+    if (!legacy_started_game(game)) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&game->lock);
+    uint8_t out = (game->first == client && game->turn == GAME_FIRSTS_TURN) ||
+                  (game->second == client && game->turn == GAME_SECONDS_TURN);
+    pthread_mutex_unlock(&game->lock);
+    return out;
+}
+
+static uint8_t legacy_shoot(server_game_t* game, server_client_t* client, Coordinate target) {
+    if (!legacy_started_game(game)) {
+        return GAME_FIELD_INVALID;
+    }
+
+    pthread_mutex_lock(&game->lock);
+    game_board_t* board = game->first == client ? &game->second_board : &game->first_board;
+    uint8_t out = game_board_shoot(board, target.x + target.y * GAME_WIDTH);
+    pthread_mutex_unlock(&game->lock);
+    return out;
+}
+
+static uint8_t legacy_won(server_game_t* game, server_client_t* client) {
+    if (!legacy_started_game(game)) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&game->lock);
+    uint8_t out = game_board_all_sunk(game->first == client ? &game->second_board : &game->first_board);
+    pthread_mutex_unlock(&game->lock);
+    return out;
+}
+
+static void legacy_finish(server_game_t* game, server_client_t* client) {
+    pthread_mutex_lock(&game->lock);
+    game->state = GAME_STATE_FINISHED;
+    game->won = game->first == client ? GAME_FIRST_WON : GAME_SECOND_WON;
+    pthread_mutex_unlock(&game->lock);
+}
+
+static void legacy_next_turn(server_game_t* game, server_client_t* client) {
+    if (!legacy_started_game(game)) {
+        return;
+    }
+
+    pthread_mutex_lock(&game->lock);
+    game->turn = game->first == client ? GAME_SECONDS_TURN : GAME_FIRSTS_TURN;
+    pthread_mutex_unlock(&game->lock);
+}
+
+static game_shot_t legacy_apply_shot(server_game_t* game, server_client_t* client, Coordinate target) {
+    game_shot_t out = { 0 };
+
+    if (!legacy_started_game(game)) {
+        out.status_code = STATUS_GAME_NOT_STARTED;
+        return out;
+    }
+
+    // Turns of both players were logged before the turn was checked
+    legacy_is_my_turn(game, client);
+    server_client_t* other = game_other_player(game, client);
+    legacy_is_my_turn(game, other);
+
+    if (!legacy_is_my_turn(game, client)) {
+        out.status_code = STATUS_GAME_NOT_MY_TURN;
+        return out;
+    }
+
+    uint8_t field = legacy_shoot(game, client, target);
+    if (field != GAME_FIELD_SHIP && field != GAME_FIELD_EMPTY) {
+        out.status_code = field == GAME_FIELD_INVALID ? STATUS_GAME_NOT_STARTED : STATUS_SHOT_ALREADY_DESTROYED;
+        return out;
+    }
+
+    out.status_code = STATUS_OK;
+    out.hit = field == GAME_FIELD_SHIP;
+    out.won = legacy_won(game, client);
+    if (out.won) {
+        legacy_finish(game, client);
+    } else if (!out.hit) {
+        legacy_next_turn(game, client);
+    }
+    out.other = game_other_player(game, client);
+    return out;
+}
+
+typedef struct {
+    server_game_t* game;
+    server_client_t* me;
+    game_board_t* board;
+    uint8_t legacy;
+    uint64_t shots;
+    uint64_t rejected;
+} player_t;
+
+static _Atomic uint32_t games_played;
+// Moves forward every time the winner sets up a new game
+static _Atomic uint32_t generation;
+
+// Shoots at every field in order, the player that sinks the other fleet first sets up the next game
+static void* run_player(void* params) {
+    player_t* player = params;
+    server_game_t* game = player->game;
+
+    uint32_t my_generation = atomic_load(&generation);
+    uint8_t index = 0;
+    while (atomic_load(&games_played) < CONTENDED_GAMES) {
+        uint32_t current = atomic_load(&generation);
+        if (current != my_generation) {
+            my_generation = current;
+            index = 0;
+        }
+
+        if (index >= GAME_WIDTH * GAME_HEIGHT) {
+            sched_yield();
+            continue;
+        }
+
+        Coordinate target = { .x = index % GAME_WIDTH, .y = index / GAME_WIDTH };
+        game_shot_t shot = player->legacy ? legacy_apply_shot(game, player->me, target)
+                                          : game_apply_shot(game, player->me, target);
+
+        if (shot.status_code == STATUS_GAME_NOT_MY_TURN || shot.status_code == STATUS_GAME_NOT_STARTED) {
+            player->rejected++;
+            sched_yield();
+            continue;
+        }
+
+        index++;
+        if (shot.status_code != STATUS_OK) {
+            continue;
+        }
+
+        player->shots++;
+        if (shot.won) {
+            pthread_mutex_lock(&game->lock);
+            game->first_board = *player->board;
+            game->second_board = *player->board;
+            game->turn = GAME_FIRSTS_TURN;
+            game->state = GAME_STATE_STARTED;
+            pthread_mutex_unlock(&game->lock);
+
+            atomic_fetch_add(&games_played, 1);
+            atomic_fetch_add(&generation, 1);
+        }
+    }
+
+    return NULL;
+}
+
+static void run_contended(const char* name, uint8_t legacy, game_board_t* board) {
+    server_client_t first = { 0 };
+    server_client_t second = { 0 };
+    server_game_t game = game_new(&first, &second);
+    game.first_board = *board;
+    game.second_board = *board;
+    game.turn = GAME_FIRSTS_TURN;
+    game.state = GAME_STATE_STARTED;
+
+    atomic_store(&games_played, 0);
+    atomic_store(&generation, 0);
+
+    player_t players[2] = {
+        { .game = &game, .me = &first, .board = board, .legacy = legacy },
+        { .game = &game, .me = &second, .board = board, .legacy = legacy },
+    };
+    pthread_t threads[2];
+
+    uint64_t start = now_ns();
+    for (uint8_t i = 0; i < 2; i++) {
+        pthread_create(&threads[i], NULL, run_player, &players[i]);
+    }
+    for (uint8_t i = 0; i < 2; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    uint64_t elapsed = now_ns() - start;
+    pthread_mutex_destroy(&game.lock);
+
+    uint64_t shots = players[0].shots + players[1].shots;
+    uint64_t rejected = players[0].rejected + players[1].rejected;
+    fprintf(stdout, "%10s %14.0f %14.1f %14lu\n", name, shots * 1e9 / elapsed, (double)elapsed / shots, rejected);
+}
+
+int main(void) {
+    server_client_t first = { 0 };
+    server_client_t second = { 0 };
+
+    uint8_t fields[GAME_WIDTH * GAME_HEIGHT];
+    fill_fields(fields);
+
+    uint64_t shots = 0;
+    uint64_t wins = 0;
+
+    legacy_game_t legacy = { .state = GAME_STATE_STARTED, .first = &first };
+    pthread_mutex_init(&legacy.lock, NULL);
+
+    uint64_t start = now_ns();
+    for (uint32_t g = 0; g < GAMES; g++) {
+        memcpy(legacy.second_game_state, fields, sizeof(fields));
+        for (int8_t i = 0; i < GAME_WIDTH * GAME_HEIGHT; i++) {
+            Coordinate target = { .x = i % GAME_WIDTH, .y = i / GAME_WIDTH };
+            legacy_register_shot(&legacy, &first, target);
+            shots++;
+            if (legacy_check_win(&legacy, &first)) {
+                wins++;
+                break;
+            }
+        }
+    }
+    uint64_t legacy_ns = now_ns() - start;
+    uint64_t legacy_shots = shots;
+    pthread_mutex_destroy(&legacy.lock);
+
+    server_game_t game = game_new(&first, &second);
+    game.state = GAME_STATE_STARTED;
+    game_board_t board = game_board_from_fields(fields);
+
+    shots = 0;
+    start = now_ns();
+    for (uint32_t g = 0; g < GAMES; g++) {
+        game.second_board = board;
+        for (int8_t i = 0; i < GAME_WIDTH * GAME_HEIGHT; i++) {
+            Coordinate target = { .x = i % GAME_WIDTH, .y = i / GAME_WIDTH };
+            game_register_shot(&game, &first, target);
+            shots++;
+            if (game_check_win(&game, &first)) {
+                wins++;
+                break;
+            }
+        }
+    }
+    uint64_t bitboard_ns = now_ns() - start;
+    pthread_mutex_destroy(&game.lock);
+
+    if (wins != 2 * GAMES || shots != legacy_shots) {
+        fprintf(stderr, RED "ERROR: Games didn't finish the same way\n" RESET);
+        return 1;
+    }
+
+    fprintf(stdout, "%10s %14s %14s\n", "boards", "shots/sec", "ns/shot");
+    fprintf(stdout, "%10s %14.0f %14.1f\n", "bytes", legacy_shots * 1e9 / legacy_ns, (double)legacy_ns / legacy_shots);
+    fprintf(stdout, "%10s %14.0f %14.1f\n", "bitboard", shots * 1e9 / bitboard_ns, (double)bitboard_ns / shots);
+
+    fprintf(stdout, "\n%u games, both players shooting from their own threads\n", CONTENDED_GAMES);
+    fprintf(stdout, "%10s %14s %14s %14s\n", "shot", "shots/sec", "ns/shot", "not my turn");
+    run_contended("locked", 1, &board);
+    run_contended("apply", 0, &board);
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include "include/errors.h"
+#include "include/globals.h"
+#include "include/histogram.h"
+#include "include/matchmaker.h"
+#include "include/server_stats.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Measures how long the matcher takes to place one queued client with 100k clients
+// in the queue. Ratings are spread so most buckets always have someone waiting.
+
+#define PLAYERS 100000
+#define ROUNDS 10
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint8_t pair_always(void* params, const matchmaker_entry_t* first, const matchmaker_entry_t* second) {
+    (void)first;
+    (void)second;
+    (*(uint64_t*)params)++;
+    return MATCHMAKER_PAIRED;
+}
+
+int main(void) {
+    server_stats_t stats;
+    if (server_stats_init(&stats) != ERR_NONE) {
+        fprintf(stderr, RED "ERROR: Failed to create stats\n" RESET);
+        return 1;
+    }
+
+    uint64_t pairs = 0;
+    matchmaker_t matchmaker;
+    memset(&matchmaker, 0, sizeof(matchmaker));
+    matchmaker.pair = pair_always;
+    matchmaker.params = &pairs;
+    matchmaker.stats = &stats;
+
+    if (matchmaker_queue_init(&matchmaker.queue, MATCHMAKER_QUEUE_CAP) != ERR_NONE) {
+        fprintf(stderr, RED "ERROR: Failed to create the queue\n" RESET);
+        return 1;
+    }
+
+    histogram_t match_latency;
+    histogram_init(&match_latency);
+    uint64_t seed = 0x9e3779b97f4a7c15ull;
+    uint64_t total_ns = 0;
+
+    for (uint32_t round = 0; round < ROUNDS; round++) {
+        uint64_t enqueued_at = now_ns();
+        for (uint32_t i = 0; i < PLAYERS; i++) {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+
+            matchmaker_entry_t entry = { .client_id = i, .rating = seed % 3200, .enqueued_at = enqueued_at };
+            if (!matchmaker_queue_push(&matchmaker.queue, &entry)) {
+                fprintf(stderr, RED "ERROR: Queue is full\n" RESET);
+                return 1;
+            }
+        }
+
+        // Same as the matcher thread, every client is matched against the waiting ones right away
+        matchmaker_entry_t entry;
+        uint64_t start = now_ns();
+        while (matchmaker_queue_pop(&matchmaker.queue, &entry)) {
+            uint64_t before = now_ns();
+            matchmaker_match(&matchmaker, &entry, before);
+            histogram_record(&match_latency, now_ns() - before);
+        }
+        matchmaker_widen(&matchmaker, now_ns());
+        total_ns += now_ns() - start;
+    }
+
+    fprintf(stdout, "%10s %10s %10s %12s %10s %10s %10s\n", "players", "pairs", "waiting", "ns/player", "p50 ns",
+            "p99 ns", "max ns");
+    fprintf(stdout, "%10u %10lu %10u %12.1f %10lu %10lu %10lu\n", PLAYERS * ROUNDS, pairs, matchmaker.waiting_len,
+            (double)total_ns / (PLAYERS * ROUNDS), histogram_percentile(&match_latency, 50),
+            histogram_percentile(&match_latency, 99), match_latency.max);
+
+    matchmaker_queue_deinit(&matchmaker.queue);
+    server_stats_deinit(&stats);
+    return 0;
+}
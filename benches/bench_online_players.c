@@ -0,0 +1,263 @@
+#include "include/errors.h"
+#include "include/globals.h"
+#include "include/online_players.h"
+#include "include/server_utils.h"
+#include "include/state.h"
+#include "include/username_map.h"
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Challenge lookups and user lists read the online players while one thread keeps
+// logging players out and back in, first under the sessions lock the way the server
+// did before and then from the published snapshot.
+
+#define PLAYERS 2000
+#define READERS 4
+#define LOOKUPS_PER_READER 200000
+// Every reader lists all players once per this many lookups
+#define LOOKUPS_PER_LIST 1000
+// Pause between two logins, players log in and out far less often than they're looked up
+#define CHURN_PAUSE_US 100
+
+// Sessions and the players ordered by username, both under the sessions lock the way the
+// server had them before the snapshot. Players are changed in place, there's room for all of them.
+typedef struct {
+    pthread_rwlock_t lock;
+    username_map_t sessions;
+    online_snapshot_t* players;
+} legacy_sessions_t;
+
+typedef struct {
+    server_state_t* state;
+    legacy_sessions_t* legacy;
+    uint64_t seed;
+    uint64_t found;
+    uint64_t listed;
+} reader_t;
+
+static _Atomic uint8_t readers_done;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint32_t next_random(uint64_t* seed) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 7;
+    *seed ^= *seed << 17;
+    return (uint32_t)(*seed % PLAYERS);
+}
+
+static server_client_t* legacy_find_client(legacy_sessions_t* legacy, server_state_t* state, char* username) {
+    pthread_rwlock_rdlock(&legacy->lock);
+    uint32_t id;
+    uint8_t found = username_map_get(&legacy->sessions, username, &id);
+    pthread_rwlock_unlock(&legacy->lock);
+
+    return found ? server_client_at(state, id) : NULL;
+}
+
+// Callers hold the sessions lock for writing
+static void legacy_insert(legacy_sessions_t* legacy, const char* username, uint32_t client_id) {
+    online_snapshot_t* players = legacy->players;
+    uint32_t i = online_snapshot_seek(players, username, 0);
+    memmove(&players->players[i + 1], &players->players[i], (size_t)(players->len - i) * sizeof(online_player_t));
+    memcpy(players->players[i].username, username, USERNAME_MAX_LEN);
+    players->players[i].client_id = client_id;
+    players->players[i].looking_for_game = 0;
+    players->len++;
+}
+
+static void legacy_remove(legacy_sessions_t* legacy, const char* username) {
+    online_snapshot_t* players = legacy->players;
+    uint32_t i = online_snapshot_seek(players, username, 0);
+    if (i == players->len || strncmp(players->players[i].username, username, USERNAME_MAX_LEN) != 0) {
+        return;
+    }
+
+    memmove(&players->players[i], &players->players[i + 1], (size_t)(players->len - i - 1) * sizeof(online_player_t));
+    players->len--;
+}
+
+// Walks the players under the sessions lock and reads the flag of every client
+static uint32_t legacy_list(legacy_sessions_t* legacy, server_state_t* state, ListUsersEntry* entries) {
+    pthread_rwlock_rdlock(&legacy->lock);
+    const online_snapshot_t* players = legacy->players;
+    for (uint32_t i = 0; i < players->len; i++) {
+        server_client_t* other = server_client_at(state, players->players[i].client_id);
+        entries[i].looking_for_game = client_looking_for_game(other) ? 1 : 0;
+        memcpy(entries[i].username, players->players[i].username, USERNAME_MAX_LEN);
+    }
+    uint32_t count = players->len;
+    pthread_rwlock_unlock(&legacy->lock);
+    return count;
+}
+
+static uint32_t snapshot_list(server_state_t* state, ListUsersEntry* entries) {
+    online_players_guard_t guard;
+    const online_snapshot_t* snapshot = online_players_read(&state->online, &guard);
+    for (uint32_t i = 0; i < snapshot->len; i++) {
+        entries[i].looking_for_game = snapshot->players[i].looking_for_game;
+        memcpy(entries[i].username, snapshot->players[i].username, USERNAME_MAX_LEN);
+    }
+    uint32_t count = snapshot->len;
+    online_players_read_end(&state->online, &guard);
+    return count;
+}
+
+static void* run_reader(void* params) {
+    reader_t* reader = params;
+    ListUsersEntry* entries = malloc(PLAYERS * sizeof(ListUsersEntry));
+
+    char username[USERNAME_MAX_LEN];
+    for (uint32_t i = 0; i < LOOKUPS_PER_READER; i++) {
+        memset(username, 0, sizeof(username));
+        snprintf(username, USERNAME_MAX_LEN, "player%u", next_random(&reader->seed));
+
+        server_client_t* client = reader->legacy != NULL ? legacy_find_client(reader->legacy, reader->state, username)
+                                                         : server_find_client_by_username(reader->state, username);
+        reader->found += client != NULL;
+
+        if (i % LOOKUPS_PER_LIST == 0) {
+            reader->listed += reader->legacy != NULL ? legacy_list(reader->legacy, reader->state, entries)
+                                                     : snapshot_list(reader->state, entries);
+        }
+    }
+
+    free(entries);
+    return NULL;
+}
+
+typedef struct {
+    server_state_t* state;
+    legacy_sessions_t* legacy;
+    uint64_t seed;
+    uint32_t changes;
+    // Time spent logging out and back in, waiting for the lock included
+    uint64_t change_ns;
+    uint64_t max_change_ns;
+} churner_t;
+
+// Logs a random player out and back in until every reader is done
+static void* run_churn(void* params) {
+    churner_t* churner = params;
+    server_state_t* state = churner->state;
+
+    legacy_sessions_t* legacy = churner->legacy;
+
+    while (!atomic_load(&readers_done)) {
+        server_client_t* client = server_client_at(state, next_random(&churner->seed));
+
+        uint64_t start = now_ns();
+        if (legacy != NULL) {
+            pthread_rwlock_wrlock(&legacy->lock);
+            username_map_remove(&legacy->sessions, client->user->username);
+            legacy_remove(legacy, client->user->username);
+            pthread_rwlock_unlock(&legacy->lock);
+
+            pthread_rwlock_wrlock(&legacy->lock);
+            username_map_put(&legacy->sessions, client->user->username, client->id);
+            legacy_insert(legacy, client->user->username, client->id);
+            pthread_rwlock_unlock(&legacy->lock);
+        } else {
+            server_remove_session(state, client);
+            server_add_session(state, client, client->user);
+        }
+        uint64_t elapsed = now_ns() - start;
+        churner->change_ns += elapsed;
+        churner->max_change_ns = elapsed > churner->max_change_ns ? elapsed : churner->max_change_ns;
+        churner->changes++;
+        usleep(CHURN_PAUSE_US);
+    }
+
+    return NULL;
+}
+
+static void run(const char* name, server_state_t* state, legacy_sessions_t* legacy) {
+    atomic_store(&readers_done, 0);
+
+    churner_t churner = { .state = state, .legacy = legacy, .seed = 0x2545f4914f6cdd1dull };
+    pthread_t churn_thread;
+    pthread_create(&churn_thread, NULL, run_churn, &churner);
+
+    reader_t readers[READERS];
+    pthread_t threads[READERS];
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < READERS; i++) {
+        readers[i] = (reader_t){ .state = state, .legacy = legacy, .seed = 0x9e3779b97f4a7c15ull + i };
+        pthread_create(&threads[i], NULL, run_reader, &readers[i]);
+    }
+
+    uint64_t found = 0;
+    uint64_t listed = 0;
+    for (uint32_t i = 0; i < READERS; i++) {
+        pthread_join(threads[i], NULL);
+        found += readers[i].found;
+        listed += readers[i].listed;
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    atomic_store(&readers_done, 1);
+    pthread_join(churn_thread, NULL);
+
+    fprintf(stdout, "%-8s %u readers: %.2f M lookups/s, %lu found, %lu players listed\n", name, READERS,
+            READERS * LOOKUPS_PER_READER / (elapsed / 1e3), found, listed);
+    fprintf(stdout, "%-8s %u logins meanwhile: %.1f us/login on average, %.1f ms the longest\n", name, churner.changes,
+            churner.changes > 0 ? churner.change_ns / 1e3 / churner.changes : 0.0, churner.max_change_ns / 1e6);
+}
+
+int main(void) {
+    server_state_t* state = calloc(1, sizeof(server_state_t));
+    server_user_t* users = calloc(PLAYERS, sizeof(server_user_t));
+    legacy_sessions_t legacy = { .players = online_snapshot_new(PLAYERS) };
+    if (state == NULL || users == NULL || server_shards_init(state) != ERR_NONE ||
+        username_map_init(&state->sessions, PLAYERS) != ERR_NONE || online_players_init(&state->online) != ERR_NONE ||
+        username_map_init(&legacy.sessions, PLAYERS) != ERR_NONE || legacy.players == NULL) {
+        fprintf(stderr, RED "ERROR: Failed to create the sessions\n" RESET);
+        return 1;
+    }
+    pthread_rwlock_init(&state->sessions_rwlock, NULL);
+    pthread_rwlock_init(&legacy.lock, NULL);
+    // Room for every player, none of them is logged in yet
+    legacy.players->len = 0;
+
+    // Clients are added to the shards in turns so client i has id i
+    struct sockaddr_in addr = { 0 };
+    for (uint32_t i = 0; i < PLAYERS; i++) {
+        snprintf(users[i].username, USERNAME_MAX_LEN, "player%u", i);
+        server_client_t* client = server_add_client(state, i, addr);
+        client->user = &users[i];
+        if (i % 3 == 0) {
+            server_set_looking_for_game(state, client, 1);
+        }
+        if (server_add_session(state, client, client->user) != ERR_NONE ||
+            username_map_put(&legacy.sessions, users[i].username, client->id) != ERR_NONE) {
+            fprintf(stderr, RED "ERROR: Failed to log in %s\n" RESET, users[i].username);
+            return 1;
+        }
+        legacy_insert(&legacy, users[i].username, client->id);
+    }
+
+    run("locked", state, &legacy);
+    run("snapshot", state, NULL);
+
+    pthread_rwlock_destroy(&legacy.lock);
+    free(legacy.players);
+    username_map_deinit(&legacy.sessions);
+    pthread_rwlock_destroy(&state->sessions_rwlock);
+    online_players_deinit(&state->online);
+    username_map_deinit(&state->sessions);
+    server_shards_deinit(state);
+    free(users);
+    free(state);
+    return 0;
+}
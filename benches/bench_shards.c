@@ -0,0 +1,238 @@
+#include "include/errors.h"
+#include "include/globals.h"
+#include "include/server_utils.h"
+#include "include/shard_lock.h"
+#include "include/state.h"
+#include "include/username_map.h"
+#include "include/users.h"
+#include "include/users_journal.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Logins look up users while one thread keeps signing new users up, first with the single
+// users lock and index the server had before and then with the sharded index.
+// Signups are journaled and wait for the fsync like they do in the server.
+
+#define USERS 100000
+#define READERS 4
+#define LOOKUPS_PER_READER 200000
+
+// Users index and lock before they were sharded
+typedef struct {
+    pthread_rwlock_t lock;
+    username_map_t index;
+} legacy_users_t;
+
+typedef struct {
+    server_state_t* state;
+    legacy_users_t* legacy;
+    uint64_t seed;
+    uint64_t found;
+} reader_t;
+
+static _Atomic uint8_t readers_done;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint32_t next_random(uint64_t* seed) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 7;
+    *seed ^= *seed << 17;
+    return (uint32_t)(*seed % USERS);
+}
+
+static server_user_t make_user(const char* prefix, uint32_t i) {
+    server_user_t user = { 0 };
+    snprintf(user.username, USERNAME_MAX_LEN, "%s%u", prefix, i);
+    snprintf(user.password, PASSWORD_MAX_LEN, "password");
+    return user;
+}
+
+static server_user_t* legacy_find_user(legacy_users_t* legacy, server_state_t* state, char* username) {
+    pthread_rwlock_rdlock(&legacy->lock);
+
+    uint32_t id;
+    server_user_t* user = NULL;
+    if (username_map_get(&legacy->index, username, &id)) {
+        user = record_table_at(&state->users, id);
+    }
+
+    pthread_rwlock_unlock(&legacy->lock);
+    return user;
+}
+
+static server_user_t* legacy_add_user(legacy_users_t* legacy, server_state_t* state, server_user_t user) {
+    pthread_rwlock_wrlock(&legacy->lock);
+
+    server_user_t* out = NULL;
+    uint64_t seq = 0;
+    uint32_t index = record_table_len(&state->users);
+    if (username_map_put(&legacy->index, user.username, index) == ERR_NONE) {
+        out = record_table_push(&state->users, &user);
+        seq = users_journal_append(&state->users_journal, USERS_JOURNAL_ADD_USER, index, &user);
+    }
+
+    pthread_rwlock_unlock(&legacy->lock);
+
+    if (seq != 0) {
+        users_journal_sync(&state->users_journal, seq);
+    }
+
+    return out;
+}
+
+static void* run_reader(void* params) {
+    reader_t* reader = params;
+
+    char username[USERNAME_MAX_LEN];
+    for (uint32_t i = 0; i < LOOKUPS_PER_READER; i++) {
+        memset(username, 0, sizeof(username));
+        snprintf(username, USERNAME_MAX_LEN, "user%u", next_random(&reader->seed));
+
+        uint32_t id;
+        server_user_t* user = reader->legacy != NULL ? legacy_find_user(reader->legacy, reader->state, username)
+                                                     : server_find_user_by_username(reader->state, username, &id);
+        reader->found += user != NULL;
+    }
+
+    return NULL;
+}
+
+typedef struct {
+    server_state_t* state;
+    legacy_users_t* legacy;
+    uint32_t signups;
+} signer_t;
+
+// Signs users up until every reader is done
+static void* run_signups(void* params) {
+    signer_t* signer = params;
+
+    while (!atomic_load(&readers_done)) {
+        server_user_t user = make_user(signer->legacy != NULL ? "legacy" : "sharded", signer->signups);
+
+        uint32_t id;
+        server_user_t* added = NULL;
+        if (signer->legacy != NULL) {
+            added = legacy_add_user(signer->legacy, signer->state, user);
+        } else if (server_add_user(signer->state, user, &added, &id) != ERR_NONE) {
+            added = NULL;
+        }
+        if (added == NULL) {
+            fprintf(stderr, RED "ERROR: Failed to sign up %s\n" RESET, user.username);
+            break;
+        }
+        signer->signups++;
+    }
+
+    return NULL;
+}
+
+static void run(const char* name, server_state_t* state, legacy_users_t* legacy) {
+    atomic_store(&readers_done, 0);
+
+    signer_t signer = { .state = state, .legacy = legacy, .signups = 0 };
+    pthread_t signer_thread;
+    pthread_create(&signer_thread, NULL, run_signups, &signer);
+
+    reader_t readers[READERS];
+    pthread_t threads[READERS];
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < READERS; i++) {
+        readers[i] = (reader_t){ .state = state, .legacy = legacy, .seed = 0x9e3779b97f4a7c15ull + i, .found = 0 };
+        pthread_create(&threads[i], NULL, run_reader, &readers[i]);
+    }
+
+    uint64_t found = 0;
+    for (uint32_t i = 0; i < READERS; i++) {
+        pthread_join(threads[i], NULL);
+        found += readers[i].found;
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    atomic_store(&readers_done, 1);
+    pthread_join(signer_thread, NULL);
+
+    fprintf(stdout, "%-8s %u readers: %.2f M lookups/s, %lu of %u found, %u signups meanwhile\n", name, READERS,
+            READERS * LOOKUPS_PER_READER / (elapsed / 1e3), found, READERS * LOOKUPS_PER_READER, signer.signups);
+}
+
+int main(void) {
+    char dir[] = "/tmp/bench_shards_XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        fprintf(stderr, RED "ERROR: Failed to create a directory for the users\n" RESET);
+        return 1;
+    }
+
+    char snapshot_path[64];
+    char log_path[64];
+    snprintf(snapshot_path, sizeof(snapshot_path), "%s/users.db", dir);
+    snprintf(log_path, sizeof(log_path), "%s/users.db.log", dir);
+
+    server_state_t* state = calloc(1, sizeof(server_state_t));
+    legacy_users_t legacy;
+    username_map_t users_index;
+    if (state == NULL || server_shards_init(state) != ERR_NONE ||
+        users_load(&state->users, &users_index, snapshot_path) != ERR_NONE ||
+        users_journal_open(&state->users_journal, snapshot_path, log_path, &state->users, &users_index,
+                           &state->users_table_lock) != ERR_NONE) {
+        fprintf(stderr, RED "ERROR: Failed to create the users\n" RESET);
+        return 1;
+    }
+
+    // Existing users aren't journaled, only the signups during the runs are
+    for (uint32_t i = 0; i < USERS; i++) {
+        server_user_t user = make_user("user", i);
+        record_table_push(&state->users, &user);
+    }
+    username_map_deinit(&users_index);
+
+    pthread_rwlock_init(&legacy.lock, NULL);
+    if (username_map_init(&legacy.index, USERS) != ERR_NONE) {
+        fprintf(stderr, RED "ERROR: Failed to create the legacy index\n" RESET);
+        return 1;
+    }
+    for (uint32_t i = 0; i < USERS; i++) {
+        username_map_put(&legacy.index, ((server_user_t*)record_table_at(&state->users, i))->username, i);
+    }
+
+    if (server_shards_index_users(state) != ERR_NONE) {
+        fprintf(stderr, RED "ERROR: Failed to index the users\n" RESET);
+        return 1;
+    }
+
+    run("single", state, &legacy);
+    run("sharded", state, NULL);
+
+    uint64_t contended = 0;
+    uint64_t wait_ns = 0;
+    for (uint32_t i = 0; i < STATE_SHARDS; i++) {
+        shard_lock_stats_t stats;
+        shard_lock_stats(&state->users_locks[i], &stats);
+        contended += stats.contended;
+        wait_ns += stats.wait_ns;
+    }
+    fprintf(stdout, "sharded users locks: %lu contended, %.1f ms waited in total\n", contended, wait_ns / 1e6);
+
+    users_journal_close(&state->users_journal);
+    username_map_deinit(&legacy.index);
+    pthread_rwlock_destroy(&legacy.lock);
+    record_table_destroy(&state->users);
+    server_shards_deinit(state);
+    free(state);
+
+    unlink(snapshot_path);
+    unlink(log_path);
+    rmdir(dir);
+    return 0;
+}
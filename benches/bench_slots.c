@@ -0,0 +1,160 @@
+#include "include/game.h"
+#include "include/globals.h"
+#include "include/server_utils.h"
+#include "include/state.h"
+#include "include/shard_lock.h"
+#include "include/slot_pool.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Compares taking a client and a game slot from the free lists with the
+// scan for a free slot the accept loop and server_add_game did before.
+// Tables have 100k slots and a random slot is freed before every add.
+
+#define SLOTS 100000
+#define ROUNDS 2000
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint32_t next_random(uint64_t* seed) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 7;
+    *seed ^= *seed << 17;
+    return (uint32_t)(*seed % SLOTS);
+}
+
+// Scan goes through the shards one after the other, same as it would with the sharded tables
+static server_client_t* legacy_add_client(server_state_t* state, int sock_fd) {
+    server_client_t* out = NULL;
+    for (uint32_t shard = 0; shard < STATE_SHARDS && out == NULL; shard++) {
+        uint64_t locked_at = shard_lock_write(&state->clients_locks[shard]);
+
+        for (uint32_t i = 0; i < slot_pool_len(&state->clients[shard]); i++) {
+            server_client_t* client = slot_pool_at(&state->clients[shard], i);
+            if (client->sock_fd == -1) {
+                client->sock_fd = sock_fd;
+                out = client;
+                break;
+            }
+        }
+
+        shard_lock_unlock(&state->clients_locks[shard], locked_at);
+    }
+
+    return out;
+}
+
+static server_game_t* legacy_add_game(server_state_t* state, server_game_t game) {
+    server_game_t* out = NULL;
+    for (uint32_t shard = 0; shard < STATE_SHARDS && out == NULL; shard++) {
+        uint64_t locked_at = shard_lock_write(&state->games_locks[shard]);
+
+        for (uint32_t i = 0; i < slot_pool_len(&state->games[shard]); i++) {
+            server_game_t* g = slot_pool_at(&state->games[shard], i);
+            if (g->state == GAME_STATE_CLOSED) {
+                out = g;
+                *out = game;
+                break;
+            }
+        }
+
+        shard_lock_unlock(&state->games_locks[shard], locked_at);
+    }
+
+    return out;
+}
+
+static server_game_t* random_game(server_state_t* state, uint64_t* seed) {
+    uint32_t r = next_random(seed);
+    slot_pool_t* pool = &state->games[STATE_SHARD(r)];
+    return slot_pool_at(pool, STATE_SHARD_SLOT(r) % slot_pool_len(pool));
+}
+
+static void bench_clients(server_state_t* state) {
+    struct sockaddr_in addr = { 0 };
+    for (uint32_t i = 0; i < SLOTS; i++) {
+        server_add_client(state, i, addr);
+    }
+
+    uint64_t seed = 0x9e3779b97f4a7c15ull;
+    uint64_t legacy_ns = 0;
+    for (uint32_t r = 0; r < ROUNDS; r++) {
+        server_client_t* client = server_client_at(state, next_random(&seed));
+        int sock_fd = client->sock_fd;
+        client->sock_fd = -1;
+
+        uint64_t start = now_ns();
+        legacy_add_client(state, sock_fd);
+        legacy_ns += now_ns() - start;
+    }
+
+    uint64_t free_list_ns = 0;
+    for (uint32_t r = 0; r < ROUNDS; r++) {
+        server_client_t* client = server_client_at(state, next_random(&seed));
+        int sock_fd = client->sock_fd;
+        client->sock_fd = -1;
+        server_remove_client(state, client);
+
+        uint64_t start = now_ns();
+        server_add_client(state, sock_fd, addr);
+        free_list_ns += now_ns() - start;
+    }
+
+    fprintf(stdout, "client slots: %u slots, scan %.0f ns/add, free list %.0f ns/add\n", SLOTS,
+            (double)legacy_ns / ROUNDS, (double)free_list_ns / ROUNDS);
+}
+
+static void bench_games(server_state_t* state) {
+    server_client_t first = { 0 };
+    server_client_t second = { 0 };
+    for (uint32_t i = 0; i < SLOTS; i++) {
+        server_add_game(state, game_new(&first, &second));
+    }
+
+    uint64_t seed = 0x2545f4914f6cdd1dull;
+    uint64_t legacy_ns = 0;
+    for (uint32_t r = 0; r < ROUNDS; r++) {
+        server_game_t* game = random_game(state, &seed);
+        game_close(game);
+
+        server_game_t new_game = game_new(&first, &second);
+        uint64_t start = now_ns();
+        legacy_add_game(state, new_game);
+        legacy_ns += now_ns() - start;
+    }
+
+    uint64_t free_list_ns = 0;
+    for (uint32_t r = 0; r < ROUNDS; r++) {
+        server_game_t* game = random_game(state, &seed);
+        server_close_game(state, game);
+
+        server_game_t new_game = game_new(&first, &second);
+        uint64_t start = now_ns();
+        server_add_game(state, new_game);
+        free_list_ns += now_ns() - start;
+    }
+
+    fprintf(stdout, "game slots: %u slots, scan %.0f ns/add, free list %.0f ns/add\n", SLOTS,
+            (double)legacy_ns / ROUNDS, (double)free_list_ns / ROUNDS);
+}
+
+int main(void) {
+    server_state_t state;
+    memset(&state, 0, sizeof(state));
+    if (server_shards_init(&state) != ERR_NONE) {
+        fprintf(stderr, RED "ERROR: Failed to create clients and games tables\n" RESET);
+        return 1;
+    }
+
+    bench_clients(&state);
+    bench_games(&state);
+
+    server_shards_deinit(&state);
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include "include/errors.h"
+#include "include/globals.h"
+#include "include/username_map.h"
+#include "include/users.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Compares username lookup through the index with the linear scan
+// server_find_user_by_username used before, for a growing number of users
+
+#define LOOKUPS 200000
+// Linear scan gets too slow to run LOOKUPS times on large user counts
+#define LINEAR_LOOKUPS 2000
+#define LINEAR_MAX_USERS 100000
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static server_user_t* linear_find(server_user_t* users, uint32_t len, const char* username) {
+    for (uint32_t i = 0; i < len; i++) {
+        if (strncmp(username, users[i].username, USERNAME_MAX_LEN) == 0) {
+            return &users[i];
+        }
+    }
+    return NULL;
+}
+
+int main(void) {
+    uint32_t counts[] = { 1000, 10000, 100000, 1000000 };
+    uint32_t counts_len = sizeof(counts) / sizeof(counts[0]);
+
+    srand(42);
+
+    fprintf(stdout, "%10s %16s %16s\n", "users", "index ns/lookup", "linear ns/lookup");
+
+    for (uint32_t c = 0; c < counts_len; c++) {
+        uint32_t count = counts[c];
+
+        server_user_t* users = calloc(count, sizeof(server_user_t));
+        if (users == NULL) {
+            error_print(ERR_ALLOC);
+            return 1;
+        }
+
+        username_map_t index;
+        if (username_map_init(&index, 0) != ERR_NONE) {
+            error_print(ERR_ALLOC);
+            return 1;
+        }
+
+        // Grow the index one user at a time like signups do
+        for (uint32_t i = 0; i < count; i++) {
+            snprintf(users[i].username, USERNAME_MAX_LEN, "player_%u", i);
+            if (username_map_put(&index, users[i].username, i) != ERR_NONE) {
+                error_print(ERR_ALLOC);
+                return 1;
+            }
+        }
+
+        uint64_t found = 0;
+        uint64_t start = now_ns();
+        for (uint32_t i = 0; i < LOOKUPS; i++) {
+            uint32_t value;
+            found += username_map_get(&index, users[rand() % count].username, &value);
+        }
+        double index_ns = (double)(now_ns() - start) / LOOKUPS;
+
+        double linear_ns = 0;
+        if (count <= LINEAR_MAX_USERS) {
+            start = now_ns();
+            for (uint32_t i = 0; i < LINEAR_LOOKUPS; i++) {
+                found += linear_find(users, count, users[rand() % count].username) != NULL;
+            }
+            linear_ns = (double)(now_ns() - start) / LINEAR_LOOKUPS;
+        }
+
+        if (found != LOOKUPS + (count <= LINEAR_MAX_USERS ? LINEAR_LOOKUPS : 0)) {
+            fprintf(stderr, RED "ERROR: Not every user was found\n" RESET);
+            return 1;
+        }
+
+        if (count <= LINEAR_MAX_USERS) {
+            fprintf(stdout, "%10u %16.1f %16.1f\n", count, index_ns, linear_ns);
+        } else {
+            fprintf(stdout, "%10u %16.1f %16s\n", count, index_ns, "-");
+        }
+
+        username_map_deinit(&index);
+        free(users);
+    }
+
+    return 0;
+}
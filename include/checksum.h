@@ -0,0 +1,10 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+
+// CRC-32 (IEEE 802.3) of len bytes, pass 0 as crc to start a new checksum
+// or a previous result to continue it over more data
+uint32_t checksum_crc32(uint32_t crc, const void* data, uint64_t len);
+
+#endif
@@ -55,6 +55,20 @@ void error_print(error_code error);
 #define ERR_GAME_NOT_STARTED 2015
 // Other player closed the connection and the game
 #define ERR_GAME_ABANDONED 2016
+// Non blocking socket has no more data to read
+#define ERR_WOULD_BLOCK 2017
+// Invalid server io mode in arguments
+#define ERR_ARG_IMODE 2018
+// Message is larger than the largest allowed message
+#define ERR_MESSAGE_TOO_LARGE 2019
+// Ships on the board don't match the fleet every player gets
+#define ERR_FLEET_INVALID 2020
+// Matchmaking queue has no space for another client
+#define ERR_QUEUE_FULL 2021
+// Peer didn't read anything for too long while a message was sent to it
+#define ERR_SEND_TIMEOUT 2022
+// Written data couldn't be synced to disk
+#define ERR_SYNC_FAILED 2023
 // Server Errors 
 #define ERR_USERNAME_EXISTS 3001
 
@@ -5,23 +5,35 @@
 #include "include/game_results.h"
 #include "include/state.h"
 
+// Outcome of a shot applied with game_apply_shot
+typedef struct {
+    // STATUS_OK or the STATUS_* the shot was rejected with
+    uint8_t status_code;
+    uint8_t hit;
+    uint8_t won;
+    // Turn after the shot
+    uint8_t turn;
+    // Player that was shot at
+    server_client_t* other;
+} game_shot_t;
+
 server_game_t game_new(server_client_t* first, server_client_t* second);
 void game_accept(server_game_t* game, server_client_t* client);
 server_client_t* game_other_player(server_game_t* game, server_client_t* player);
 void game_close(server_game_t* game);
-void game_set_clients_game_state(server_game_t* game, server_client_t* client, uint8_t* new_game_state);
+void game_set_clients_game_state(server_game_t* game, server_client_t* client, game_board_t board);
 
 // Status check functions
 uint8_t game_closed(server_game_t *game);
 uint8_t game_started(server_game_t *game);
 uint8_t game_accepted(server_game_t* game);
 uint8_t game_set_inital_turn(server_game_t* game, server_client_t* client);
-uint8_t game_is_my_turn(server_game_t* game, server_client_t* client);
 uint8_t game_register_shot(server_game_t* game, server_client_t* client, Coordinate target);
-void game_next_turn(server_game_t* game, server_client_t* client);
+// Checks the turn, shoots at the other player's board, checks the win and passes the turn
+// in one critical section. Winning shot finishes the game.
+game_shot_t game_apply_shot(server_game_t* game, server_client_t* client, Coordinate target);
 // 1 of the passed client won, 0 if no one won, -1 is other client won
 uint8_t game_check_win(server_game_t* game, server_client_t* client);
 uint8_t game_finished(server_game_t* game);
-void game_finish(server_game_t* game, server_client_t* client);
 game_results_t game_create_result(server_game_t* game);
 #endif 
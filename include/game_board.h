@@ -0,0 +1,28 @@
+#ifndef GAME_BOARD_H
+#define GAME_BOARD_H
+
+#include "include/globals.h"
+#include <stdint.h>
+
+// Field (x, y) is bit x + y * GAME_WIDTH of every mask
+#define GAME_BOARD_BIT(index) ((uint64_t)1 << (index))
+
+// Board of one player kept as bitmasks, hits are always a subset of ships
+// and misses never overlap ships
+typedef struct {
+    uint64_t ships;
+    uint64_t hits;
+    uint64_t misses;
+} game_board_t;
+
+// Converts the board from the wire format (one GAME_FIELD_* per field)
+game_board_t game_board_from_fields(const uint8_t* fields);
+// Converts the board back to one GAME_FIELD_* per field
+void game_board_to_fields(const game_board_t* board, uint8_t* fields);
+
+// Marks the field as hit or missed and returns the GAME_FIELD_* value it had before the shot
+uint8_t game_board_shoot(game_board_t* board, uint8_t index);
+// Returns 1 if every ship on the board is hit
+uint8_t game_board_all_sunk(const game_board_t* board);
+
+#endif
@@ -3,19 +3,52 @@
 
 #include "include/errors.h"
 #include "include/globals.h"
-#include "include/vector/vector.h"
+#include "include/username_map.h"
+#include "include/record_table.h"
+#include <stdint.h>
+
+// Every field takes 2 bits (GAME_FIELD_EMPTY, SHIP, HIT or MISS), 4 fields per byte
+#define GAME_RESULTS_BOARD_SIZE (GAME_WIDTH * GAME_HEIGHT / 4)
+
+// Player id of users that couldn't be found while converting legacy results
+#define GAME_RESULTS_UNKNOWN_USER UINT32_MAX
+
+// Results file starts with the header followed by game_results_t records
+#define GAME_RESULTS_MAGIC 0x31525342 // "BSR1"
+#define GAME_RESULTS_VERSION 1
 
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+} game_results_header_t;
+
+typedef struct {
+    // Index of the player in the users table
+    uint32_t first_player_id;
+    uint32_t second_player_id;
+    uint8_t first_game_state[GAME_RESULTS_BOARD_SIZE];
+    uint8_t second_game_state[GAME_RESULTS_BOARD_SIZE];
+    uint8_t won;
+    uint8_t padding[3];
+} game_results_t;
+
+// Results saved before the file had a header, converted on load
 typedef struct {
     char first_player_username[USERNAME_MAX_LEN];
     char second_player_username[USERNAME_MAX_LEN];
     uint8_t won;
     uint8_t first_game_state[GAME_WIDTH * GAME_HEIGHT];
     uint8_t second_game_state[GAME_WIDTH * GAME_HEIGHT];
-} game_results_t;
+} game_results_legacy_t;
 
 #define GAME_RESULTS_FILEPATH "./results.db"
 
-error_code game_results_load(Vector* results, const char* filepath);
-error_code game_results_save(Vector* users, const char* filepath);
+// Users index is only used to find player ids when the file has legacy results
+error_code game_results_load(record_table_t* results, const char* filepath, username_map_t* users_index);
+error_code game_results_save(record_table_t* results, const char* filepath);
+
+// Packs one GAME_FIELD_* per field into GAME_RESULTS_BOARD_SIZE bytes and back
+void game_results_pack_board(const uint8_t* fields, uint8_t* packed);
+void game_results_unpack_board(const uint8_t* packed, uint8_t* fields);
 
 #endif
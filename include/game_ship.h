@@ -3,6 +3,7 @@
     
 #include "include/coordinate.h"
 #include "include/errors.h"
+#include <stdint.h>
 
 typedef struct {
     Coordinate start;
@@ -11,7 +12,14 @@ typedef struct {
     uint8_t height;
 } GameShip;
 
+// Longest ship in the fleet
+#define GAME_SHIP_MAX_LEN 4
+
 error_code game_ship_validate_coordinates(GameShip ship);
 error_code game_ship_validate_fields(uint8_t* game_state, GameShip ship);
+// Validates the whole board at once, ships is a bitmask with field (x, y) at bit x + y * GAME_WIDTH.
+// Same rules as placing the ships one by one: ships are straight lines,
+// only corners can touch and the fleet is 1x4, 2x3, 3x2 and 4x1 ships
+error_code game_ship_validate_fleet(uint64_t ships);
 
 #endif
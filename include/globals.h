@@ -38,6 +38,33 @@
 #define MSG_PLAYERS_SHOT 11
 // Informing the other player where the shot went
 #define MSG_REGISTER_SHOT 12
+// Request counts, response status counts and latencies of the server
+#define MSG_STATS 13
+// One page of logged in users ordered by username
+#define MSG_LIST_USERS_PAGE 14
+// Client waits in the matchmaking queue until the server finds an opponent
+#define MSG_JOIN_QUEUE 15
+#define MSG_LEAVE_QUEUE 16
+#define MSG_MATCH_FOUND 17 // This is sent to the client
+// Best players by wins and the rank of the player that asked
+#define MSG_LEADERBOARD 18
+// Games of the player that asked, newest first
+#define MSG_GAME_HISTORY 19
+
+// Tables indexed by message type (stats, etc..), unknown types are counted at 0
+#define MSG_TYPES_LEN (MSG_GAME_HISTORY + 1)
+
+// Filters of the list users page request
+// Only users that are looking for a game
+#define LIST_USERS_FILTER_LOOKING_FOR_GAME 0x01
+// Most users returned in one page, limit 0 means the most users
+#define LIST_USERS_PAGE_MAX 256
+
+// Most players returned by the leaderboard request, limit 0 means the most players
+#define LEADERBOARD_TOP_MAX 100
+
+// Most games returned in one page of the game history, limit 0 means the most games
+#define GAME_HISTORY_PAGE_MAX 64
 
 // Request was processed successfully
 #define STATUS_OK 1
@@ -67,14 +94,25 @@
 #define STATUS_SHOT_ALREADY_DESTROYED 13
 // Player sent a shot but its not his turn
 #define STATUS_GAME_NOT_MY_TURN 14
+// Player sent a board with invalid ship placement
+#define STATUS_GAME_INVALID_FLEET 15
 
 // Unknown error
 #define STATUS_UNKNOWN_ERROR 255 
 
+// Tables indexed by status code, STATUS_UNKNOWN_ERROR is counted at 0
+#define STATUS_CODES_LEN (STATUS_GAME_INVALID_FLEET + 1)
+
 
 // Server input buffer size
 #define IN_BUFFER_SIZE 1024
 
+// How server handles client connections
+// Every client is registered with epoll and handled by a fixed pool of worker threads
+#define SERVER_MODE_EPOLL 0
+// Every client gets its own handler thread
+#define SERVER_MODE_THREADS 1
+
 // Color codes
 #define RED   "\033[31m"
 #define GREEN "\033[32m"
@@ -0,0 +1,35 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+// Every power of two range is split into HISTOGRAM_SUB_BUCKETS buckets so a
+// recorded value is off by at most 1 / HISTOGRAM_SUB_BUCKETS (~3%) of itself
+#define HISTOGRAM_SUB_BUCKET_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+// Log-linear histogram of uint64_t values (latencies in ns, etc..) with a fixed
+// number of buckets so recording never allocates. Plain functions are not thread
+// safe, every thread records into its own histogram and they are merged when read.
+// Histograms that can be shared by threads use the _atomic functions only.
+typedef struct {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+} histogram_t;
+
+void histogram_init(histogram_t* histogram);
+void histogram_record(histogram_t* histogram, uint64_t value);
+// Adds all values recorded in src to dst
+void histogram_merge(histogram_t* dst, const histogram_t* src);
+// Lock free versions, src of the merge can be recorded into while it's merged
+void histogram_record_atomic(histogram_t* histogram, uint64_t value);
+void histogram_merge_atomic(histogram_t* dst, const histogram_t* src);
+// Returns the largest value that falls into the same bucket as the value at
+// the given percentile (0 - 100), 0 if nothing was recorded
+uint64_t histogram_percentile(const histogram_t* histogram, double percentile);
+
+#endif
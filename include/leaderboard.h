@@ -0,0 +1,68 @@
+#ifndef LEADERBOARD_H
+#define LEADERBOARD_H
+
+#include "include/errors.h"
+#include "include/record_table.h"
+#include <stdint.h>
+
+// Enough levels for millions of players with p = 1/4
+#define LEADERBOARD_MAX_LEVEL 16
+
+typedef struct leaderboard_node_t leaderboard_node_t;
+
+typedef struct {
+    leaderboard_node_t* next;
+    // Number of players the link skips over, rank is the sum of spans on the way to the player
+    uint32_t span;
+} leaderboard_link_t;
+
+struct leaderboard_node_t {
+    uint32_t user_id;
+    uint32_t wins;
+    uint32_t losses;
+    uint8_t level;
+    // One link per level of the node
+    leaderboard_link_t links[];
+};
+
+typedef struct {
+    uint32_t user_id;
+    uint32_t wins;
+    uint32_t losses;
+} leaderboard_entry_t;
+
+// Players that finished at least one game ordered by wins, then by fewer losses and
+// then by user id. Skip list links count the players they skip so the rank of a player
+// is found on the way down like a search. Leaderboard is not thread safe, caller holds
+// the lock that protects it.
+typedef struct {
+    // Head has LEADERBOARD_MAX_LEVEL links and no player
+    leaderboard_node_t* head;
+    uint32_t len;
+    uint8_t level;
+    uint64_t seed;
+
+    // Node of every player indexed by user id, NULL if the user didn't finish a game
+    leaderboard_node_t** players;
+    uint32_t players_cap;
+} leaderboard_t;
+
+error_code leaderboard_init(leaderboard_t* leaderboard);
+void leaderboard_deinit(leaderboard_t* leaderboard);
+
+// Counts a finished game for both players
+error_code leaderboard_record(leaderboard_t* leaderboard, uint32_t winner_id, uint32_t loser_id);
+// Replaces the counters of the player, adds it if it's not on the leaderboard yet
+error_code leaderboard_set(leaderboard_t* leaderboard, uint32_t user_id, uint32_t wins, uint32_t losses);
+
+// Returns the rank of the player starting at 1 and fills the entry, 0 if the player didn't finish a game
+uint32_t leaderboard_rank(const leaderboard_t* leaderboard, uint32_t user_id, leaderboard_entry_t* entry);
+// Fills at most n best players, returns how many were filled
+uint32_t leaderboard_top(const leaderboard_t* leaderboard, leaderboard_entry_t* entries, uint32_t n);
+
+// Counts wins and losses of every result with the number of threads and fills the empty leaderboard.
+// Results of players with an id >= users_len (unknown legacy players) are skipped.
+error_code leaderboard_rebuild(leaderboard_t* leaderboard, const record_table_t* results, uint32_t users_len,
+                               uint32_t threads);
+
+#endif
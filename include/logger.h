@@ -0,0 +1,84 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include "include/errors.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+
+// Calls below this level are compiled out, build with -DLOG_LEVEL=LOG_LEVEL_DEBUG to get every request logged
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Record is copied into the ring as is, arguments are formatted by the logger thread.
+// Strings are copied into the record and cut if they don't fit.
+#define LOGGER_RECORD_SIZE 256
+#define LOGGER_ARGS_SIZE (LOGGER_RECORD_SIZE - 24)
+// Records in every thread's ring, a record is dropped when the ring is full
+#define LOGGER_RING_RECORDS 256
+// How long the logger thread sleeps when there is nothing to write
+#define LOGGER_IDLE_SLEEP_US 1000
+
+typedef struct {
+    // CLOCK_REALTIME in ns
+    uint64_t timestamp;
+    // Format string has to be a literal, only the pointer is kept
+    const char* fmt;
+    uint8_t level;
+    // Arguments didn't fit into the record, rest of the format is written without them
+    uint8_t truncated;
+    uint16_t args_len;
+    char args[LOGGER_ARGS_SIZE];
+} logger_record_t;
+
+// Single producer (the thread that owns it) single consumer (logger thread) ring
+typedef struct logger_ring_t {
+    logger_record_t records[LOGGER_RING_RECORDS];
+    // Next record the thread writes to, only the owning thread changes it
+    _Atomic uint64_t head;
+    // Next record the logger thread formats, only the logger thread changes it
+    _Atomic uint64_t tail;
+    _Atomic uint64_t dropped;
+    // Owning thread exited, ring is freed after it's drained
+    atomic_bool closed;
+    // Owning thread is putting a record into the ring, logger_stop waits for it before the last drain
+    atomic_bool writing;
+    struct logger_ring_t* next;
+} logger_ring_t;
+
+// Starts the logger thread. Until it's started and after it's stopped records are written
+// synchronously. Colors are used only if the output is a terminal and NO_COLOR isn't set.
+error_code logger_start(void);
+// Writes everything that is still in the rings and stops the logger thread
+void logger_stop(void);
+
+// Never blocks, with a full ring the record is dropped and counted
+void logger_write(uint8_t level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) logger_write(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do { if (0) logger_write(LOG_LEVEL_DEBUG, __VA_ARGS__); } while (0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) logger_write(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do { if (0) logger_write(LOG_LEVEL_INFO, __VA_ARGS__); } while (0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(...) logger_write(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do { if (0) logger_write(LOG_LEVEL_WARN, __VA_ARGS__); } while (0)
+#endif
+
+#define LOG_ERROR(...) logger_write(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+#endif
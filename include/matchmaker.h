@@ -0,0 +1,107 @@
+#ifndef MATCHMAKER_H
+#define MATCHMAKER_H
+
+#include "include/errors.h"
+#include "include/server_stats.h"
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Clients that can wait in the queue at once, has to be a power of two
+#define MATCHMAKER_QUEUE_CAP (128 * 1024)
+// Most entries the matcher takes from the queue before it pairs them
+#define MATCHMAKER_BATCH 256
+
+// Waiting clients are kept in buckets of ratings, the last bucket also takes every higher rating
+#define MATCHMAKER_BUCKET_WIDTH 25
+#define MATCHMAKER_BUCKETS 128
+#define MATCHMAKER_BUCKET_WORDS (MATCHMAKER_BUCKETS / 64)
+// Clients in the same bucket are paired right away, the window grows by one
+// bucket on both sides every time the older client waits this long
+#define MATCHMAKER_WIDEN_NS 1000000000ull
+// How often the matcher wakes up to widen the windows while clients are waiting
+#define MATCHMAKER_TICK_MS 250
+
+// Results of the pair function
+#define MATCHMAKER_PAIRED 0
+// Entry is no longer valid (client left the queue, disconnected, ..) and is dropped
+#define MATCHMAKER_FIRST_STALE 1
+#define MATCHMAKER_SECOND_STALE 2
+// Clients couldn't be paired (no room for their game), both entries are dropped and no match is counted
+#define MATCHMAKER_FAILED 3
+
+typedef struct {
+    uint32_t client_id;
+    // Ticket the client got when it joined, entry is stale once the client's ticket changes
+    uint32_t ticket;
+    // Rating of the user when the client joined
+    uint32_t rating;
+    uint64_t enqueued_at;
+} matchmaker_entry_t;
+
+typedef struct {
+    // Position the cell is ready for, producers wait for pos and consumers for pos + 1
+    _Atomic uint64_t sequence;
+    matchmaker_entry_t entry;
+} matchmaker_cell_t;
+
+// Bounded lock-free queue, many producers (handlers) and many consumers
+typedef struct {
+    matchmaker_cell_t* cells;
+    uint64_t mask;
+    // Producers and consumers don't share a cache line
+    _Alignas(64) _Atomic uint64_t enqueue_pos;
+    _Alignas(64) _Atomic uint64_t dequeue_pos;
+} matchmaker_queue_t;
+
+// Tries to pair the clients of both entries, returns MATCHMAKER_PAIRED or tells which entry is stale
+typedef uint8_t (*matchmaker_pair_fn)(void* params, const matchmaker_entry_t* first, const matchmaker_entry_t* second);
+
+// Pairs clients that joined the queue from a background thread. Handlers only push an
+// entry and wake the matcher, the matcher pairs every queued client with the closest rated
+// waiting client that is inside the window. Two clients in one bucket are always paired
+// so every bucket holds at most one waiting client and finding an opponent only
+// walks the occupied bits, no matter how many clients are queued.
+typedef struct {
+    matchmaker_queue_t queue;
+
+    // Only used by the matcher thread
+    matchmaker_entry_t waiting[MATCHMAKER_BUCKETS];
+    uint64_t occupied[MATCHMAKER_BUCKET_WORDS];
+    uint32_t waiting_len;
+    // No waiting client joined before this, limits how far an opponent can be
+    uint64_t oldest_waiting;
+
+    matchmaker_pair_fn pair;
+    void* params;
+    // Time to match and queue depth are recorded here
+    server_stats_t* stats;
+
+    // Posted after every push and when the matcher is stopping
+    sem_t pending;
+    atomic_uint_fast8_t running;
+    pthread_t thread;
+} matchmaker_t;
+
+error_code matchmaker_queue_init(matchmaker_queue_t* queue, uint64_t cap);
+void matchmaker_queue_deinit(matchmaker_queue_t* queue);
+// Returns 0 if the queue is full
+uint8_t matchmaker_queue_push(matchmaker_queue_t* queue, const matchmaker_entry_t* entry);
+// Returns 0 if the queue is empty
+uint8_t matchmaker_queue_pop(matchmaker_queue_t* queue, matchmaker_entry_t* entry);
+// Entries in the queue, only a snapshot when there are concurrent pushes and pops
+uint64_t matchmaker_queue_len(matchmaker_queue_t* queue);
+
+error_code matchmaker_start(matchmaker_t* matchmaker, server_stats_t* stats, matchmaker_pair_fn pair, void* params);
+void matchmaker_stop(matchmaker_t* matchmaker);
+// Queues the entry and wakes the matcher, ERR_QUEUE_FULL if there is no space
+error_code matchmaker_push(matchmaker_t* matchmaker, const matchmaker_entry_t* entry);
+
+// Matcher's steps, exposed for tests and benchmarks. Pairs the entry with a waiting client
+// or leaves it waiting, returns 1 if it was paired.
+uint8_t matchmaker_match(matchmaker_t* matchmaker, const matchmaker_entry_t* entry, uint64_t now);
+// Pairs waiting clients whose windows grew enough since the last call
+void matchmaker_widen(matchmaker_t* matchmaker, uint64_t now);
+
+#endif
@@ -6,8 +6,55 @@
 #include <stdint.h>
 #include <include/globals.h>
 
+// Every message is sent as a frame, 4 byte message length in
+// network byte order followed by the message itself
+#define MESSAGE_HEADER_LEN 4
+// Largest message server accepts from the client
+#define MESSAGE_MAX_LEN IN_BUFFER_SIZE
+// Size of the buffer used to read as many frames as possible with one recv
+#define MESSAGE_READ_BUFFER_SIZE (64 * 1024)
+// Largest message read_message_alloc accepts, lists of users are larger than the read buffer
+#define MESSAGE_ALLOC_MAX_LEN (16 * 1024 * 1024)
+// Frames waiting for a peer that doesn't read are dropped past this many bytes,
+// a single frame is always taken even if it's larger
+#define MESSAGE_WRITER_MAX_LEN (4 * 1024 * 1024)
+// Longest send_message waits for a non blocking socket to take more data
+#define MESSAGE_SEND_TIMEOUT_MS 5000
+
+// Keeps the part of the frame that was read but isn't complete yet
+typedef struct {
+    uint32_t len;
+    char data[MESSAGE_HEADER_LEN + MESSAGE_MAX_LEN];
+} message_reader_t;
+
+// Frames that were queued but the socket didn't take yet, sent once it's writable again
+typedef struct {
+    uint32_t len;
+    uint32_t cap;
+    char* data;
+} message_writer_t;
+
+// Called for every complete message, params are passed to read_messages
+typedef void (*message_handler_fn)(void* params, const char* message, uint32_t len);
+
+// Sends one frame, blocks until the whole frame is written. On a non blocking socket that
+// doesn't take any data for MESSAGE_SEND_TIMEOUT_MS ERR_SEND_TIMEOUT is returned
 error_code send_message(int sock_fd, const void* message, uint32_t len);
+// Appends one frame behind the frames already queued. ERR_QUEUE_FULL if the queued
+// frames would grow past MESSAGE_WRITER_MAX_LEN, nothing is queued then
+error_code message_writer_push(message_writer_t* writer, const void* message, uint32_t len);
+// Sends as much of the queued frames as the socket takes without blocking.
+// ERR_WOULD_BLOCK if some of them are still queued
+error_code message_writer_flush(int sock_fd, message_writer_t* writer);
+void message_writer_deinit(message_writer_t* writer);
+// Blocks until one frame is read. If the message is shorter than len
+// rest of the buffer is zeroed and if it's longer the rest of it is dropped
 error_code read_message(int sock_fd, void* buffer, uint32_t len);
+// Blocks until one frame is read into a buffer allocated for it, caller frees the buffer
+error_code read_message_alloc(int sock_fd, void** buffer, uint32_t* len);
+// Reads up to MESSAGE_READ_BUFFER_SIZE bytes with one recv and calls the handler for every
+// complete message. If the socket is non blocking and empty ERR_WOULD_BLOCK is returned
+error_code read_messages(int sock_fd, message_reader_t* reader, message_handler_fn handler, void* params);
 
 // Responses
 typedef struct {
@@ -44,6 +91,12 @@ typedef union {
     ErrorResponseMessage error; 
 } LogoutResponseMessage;
 
+typedef struct {
+    uint8_t looking_for_game;
+    char username[USERNAME_MAX_LEN];
+} ListUsersEntry;
+
+// Followed by count ListUsersEntry in the same message
 typedef struct {
     uint8_t status_code;
     uint32_t count;
@@ -54,6 +107,67 @@ typedef union {
     ErrorResponseMessage error; 
 } ListUsersResponseMessage;
 
+// Followed by count ListUsersEntry in the same message
+typedef struct {
+    uint8_t status_code;
+    // There are more users after the last user of the page
+    uint8_t more;
+    uint32_t count;
+} ListUsersPageSuccessResponseMessage;
+
+typedef union {
+    ListUsersPageSuccessResponseMessage success;
+    ErrorResponseMessage error;
+} ListUsersPageResponseMessage;
+
+// Followed by count LeaderboardEntry in the same message, best player first
+typedef struct {
+    uint8_t status_code;
+    uint32_t count;
+    // Rank of the player that asked starting at 1, 0 if the player didn't finish a game yet
+    uint32_t rank;
+    uint32_t wins;
+    uint32_t losses;
+    uint32_t rating;
+} LeaderboardSuccessResponseMessage;
+
+typedef union {
+    LeaderboardSuccessResponseMessage success;
+    ErrorResponseMessage error;
+} LeaderboardResponseMessage;
+
+typedef struct {
+    char username[USERNAME_MAX_LEN];
+    uint32_t wins;
+    uint32_t losses;
+    uint32_t rating;
+} LeaderboardEntry;
+
+// Followed by count GameHistoryEntry in the same message, newest game first
+typedef struct {
+    uint8_t status_code;
+    uint32_t count;
+    // Every game the player finished
+    uint32_t games;
+    // Cursor of the next page, 0 if there are no older games
+    uint32_t next_cursor;
+} GameHistorySuccessResponseMessage;
+
+typedef union {
+    GameHistorySuccessResponseMessage success;
+    ErrorResponseMessage error;
+} GameHistoryResponseMessage;
+
+typedef struct {
+    // Empty if the opponent isn't a registered user
+    char opponent[USERNAME_MAX_LEN];
+    uint32_t game_id;
+    uint8_t won;
+    // Ship fields hit by the player and by the opponent
+    uint8_t hits;
+    uint8_t opponent_hits;
+} GameHistoryEntry;
+
 typedef struct {
     uint8_t status_code;
 } LookForGameSuccessResponseMessage;
@@ -72,6 +186,26 @@ typedef union {
     ErrorResponseMessage error; 
 } CancelLookForGameResponseMessage;
 
+typedef struct {
+    uint8_t status_code;
+} JoinQueueSuccessResponseMessage;
+
+typedef union {
+    JoinQueueSuccessResponseMessage success;
+    ErrorResponseMessage error;
+} JoinQueueResponseMessage;
+
+typedef struct {
+    uint8_t status_code;
+} LeaveQueueSuccessResponseMessage;
+
+// STATUS_NOT_FOUND if the client isn't in the queue, it was
+// already matched if it joined and didn't leave before
+typedef union {
+    LeaveQueueSuccessResponseMessage success;
+    ErrorResponseMessage error;
+} LeaveQueueResponseMessage;
+
 typedef struct {
     uint8_t status_code;
     uint32_t game_id;
@@ -104,6 +238,33 @@ typedef struct {
     ErrorResponseMessage error; 
 } PlayersShotResponseMessage;
 
+typedef struct {
+    uint64_t count;
+    // Latencies in ns
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+} StatsLatency;
+
+typedef struct {
+    uint8_t status_code;
+    uint64_t uptime_ms;
+    // Indexed by message type
+    StatsLatency requests[MSG_TYPES_LEN];
+    // Number of responses sent with every status code
+    uint64_t statuses[STATUS_CODES_LEN];
+    // Wait of every matched client, there are two per match
+    StatsLatency time_to_match;
+    // Clients waiting in the matchmaking queue
+    uint64_t queue_depth;
+} StatsSuccessResponseMessage;
+
+typedef union {
+    StatsSuccessResponseMessage success;
+    ErrorResponseMessage error;
+} StatsResponseMessage;
+
 // Requests 
 typedef struct {
     uint8_t type;
@@ -127,16 +288,67 @@ typedef struct {
     char api_key[API_KEY_LEN];
 } ListUsersRequestMessage;
 
+typedef struct {
+    uint8_t type;
+    char api_key[API_KEY_LEN];
+    // Page starts after this username, empty for the first page
+    char cursor[USERNAME_MAX_LEN];
+    // Only usernames that start with the prefix, empty for every user
+    char prefix[USERNAME_MAX_LEN];
+    // LIST_USERS_FILTER_* flags
+    uint8_t filters;
+    uint32_t limit;
+} ListUsersPageRequestMessage;
+
 typedef struct {
     uint8_t type;
     char api_key[API_KEY_LEN];
 } LookForGameRequestMessage;
 
+typedef struct {
+    uint8_t type;
+    char api_key[API_KEY_LEN];
+} StatsRequestMessage;
+
 typedef struct {
     uint8_t type;
     char api_key[API_KEY_LEN];
 } CancelLookForGameRequestMessage;
 
+typedef struct {
+    uint8_t type;
+    char api_key[API_KEY_LEN];
+} JoinQueueRequestMessage;
+
+typedef struct {
+    uint8_t type;
+    char api_key[API_KEY_LEN];
+} LeaveQueueRequestMessage;
+
+typedef struct {
+    uint8_t type;
+    char api_key[API_KEY_LEN];
+    uint32_t limit;
+} LeaderboardRequestMessage;
+
+typedef struct {
+    uint8_t type;
+    char api_key[API_KEY_LEN];
+    // Next cursor of the previous page, 0 starts from the newest game
+    uint32_t cursor;
+    uint32_t limit;
+} GameHistoryRequestMessage;
+
+// Sent by the server to both clients when the matchmaker pairs them,
+// game is already accepted so the clients continue with the game start
+typedef struct {
+    uint8_t type;
+    // STATUS_UNKNOWN_ERROR if the game couldn't be created, both clients are out of the queue then
+    uint8_t status_code;
+    uint32_t game_id;
+    char opponent_username[USERNAME_MAX_LEN];
+} MatchFoundMessage;
+
 // Set by the client to challenge other clients
 // target_username is the username 
 // of the client you wish to play with
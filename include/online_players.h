@@ -0,0 +1,88 @@
+#ifndef ONLINE_PLAYERS_H
+#define ONLINE_PLAYERS_H
+
+#include "include/errors.h"
+#include "include/globals.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Threads are spread over the reader slots the same way they are over the stats slots
+#define ONLINE_PLAYERS_READER_SLOTS 16
+
+typedef struct {
+    char username[USERNAME_MAX_LEN];
+    uint32_t client_id;
+    uint8_t looking_for_game;
+} online_player_t;
+
+// Logged in players ordered by username. Snapshot never changes once it's published,
+// every change of the players publishes a new one.
+typedef struct online_snapshot_t {
+    // Next snapshot waiting to be freed once it's retired
+    struct online_snapshot_t* next_retired;
+    uint32_t len;
+    online_player_t players[];
+} online_snapshot_t;
+
+// Readers currently inside a read section of the slot's threads, one counter per epoch
+typedef struct {
+    _Atomic uint64_t active[2];
+} __attribute__((aligned(64))) online_players_reader_t;
+
+// Published snapshot of the online players. Reading it takes no lock, a reader only
+// counts itself in its slot for the current epoch. Writer swaps the snapshot and retires
+// the old one, it's freed after the epoch was flipped twice and the readers of the
+// old epoch were gone both times. Writers never wait for readers, a retired snapshot
+// that's still read is freed by one of the next writers.
+typedef struct {
+    _Atomic(online_snapshot_t*) current;
+    _Atomic uint32_t epoch;
+    online_players_reader_t* readers;
+    atomic_uint next_slot;
+
+    // Snapshots retired since the current grace period started
+    online_snapshot_t* pending;
+    // Snapshots freed at the end of the current grace period and the number of flips done for it
+    online_snapshot_t* retiring;
+    uint32_t retiring_len;
+    uint8_t flips;
+    pthread_mutex_t retire_lock;
+} online_players_t;
+
+// Read section, passed from online_players_read to online_players_read_end
+typedef struct {
+    uint32_t slot;
+    uint32_t epoch;
+} online_players_guard_t;
+
+// Publishes an empty snapshot
+error_code online_players_init(online_players_t* online);
+void online_players_deinit(online_players_t* online);
+
+// Snapshot stays valid until online_players_read_end, never blocks
+const online_snapshot_t* online_players_read(online_players_t* online, online_players_guard_t* guard);
+void online_players_read_end(online_players_t* online, const online_players_guard_t* guard);
+
+// Snapshot with room for len players, players are filled in by the caller before it's published
+online_snapshot_t* online_snapshot_new(uint32_t len);
+// Copy of the snapshot with the player added, or replaced if its username is already there. NULL if it can't be allocated
+online_snapshot_t* online_snapshot_put(const online_snapshot_t* snapshot, const online_player_t* player);
+// Copy of the snapshot without the username. NULL if it can't be allocated
+online_snapshot_t* online_snapshot_remove(const online_snapshot_t* snapshot, const char* username);
+// Current snapshot for the writer, callers are serialized by the same lock as the publishes
+const online_snapshot_t* online_players_current(online_players_t* online);
+// Publishes the snapshot and returns the previous one, callers that publish are serialized by their own lock.
+// Previous snapshot is passed to online_players_retire after that lock is released.
+online_snapshot_t* online_players_publish(online_players_t* online, online_snapshot_t* snapshot);
+// Frees the snapshot once no reader can still see it, together with the snapshots retired before.
+// Snapshot can be NULL to only free the older ones. Returns the number of snapshots still read.
+uint32_t online_players_retire(online_players_t* online, online_snapshot_t* snapshot);
+
+// Index of the first player whose username is >= username (or > username if exclusive is set),
+// len of the snapshot if there is none
+uint32_t online_snapshot_seek(const online_snapshot_t* snapshot, const char* username, uint8_t exclusive);
+// Returns NULL if the username isn't in the snapshot
+const online_player_t* online_snapshot_find(const online_snapshot_t* snapshot, const char* username);
+
+#endif
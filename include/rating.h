@@ -0,0 +1,15 @@
+#ifndef RATING_H
+#define RATING_H
+
+#include <stdint.h>
+
+// Rating of a new user
+#define RATING_DEFAULT 1200
+// Most points a single game can move a rating
+#define RATING_K 32
+
+// Elo update after one game, the loser loses what the winner gains. Beating a higher
+// rated player gains more than beating a lower rated one, ratings never go below 0.
+void rating_update(uint32_t* winner, uint32_t* loser);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef RECORD_TABLE_H
+#define RECORD_TABLE_H
+
+#include "include/errors.h"
+#include "include/slot_pool.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// Table of fixed size records loaded from a file. Records that were in the file
+// are not copied, the file is mapped and the table points straight at the mapping.
+// Records added while the server is running go to an in-memory tail, records of
+// the tail never move so pointers to them stay valid while the table grows.
+//
+// Mapping is private so records can be changed in memory without changing
+// the file, unchanged pages stay shared with the page cache.
+typedef struct {
+    uint32_t element_size;
+
+    void* map;
+    uint64_t map_len;
+    // First record in the mapping and the number of mapped records
+    char* mapped;
+    uint32_t mapped_len;
+
+    // Records added after the file was mapped
+    slot_pool_t tail;
+} record_table_t;
+
+error_code record_table_create(record_table_t* table, uint32_t element_size);
+void record_table_destroy(record_table_t* table);
+
+// Maps count records that start at offset in the file, fd can be closed after the call
+error_code record_table_map(record_table_t* table, int fd, uint64_t offset, uint32_t count);
+
+uint32_t record_table_len(const record_table_t* table);
+void* record_table_at(const record_table_t* table, uint32_t index);
+// Returns the added record or NULL if the tail couldn't grow
+void* record_table_push(record_table_t* table, void* element);
+// Removes the record that was pushed last, mapped records are never removed
+void record_table_pop(record_table_t* table);
+
+// Writes all records to the file, mapped records first
+error_code record_table_write(const record_table_t* table, FILE* file);
+// Copies all records next to each other into out, which has room for record_table_len records
+void record_table_copy(const record_table_t* table, void* out);
+
+#endif
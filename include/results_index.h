@@ -0,0 +1,78 @@
+#ifndef RESULTS_INDEX_H
+#define RESULTS_INDEX_H
+
+#include "include/errors.h"
+#include "include/game_results.h"
+#include "include/record_table.h"
+#include <stdint.h>
+
+// Index file starts with the header followed by one results_index_link_t per game result
+#define RESULTS_INDEX_MAGIC 0x31495242 // "BRI1"
+// Heads file starts with results_index_heads_header_t followed by one results_index_head_t per player
+#define RESULTS_INDEX_HEADS_MAGIC 0x31485242 // "BRH1"
+#define RESULTS_INDEX_VERSION 1
+
+// Player has no earlier game
+#define RESULTS_INDEX_NONE UINT32_MAX
+
+#define RESULTS_INDEX_FILEPATH "./results.idx"
+#define RESULTS_INDEX_HEADS_FILEPATH "./results.idx.heads"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+} results_index_header_t;
+
+// Result at the same position in the results file as the link,
+// every player of the result points to their previous game
+typedef struct {
+    uint32_t first_prev;
+    uint32_t second_prev;
+} results_index_link_t;
+
+typedef struct {
+    // Last game of the player, RESULTS_INDEX_NONE if the player has no games
+    uint32_t last;
+    uint32_t games;
+} results_index_head_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    // Heads are up to date with this many links, later links are replayed on load
+    uint32_t links_len;
+    uint32_t heads_len;
+} results_index_heads_header_t;
+
+// Games of every player linked from the newest to the oldest, so the history
+// of a player is read without looking at the games of other players.
+//
+// Links are appended next to the results by the results writer. Heads are saved
+// when the server stops, links added after the heads were saved are replayed on load
+// and results without a link (missing or cut index file) are linked again.
+typedef struct {
+    record_table_t links;
+    results_index_head_t* heads;
+    uint32_t heads_cap;
+} results_index_t;
+
+// Results have to be loaded first
+error_code results_index_load(results_index_t* index, const record_table_t* results, const char* filepath,
+                              const char* heads_filepath);
+void results_index_deinit(results_index_t* index);
+error_code results_index_save_heads(const results_index_t* index, const char* heads_filepath);
+
+// Links the result that was just added to the results, link is returned so it can be written to the index file.
+// Link is returned even if the heads couldn't grow, the result is then missing from the history of its players.
+// ERR_ALLOC if the link itself can't be added, the result is then missing from the history as well
+error_code results_index_add(results_index_t* index, const game_results_t* result, results_index_link_t* link);
+
+// Newest game of the player, RESULTS_INDEX_NONE if the player has no games
+uint32_t results_index_last(const results_index_t* index, uint32_t user_id);
+uint32_t results_index_games(const results_index_t* index, uint32_t user_id);
+// Game of the player before the result, RESULTS_INDEX_NONE if it's the first game of the player
+// or the result has no link
+uint32_t results_index_prev(const results_index_t* index, const record_table_t* results, uint32_t user_id,
+                            uint32_t result_id);
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef RESULTS_WRITER_H
+#define RESULTS_WRITER_H
+
+#include "include/errors.h"
+#include "include/game_results.h"
+#include "include/results_index.h"
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Most results written with a single write
+#define RESULTS_WRITER_BATCH 256
+
+typedef struct results_writer_node_t results_writer_node_t;
+
+struct results_writer_node_t {
+    _Atomic(results_writer_node_t*) next;
+    game_results_t result;
+    results_index_link_t link;
+};
+
+// Appends game results to the results file and their links to the index file from a background thread.
+// Handlers push results to a lock-free queue (multiple producers, single consumer)
+// and the writer thread writes everything that is queued with as few writes as possible.
+typedef struct {
+    // Producers push at the head and the writer pops from the tail
+    _Atomic(results_writer_node_t*) head;
+    results_writer_node_t* tail;
+    // Queue always has at least one node, stub is used when it's empty
+    results_writer_node_t stub;
+
+    // Posted after every push and when the writer is stopping
+    sem_t pending;
+    atomic_uint_fast8_t running;
+
+    int fd;
+    int index_fd;
+    // End of the last batch that was written and synced to both files
+    uint64_t size;
+    uint64_t index_size;
+    // Set when a batch couldn't be written, both files are cut back to the last batch
+    // and nothing is written after it so the results and links stay aligned
+    _Atomic error_code write_error;
+    pthread_t thread;
+} results_writer_t;
+
+error_code results_writer_start(results_writer_t* writer, const char* filepath, const char* index_filepath);
+// Writes every queued result and stops the writer thread
+void results_writer_stop(results_writer_t* writer);
+// Queues the result and its link, never waits for the disk.
+// ERR_SYNC_FAILED once a batch couldn't be written, the result is then not queued
+error_code results_writer_push(results_writer_t* writer, const game_results_t* result, const results_index_link_t* link);
+
+#endif
@@ -9,11 +9,25 @@ error_code handle_signup_request(server_client_t* client, const char* buffer);
 error_code handle_login_request(server_client_t* client, const char* buffer);
 error_code handle_logout_request(server_client_t* client, const char* buffer);
 error_code handle_list_users(server_client_t* client, const char* buffer);
+// Returns up to limit logged in users after the cursor, ordered by username
+error_code handle_list_users_page(server_client_t* client, const char* buffer);
 error_code handle_look_for_game(server_client_t* client, const char* buffer);
+// Matchmaker pairs the client with the next client in the queue and sends MSG_MATCH_FOUND to both
+error_code handle_join_queue(server_client_t* client, const char* buffer);
+error_code handle_leave_queue(server_client_t* client, const char* buffer);
+error_code handle_leaderboard(server_client_t* client, const char* buffer);
+error_code handle_game_history(server_client_t* client, const char* buffer);
 error_code handle_cancel_look_for_game(server_client_t* client, const char* buffer);
 error_code handle_challenge_player(server_client_t* client, const char* buffer);
 error_code handle_challenge_answer(server_client_t* client, const char* buffer);
 error_code handle_game_start(server_client_t* client, const char* buffer);
 error_code handle_players_shot(server_client_t* client, const char* buffer);
+error_code handle_stats(server_client_t* client, const char* buffer);
+
+// Parses the message type and calls the matching handler, params is the server_client_t*.
+// Matches message_handler_fn so it can be passed to read_messages
+void handle_client_message(void* params, const char* message, uint32_t len);
+// Closes the client's socket, frees the client slot and closes the game client was in
+void handle_client_disconnect(server_client_t* client);
 
 #endif
@@ -0,0 +1,33 @@
+#ifndef SERVER_REACTOR_H
+#define SERVER_REACTOR_H
+
+#include "include/errors.h"
+#include "include/state.h"
+#include <pthread.h>
+#include <stdint.h>
+
+// Maximum number of events one worker takes from epoll at once
+#define REACTOR_MAX_EVENTS 64
+
+// Epoll based event loop used in SERVER_MODE_EPOLL.
+// Client sockets are non blocking and registered as edge triggered and one shot
+// so only one worker at a time is handling the messages of a single client.
+// Writability is watched on a duplicate of the socket, its event never rearms the reads.
+typedef struct {
+    int epoll_fd;
+    // eventfd used to wake up and stop the workers
+    int wakeup_fd;
+    pthread_t* workers;
+    uint32_t workers_len;
+} server_reactor_t;
+
+// Starts workers_len worker threads, if workers_len is 0 one worker per core is started
+error_code reactor_start(server_reactor_t* reactor, uint32_t workers_len);
+// Makes the client's socket non blocking and starts waiting for its messages
+error_code reactor_add_client(server_reactor_t* reactor, server_client_t* client);
+// Client's queued frames are flushed by a worker once its socket is writable, called with the send lock held
+error_code reactor_wait_writable(int epoll_fd, server_client_t* client);
+// Stops and joins all of the workers
+void reactor_stop(server_reactor_t* reactor);
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef SERVER_STATS_H
+#define SERVER_STATS_H
+
+#include "include/errors.h"
+#include "include/globals.h"
+#include "include/histogram.h"
+#include "include/messages.h"
+#include "include/shard_lock.h"
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Threads are spread over the slots, with the epoll reactor every
+// worker has a slot of its own. Threads that share a slot only share cache lines.
+#define SERVER_STATS_SLOTS 16
+
+// Sharded tables whose locks are written out with the stats
+#define SERVER_STATS_LOCK_TABLES 8
+
+typedef struct {
+    const char* name;
+    const shard_lock_t* locks;
+    uint32_t count;
+} server_stats_locks_t;
+
+typedef struct {
+    // Handler latency of every request type, count of the histogram is the request count
+    histogram_t latencies[MSG_TYPES_LEN];
+    // Responses sent with every status code
+    uint64_t statuses[STATUS_CODES_LEN];
+} __attribute__((aligned(64))) server_stats_slot_t;
+
+// Request counts, response statuses and handler latencies. Every thread records into
+// its own slot without locks and slots are only added together when the stats are read.
+typedef struct {
+    server_stats_slot_t* slots;
+    atomic_uint next_slot;
+    uint64_t started_at;
+
+    // Time from joining the matchmaking queue to getting an opponent, only the matcher records it
+    histogram_t* time_to_match;
+    // Clients waiting for an opponent when the matcher last looked at the queue
+    _Atomic uint64_t queue_depth;
+
+    // Locks of the sharded tables, added before the server starts accepting clients
+    server_stats_locks_t locks[SERVER_STATS_LOCK_TABLES];
+    uint32_t locks_len;
+} server_stats_t;
+
+error_code server_stats_init(server_stats_t* stats);
+void server_stats_deinit(server_stats_t* stats);
+
+uint64_t server_stats_now_ns(void);
+
+void server_stats_record_request(server_stats_t* stats, uint8_t type, uint64_t latency_ns);
+void server_stats_record_status(server_stats_t* stats, uint8_t status_code);
+void server_stats_record_match(server_stats_t* stats, uint64_t waited_ns);
+void server_stats_set_queue_depth(server_stats_t* stats, uint64_t depth);
+// Counters of every lock of the table are written to the dump, one line per shard
+error_code server_stats_add_locks(server_stats_t* stats, const char* name, const shard_lock_t* locks, uint32_t count);
+
+// Adds all slots together into the response message
+error_code server_stats_collect(server_stats_t* stats, StatsSuccessResponseMessage* out);
+// Writes the stats as a table, file is replaced atomically
+error_code server_stats_dump(server_stats_t* stats, const char* filepath);
+
+#endif
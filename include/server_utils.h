@@ -5,11 +5,36 @@
 #include "include/state.h"
 #include "include/users.h"
 
-server_user_t* server_add_user(server_state_t* state, server_user_t user);
-server_user_t* server_find_user_by_username(server_state_t* state, char* username);
+// Creates the pools, free lists and locks of every shard and empty users indexes
+error_code server_shards_init(server_state_t* state);
+void server_shards_deinit(server_state_t* state);
+// Puts every user of the users table into the index of its shard
+error_code server_shards_index_users(server_state_t* state);
 
+// Sets out to the added user and id to its index. Returns ERR_USERNAME_EXISTS if the username is
+// already taken, ERR_ALLOC if the users table can't grow and ERR_SYNC_FAILED if the user isn't on disk.
+// User stays added even if it isn't on disk.
+error_code server_add_user(server_state_t* state, server_user_t user, server_user_t** out, uint32_t* id);
+server_user_t* server_find_user_by_username(server_state_t* state, char* username, uint32_t* id);
+
+// Client with the id, the id has to belong to a client that was added
+server_client_t* server_client_at(server_state_t* state, uint32_t id);
+// Returns the client that is logged in as the user with passed username or NULL.
+// Looks the username up in the online players snapshot, takes no lock.
 server_client_t* server_find_client_by_username(server_state_t* state, char* username);
+// Marks the client as logged in as the user, returns ERR_USERNAME_EXISTS if
+// some other client is already logged in as the same user
+error_code server_add_session(server_state_t* state, server_client_t* client, server_user_t* user);
+// Removes the session of a logged in client
+void server_remove_session(server_state_t* state, server_client_t* client);
+
+// Reuses the slot of a disconnected client, the clients only grow when every slot is taken.
+// Returns NULL if the clients table is full
+server_client_t* server_add_client(server_state_t* state, int sock_fd, struct sockaddr_in addr);
+// Slot of the disconnected client can be taken by the next client
+void server_remove_client(server_state_t* state, server_client_t* client);
 
+// Reuses the slot of a closed game, same as the clients. Returns NULL if the games table is full
 server_game_t* server_add_game(server_state_t* state, server_game_t game);
 void server_close_game(server_state_t* state, server_game_t* game);
 
@@ -18,10 +43,40 @@ void client_set_logged_in(server_client_t* client);
 void client_clear_logged_in(server_client_t* client);
 
 uint8_t client_looking_for_game(server_client_t* client);
-void client_set_looking_for_game(server_client_t* client);
-void client_clear_looking_for_game(server_client_t* client);
+// Changes the flag and publishes it to the online players
+void server_set_looking_for_game(server_state_t* state, server_client_t* client, uint8_t looking_for_game);
+// Claims the client for the game unless it still plays another one. Challenges and the matcher
+// both claim the players of their game, only one of them gets a client. Returns 1 if it was claimed.
+uint8_t client_claim_game(server_client_t* client, server_game_t* game);
+// Client has to be claimed for the game first
 void client_join_game(server_client_t* client, server_game_t* game);
+// Queued clients are paired by the matcher and can't be challenged
+uint8_t client_in_queue(server_client_t* client);
+// Client still plays the game it was claimed for, finished and closed games don't count
+uint8_t client_playing_game(server_client_t* client);
 
+// Also updates the ratings and the leaderboard. NULL if the result couldn't be added to the results
+// and the index, it's then not written either
 game_results_t* server_add_game_result(server_state_t* state, game_results_t res);
+// Moves the ratings of the players by the result, saved in the users journal
+void server_update_ratings(server_state_t* state, const game_results_t* res);
+uint32_t server_user_rating(server_state_t* state, uint32_t user_id);
+
+// Puts the client into the matchmaking queue, ERR_IARG if it's already there
+error_code server_join_queue(server_state_t* state, server_client_t* client);
+// Returns 1 if the client was taken out of the queue and 0 if it wasn't
+// in the queue or the matchmaker already paired it
+uint8_t server_leave_queue(server_client_t* client);
+// Matchmaker's pair function, creates the game and lets both clients know about it
+uint8_t server_match_clients(void* params, const matchmaker_entry_t* first, const matchmaker_entry_t* second);
+
+// Sends a message to the client while holding client's send lock. In epoll mode the message is queued
+// behind the frames the socket didn't take yet and never blocks, a client that stops reading is disconnected.
+// ERR_PEER_CLOSED if the client is disconnected or its socket was shut down.
+error_code server_send_message(server_client_t* client, const void* message, uint32_t len);
+// Sends the frames queued for the client once its socket is writable again
+void server_flush_client(server_client_t* client);
+// Sends a response to the client's request, status code of the response is counted in the stats
+error_code server_send_response(server_client_t* client, const void* message, uint32_t len);
 
 #endif
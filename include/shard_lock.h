@@ -0,0 +1,47 @@
+#ifndef SHARD_LOCK_H
+#define SHARD_LOCK_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Every thread adds its reads to the lock it holds once per this many reads
+#define SHARD_LOCK_READ_SAMPLE 64
+
+// Read-write lock of one shard of a table, counts how often it's taken, how often
+// it had to wait and for how long writers hold it. Reads are short and many so only
+// their waits are timed. Every lock has its own cache line so threads working on
+// different shards don't share the counters.
+typedef struct {
+    pthread_rwlock_t lock;
+    // Sampled, one read in SHARD_LOCK_READ_SAMPLE of a thread adds SHARD_LOCK_READ_SAMPLE.
+    // Uncontended reads then only write the line of the lock in pthread_rwlock_tryrdlock.
+    _Atomic uint64_t reads;
+    _Atomic uint64_t writes;
+    // Acquisitions that found the lock taken and had to wait
+    _Atomic uint64_t contended;
+    _Atomic uint64_t wait_ns;
+    // Time the lock was held for writing
+    _Atomic uint64_t hold_ns;
+} __attribute__((aligned(64))) shard_lock_t;
+
+// Counters of a lock read at one moment
+typedef struct {
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t contended;
+    uint64_t wait_ns;
+    uint64_t hold_ns;
+} shard_lock_stats_t;
+
+void shard_lock_init(shard_lock_t* lock);
+void shard_lock_destroy(shard_lock_t* lock);
+
+// Return the time the lock was taken for writing (0 for reads), it's passed back to shard_lock_unlock
+uint64_t shard_lock_read(shard_lock_t* lock);
+uint64_t shard_lock_write(shard_lock_t* lock);
+void shard_lock_unlock(shard_lock_t* lock, uint64_t locked_at);
+
+void shard_lock_stats(const shard_lock_t* lock, shard_lock_stats_t* out);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef SLOT_POOL_H
+#define SLOT_POOL_H
+
+#include "include/errors.h"
+#include <stdint.h>
+
+// Elements in one chunk, chunks are never moved or freed while the pool is used
+#define SLOT_POOL_CHUNK_SHIFT 8
+#define SLOT_POOL_CHUNK_LEN (1u << SLOT_POOL_CHUNK_SHIFT)
+// Chunk table is allocated once, the pool holds at most 16M elements
+#define SLOT_POOL_MAX_CHUNKS 65536
+
+// Table of elements that keep their address while the table grows, so pointers
+// to clients, games and records stay valid for handlers that hold them without a lock.
+// Elements are stored in fixed size chunks, growing only adds a chunk and
+// the index of an element is enough to find its chunk.
+//
+// Pool isn't locked, pushes need the same lock as the table the pool is used for.
+typedef struct {
+    uint32_t element_size;
+    uint32_t len;
+    char** chunks;
+} slot_pool_t;
+
+error_code slot_pool_init(slot_pool_t* pool, uint32_t element_size);
+void slot_pool_deinit(slot_pool_t* pool);
+
+uint32_t slot_pool_len(const slot_pool_t* pool);
+void* slot_pool_at(const slot_pool_t* pool, uint32_t index);
+// Returns the added element, NULL if the pool is full or the chunk couldn't be allocated
+void* slot_pool_push(slot_pool_t* pool, const void* element);
+// Removes the last element, its chunk is kept for the next push
+void slot_pool_pop(slot_pool_t* pool);
+
+#endif
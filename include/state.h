@@ -1,13 +1,39 @@
 #ifndef STATE_H
 #define STATE_H
 
+#include "include/game_board.h"
+#include "include/leaderboard.h"
+#include "include/results_index.h"
 #include "include/users.h"
+#include "include/users_journal.h"
 #include "include/globals.h"
-#include "include/vector/vector.h"
+#include "include/matchmaker.h"
+#include "include/messages.h"
+#include "include/online_players.h"
+#include "include/results_writer.h"
+#include "include/server_stats.h"
+#include "include/shard_lock.h"
+#include "include/slot_pool.h"
 #include <bits/pthreadtypes.h>
 #include <netinet/in.h>
+#include <stdatomic.h>
 #include <stdint.h>
 
+// Ends the lists of free client and game slots
+#define SLOT_NONE UINT32_MAX
+// Client isn't claimed for any game
+#define GAME_CLAIM_NONE UINT64_MAX
+
+// Users index, clients and games are split into shards that are locked separately
+#define STATE_SHARDS_SHIFT 4
+#define STATE_SHARDS (1u << STATE_SHARDS_SHIFT)
+// Users are sharded by the high bits of the username hash, the low bits place them inside the shard's map.
+// Hash is multiplied first, usernames that only differ at the end barely change the high bits of FNV.
+#define STATE_USERS_SHARD(hash) ((uint32_t)((hash) * 2654435769u) >> (32 - STATE_SHARDS_SHIFT))
+// Clients are sharded by the low bits of the client id, games by the low bits of the game id
+#define STATE_SHARD(id) ((id) & (STATE_SHARDS - 1))
+#define STATE_SHARD_SLOT(id) ((id) >> STATE_SHARDS_SHIFT)
+
 typedef struct server_game_t server_game_t;
 
 typedef struct {
@@ -38,28 +64,67 @@ typedef struct {
 typedef struct {
     int sock_fd; 
 	uint16_t port;
-
-    // Array of clients 
-    Vector clients;
-    // Lock used to limit access to array
-    pthread_rwlock_t clients_rwlock;
+    // SERVER_MODE_EPOLL or SERVER_MODE_THREADS
+    uint8_t mode;
+    // Epoll instance of the reactor, clients wait on it for their sockets to become writable
+    int epoll_fd;
+
+    // Clients never move, handlers keep pointers to them while the table grows.
+    // Client id is the slot in the shard's pool followed by the shard.
+    slot_pool_t clients[STATE_SHARDS];
+    // Lock of every shard protects its pool and free list
+    shard_lock_t clients_locks[STATE_SHARDS];
+    // Slot of the last disconnected client of every shard, free slots are linked through next_free
+    uint32_t clients_free[STATE_SHARDS];
+    // New clients are spread over the shards in turns
+    _Atomic uint32_t next_clients_shard;
+
+    // Maps username of every logged in user to the id of the client
+    username_map_t sessions;
+    pthread_rwlock_t sessions_rwlock;
+    // Logged in users ordered by username with their looking for game flags, read without locks.
+    // Copied and republished under the sessions lock on every login, logout and flag change.
+    online_players_t online;
   
-    Vector games;
-    pthread_rwlock_t games_rwlock;
-    uint32_t next_game_id;
+    // Games never move, same as the clients. Game is in the shard of its id.
+    slot_pool_t games[STATE_SHARDS];
+    shard_lock_t games_locks[STATE_SHARDS];
+    // Slot of the last closed game of every shard, free slots are linked through next_free
+    uint32_t games_free[STATE_SHARDS];
+    _Atomic uint32_t next_game_id;
 
     // List of all registered users. 
     // Loaded from a file at the start of program
-    Vector users;
-    // Server initalizes users.
-    // Clients can trigger signup which will modify the users 
-    // Clients can trigger login which needs to read the users
-    pthread_rwlock_t users_rwlock;
+    record_table_t users;
+    // Signups and rating changes take the lock for writing, reading a rating takes it for reading.
+    // Users never move and usernames never change so looking up a user doesn't need it.
+    shard_lock_t users_table_lock;
+    // Maps username to the index in users table, a map per shard
+    username_map_t users_index[STATE_SHARDS];
+    // Signup takes the lock of the username's shard before the table lock,
+    // logins of users in other shards don't wait for it
+    shard_lock_t users_locks[STATE_SHARDS];
+    // Every signup is appended to the journal while holding the users table lock
+    users_journal_t users_journal;
 
 
     // Finished games are added to the game results
-    Vector game_results;
+    record_table_t game_results;
+    // Games of every player, changed together with the game results under the same lock
+    results_index_t results_index;
     pthread_rwlock_t game_results_rwlock;
+    // Appends finished games to the results file
+    results_writer_t results_writer;
+
+    // Wins and losses of every player, rebuilt from the game results at start
+    leaderboard_t leaderboard;
+    pthread_rwlock_t leaderboard_rwlock;
+
+    // Request counts, response statuses and handler latencies
+    server_stats_t stats;
+
+    // Pairs clients that joined the matchmaking queue
+    matchmaker_t matchmaker;
 } server_state_t;
 
 typedef struct {
@@ -68,19 +133,47 @@ typedef struct {
 
     // Back pointer to whole server state
 	server_state_t* server_state;
+    // Slot in the clients pool of the shard followed by the shard
+    uint32_t id;
+    // Next free slot while the client is disconnected
+    uint32_t next_free;
 
     // User information about client
 	server_user_t* user;
+    // Index of the user in the users table
+    uint32_t user_id;
 
 	int sock_fd;
 	struct sockaddr_in addr;
     char api_key[API_KEY_LEN];
     uint32_t flags;
     server_game_t* game;
+    // Game the client was claimed for, the game id in the high half and its slot in the low half.
+    // Claim ends once that game is closed or finished, game ids are never reused so a claim of
+    // a closed game whose slot already holds another game isn't mistaken for a new one.
+    _Atomic uint64_t game_claim;
+    // Odd while the client is in the matchmaking queue. Joining, leaving and being matched
+    // all move it forward so queue entries with an older ticket are stale.
+    _Atomic uint32_t queue_ticket;
+    // Partial message read from the socket
+    message_reader_t reader;
+    // Other clients' handlers also send messages to this client (challenges, shots),
+    // lock is held for the whole frame so frames never get interleaved
+    pthread_mutex_t send_lock;
+    // Frames the socket didn't take yet, only used in epoll mode. Protected by the send lock.
+    message_writer_t writer;
+    // Duplicate of the socket registered with epoll for writability, -1 in threads mode
+    int out_fd;
+    // Set once sending to the client failed and its socket was shut down
+    _Atomic uint8_t closing;
 } server_client_t;
 
 struct server_game_t {
     uint32_t id;
+    // Index of the game in the games pool of its shard
+    uint32_t slot;
+    // Next free slot while the game is closed
+    uint32_t next_free;
 
     server_client_t* first;
     server_client_t* second;
@@ -94,8 +187,8 @@ struct server_game_t {
     // prevent concurrent access from both players at the same time
     pthread_mutex_t lock;
 
-    uint8_t first_game_state[GAME_WIDTH * GAME_HEIGHT];
-    uint8_t second_game_state[GAME_WIDTH * GAME_HEIGHT];
+    game_board_t first_board;
+    game_board_t second_board;
     uint8_t first_state_set;
     uint8_t second_state_set;
 
@@ -0,0 +1,44 @@
+#ifndef USERNAME_MAP_H
+#define USERNAME_MAP_H
+
+#include "include/errors.h"
+#include "include/globals.h"
+#include <stdint.h>
+
+// Entry hash values with special meaning, real hashes are always >= USERNAME_MAP_TOMBSTONE + 1
+#define USERNAME_MAP_EMPTY 0
+#define USERNAME_MAP_TOMBSTONE 1
+
+// Map is grown when (len + tombstones) * 4 >= cap * 3
+#define USERNAME_MAP_MIN_CAP 16
+
+typedef struct {
+    uint32_t hash;
+    uint32_t value;
+    char key[USERNAME_MAX_LEN];
+} username_map_entry_t;
+
+// Open addressing hash map (linear probing) from username to an uint32_t value.
+// Map is not thread safe, caller holds the lock that protects the map.
+typedef struct {
+    username_map_entry_t* entries;
+    // Always a power of two
+    uint32_t cap;
+    uint32_t len;
+    uint32_t tombstones;
+} username_map_t;
+
+error_code username_map_init(username_map_t* map, uint32_t cap);
+void username_map_deinit(username_map_t* map);
+
+// Returns ERR_USERNAME_EXISTS if the key is already in the map
+error_code username_map_put(username_map_t* map, const char* key, uint32_t value);
+// Returns 1 and sets the value if the key is found and 0 otherwise
+uint8_t username_map_get(const username_map_t* map, const char* key, uint32_t* value);
+// Returns 1 if the key was removed and 0 if it wasn't in the map
+uint8_t username_map_remove(username_map_t* map, const char* key);
+
+// Hash the map uses for the key, entries are placed by its low bits
+uint32_t username_map_hash(const char* key);
+
+#endif
@@ -3,7 +3,9 @@
 
 #include "include/errors.h"
 #include "include/globals.h"
-#include "include/vector/vector.h"
+#include "include/username_map.h"
+#include "include/record_table.h"
+#include <stdint.h>
 
 typedef struct {
 	char username[USERNAME_MAX_LEN];
@@ -14,11 +16,31 @@ typedef struct {
 typedef struct {
 	char username[USERNAME_MAX_LEN];
 	char password[PASSWORD_MAX_LEN];
+	// Elo rating, updated after every finished game
+	uint32_t rating;
 } server_user_t;
 
+// Users file starts with the header followed by server_user_t records
+#define USERS_MAGIC 0x31535542 // "BUS1"
+#define USERS_VERSION 1
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+} users_header_t;
+
+// Users saved before the file had a header, converted on load
+typedef struct {
+	char username[USERNAME_MAX_LEN];
+	char password[PASSWORD_MAX_LEN];
+} server_user_legacy_t;
+
 // These are the functions used by server to store and load users 
 // These functions work with server_user_t
-error_code users_load(Vector* users, const char* filepath);
-error_code users_save(Vector* users, const char* filepath);
+// Index maps username to the index of the user in the users table
+error_code users_load(record_table_t* users, username_map_t* index, const char* filepath);
+error_code users_save(record_table_t* users, const char* filepath);
+// Saves users copied out of the table, so the table doesn't have to stay locked while they're written
+error_code users_save_array(const server_user_t* users, uint32_t len, const char* filepath);
 
 #endif
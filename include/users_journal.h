@@ -0,0 +1,98 @@
+#ifndef USERS_JOURNAL_H
+#define USERS_JOURNAL_H
+
+#include "include/errors.h"
+#include "include/username_map.h"
+#include "include/users.h"
+#include "include/record_table.h"
+#include "include/shard_lock.h"
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+
+// Record types
+#define USERS_JOURNAL_ADD_USER 1
+// Replaces the user at the index (rating changed)
+#define USERS_JOURNAL_UPDATE_USER 2
+
+// Log is compacted into a new snapshot once it has this many records
+#define USERS_JOURNAL_COMPACT_RECORDS 4096
+
+// One record in the log. Records are only appended, a record that is cut
+// or has an invalid checksum is the end of the log (crash in the middle of a write)
+typedef struct {
+    // CRC-32 of everything after the checksum
+    uint32_t checksum;
+    uint32_t type;
+    // Index of the user in the users table
+    uint32_t index;
+    server_user_t user;
+} users_journal_record_t;
+
+// Record of a log written before users had a rating, converted on replay
+typedef struct {
+    uint32_t checksum;
+    uint32_t type;
+    uint32_t index;
+    server_user_legacy_t user;
+} users_journal_legacy_record_t;
+
+// Users are saved as a snapshot (users_save format) and a log of
+// every change made after the snapshot was written.
+// Records are written right away and fsynced by a background thread,
+// every fsync covers all records written before it (group commit).
+// Flusher also compacts the log: the users are copied and the log is swapped for an empty
+// one under the users lock, the snapshot is written once the lock is released. Until then
+// the old log stays next to the new one and replay applies both.
+typedef struct {
+    const char* snapshot_path;
+    const char* log_path;
+    // Log moved aside by the last compaction, removed once the snapshot covers it
+    char old_log_path[PATH_MAX];
+    uint8_t old_log;
+    int fd;
+
+    // Users that are saved, the journal only reads them while compacting
+    record_table_t* users;
+    shard_lock_t* users_lock;
+
+    pthread_mutex_t lock;
+    // Signaled when there are new records to sync or the journal is closing
+    pthread_cond_t pending;
+    // Signaled after every fsync
+    pthread_cond_t synced_cond;
+    // Sequence number of the last written and the last synced record
+    uint64_t written;
+    uint64_t synced;
+    // Set when an fsync fails and never cleared. Kernel can drop the pages that failed
+    // so a later fsync that succeeds doesn't mean the records before it are on disk.
+    error_code sync_error;
+    // Records in the log since the last compaction
+    uint32_t log_records;
+    uint8_t running;
+    // Compaction asked for by users_journal_compact, compactions done so far and the result of the last one
+    uint8_t compact_requested;
+    uint8_t compacting;
+    uint32_t compactions;
+    error_code compact_error;
+
+    pthread_t flusher;
+} users_journal_t;
+
+// Replays the logs on top of already loaded snapshot users and starts the flusher thread.
+// users_lock is the lock appends are done under, it's taken for reading while the users are copied.
+error_code users_journal_open(users_journal_t* journal, const char* snapshot_path, const char* log_path,
+                              record_table_t* users, username_map_t* index, shard_lock_t* users_lock);
+// Syncs everything that is written and stops the flusher thread
+void users_journal_close(users_journal_t* journal);
+
+// Writes the record, caller holds users_lock for writing so records are in the users order.
+// Returns the sequence number to pass to users_journal_sync or 0 if writing failed
+uint64_t users_journal_append(users_journal_t* journal, uint32_t type, uint32_t index, const server_user_t* user);
+// Blocks until the record with the sequence number is on disk.
+// ERR_SYNC_FAILED if an fsync failed before the record was synced
+error_code users_journal_sync(users_journal_t* journal, uint64_t seq);
+// Has the flusher write all users to a new snapshot and empty the log, waits until it's done
+error_code users_journal_compact(users_journal_t* journal);
+
+#endif
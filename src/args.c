@@ -5,9 +5,10 @@
 #include <include/args.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 void client_usage(char* exe) { fprintf(stderr, "Usage: %s <server_ip> <server_port>\n", exe); }
-void server_usage(char* exe) { fprintf(stderr, "Usage: %s <server_port>\n", exe); }
+void server_usage(char* exe) { fprintf(stderr, "Usage: %s <server_port> [epoll|threads]\n", exe); }
 
 error_code client_parse_args(client_state_t* state, int argc, char** argv)
 {
@@ -51,6 +52,20 @@ error_code server_parse_args(server_state_t* state, int argc, char** argv)
 	}
 
 	state->port = port;
+
+	state->mode = SERVER_MODE_EPOLL;
+	if (argc < 3) {
+		return ERR_NONE;
+	}
+
+	if (strcmp(argv[2], "threads") == 0) {
+		state->mode = SERVER_MODE_THREADS;
+	} else if (strcmp(argv[2], "epoll") != 0) {
+		server_usage(argv[0]);
+		error_print(ERR_ARG_IMODE);
+		return ERR_ARG_IMODE;
+	}
+
 	return ERR_NONE;
 }
 
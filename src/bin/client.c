@@ -15,16 +15,30 @@
 #include <netinet/in.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/poll.h>
 #include <termios.h>
 #include <unistd.h>
 
+// Users shown at once when searching for players
+#define CLIENT_USERS_PAGE_LEN 20
+
+// Best players shown on the leaderboard
+#define CLIENT_LEADERBOARD_LEN 10
+
+// Games shown at once in the game history
+#define CLIENT_GAME_HISTORY_LEN 20
+
 error_code client_signup(client_state_t* state);
 error_code client_login(client_state_t* state);
 error_code client_logout(client_state_t* state);
 error_code client_list_users(client_state_t* state);
+error_code client_find_users(client_state_t* state);
+error_code client_quick_match(client_state_t* state);
+error_code client_leaderboard(client_state_t* state);
+error_code client_game_history(client_state_t* state);
 error_code client_look_for_game(client_state_t* state);
 error_code client_cancel_look_for_game(client_state_t* state);
 error_code client_challenge_player(client_state_t* state);
@@ -160,6 +174,26 @@ int main(int argc, char** argv)
                     }
                 }
 				break;
+			case 4:
+                client_find_users(&state);
+				break;
+			case 5:
+                client_quick_match(&state);
+                // Matchmaker found an opponent
+                if (state.game.game_id != 0) {
+                    err = client_start_game(&state);
+                    if (err != ERR_NONE) {
+                        fprintf(stderr, RED "%s Something went wrong while playing the game, quitting the game\n" RESET, error_to_string(err));
+                        break;
+                    }
+                }
+				break;
+			case 6:
+                client_leaderboard(&state);
+				break;
+			case 7:
+                client_game_history(&state);
+				break;
 			default:
 				fprintf(stderr, RED "ERROR: invalid choice\n" RESET);
 				break;
@@ -456,6 +490,71 @@ error_code client_signup(client_state_t* state)
 	return ERR_NONE;
 }
 
+error_code client_leaderboard(client_state_t* state) {
+    LeaderboardRequestMessage req = { 0 };
+    req.type = MSG_LEADERBOARD;
+    strncpy(req.api_key, state->api_key, API_KEY_LEN);
+    req.limit = CLIENT_LEADERBOARD_LEN;
+
+    error_code err = send_message(state->sock_fd, &req, sizeof(req));
+    if (err != ERR_NONE) {
+        fprintf(stderr, RED "%s Failed to send leaderboard request\n" RESET, error_to_string(err));
+        return err;
+    }
+
+    char* message;
+    uint32_t len;
+    err = read_message_alloc(state->sock_fd, (void**)&message, &len);
+    if (err != ERR_NONE) {
+        fprintf(stderr, RED "%s Failed to read leaderboard response\n" RESET, error_to_string(err));
+        return err;
+    }
+
+    if (len == 0 || message[0] != STATUS_OK) {
+        ErrorResponseMessage res = { 0 };
+        memcpy(&res, message, len < sizeof(res) ? len : sizeof(res));
+        free(message);
+
+        fprintf(stderr, RED "ERROR: Leaderboard request failed, %d - %.*s\n" RESET, res.status_code,
+                ERROR_MESSAGE_MAX_LEN, res.message);
+
+        if (res.status_code == STATUS_UNAUTHORIZED) {
+            return ERR_UNATHORIZED;
+        }
+
+        return ERR_UNKNOWN;
+    }
+
+    LeaderboardSuccessResponseMessage res = { 0 };
+    memcpy(&res, message, len < sizeof(res) ? len : sizeof(res));
+    if (len < sizeof(res) || (len - sizeof(res)) / sizeof(LeaderboardEntry) < res.count) {
+        free(message);
+        fprintf(stderr, RED "ERROR: Leaderboard response is too short for %u players\n" RESET, res.count);
+        return ERR_UNKNOWN;
+    }
+
+    const LeaderboardEntry* entries = (const LeaderboardEntry*)(message + sizeof(res));
+
+    fprintf(stdout, "Leaderboard\n");
+    fprintf(stdout, "==========================\n");
+
+    for (uint32_t i = 0; i < res.count; i++) {
+        fprintf(stdout, "%3u. \"%.*s\" %u wins, %u losses, rating %u\n", i + 1, USERNAME_MAX_LEN,
+                entries[i].username, entries[i].wins, entries[i].losses, entries[i].rating);
+    }
+
+    fprintf(stdout, "==========================\n");
+    if (res.rank == 0) {
+        fprintf(stdout, "You haven't finished a game yet, rating %u\n", res.rating);
+    } else {
+        fprintf(stdout, "You are ranked %u with %u wins, %u losses, rating %u\n", res.rank, res.wins, res.losses,
+                res.rating);
+    }
+
+    free(message);
+    return ERR_NONE;
+}
+
 error_code client_list_users(client_state_t* state) {
     ListUsersRequestMessage req;
     req.type = MSG_LIST_USERS;
@@ -467,48 +566,199 @@ error_code client_list_users(client_state_t* state) {
         return err;
     }
 
-    ListUsersResponseMessage res;
-    err = read_message(state->sock_fd, &res, sizeof(res));
+    // Whole list comes in one message
+    char* message;
+    uint32_t len;
+    err = read_message_alloc(state->sock_fd, (void**)&message, &len);
     if (err != ERR_NONE) {
         fprintf(stderr, RED "%s Failed to read list users response\n" RESET, error_to_string(err));
         return err;
     }
 
-    if (res.error.status_code != STATUS_OK) {
-        fprintf(stderr, RED "ERROR: List users request failed, %d - %s\n" RESET, res.error.status_code, res.error.message);
+    if (len == 0 || message[0] != STATUS_OK) {
+        ErrorResponseMessage res = { 0 };
+        memcpy(&res, message, len < sizeof(res) ? len : sizeof(res));
+        free(message);
 
-        if (res.error.status_code == STATUS_UNAUTHORIZED) {
+        fprintf(stderr, RED "ERROR: List users request failed, %d - %.*s\n" RESET, res.status_code,
+                ERROR_MESSAGE_MAX_LEN, res.message);
+
+        if (res.status_code == STATUS_UNAUTHORIZED) {
             return ERR_UNATHORIZED;
         }
 
         return ERR_UNKNOWN;
     }
 
+    ListUsersSuccessResponseMessage res = { 0 };
+    memcpy(&res, message, len < sizeof(res) ? len : sizeof(res));
+    if (len < sizeof(res) || (len - sizeof(res)) / sizeof(ListUsersEntry) < res.count) {
+        free(message);
+        fprintf(stderr, RED "ERROR: List users response is too short for %u users\n" RESET, res.count);
+        return ERR_UNKNOWN;
+    }
+
+    const ListUsersEntry* entries = (const ListUsersEntry*)(message + sizeof(res));
+
+    fprintf(stdout, "Listing %u users\n(Green looking for games):\n", res.count);
+    fprintf(stdout, "==========================\n");
+
+    for (uint32_t i = 0; i < res.count; i++) {
+        if (entries[i].looking_for_game) {
+            fprintf(stdout, GREEN "\"%.*s\"\n" RESET, USERNAME_MAX_LEN, entries[i].username);
+        } else {
+            fprintf(stdout, "\"%.*s\"\n", USERNAME_MAX_LEN, entries[i].username);
+        }
+    }
+
+    fprintf(stdout, "==========================\n");
+
+    free(message);
+    return ERR_NONE;
+}
 
-    char username[USERNAME_MAX_LEN];
+error_code client_find_users(client_state_t* state) {
+    ListUsersPageRequestMessage req = { 0 };
+    req.type = MSG_LIST_USERS_PAGE;
+    req.limit = CLIENT_USERS_PAGE_LEN;
+    strncpy(req.api_key, state->api_key, API_KEY_LEN);
+
+    fprintf(stdout, "Username starts with (empty for everyone): ");
+    error_code err = read_line(req.prefix, USERNAME_MAX_LEN);
+    if (err != ERR_NONE) {
+        fprintf(stderr, RED "%s Failed to read username prefix\n" RESET, error_to_string(err));
+        return err;
+    }
+
+    char line[2];
+    fprintf(stdout, "Only players looking for a game (y/n): ");
+    err = read_line(line, 2);
+    if (err == ERR_NONE && (line[0] == 'y' || line[0] == 'Y')) {
+        req.filters |= LIST_USERS_FILTER_LOOKING_FOR_GAME;
+    }
+
+    char message[sizeof(ListUsersPageSuccessResponseMessage) + LIST_USERS_PAGE_MAX * sizeof(ListUsersEntry)];
+    ListUsersPageResponseMessage* res = (ListUsersPageResponseMessage*)message;
+    const ListUsersEntry* entries = (const ListUsersEntry*)(message + sizeof(ListUsersPageSuccessResponseMessage));
 
-    fprintf(stdout, "Listing %u users\n(Green looking for games):\n", res.success.count);
     fprintf(stdout, "==========================\n");
 
-    uint8_t looking_for_game = 0;
-    for (uint32_t i = 0; i < res.success.count; i++) {
-        err = read_message(state->sock_fd, &looking_for_game, sizeof(looking_for_game));
+    while (1) {
+        err = send_message(state->sock_fd, &req, sizeof(req));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "%s Failed to looking for game\n" RESET, error_to_string(err));
+            fprintf(stderr, RED "%s Failed to send list users page request\n" RESET, error_to_string(err));
             return err;
         }
 
-        err = read_message(state->sock_fd, username, USERNAME_MAX_LEN);
+        err = read_message(state->sock_fd, message, sizeof(message));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "%s Failed to read username\n" RESET, error_to_string(err));
+            fprintf(stderr, RED "%s Failed to read list users page response\n" RESET, error_to_string(err));
             return err;
         }
 
-        if (looking_for_game) {
-            fprintf(stdout, GREEN "\"%s\"\n" RESET, username);
-        } else {
-            fprintf(stdout, "\"%s\"\n", username);
+        if (res->error.status_code != STATUS_OK) {
+            fprintf(stderr, RED "ERROR: List users request failed, %d - %s\n" RESET, res->error.status_code, res->error.message);
+
+            if (res->error.status_code == STATUS_UNAUTHORIZED) {
+                return ERR_UNATHORIZED;
+            }
+
+            return ERR_UNKNOWN;
+        }
+
+        uint32_t count = res->success.count < LIST_USERS_PAGE_MAX ? res->success.count : LIST_USERS_PAGE_MAX;
+        for (uint32_t i = 0; i < count; i++) {
+            if (entries[i].looking_for_game) {
+                fprintf(stdout, GREEN "\"%.*s\"\n" RESET, USERNAME_MAX_LEN, entries[i].username);
+            } else {
+                fprintf(stdout, "\"%.*s\"\n", USERNAME_MAX_LEN, entries[i].username);
+            }
+        }
+
+        if (!res->success.more || count == 0) {
+            break;
+        }
+
+        fprintf(stdout, "Show more (y/n): ");
+        err = read_line(line, 2);
+        if (err != ERR_NONE || (line[0] != 'y' && line[0] != 'Y')) {
+            break;
         }
+
+        // Next page starts after the last user of this one
+        memcpy(req.cursor, entries[count - 1].username, USERNAME_MAX_LEN);
+    }
+
+    fprintf(stdout, "==========================\n");
+
+    return ERR_NONE;
+}
+
+error_code client_game_history(client_state_t* state) {
+    GameHistoryRequestMessage req = { 0 };
+    req.type = MSG_GAME_HISTORY;
+    req.limit = CLIENT_GAME_HISTORY_LEN;
+    strncpy(req.api_key, state->api_key, API_KEY_LEN);
+
+    char message[sizeof(GameHistorySuccessResponseMessage) + GAME_HISTORY_PAGE_MAX * sizeof(GameHistoryEntry)];
+    GameHistoryResponseMessage* res = (GameHistoryResponseMessage*)message;
+    const GameHistoryEntry* entries = (const GameHistoryEntry*)(message + sizeof(GameHistorySuccessResponseMessage));
+
+    char line[2];
+    uint8_t first_page = 1;
+
+    while (1) {
+        error_code err = send_message(state->sock_fd, &req, sizeof(req));
+        if (err != ERR_NONE) {
+            fprintf(stderr, RED "%s Failed to send game history request\n" RESET, error_to_string(err));
+            return err;
+        }
+
+        err = read_message(state->sock_fd, message, sizeof(message));
+        if (err != ERR_NONE) {
+            fprintf(stderr, RED "%s Failed to read game history response\n" RESET, error_to_string(err));
+            return err;
+        }
+
+        if (res->error.status_code != STATUS_OK) {
+            fprintf(stderr, RED "ERROR: Game history request failed, %d - %s\n" RESET, res->error.status_code, res->error.message);
+
+            if (res->error.status_code == STATUS_UNAUTHORIZED) {
+                return ERR_UNATHORIZED;
+            }
+
+            return ERR_UNKNOWN;
+        }
+
+        if (first_page) {
+            fprintf(stdout, "You finished %u games\n", res->success.games);
+            fprintf(stdout, "==========================\n");
+            first_page = 0;
+        }
+
+        uint32_t count = res->success.count < GAME_HISTORY_PAGE_MAX ? res->success.count : GAME_HISTORY_PAGE_MAX;
+        for (uint32_t i = 0; i < count; i++) {
+            const char* opponent = entries[i].opponent[0] != '\0' ? entries[i].opponent : "(unknown)";
+            if (entries[i].won) {
+                fprintf(stdout, GREEN "Won against \"%.*s\", hit %u, got hit %u\n" RESET, USERNAME_MAX_LEN, opponent,
+                        entries[i].hits, entries[i].opponent_hits);
+            } else {
+                fprintf(stdout, RED "Lost against \"%.*s\", hit %u, got hit %u\n" RESET, USERNAME_MAX_LEN, opponent,
+                        entries[i].hits, entries[i].opponent_hits);
+            }
+        }
+
+        if (res->success.next_cursor == 0 || count == 0) {
+            break;
+        }
+
+        fprintf(stdout, "Show older games (y/n): ");
+        err = read_line(line, 2);
+        if (err != ERR_NONE || (line[0] != 'y' && line[0] != 'Y')) {
+            break;
+        }
+
+        req.cursor = res->success.next_cursor;
     }
 
     fprintf(stdout, "==========================\n");
@@ -746,6 +996,120 @@ error_code client_respond_to_challenge(client_state_t* state, uint8_t* accepted)
     return ERR_NONE;
 }
 
+error_code client_quick_match(client_state_t* state) {
+    JoinQueueRequestMessage req;
+    req.type = MSG_JOIN_QUEUE;
+    strncpy(req.api_key, state->api_key, API_KEY_LEN);
+
+    error_code err = send_message(state->sock_fd, &req, sizeof(req));
+    if (err != ERR_NONE) {
+        fprintf(stderr, RED "%s Failed to send join queue request\n" RESET, error_to_string(err));
+        return err;
+    }
+
+    fprintf(stdout, "Waiting for an opponent (press q to cancel)\n");
+
+    struct pollfd poll_fds[2] = {
+        { .fd = STDIN_FILENO, .events = POLLIN },
+        { .fd = state->sock_fd, .events = POLLIN },
+    };
+
+    struct termios new, old;
+    tcgetattr(STDIN_FILENO, &old);
+    new = old;
+    new.c_lflag &= ~(ICANON | ECHO);
+    tcsetattr(STDIN_FILENO, TCSANOW, &new);
+
+    // Match found can come before the join response and after the leave request
+    uint8_t joined = 0;
+    uint8_t leaving = 0;
+    uint8_t matched = 0;
+    MatchFoundMessage match = { 0 };
+
+    while (!(joined && matched)) {
+        if (poll(poll_fds, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, RED "ERROR: poll failed %s\n" RESET, strerror(errno));
+            err = ERR_UNKNOWN;
+            break;
+        }
+
+        if ((poll_fds[0].revents & POLLIN) && getchar() == 'q' && !leaving && !matched) {
+            LeaveQueueRequestMessage leave;
+            leave.type = MSG_LEAVE_QUEUE;
+            strncpy(leave.api_key, state->api_key, API_KEY_LEN);
+
+            err = send_message(state->sock_fd, &leave, sizeof(leave));
+            if (err != ERR_NONE) {
+                fprintf(stderr, RED "%s Failed to send leave queue request\n" RESET, error_to_string(err));
+                break;
+            }
+            leaving = 1;
+        }
+
+        if (!(poll_fds[1].revents & POLLIN)) {
+            continue;
+        }
+
+        char* message;
+        uint32_t len;
+        err = read_message_alloc(state->sock_fd, (void**)&message, &len);
+        if (err != ERR_NONE) {
+            fprintf(stderr, RED "%s Failed to read matchmaking message\n" RESET, error_to_string(err));
+            break;
+        }
+
+        if (len == sizeof(MatchFoundMessage) && message[0] == MSG_MATCH_FOUND) {
+            memcpy(&match, message, sizeof(match));
+            matched = 1;
+            free(message);
+            continue;
+        }
+
+        ErrorResponseMessage res = { 0 };
+        memcpy(&res, message, len < sizeof(res) ? len : sizeof(res));
+        free(message);
+
+        if (!joined) {
+            joined = 1;
+            if (res.status_code != STATUS_OK) {
+                fprintf(stderr, RED "ERROR: Join queue request failed, %d - %.*s\n" RESET, res.status_code,
+                        ERROR_MESSAGE_MAX_LEN, res.message);
+                err = res.status_code == STATUS_UNAUTHORIZED ? ERR_UNATHORIZED : ERR_UNKNOWN;
+                break;
+            }
+            continue;
+        }
+
+        // Leave response, if the client wasn't in the queue anymore the match is on the way
+        leaving = 0;
+        if (res.status_code == STATUS_OK) {
+            fprintf(stdout, "Left the queue\n");
+            break;
+        }
+    }
+
+    tcsetattr(STDIN_FILENO, TCSANOW, &old);
+
+    if (!(joined && matched)) {
+        return err;
+    }
+
+    if (match.status_code != STATUS_OK) {
+        fprintf(stderr, RED "ERROR: Matched with \"%.*s\" but the game couldn't be created, %d\n" RESET,
+                USERNAME_MAX_LEN, match.opponent_username, match.status_code);
+        return ERR_UNKNOWN;
+    }
+
+    state->game.game_id = match.game_id;
+    fprintf(stdout, GREEN "Matched with \"%.*s\", joined a new game with id %d\n" RESET, USERNAME_MAX_LEN,
+            match.opponent_username, state->game.game_id);
+
+    return ERR_NONE;
+}
+
 error_code client_read_game_data(client_state_t* state) {
     ChallengePlayerResponseMessage res;
     error_code err = read_message(state->sock_fd, &res, sizeof(res));
@@ -1307,7 +1671,7 @@ error_code client_menu_create(menu_t* menu)
 
 	{
 		menu_page_t page;
-		err = menu_page_init(&page, 4);
+		err = menu_page_init(&page, 8);
 		if (err != ERR_NONE) {
 			return err;
 		}
@@ -1324,6 +1688,22 @@ error_code client_menu_create(menu_t* menu)
 			menu_item_t item = { .index = 3, .prompt = "Challenge other player" };
 			menu_page_add_item(&page, item);
 		}
+		{
+			menu_item_t item = { .index = 4, .prompt = "Find players" };
+			menu_page_add_item(&page, item);
+		}
+		{
+			menu_item_t item = { .index = 5, .prompt = "Quick match" };
+			menu_page_add_item(&page, item);
+		}
+		{
+			menu_item_t item = { .index = 6, .prompt = "Leaderboard" };
+			menu_page_add_item(&page, item);
+		}
+		{
+			menu_item_t item = { .index = 7, .prompt = "Game history" };
+			menu_page_add_item(&page, item);
+		}
 		{
 			menu_item_t item = { .index = 0, .prompt = "Logout" };
 			menu_page_add_item(&page, item);
@@ -0,0 +1,648 @@
+#include "include/args.h"
+#include "include/coordinate.h"
+#include "include/errors.h"
+#include "include/globals.h"
+#include "include/histogram.h"
+#include "include/messages.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+// Headless load generator. Bots are started at a fixed arrival rate and split
+// into pairs, in every pair the host looks for a game and the guest challenges
+// it, then they play until one of them wins and start the next game.
+// Before that every bot signs up, logs out and logs in again.
+//
+// Every worker thread drives its own bots with epoll so thousands of bots
+// don't need thousands of threads. Both bots of a pair belong to the same worker.
+
+#define LOADGEN_DEFAULT_CLIENTS 1000
+#define LOADGEN_DEFAULT_RATE 500
+#define LOADGEN_DEFAULT_DURATION 10
+#define LOADGEN_MAX_EVENTS 256
+// How long a worker waits for events before it starts more bots
+#define LOADGEN_POLL_MS 1
+
+#define LOADGEN_MSG_TYPES (MSG_REGISTER_SHOT + 1)
+
+// Bot states, bot waits for the response of the request it sent last
+#define BOT_NOT_STARTED 0
+#define BOT_SIGNUP 1
+#define BOT_LOGOUT 2
+#define BOT_LOGIN 3
+#define BOT_IDLE 4
+#define BOT_LOOKING 5
+#define BOT_WAITING_FOR_CHALLENGE 6
+#define BOT_CHALLENGING 7
+#define BOT_ANSWERING 8
+#define BOT_STARTING 9
+#define BOT_SHOOTING 10
+#define BOT_WAITING_FOR_SHOT 11
+#define BOT_CLOSED 12
+
+typedef struct loadgen_worker loadgen_worker_t;
+
+typedef struct loadgen_bot {
+    int sock_fd;
+    uint8_t state;
+    uint8_t host;
+    struct loadgen_bot* peer;
+    loadgen_worker_t* worker;
+
+    char username[USERNAME_MAX_LEN];
+    char api_key[API_KEY_LEN];
+
+    // Request that is waiting for the response and when it was sent
+    uint8_t pending;
+    uint64_t sent_at;
+
+    // Fields are shot in order so the bot never shoots the same field twice
+    uint8_t next_shot;
+
+    message_reader_t reader;
+} loadgen_bot_t;
+
+struct loadgen_worker {
+    pthread_t thread;
+    uint32_t id;
+    int epoll_fd;
+
+    loadgen_bot_t* bots;
+    uint32_t bots_len;
+    uint32_t started;
+
+    histogram_t latencies[LOADGEN_MSG_TYPES];
+    uint64_t errors[LOADGEN_MSG_TYPES];
+    uint64_t games;
+    uint64_t disconnects;
+};
+
+typedef struct {
+    struct sockaddr_in addr;
+    uint32_t clients;
+    uint32_t rate;
+    uint32_t duration;
+    uint32_t workers_len;
+
+    // Makes usernames unique between runs
+    uint32_t run_id;
+    uint64_t start;
+    uint64_t end;
+} loadgen_config_t;
+
+static loadgen_config_t config;
+
+static const char* message_names[LOADGEN_MSG_TYPES] = {
+    [MSG_SIGNUP] = "signup",
+    [MSG_LOGIN] = "login",
+    [MSG_LOGOUT] = "logout",
+    [MSG_LOOK_FOR_GAME] = "look_for_game",
+    [MSG_CHALLENGE_PLAYER] = "challenge",
+    [MSG_CHALLENGE_ANSWER] = "challenge_answer",
+    [MSG_GAME_START] = "game_start",
+    [MSG_PLAYERS_SHOT] = "shot",
+};
+
+// Every bot places its ships the same way, server only checks that the fleet is valid
+static const uint8_t fleet[GAME_HEIGHT][GAME_WIDTH] = {
+    { 1, 1, 1, 1, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 1, 1, 1, 0, 1, 1, 1, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 1, 1, 0, 1, 1, 0, 1, 1 },
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 1, 0, 1, 0, 1, 0, 1, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+
+static void loadgen_usage(char* exe) {
+    fprintf(stderr, "Usage: %s <server_ip> <server_port> [clients] [arrival_rate] [duration_s] [threads]\n", exe);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static error_code parse_count(char* s_count, uint32_t* count) {
+    char* rest = NULL;
+    unsigned long parsed = strtoul(s_count, &rest, 10);
+    if (rest == NULL || *rest != '\0' || parsed == 0 || parsed > UINT32_MAX) {
+        return ERR_IARG;
+    }
+
+    *count = parsed;
+    return ERR_NONE;
+}
+
+static error_code loadgen_parse_args(int argc, char** argv) {
+    if (argc < 3) {
+        loadgen_usage(argv[0]);
+        return ERR_ARG_NOT_ENOUGH;
+    }
+
+    uint16_t port;
+    error_code err = parse_port(argv[2], &port);
+    if (err != ERR_NONE) {
+        error_print(err);
+        return err;
+    }
+
+    config.addr.sin_addr.s_addr = inet_addr(argv[1]);
+    config.addr.sin_family = AF_INET;
+    config.addr.sin_port = htons(port);
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    config.clients = LOADGEN_DEFAULT_CLIENTS;
+    config.rate = LOADGEN_DEFAULT_RATE;
+    config.duration = LOADGEN_DEFAULT_DURATION;
+    config.workers_len = cores > 0 ? (uint32_t)cores : 1;
+
+    uint32_t* optional[] = { &config.clients, &config.rate, &config.duration, &config.workers_len };
+    for (int i = 3; i < argc && i - 3 < 4; i++) {
+        if (parse_count(argv[i], optional[i - 3]) != ERR_NONE) {
+            loadgen_usage(argv[0]);
+            return ERR_IARG;
+        }
+    }
+
+    // Bots play in pairs
+    config.clients += config.clients % 2;
+    if (config.workers_len > config.clients / 2) {
+        config.workers_len = config.clients / 2;
+    }
+
+    return ERR_NONE;
+}
+
+static void bot_close(loadgen_bot_t* bot) {
+    if (bot->state == BOT_CLOSED) {
+        return;
+    }
+
+    // Closing the socket also removes it from epoll
+    if (bot->sock_fd != -1) {
+        close(bot->sock_fd);
+        bot->sock_fd = -1;
+    }
+
+    bot->state = BOT_CLOSED;
+    bot->worker->disconnects++;
+
+    // Server would abandon the game anyway, stop the other bot too
+    bot_close(bot->peer);
+}
+
+static void bot_send(loadgen_bot_t* bot, uint8_t state, const void* message, uint32_t len) {
+    bot->state = state;
+    bot->pending = *(uint8_t*)message;
+    bot->sent_at = now_ns();
+
+    error_code err = send_message(bot->sock_fd, message, len);
+    if (err != ERR_NONE) {
+        fprintf(stderr, RED "ERROR: BOT %s: Failed to send message %u, %s\n" RESET, bot->username, bot->pending,
+                error_to_string(err));
+        bot_close(bot);
+    }
+}
+
+// Records the latency of the pending request, returns 0 and closes
+// the bot if the server didn't process the request successfully
+static uint8_t bot_received(loadgen_bot_t* bot, const char* message) {
+    uint8_t status_code = (uint8_t)message[0];
+    if (status_code != STATUS_OK) {
+        const ErrorResponseMessage* res = (const ErrorResponseMessage*)message;
+        fprintf(stderr, RED "ERROR: BOT %s: Request %u failed with status %u, %.*s\n" RESET, bot->username,
+                bot->pending, status_code, ERROR_MESSAGE_MAX_LEN, res->message);
+        bot->worker->errors[bot->pending]++;
+        bot_close(bot);
+        return 0;
+    }
+
+    histogram_record(&bot->worker->latencies[bot->pending], now_ns() - bot->sent_at);
+    return 1;
+}
+
+static void bot_signup(loadgen_bot_t* bot) {
+    SignupRequestMessage req = { .type = MSG_SIGNUP };
+    strncpy(req.username, bot->username, USERNAME_MAX_LEN);
+    strncpy(req.password, "loadgen", PASSWORD_MAX_LEN);
+    bot_send(bot, BOT_SIGNUP, &req, sizeof(req));
+}
+
+static void bot_logout(loadgen_bot_t* bot) {
+    LogoutRequestMessage req = { .type = MSG_LOGOUT };
+    memcpy(req.api_key, bot->api_key, API_KEY_LEN);
+    bot_send(bot, BOT_LOGOUT, &req, sizeof(req));
+}
+
+static void bot_login(loadgen_bot_t* bot) {
+    LoginRequestMessage req = { .type = MSG_LOGIN };
+    strncpy(req.username, bot->username, USERNAME_MAX_LEN);
+    strncpy(req.password, "loadgen", PASSWORD_MAX_LEN);
+    bot_send(bot, BOT_LOGIN, &req, sizeof(req));
+}
+
+static void bot_look_for_game(loadgen_bot_t* bot) {
+    LookForGameRequestMessage req = { .type = MSG_LOOK_FOR_GAME };
+    memcpy(req.api_key, bot->api_key, API_KEY_LEN);
+    bot_send(bot, BOT_LOOKING, &req, sizeof(req));
+}
+
+// Guest can challenge the host only once it's idle and the host is looking for a game
+static void bot_try_challenge(loadgen_bot_t* guest) {
+    loadgen_bot_t* host = guest->peer;
+    if (guest->state != BOT_IDLE || host->state != BOT_WAITING_FOR_CHALLENGE) {
+        return;
+    }
+
+    ChallengePlayerRequestMessage req = { .type = MSG_CHALLENGE_PLAYER };
+    memcpy(req.api_key, guest->api_key, API_KEY_LEN);
+    strncpy(req.target_username, host->username, USERNAME_MAX_LEN);
+    bot_send(guest, BOT_CHALLENGING, &req, sizeof(req));
+}
+
+static void bot_start_game(loadgen_bot_t* bot) {
+    GameStartRequestMessage req = { .type = MSG_GAME_START };
+    memcpy(req.api_key, bot->api_key, API_KEY_LEN);
+    memcpy(req.game_state, fleet, sizeof(req.game_state));
+
+    bot->next_shot = 0;
+    bot_send(bot, BOT_STARTING, &req, sizeof(req));
+}
+
+static void bot_shoot(loadgen_bot_t* bot) {
+    PlayersShotRequestMessage req = { .type = MSG_PLAYERS_SHOT };
+    memcpy(req.api_key, bot->api_key, API_KEY_LEN);
+    req.target.x = bot->next_shot % GAME_WIDTH;
+    req.target.y = bot->next_shot / GAME_WIDTH;
+
+    bot->next_shot++;
+    bot_send(bot, BOT_SHOOTING, &req, sizeof(req));
+}
+
+// Host looks for the next game and the guest waits for it
+static void bot_game_over(loadgen_bot_t* bot) {
+    if (bot->host) {
+        bot->worker->games++;
+        bot_look_for_game(bot);
+    } else {
+        bot->state = BOT_IDLE;
+        bot_try_challenge(bot);
+    }
+}
+
+// Responses don't carry the request type so the bot state
+// decides what the message is a response to
+static void bot_handle_message(void* params, const char* message, uint32_t len) {
+    loadgen_bot_t* bot = params;
+    if (bot->state == BOT_CLOSED || len == 0) {
+        return;
+    }
+
+    switch (bot->state) {
+    // Signup also logs the user in, logout first so the login is measured too
+    case BOT_SIGNUP:
+        if (bot_received(bot, message)) {
+            memcpy(bot->api_key, ((const SignupResponseMessage*)message)->success.api_key, API_KEY_LEN);
+            bot_logout(bot);
+        }
+        break;
+
+    case BOT_LOGOUT:
+        if (bot_received(bot, message)) {
+            bot_login(bot);
+        }
+        break;
+
+    case BOT_LOGIN:
+        if (!bot_received(bot, message)) {
+            break;
+        }
+
+        memcpy(bot->api_key, ((const LoginResponseMessage*)message)->success.api_key, API_KEY_LEN);
+        if (bot->host) {
+            bot_look_for_game(bot);
+        } else {
+            bot->state = BOT_IDLE;
+            bot_try_challenge(bot);
+        }
+        break;
+
+    case BOT_LOOKING:
+        if (bot_received(bot, message)) {
+            bot->state = BOT_WAITING_FOR_CHALLENGE;
+            bot_try_challenge(bot->peer);
+        }
+        break;
+
+    case BOT_WAITING_FOR_CHALLENGE: {
+        if (message[0] != MSG_CHALLENGE_QUESTION || len != sizeof(ChallengeQuestionRequestMessage)) {
+            fprintf(stderr, RED "ERROR: BOT %s: Expected a challenge question\n" RESET, bot->username);
+            bot_close(bot);
+            break;
+        }
+
+        ChallengeAnswerRequestMessage req = { .type = MSG_CHALLENGE_ANSWER, .accept = 1 };
+        memcpy(req.api_key, bot->api_key, API_KEY_LEN);
+        bot_send(bot, BOT_ANSWERING, &req, sizeof(req));
+        break;
+    }
+
+    case BOT_CHALLENGING:
+    case BOT_ANSWERING:
+    case BOT_STARTING:
+        if (!bot_received(bot, message)) {
+            break;
+        }
+
+        if (bot->state != BOT_STARTING) {
+            bot_start_game(bot);
+        } else if (((const GameStartResponseMessage*)message)->success.first_turn) {
+            bot_shoot(bot);
+        } else {
+            bot->state = BOT_WAITING_FOR_SHOT;
+        }
+        break;
+
+    case BOT_SHOOTING: {
+        if (!bot_received(bot, message)) {
+            break;
+        }
+
+        const PlayersShotSucessResponseMessage* res = (const PlayersShotSucessResponseMessage*)message;
+        if (res->win) {
+            bot_game_over(bot);
+        } else if (res->hit) {
+            bot_shoot(bot);
+        } else {
+            bot->state = BOT_WAITING_FOR_SHOT;
+        }
+        break;
+    }
+
+    case BOT_WAITING_FOR_SHOT: {
+        if (message[0] != MSG_REGISTER_SHOT || len != sizeof(RegisterShotRequestMessage)) {
+            fprintf(stderr, RED "ERROR: BOT %s: Expected a register shot request\n" RESET, bot->username);
+            bot_close(bot);
+            break;
+        }
+
+        const RegisterShotRequestMessage* req = (const RegisterShotRequestMessage*)message;
+        if (req->lose) {
+            bot_game_over(bot);
+        } else if (!req->hit) {
+            bot_shoot(bot);
+        }
+        break;
+    }
+
+    default:
+        fprintf(stderr, RED "ERROR: BOT %s: Unexpected message in state %u\n" RESET, bot->username, bot->state);
+        bot_close(bot);
+        break;
+    }
+}
+
+static error_code bot_connect(loadgen_worker_t* worker, loadgen_bot_t* bot) {
+    int sock_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock_fd == -1) {
+        return ERR_UNKNOWN;
+    }
+
+    if (connect(sock_fd, (struct sockaddr*)&config.addr, sizeof(config.addr)) == -1) {
+        close(sock_fd);
+        return ERR_IARG;
+    }
+
+    // Requests are small and latency is measured, don't let Nagle delay them
+    int one = 1;
+    setsockopt(sock_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    int flags = fcntl(sock_fd, F_GETFL, 0);
+    if (flags == -1 || fcntl(sock_fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        close(sock_fd);
+        return ERR_IFD;
+    }
+
+    struct epoll_event event = { .events = EPOLLIN | EPOLLRDHUP, .data.ptr = bot };
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, sock_fd, &event) == -1) {
+        close(sock_fd);
+        return ERR_IFD;
+    }
+
+    bot->sock_fd = sock_fd;
+    return ERR_NONE;
+}
+
+// Bots of the worker are started evenly over time so all
+// workers together start config.rate bots per second
+static void worker_start_bots(loadgen_worker_t* worker, uint64_t now) {
+    uint64_t elapsed = now - config.start;
+    uint64_t due = elapsed * config.rate / config.workers_len / 1000000000ull + 1;
+    if (due > worker->bots_len) {
+        due = worker->bots_len;
+    }
+
+    for (; worker->started < due; worker->started++) {
+        loadgen_bot_t* bot = &worker->bots[worker->started];
+        if (bot->state == BOT_CLOSED) {
+            continue;
+        }
+
+        error_code err = bot_connect(worker, bot);
+        if (err != ERR_NONE) {
+            fprintf(stderr, RED "ERROR: BOT %s: Failed to connect, %s\n" RESET, bot->username, error_to_string(err));
+            bot_close(bot);
+            continue;
+        }
+
+        bot_signup(bot);
+    }
+}
+
+static void* worker_run(void* params) {
+    loadgen_worker_t* worker = params;
+    struct epoll_event events[LOADGEN_MAX_EVENTS];
+
+    while (1) {
+        uint64_t now = now_ns();
+        if (now >= config.end) {
+            break;
+        }
+
+        worker_start_bots(worker, now);
+
+        int ready = epoll_wait(worker->epoll_fd, events, LOADGEN_MAX_EVENTS, LOADGEN_POLL_MS);
+        if (ready == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            fprintf(stderr, RED "ERROR: Worker %u failed to wait for events, %s\n" RESET, worker->id, strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < ready; i++) {
+            loadgen_bot_t* bot = events[i].data.ptr;
+            if (bot->state == BOT_CLOSED) {
+                continue;
+            }
+
+            // Socket is level triggered, whatever isn't read now is reported again
+            error_code err = read_messages(bot->sock_fd, &bot->reader, bot_handle_message, bot);
+            if (err != ERR_NONE && err != ERR_WOULD_BLOCK) {
+                fprintf(stderr, RED "ERROR: BOT %s: Connection closed, %s\n" RESET, bot->username, error_to_string(err));
+                bot_close(bot);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static error_code worker_init(loadgen_worker_t* worker, uint32_t id, uint32_t bots_len) {
+    memset(worker, 0, sizeof(loadgen_worker_t));
+    worker->id = id;
+    worker->bots_len = bots_len;
+
+    for (uint32_t i = 0; i < LOADGEN_MSG_TYPES; i++) {
+        histogram_init(&worker->latencies[i]);
+    }
+
+    worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (worker->epoll_fd == -1) {
+        return ERR_UNKNOWN;
+    }
+
+    worker->bots = calloc(bots_len, sizeof(loadgen_bot_t));
+    if (worker->bots == NULL) {
+        close(worker->epoll_fd);
+        return ERR_ALLOC;
+    }
+
+    // Bots next to each other play together, even one is the host
+    for (uint32_t i = 0; i < bots_len; i++) {
+        loadgen_bot_t* bot = &worker->bots[i];
+        bot->sock_fd = -1;
+        bot->state = BOT_NOT_STARTED;
+        bot->host = i % 2 == 0;
+        bot->peer = &worker->bots[i ^ 1];
+        bot->worker = worker;
+        snprintf(bot->username, USERNAME_MAX_LEN, "lg%x_%u_%u", config.run_id, id, i);
+    }
+
+    return ERR_NONE;
+}
+
+static void worker_deinit(loadgen_worker_t* worker) {
+    for (uint32_t i = 0; i < worker->bots_len; i++) {
+        if (worker->bots[i].sock_fd != -1) {
+            close(worker->bots[i].sock_fd);
+        }
+    }
+
+    free(worker->bots);
+    close(worker->epoll_fd);
+}
+
+static void loadgen_report(loadgen_worker_t* workers, double elapsed) {
+    histogram_t total;
+    uint64_t games = 0;
+    uint64_t disconnects = 0;
+
+    for (uint32_t i = 0; i < config.workers_len; i++) {
+        games += workers[i].games;
+        disconnects += workers[i].disconnects;
+    }
+
+    fprintf(stdout, "\n%u clients, %u arrivals/s, %u threads, %.1fs\n", config.clients, config.rate,
+            config.workers_len, elapsed);
+    fprintf(stdout, "%-18s %10s %10s %10s %10s %10s %10s %8s\n", "message", "count", "per sec", "p50 us", "p99 us",
+            "p999 us", "max us", "errors");
+
+    for (uint32_t type = 0; type < LOADGEN_MSG_TYPES; type++) {
+        if (message_names[type] == NULL) {
+            continue;
+        }
+
+        histogram_init(&total);
+        uint64_t errors = 0;
+        for (uint32_t i = 0; i < config.workers_len; i++) {
+            histogram_merge(&total, &workers[i].latencies[type]);
+            errors += workers[i].errors[type];
+        }
+
+        fprintf(stdout, "%-18s %10lu %10.0f %10.1f %10.1f %10.1f %10.1f %8lu\n", message_names[type], total.count,
+                total.count / elapsed, histogram_percentile(&total, 50) / 1000.0,
+                histogram_percentile(&total, 99) / 1000.0, histogram_percentile(&total, 99.9) / 1000.0,
+                total.max / 1000.0, errors);
+    }
+
+    fprintf(stdout, "games finished %lu (%.0f per sec), bots disconnected %lu\n", games, games / elapsed, disconnects);
+}
+
+int main(int argc, char** argv) {
+    if (loadgen_parse_args(argc, argv) != ERR_NONE) {
+        return 1;
+    }
+
+    config.run_id = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16);
+
+    loadgen_worker_t* workers = calloc(config.workers_len, sizeof(loadgen_worker_t));
+    if (workers == NULL) {
+        error_print(ERR_ALLOC);
+        return 1;
+    }
+
+    // Pairs are split between workers, first workers get the extra pairs
+    uint32_t pairs = config.clients / 2;
+    for (uint32_t i = 0; i < config.workers_len; i++) {
+        uint32_t worker_pairs = pairs / config.workers_len + (i < pairs % config.workers_len);
+        error_code err = worker_init(&workers[i], i, worker_pairs * 2);
+        if (err != ERR_NONE) {
+            error_print(err);
+            return 1;
+        }
+    }
+
+    fprintf(stdout, "Starting %u clients at %u per second on %u threads for %u seconds\n", config.clients,
+            config.rate, config.workers_len, config.duration);
+
+    config.start = now_ns();
+    config.end = config.start + (uint64_t)config.duration * 1000000000ull;
+
+    uint32_t started = 0;
+    for (; started < config.workers_len; started++) {
+        if (pthread_create(&workers[started].thread, NULL, worker_run, &workers[started]) != 0) {
+            fprintf(stderr, RED "ERROR: Failed to start worker %u\n" RESET, started);
+            break;
+        }
+    }
+
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    loadgen_report(workers, (now_ns() - config.start) / 1e9);
+
+    for (uint32_t i = 0; i < config.workers_len; i++) {
+        worker_deinit(&workers[i]);
+    }
+
+    free(workers);
+    return 0;
+}
@@ -1,4 +1,6 @@
 #include "include/game_results.h"
+#include "include/logger.h"
+#include "include/results_writer.h"
 #include <include/users.h>
 #include <include/server_handlers.h>
 #include <include/server_utils.h>
@@ -9,10 +11,10 @@
 #include <assert.h>
 #include <include/args.h>
 #include <include/errors.h>
-#include <include/server.h>
+#include <include/server_reactor.h>
 #include <include/state.h>
-#include <include/vector/vector.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdint.h>
@@ -25,10 +27,11 @@
 #include <sys/poll.h>
 
 #define USERS_FILEPATH "./users.db"
+#define USERS_LOG_FILEPATH "./users.db.log"
+// Written on SIGUSR1
+#define STATS_FILEPATH "./server_stats.txt"
 
 void* handle_client_connetion(void* params);
-void handle_client_disconnect(server_client_t* client);
-void generate_random_hex_string(char* buffer, uint32_t len);
 
 volatile sig_atomic_t interrupted = 0;
 
@@ -36,6 +39,13 @@ void handle_sigint(int sig) {
     interrupted = sig;
 }
 
+volatile sig_atomic_t dump_stats = 0;
+
+void handle_sigusr1(int sig) {
+    (void)sig;
+    dump_stats = 1;
+}
+
 int main(int argc, char** argv)
 {
     srand(time(NULL));
@@ -43,6 +53,7 @@ int main(int argc, char** argv)
     // Need to register a signal handler so that poll will 
     // catch the signal and return EINTR
     signal(SIGINT, handle_sigint);
+    signal(SIGUSR1, handle_sigusr1);
 
 	server_state_t state = { 0 };
     // TODO load games and set the next id after that
@@ -54,43 +65,154 @@ int main(int argc, char** argv)
         return 1; 
     }
 
-    vector_create(&state.games, sizeof(server_game_t));
-	vector_create(&state.clients, sizeof(server_client_t));
+    err = server_shards_init(&state);
+    if (err != ERR_NONE) {
+        fprintf(stderr, RED "%s failed to create clients, games and users shards\n" RESET, error_to_string(err));
+        return 1;
+    }
 
-	pthread_rwlock_init(&state.clients_rwlock, NULL);
-    pthread_rwlock_init(&state.users_rwlock, NULL);
-    pthread_rwlock_init(&state.games_rwlock, NULL);
     pthread_rwlock_init(&state.game_results_rwlock, NULL);
+    pthread_rwlock_init(&state.sessions_rwlock, NULL);
+    pthread_rwlock_init(&state.leaderboard_rwlock, NULL);
+
+    err = server_stats_init(&state.stats);
+    if (err != ERR_NONE) {
+        fprintf(stderr, RED "%s failed to create stats\n" RESET, error_to_string(err));
+        return 1;
+    }
+
+    server_stats_add_locks(&state.stats, "users", state.users_locks, STATE_SHARDS);
+    server_stats_add_locks(&state.stats, "users_table", &state.users_table_lock, 1);
+    server_stats_add_locks(&state.stats, "clients", state.clients_locks, STATE_SHARDS);
+    server_stats_add_locks(&state.stats, "games", state.games_locks, STATE_SHARDS);
+
+    err = username_map_init(&state.sessions, 0);
+    if (err != ERR_NONE) {
+        fprintf(stderr, RED "%s failed to create sessions\n" RESET, error_to_string(err));
+        return 1;
+    }
+
+    err = online_players_init(&state.online);
+    if (err != ERR_NONE) {
+        fprintf(stderr, RED "%s failed to create online players\n" RESET, error_to_string(err));
+        return 1;
+    }
 
     // Load all users from a file
-    // Users load will initalize users vector
-    err = users_load(&state.users, USERS_FILEPATH);
+    // Users load will initalize users table
+    // Index of all users is only used while loading, it's split into the shards afterwards
+    username_map_t users_index;
+    err = users_load(&state.users, &users_index, USERS_FILEPATH);
     if (err != ERR_NONE) {
         fprintf(stderr, RED "%s failed to read users\n" RESET, error_to_string(err));
         return 1;
     }
 
-    // Game results load will initialize game results vector
-    err = game_results_load(&state.game_results, GAME_RESULTS_FILEPATH);
+    // Users added after the snapshot was written are in the log
+    err = users_journal_open(&state.users_journal, USERS_FILEPATH, USERS_LOG_FILEPATH,
+                             &state.users, &users_index, &state.users_table_lock);
+    if (err != ERR_NONE) {
+        fprintf(stderr, RED "%s failed to open users log\n" RESET, error_to_string(err));
+        return 1;
+    }
+
+    // Game results load will initialize game results table
+    err = game_results_load(&state.game_results, GAME_RESULTS_FILEPATH, &users_index);
     if (err != ERR_NONE) {
         fprintf(stderr, RED "%s failed to read game results\n" RESET, error_to_string(err));
         return 1;
     }
 
+    username_map_deinit(&users_index);
+    err = server_shards_index_users(&state);
+    if (err != ERR_NONE) {
+        fprintf(stderr, RED "%s failed to index users\n" RESET, error_to_string(err));
+        return 1;
+    }
+
+    err = results_index_load(&state.results_index, &state.game_results, RESULTS_INDEX_FILEPATH,
+                             RESULTS_INDEX_HEADS_FILEPATH);
+    if (err != ERR_NONE) {
+        fprintf(stderr, RED "%s failed to read game results index\n" RESET, error_to_string(err));
+        return 1;
+    }
+
+    err = leaderboard_init(&state.leaderboard);
+    if (err != ERR_NONE) {
+        fprintf(stderr, RED "%s failed to create leaderboard\n" RESET, error_to_string(err));
+        return 1;
+    }
+
+    // Results are counted by every core, the server doesn't accept clients yet
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t rebuild_start = server_stats_now_ns();
+    err = leaderboard_rebuild(&state.leaderboard, &state.game_results, record_table_len(&state.users),
+                              cores > 0 ? (uint32_t)cores : 1);
+    if (err != ERR_NONE) {
+        fprintf(stderr, RED "%s failed to rebuild leaderboard\n" RESET, error_to_string(err));
+        return 1;
+    }
+    fprintf(stdout, "Rebuilt leaderboard of %u players from %u game results in %.1f ms\n", state.leaderboard.len,
+            record_table_len(&state.game_results), (server_stats_now_ns() - rebuild_start) / 1e6);
+
+    // Game results are added to the file as soon as the game is finished
+    err = results_writer_start(&state.results_writer, GAME_RESULTS_FILEPATH, RESULTS_INDEX_FILEPATH);
+    if (err != ERR_NONE) {
+        fprintf(stderr, RED "%s failed to start game results writer\n" RESET, error_to_string(err));
+        return 1;
+    }
+
+    err = matchmaker_start(&state.matchmaker, &state.stats, server_match_clients, &state);
+    if (err != ERR_NONE) {
+        fprintf(stderr, RED "%s failed to start the matchmaker\n" RESET, error_to_string(err));
+        return 1;
+    }
+
+    server_reactor_t reactor = { 0 };
+    if (state.mode == SERVER_MODE_EPOLL) {
+        err = reactor_start(&reactor, 0);
+        if (err != ERR_NONE) {
+            fprintf(stderr, RED "%s failed to start the reactor\n" RESET, error_to_string(err));
+            return 1;
+        }
+        state.epoll_fd = reactor.epoll_fd;
+    }
+
 	state.sock_fd = server_start(state.port);
 	if (state.sock_fd == -1) {
 		fprintf(stderr, RED "ERROR: Failed to start server\n" RESET);
         return 1;
 	}
 
-    fprintf(stdout, "Server started on port %u\n", state.port);
+    fprintf(stdout, "Server started on port %u in %s mode\n", state.port,
+            state.mode == SERVER_MODE_EPOLL ? "epoll" : "threads");
+
+    // From here on handlers log through the logger thread
+    err = logger_start();
+    if (err != ERR_NONE) {
+        return 1;
+    }
 
     struct pollfd server_poll_fd = { .fd = state.sock_fd, .events = POLLIN };
 
 	while (!interrupted) {
         int ret = poll(&server_poll_fd, 1, -1);
         if (ret == -1 && errno == EINTR) {
-            break;
+            if (dump_stats) {
+                dump_stats = 0;
+                err = server_stats_dump(&state.stats, STATS_FILEPATH);
+                if (err != ERR_NONE) {
+                    LOG_ERROR("%s failed to write stats", error_to_string(err));
+                } else {
+                    LOG_INFO("Stats written to %s", STATS_FILEPATH);
+                }
+            }
+
+            if (interrupted) {
+                break;
+            }
+
+            continue;
         } 
 
         if (server_poll_fd.revents & POLLIN) {
@@ -99,64 +221,72 @@ int main(int argc, char** argv)
 
             int client_sock_fd = accept(state.sock_fd, (struct sockaddr*)&client_addr, &len);
             if (client_sock_fd == -1) {
-                fprintf(stderr, RED "ERROR: Failed to accept connection\n" RESET);
+                LOG_ERROR("Failed to accept connection");
                 break;
             }
-    
-            // try to find disconnected client;
-        
-            pthread_rwlock_wrlock(&state.clients_rwlock);
-
-            server_client_t* client_p = NULL;
-            for (uint32_t i = 0; i < state.clients.logical_length; i++) {
-                server_client_t* client = vector_at(&state.clients, i);
-                if (client->sock_fd == -1) {
-                    fprintf(stdout, "Found free space for client at index %d, vector len %d\n", i, state.clients.logical_length);
-                    // this is free space that we can use
-                    client->sock_fd = client_sock_fd;
-                    client->server_state = &state;
-                    client->addr = client_addr;
-                    client->flags = 0;
-                    client_p = client;
-                    break;
-                }
-            }
 
+            // Responses and pushes to the other player are small writes right after
+            // each other, without this Nagle holds the second one until the ACK
+            int one = 1;
+            setsockopt(client_sock_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    
+            server_client_t* client_p = server_add_client(&state, client_sock_fd, client_addr);
             if (client_p == NULL) {
-                // if we didn't find free space add one more
-                server_client_t new_client =  {
-                    .sock_fd = client_sock_fd,
-                    .server_state=  &state,
-                    .addr = client_addr,
-                    .flags = 0,
-                };
-                vector_push(&state.clients, &new_client);
-                client_p = vector_at(&state.clients, state.clients.logical_length - 1);
-                // fprintf(stdout, "Didn't find free space for client, new vector len %d\n", state.clients.logical_length);
+                LOG_ERROR("CLIENT %d: Clients table is full, closing connection", client_sock_fd);
+                close(client_sock_fd);
+                continue;
             }
 
-            pthread_rwlock_unlock(&state.clients_rwlock);
+            if (state.mode == SERVER_MODE_THREADS) {
+                // Signals have to reach the main thread to interrupt the poll
+                sigset_t blocked, old;
+                sigfillset(&blocked);
+                pthread_sigmask(SIG_BLOCK, &blocked, &old);
+                pthread_create(&(client_p->handler_thread), NULL, handle_client_connetion, client_p);
+                pthread_sigmask(SIG_SETMASK, &old, NULL);
+                pthread_detach(client_p->handler_thread);
+                continue;
+            }
 
-            pthread_create(&(client_p->handler_thread), NULL, handle_client_connetion, client_p);
-            pthread_detach(client_p->handler_thread);
+            err = reactor_add_client(&reactor, client_p);
+            if (err != ERR_NONE) {
+                LOG_ERROR("%s CLIENT %d: Failed to register client with the reactor",
+                        error_to_string(err), client_sock_fd);
+                handle_client_disconnect(client_p);
+            }
         }
 	}
 
     fprintf(stderr, "\nStopping server..\n");
 
-    err = users_save(&state.users, USERS_FILEPATH);
+    if (state.mode == SERVER_MODE_EPOLL) {
+        reactor_stop(&reactor);
+    }
+    matchmaker_stop(&state.matchmaker);
+    logger_stop();
+
+    // Every user is already in the snapshot or the log
+    users_journal_close(&state.users_journal);
+    results_writer_stop(&state.results_writer);
+
+    // Links written by the writer are replayed on load until the heads are saved again
+    err = results_index_save_heads(&state.results_index, RESULTS_INDEX_HEADS_FILEPATH);
     if (err != ERR_NONE) {
-        fprintf(stderr, RED "%s failed to save users" RESET, error_to_string(err));
+        fprintf(stderr, RED "%s failed to save game results index heads\n" RESET, error_to_string(err));
     }
 
 	close(state.sock_fd);
-	vector_destroy(&state.clients, NULL);
-	vector_destroy(&state.users, NULL);
-	vector_destroy(&state.game_results, NULL);
-	pthread_rwlock_destroy(&state.clients_rwlock);
-	pthread_rwlock_destroy(&state.users_rwlock);
-	pthread_rwlock_destroy(&state.games_rwlock);
+	server_shards_deinit(&state);
+	record_table_destroy(&state.users);
+	username_map_deinit(&state.sessions);
+	online_players_deinit(&state.online);
+	leaderboard_deinit(&state.leaderboard);
+	results_index_deinit(&state.results_index);
+	record_table_destroy(&state.game_results);
 	pthread_rwlock_destroy(&state.game_results_rwlock);
+	pthread_rwlock_destroy(&state.sessions_rwlock);
+	pthread_rwlock_destroy(&state.leaderboard_rwlock);
+	server_stats_deinit(&state.stats);
 
 	return 0;
 }
@@ -165,155 +295,27 @@ void* handle_client_connetion(void* params)
 {
 	server_client_t* client = params;
 
-	fprintf(stdout, "Running client handler SOCK: %d\n", client->sock_fd);
-
-    char buffer[IN_BUFFER_SIZE];
+	LOG_DEBUG("Running client handler SOCK: %d", client->sock_fd);
 
     while (1) {
-        memset(buffer, 0, IN_BUFFER_SIZE);
-        error_code err = read_message(client->sock_fd, buffer, IN_BUFFER_SIZE);
+        error_code err = read_messages(client->sock_fd, &client->reader, handle_client_message, client);
         if (err != ERR_NONE) {
             if (err == ERR_PEER_CLOSED) {
-                fprintf(stderr, GREEN "CLIENT %d: Disconnected\n" RESET, client->sock_fd);
+                LOG_INFO("CLIENT %d: Disconnected", client->sock_fd);
                 break;
             }
 
-            fprintf(stderr, RED "ERROR: CLIENT %d: Failed to read client message, %d - %s\n" RESET, client->sock_fd, err, error_to_string(err));
-            if (err == ERR_IFD) {
-                fprintf(stderr, RED "ERROR: CLIENT %d: Something is wrong with socket, closing connection\n" RESET, client->sock_fd);
+            LOG_ERROR("CLIENT %d: Failed to read client message, %d - %s", client->sock_fd, err, error_to_string(err));
+            if (err == ERR_IFD || err == ERR_MESSAGE_TOO_LARGE) {
+                LOG_ERROR("CLIENT %d: Something is wrong with socket, closing connection", client->sock_fd);
                 break;
             }
 
             continue;
         }
-
-        // Parse message type
-        uint8_t message_type = *((uint8_t*)(buffer));
-        switch (message_type) {
-            case MSG_SIGNUP: {
-                fprintf(stdout, "CLIENT %d: Received signup request\n", client->sock_fd);
-                error_code err = handle_signup_request(client, buffer);
-                if (err != ERR_NONE) {
-                    fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send signup response, %d - %s\n" RESET,
-                            client->sock_fd, err, error_to_string(err));
-                }
-
-                break;
-            }
-
-            case MSG_LOGIN: {
-                fprintf(stdout, "CLIENT %d: Received login request\n", client->sock_fd);
-                error_code err = handle_login_request(client, buffer);
-                if (err != ERR_NONE) {
-                    fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send login response, %d - %s\n" RESET,
-                            client->sock_fd, err, error_to_string(err));
-                }
-
-                break;
-            }
-            case MSG_LOGOUT: {
-                fprintf(stdout, "CLIENT %d: Received logout request\n", client->sock_fd);
-                error_code err = handle_logout_request(client, buffer);
-                if (err != ERR_NONE) {
-                    fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send login response, %d - %s\n" RESET,
-                            client->sock_fd, err, error_to_string(err));
-                }
-
-                break;
-            }
-            case MSG_LIST_USERS: {
-                fprintf(stdout, "CLIENT %d: Received list users request\n", client->sock_fd);
-                error_code err = handle_list_users(client, buffer);
-                if (err != ERR_NONE) {
-                    fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send login response, %d - %s\n" RESET,
-                            client->sock_fd, err, error_to_string(err));
-                }
-
-                break;
-            }
-            case MSG_LOOK_FOR_GAME: {
-                fprintf(stdout, "CLIENT %d: Received look for game request\n", client->sock_fd);
-                error_code err = handle_look_for_game(client, buffer);
-                if (err != ERR_NONE) {
-                    fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send look for game response, %d - %s\n" RESET,
-                            client->sock_fd, err, error_to_string(err));
-                }
-                break;
-            }
-            case MSG_CANCEL_LOOK_FOR_GAME: {
-                fprintf(stdout, "CLIENT %d: Received cancel look for game request\n", client->sock_fd);
-                error_code err = handle_cancel_look_for_game(client, buffer);
-                if (err != ERR_NONE) {
-                    fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send cancel look for game response, %d - %s\n" RESET,
-                            client->sock_fd, err, error_to_string(err));
-                }
-                break;
-            }
-            case MSG_CHALLENGE_PLAYER: {
-                fprintf(stdout, "CLIENT %d: Received challenge player request\n", client->sock_fd);
-                error_code err =  handle_challenge_player(client, buffer);
-                if (err != ERR_NONE) {
-                    fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send challenge player response, %d - %s\n" RESET,
-                            client->sock_fd, err, error_to_string(err));
-                }
-                break;
-            }
-            case MSG_CHALLENGE_ANSWER: {
-                fprintf(stdout, "CLIENT %d: Received challenge answer request\n", client->sock_fd);
-                error_code err = handle_challenge_answer(client, buffer);
-                if (err != ERR_NONE) {
-                    fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send challenge answer response, %d - %s\n" RESET,
-                            client->sock_fd, err, error_to_string(err));
-                }
-                break;
-            }
-            case MSG_GAME_START: {
-                fprintf(stdout, "CLIENT %d: Received game start request\n", client->sock_fd);
-                error_code err = handle_game_start(client, buffer);
-                if (err != ERR_NONE) {
-                    fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send game start response, %d - %s\n" RESET,
-                            client->sock_fd, err, error_to_string(err));
-                }
-                break;
-            }
-            case MSG_PLAYERS_SHOT: {
-                fprintf(stdout, "CLIENT %d: Received player shot request\n", client->sock_fd);
-                error_code err = handle_players_shot(client, buffer);
-                if (err != ERR_NONE) {
-                    fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send player shot response, %d - %s\n" RESET,
-                            client->sock_fd, err, error_to_string(err));
-                }
-                break;
-            }
-            default: {
-                fprintf(stderr, RED "ERROR: CLIENT %d: Message type is unknown %u\n" RESET, client->sock_fd, message_type);
-                error_code err = handle_unknown_request(client);
-                if (err != ERR_NONE) {
-                    fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send message type unknown response, %d - %s\n" RESET,
-                            client->sock_fd, err, error_to_string(err));
-                }
-            }
-        }
     }
 
     handle_client_disconnect(client);
 
 	return NULL;
 }
-
-void handle_client_disconnect(server_client_t* client) {
-    close(client->sock_fd);
-    client->user = NULL;
-    client->flags = 0;
-    client->sock_fd = -1;
-
-    if (client->game == NULL) {
-        return;
-    }
-
-    if (client->game->state != GAME_STATE_CLOSED) {
-        // close the game, other client will get an error when he tries to 
-        // send some game events 
-        server_close_game(client->server_state, client->game); 
-    }
-}
@@ -0,0 +1,30 @@
+#include "include/checksum.h"
+#include <pthread.h>
+#include <stdint.h>
+
+#define CRC32_POLYNOMIAL 0xEDB88320u
+
+static uint32_t crc32_table[256];
+static pthread_once_t crc32_table_once = PTHREAD_ONCE_INIT;
+
+static void crc32_build_table(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? (crc >> 1) ^ CRC32_POLYNOMIAL : crc >> 1;
+        }
+        crc32_table[i] = crc;
+    }
+}
+
+uint32_t checksum_crc32(uint32_t crc, const void* data, uint64_t len) {
+    pthread_once(&crc32_table_once, crc32_build_table);
+
+    const uint8_t* bytes = data;
+    crc = ~crc;
+    for (uint64_t i = 0; i < len; i++) {
+        crc = crc32_table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
@@ -33,6 +33,20 @@ char* error_to_string(error_code error)
         return "ERROR: Connection peer closed the connection";
     case ERR_UNATHORIZED:
         return "ERROR: Invalid Api key provided";
+    case ERR_WOULD_BLOCK:
+        return "ERROR: Operation would block";
+    case ERR_ARG_IMODE:
+        return "ERROR: Server mode needs to be either epoll or threads";
+    case ERR_MESSAGE_TOO_LARGE:
+        return "ERROR: Message is too large";
+    case ERR_FLEET_INVALID:
+        return "ERROR: Fleet is invalid";
+    case ERR_QUEUE_FULL:
+        return "ERROR: Queue is full";
+    case ERR_SEND_TIMEOUT:
+        return "ERROR: Peer stopped reading messages";
+    case ERR_SYNC_FAILED:
+        return "ERROR: Failed to sync data to disk";
 	default:
 		return "UNREACHABLE";
 	}
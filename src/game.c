@@ -1,4 +1,5 @@
 #include "include/game.h"
+#include "include/game_board.h"
 #include "include/globals.h"
 #include "include/state.h"
 #include <pthread.h>
@@ -92,23 +93,20 @@ server_client_t* game_other_player(server_game_t* game, server_client_t* player)
     return out;
 }
 
-void game_set_clients_game_state(server_game_t* game, server_client_t* client, uint8_t* new_game_state) {
+void game_set_clients_game_state(server_game_t* game, server_client_t* client, game_board_t board) {
     pthread_mutex_lock(&game->lock);
     if (game->state != GAME_STATE_WAITING_FOR_PLAYERS_STATES) {
         UNREACHABLE;
     }
 
-    uint8_t* state = NULL;
     if (game->first == client) {
-        state = game->first_game_state;
+        game->first_board = board;
         game->first_state_set = 1;
     } else if (game->second == client) {
-        state = game->second_game_state;
+        game->second_board = board;
         game->second_state_set = 1;
     }
 
-    memcpy(state, new_game_state, GAME_WIDTH * GAME_HEIGHT);
-
     if (game->first_state_set && game->second_state_set) {
         game->state = GAME_STATE_STARTED;
     }
@@ -137,36 +135,28 @@ inline uint8_t game_set_inital_turn(server_game_t* game, server_client_t* client
     return out;
 }
 
-// Sets the turn to current the other player
-inline void game_next_turn(server_game_t* game, server_client_t* client) {
+// Registeres a shot chainging the game state
+// returning the state of the field before the changes 
+uint8_t game_register_shot(server_game_t* game, server_client_t* client, Coordinate target) {
     if (!game_started(game)) {
         UNREACHABLE;
     }
 
     pthread_mutex_lock(&game->lock);
 
+    uint8_t out = 0;
+    game_board_t* target_board = NULL;
+
     if (game->first == client) {
-        game->turn = GAME_SECONDS_TURN;
+        target_board = &game->second_board;
     } else {
-        game->turn = GAME_FIRSTS_TURN;
-    }
-
-    pthread_mutex_unlock(&game->lock);
-}
-
-uint8_t game_is_my_turn(server_game_t* game, server_client_t* client) {
-    if (!game_started(game)) {
-        UNREACHABLE;
+        target_board = &game->first_board;
     }
 
-    pthread_mutex_lock(&game->lock);
-
-    uint8_t out  = 0;
-
-    if (game->first == client && game->turn == GAME_FIRSTS_TURN) {
-        out = 1;
-    } else if (game->second == client && game->turn == GAME_SECONDS_TURN) {
-        out = 1;
+    if (target.x < 0 || target.x >= GAME_WIDTH || target.y < 0 || target.y >= GAME_HEIGHT) {
+        out = GAME_FIELD_INVALID;
+    } else {
+        out = game_board_shoot(target_board, target.x + target.y * GAME_WIDTH);
     }
 
     pthread_mutex_unlock(&game->lock);
@@ -174,42 +164,40 @@ uint8_t game_is_my_turn(server_game_t* game, server_client_t* client) {
     return out;
 }
 
-// Registeres a shot chainging the game state
-// returning the state of the field before the changes 
-uint8_t game_register_shot(server_game_t* game, server_client_t* client, Coordinate target) {
-    if (!game_started(game)) {
-        UNREACHABLE;
-    }
+game_shot_t game_apply_shot(server_game_t* game, server_client_t* client, Coordinate target) {
+    game_shot_t out = { 0 };
 
     pthread_mutex_lock(&game->lock);
 
-    uint8_t out = 0;
-    uint8_t* target_board = NULL;
+    uint8_t first = game->first == client;
+    out.other = first ? game->second : game->first;
+    out.turn = game->turn;
 
-    if (game->first == client) {
-        target_board = game->second_game_state;
+    if (game->state != GAME_STATE_STARTED) {
+        out.status_code = STATUS_GAME_NOT_STARTED;
+    } else if (game->turn != (first ? GAME_FIRSTS_TURN : GAME_SECONDS_TURN)) {
+        out.status_code = STATUS_GAME_NOT_MY_TURN;
+    } else if (target.x < 0 || target.x >= GAME_WIDTH || target.y < 0 || target.y >= GAME_HEIGHT) {
+        out.status_code = STATUS_SHOT_INVALID_FIELD;
     } else {
-        target_board = game->first_game_state;
-    }
-
-    int8_t index = target.x + target.y * GAME_WIDTH;
-    if (index < 0 && index >= GAME_WIDTH * GAME_HEIGHT) {
-        out = GAME_FIELD_INVALID;
-    } else {
-        out = target_board[index];
-        switch (out) {
-            case GAME_FIELD_EMPTY:
-                target_board[index] = GAME_FIELD_MISS;
-                break;
-            case GAME_FIELD_SHIP:
-                target_board[index] = GAME_FIELD_HIT;
-                break;
-            case GAME_FIELD_MISS:
-                break;
-            case GAME_FIELD_HIT:
-                break;
-            default:
-                UNREACHABLE;
+        game_board_t* target_board = first ? &game->second_board : &game->first_board;
+        uint8_t field = game_board_shoot(target_board, target.x + target.y * GAME_WIDTH);
+
+        if (field == GAME_FIELD_HIT || field == GAME_FIELD_MISS) {
+            out.status_code = STATUS_SHOT_ALREADY_DESTROYED;
+        } else {
+            out.status_code = STATUS_OK;
+            out.hit = field == GAME_FIELD_SHIP;
+
+            // Opponent can't win on my turn, only the board that was shot at is checked
+            if (game_board_all_sunk(target_board)) {
+                out.won = 1;
+                game->state = GAME_STATE_FINISHED;
+                game->won = first ? GAME_FIRST_WON : GAME_SECOND_WON;
+            } else if (!out.hit) {
+                game->turn = first ? GAME_SECONDS_TURN : GAME_FIRSTS_TURN;
+            }
+            out.turn = game->turn;
         }
     }
 
@@ -223,30 +211,16 @@ uint8_t game_check_win(server_game_t* game, server_client_t* client) {
         UNREACHABLE;
     }
 
-    int8_t out = 0;
     pthread_mutex_lock(&game->lock);
 
-    uint8_t* opponents_board = NULL;
-
+    // If opponent doesn't have any ships left we won
+    uint8_t out = 0;
     if (game->first == client) {
-        opponents_board = game->second_game_state;
+        out = game_board_all_sunk(&game->second_board);
     } else {
-        opponents_board = game->first_game_state;
-    }
-   
-    uint8_t opponents_ships = 0;
-    for (uint16_t i = 0; i < GAME_WIDTH * GAME_HEIGHT; i++) {
-        if (opponents_board[i] == GAME_FIELD_SHIP) {
-            opponents_ships++;
-            break;
-        }
+        out = game_board_all_sunk(&game->first_board);
     }
 
-    // If opponent doesn't have any ships left we won
-    if (opponents_ships == 0) {
-        out = 1;
-    } 
-
     pthread_mutex_unlock(&game->lock);
 
     return out;
@@ -259,19 +233,6 @@ uint8_t game_finished(server_game_t* game) {
     return out;
 }
 
-void game_finish(server_game_t* game, server_client_t* client) {
-    pthread_mutex_lock(&game->lock);
-    game->state = GAME_STATE_FINISHED;
-
-    if (game->first == client) {
-        game->won = GAME_FIRST_WON;
-    } else {
-        game->won = GAME_SECOND_WON;
-    }
-
-    pthread_mutex_unlock(&game->lock);
-}
-
 
 game_results_t game_create_result(server_game_t* game) {
     if (!game_finished(game)) {
@@ -280,12 +241,16 @@ game_results_t game_create_result(server_game_t* game) {
 
     pthread_mutex_lock(&game->lock);
 
-    game_results_t res;
+    uint8_t fields[GAME_WIDTH * GAME_HEIGHT];
+
+    game_results_t res = { 0 };
     res.won = game->won;
-    memcpy(res.first_game_state, game->first_game_state, GAME_WIDTH * GAME_HEIGHT);
-    memcpy(res.second_game_state, game->second_game_state, GAME_WIDTH * GAME_HEIGHT);
-    strncpy(res.first_player_username, game->first->user->username, USERNAME_MAX_LEN);
-    strncpy(res.second_player_username, game->second->user->username, USERNAME_MAX_LEN);
+    res.first_player_id = game->first->user_id;
+    res.second_player_id = game->second->user_id;
+    game_board_to_fields(&game->first_board, fields);
+    game_results_pack_board(fields, res.first_game_state);
+    game_board_to_fields(&game->second_board, fields);
+    game_results_pack_board(fields, res.second_game_state);
     pthread_mutex_unlock(&game->lock);
 
     return res;
@@ -0,0 +1,65 @@
+#include "include/game_board.h"
+#include "include/globals.h"
+#include <stdint.h>
+
+game_board_t game_board_from_fields(const uint8_t* fields) {
+    game_board_t board = { 0 };
+
+    for (uint8_t i = 0; i < GAME_WIDTH * GAME_HEIGHT; i++) {
+        switch (fields[i]) {
+            case GAME_FIELD_SHIP:
+                board.ships |= GAME_BOARD_BIT(i);
+                break;
+            case GAME_FIELD_HIT:
+                board.ships |= GAME_BOARD_BIT(i);
+                board.hits |= GAME_BOARD_BIT(i);
+                break;
+            case GAME_FIELD_MISS:
+                board.misses |= GAME_BOARD_BIT(i);
+                break;
+            default:
+                break;
+        }
+    }
+
+    return board;
+}
+
+void game_board_to_fields(const game_board_t* board, uint8_t* fields) {
+    for (uint8_t i = 0; i < GAME_WIDTH * GAME_HEIGHT; i++) {
+        uint64_t bit = GAME_BOARD_BIT(i);
+        if (board->hits & bit) {
+            fields[i] = GAME_FIELD_HIT;
+        } else if (board->ships & bit) {
+            fields[i] = GAME_FIELD_SHIP;
+        } else if (board->misses & bit) {
+            fields[i] = GAME_FIELD_MISS;
+        } else {
+            fields[i] = GAME_FIELD_EMPTY;
+        }
+    }
+}
+
+uint8_t game_board_shoot(game_board_t* board, uint8_t index) {
+    uint64_t bit = GAME_BOARD_BIT(index);
+
+    if (board->hits & bit) {
+        return GAME_FIELD_HIT;
+    }
+
+    if (board->misses & bit) {
+        return GAME_FIELD_MISS;
+    }
+
+    if (board->ships & bit) {
+        board->hits |= bit;
+        return GAME_FIELD_SHIP;
+    }
+
+    board->misses |= bit;
+    return GAME_FIELD_EMPTY;
+}
+
+uint8_t game_board_all_sunk(const game_board_t* board) {
+    return (board->ships & ~board->hits) == 0;
+}
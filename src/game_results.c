@@ -1,6 +1,106 @@
 #include <include/game_results.h>
+#include "include/username_map.h"
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+void game_results_pack_board(const uint8_t* fields, uint8_t* packed) {
+    memset(packed, 0, GAME_RESULTS_BOARD_SIZE);
+    for (uint8_t i = 0; i < GAME_WIDTH * GAME_HEIGHT; i++) {
+        packed[i / 4] |= (fields[i] & 3) << ((i % 4) * 2);
+    }
+}
+
+void game_results_unpack_board(const uint8_t* packed, uint8_t* fields) {
+    for (uint8_t i = 0; i < GAME_WIDTH * GAME_HEIGHT; i++) {
+        fields[i] = (packed[i / 4] >> ((i % 4) * 2)) & 3;
+    }
+}
+
+static uint32_t game_results_find_player(username_map_t* users_index, const char* username, uint64_t* missing) {
+    uint32_t id;
+    if (users_index == NULL || !username_map_get(users_index, username, &id)) {
+        (*missing)++;
+        return GAME_RESULTS_UNKNOWN_USER;
+    }
+    return id;
+}
+
+// Results file without a header is an array of game_results_legacy_t,
+// every result is converted into a new file that replaces the legacy one
+static error_code game_results_convert_legacy(FILE* file, uint64_t size, const char* filepath, username_map_t* users_index) {
+    if (size % sizeof(game_results_legacy_t) != 0) {
+        fprintf(stderr, RED "ERROR: Game results file has no header and isn't a legacy results file\n" RESET);
+        return ERR_UNKNOWN;
+    }
+
+    char tmp_filepath[PATH_MAX];
+    if (snprintf(tmp_filepath, sizeof(tmp_filepath), "%s.tmp", filepath) >= (int)sizeof(tmp_filepath)) {
+        return ERR_IARG;
+    }
+
+    FILE* converted = fopen(tmp_filepath, "w");
+    if (converted == NULL) {
+        return ERR_UNKNOWN;
+    }
+
+    game_results_header_t header = { .magic = GAME_RESULTS_MAGIC, .version = GAME_RESULTS_VERSION };
+    fwrite(&header, sizeof(header), 1, converted);
+
+    uint64_t results_count = size / sizeof(game_results_legacy_t);
+    uint64_t missing = 0;
+    game_results_legacy_t legacy;
+
+    for (uint64_t i = 0; i < results_count; i++) {
+        if (fread(&legacy, sizeof(legacy), 1, file) != 1) {
+            fprintf(stderr, RED "ERROR: Failed to read legacy game result %lu\n" RESET, i);
+            fclose(converted);
+            unlink(tmp_filepath);
+            return ERR_UNKNOWN;
+        }
+
+        game_results_t result = { 0 };
+        result.first_player_id = game_results_find_player(users_index, legacy.first_player_username, &missing);
+        result.second_player_id = game_results_find_player(users_index, legacy.second_player_username, &missing);
+        result.won = legacy.won;
+        game_results_pack_board(legacy.first_game_state, result.first_game_state);
+        game_results_pack_board(legacy.second_game_state, result.second_game_state);
+
+        fwrite(&result, sizeof(result), 1, converted);
+    }
+
+    if (ferror(converted) || fflush(converted) != 0 || fsync(fileno(converted)) == -1) {
+        fclose(converted);
+        unlink(tmp_filepath);
+        return ERR_UNKNOWN;
+    }
+
+    fclose(converted);
+
+    if (rename(tmp_filepath, filepath) == -1) {
+        unlink(tmp_filepath);
+        return ERR_UNKNOWN;
+    }
+
+    if (missing > 0) {
+        fprintf(stderr, YELLOW "WARNING: %lu players from legacy game results are not registered users\n" RESET, missing);
+    }
+
+    fprintf(stdout, "Converted %lu legacy game results, %lu -> %lu bytes\n", results_count, size,
+            sizeof(game_results_header_t) + results_count * sizeof(game_results_t));
+    return ERR_NONE;
+}
+
+// Results are not read into memory, the file is mapped like the users file
+error_code game_results_load(record_table_t* results, const char* filepath, username_map_t* users_index) {
+    error_code err = record_table_create(results, sizeof(game_results_t));
+    if (err != ERR_NONE) {
+        return err;
+    }
 
-error_code game_results_load(Vector* results, const char* filepath) {
     FILE* file = fopen(filepath, "ab+");;
     if (file == NULL) {
         return ERR_UNKNOWN;
@@ -30,65 +130,97 @@ error_code game_results_load(Vector* results, const char* filepath) {
         return ERR_UNKNOWN;
     }
 
-    uint64_t results_count = size / sizeof(game_results_t);
-    if (results_count == 0) {
+    if (size == 0) {
+        // New file, results are appended after the header
+        game_results_header_t header = { .magic = GAME_RESULTS_MAGIC, .version = GAME_RESULTS_VERSION };
+        if (fwrite(&header, sizeof(header), 1, file) != 1 || fflush(file) != 0) {
+            fclose(file);
+            return ERR_UNKNOWN;
+        }
+
         fprintf(stdout, "No game results to load, skipping...\n");
-        vector_create(results, sizeof(game_results_t));
         fclose(file);
         return ERR_NONE;
     }
 
-    // allocate memory for all game results
-    results->elements = malloc(sizeof(game_results_t) * results_count);
-    if (results->elements == NULL) {
+    game_results_header_t header = { 0 };
+    if (size < sizeof(header) || fread(&header, sizeof(header), 1, file) != 1 || header.magic != GAME_RESULTS_MAGIC) {
+        fseek(file, 0, SEEK_SET);
+        err = game_results_convert_legacy(file, size, filepath, users_index);
         fclose(file);
-        return ERR_ALLOC;
-    }
+        if (err != ERR_NONE) {
+            return err;
+        }
 
-    results->element_size = sizeof(game_results_t); 
-    results->logical_length = results_count;
-    results->actual_length = results_count;
+        // Load the converted file
+        record_table_destroy(results);
+        return game_results_load(results, filepath, users_index);
+    }
 
-    uint64_t count = fread(results->elements, sizeof(game_results_t), results_count, file);
-    if (ferror(file)) {
-        fprintf(stderr, RED "ERROR: Failed to read all game results: expected %lu, read %lu\n" RESET, results_count, count);
+    if (header.version != GAME_RESULTS_VERSION) {
+        fprintf(stderr, RED "ERROR: Unsupported game results version %u\n" RESET, header.version);
         fclose(file);
         return ERR_UNKNOWN;
     }
 
-    if (count == results_count) {
-        fprintf(stdout, "Loaded all %lu game results, total file size %lu\n" RESET, results_count, size);
+    uint64_t results_size = size - sizeof(header);
+    uint64_t results_count = results_size / sizeof(game_results_t);
+
+    if (results_size % sizeof(game_results_t) != 0) {
+        // Server stopped in the middle of a write, drop the cut result
+        // so new results are appended right after the last whole one
+        fprintf(stderr, YELLOW "WARNING: Last game result is incomplete, dropping it\n" RESET);
+        if (ftruncate(fileno(file), sizeof(header) + results_count * sizeof(game_results_t)) == -1) {
+            fclose(file);
+            return ERR_UNKNOWN;
+        }
+    }
+
+    if (results_count == 0) {
+        fprintf(stdout, "No game results to load, skipping...\n");
         fclose(file);
         return ERR_NONE;
     }
 
-    // We didn't reach the end of file 
-    fprintf(stderr, RED "ERROR: Didn't reach the end of file, game results to read: expected %lu, read %lu\n" RESET, results_count, count);
+    // Mapping stays valid after the file is closed
+    err = record_table_map(results, fileno(file), sizeof(header), results_count);
     fclose(file);
-    return ERR_UNKNOWN;
+    if (err != ERR_NONE) {
+        return err;
+    }
+
+    fprintf(stdout, "Loaded all %lu game results, total file size %lu\n" RESET, results_count, size);
+    return ERR_NONE;
 }
 
-error_code game_results_save(Vector* results, const char* filepath) {
-    FILE* file = fopen(filepath, "w");;
+// Same as users_save, results are written to a temporary file that replaces the old one
+error_code game_results_save(record_table_t* results, const char* filepath) {
+    char tmp_filepath[PATH_MAX];
+    if (snprintf(tmp_filepath, sizeof(tmp_filepath), "%s.tmp", filepath) >= (int)sizeof(tmp_filepath)) {
+        return ERR_IARG;
+    }
+
+    FILE* file = fopen(tmp_filepath, "w");
     if (file == NULL) {
         return ERR_UNKNOWN;
     }
 
-    fseek(file, 0, SEEK_SET);
-    int64_t isize = ftell(file);
-    if (isize == -1) {
+    game_results_header_t header = { .magic = GAME_RESULTS_MAGIC, .version = GAME_RESULTS_VERSION };
+    fwrite(&header, sizeof(header), 1, file);
+    error_code err = record_table_write(results, file);
+    if (err != ERR_NONE || ferror(file) || fflush(file) != 0 || fsync(fileno(file)) == -1) {
         fclose(file);
+        unlink(tmp_filepath);
         return ERR_UNKNOWN;
     }
 
-    fwrite(results->elements, sizeof(game_results_t), results->logical_length, file);
-    if (ferror(file)) {
-        fclose(file);
+    fclose(file);
+
+    if (rename(tmp_filepath, filepath) == -1) {
+        unlink(tmp_filepath);
         return ERR_UNKNOWN;
     }
 
-    fprintf(stdout, "Saved %u game results\n" RESET, results->logical_length);
-
-    fclose(file);
+    fprintf(stdout, "Saved %u game results\n" RESET, record_table_len(results));
     return ERR_NONE;
 }
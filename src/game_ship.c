@@ -149,3 +149,55 @@ error_code game_ship_validate_fields(uint8_t* game_state, GameShip ship) {
 
     return ERR_NONE;
 }
+
+#define COLUMN_A 0x0101010101010101ull
+#define COLUMN_H (COLUMN_A << (GAME_WIDTH - 1))
+
+// Number of ships of every length, index 0 are ships of length 1
+static const uint8_t fleet[GAME_SHIP_MAX_LEN] = { 4, 3, 2, 1 };
+
+error_code game_ship_validate_fleet(uint64_t ships) {
+    // Bit i is set if the field next to field i is a ship,
+    // shifts that wrap around to the other row are masked out
+    uint64_t right = (ships >> 1) & ~COLUMN_H;
+    uint64_t left = (ships << 1) & ~COLUMN_A;
+    uint64_t down = ships >> GAME_WIDTH;
+    uint64_t up = ships << GAME_WIDTH;
+
+    uint64_t horizontal = ships & (left | right);
+    uint64_t vertical = ships & (up | down);
+
+    // Field with both horizontal and vertical neighbours is a bend (or ships
+    // touching side by side), every connected group of fields has to be a line
+    if (horizontal & vertical) {
+        return ERR_SHIP_COORDINATE_OCCUPIED;
+    }
+
+    // Every line has one head, its left or top field
+    uint64_t horizontal_runs = ships & right & ~left;
+    uint64_t vertical_runs = ships & down & ~up;
+
+    // Ships with at least len fields, keep only heads that have a ship len - 1 fields away
+    uint8_t at_least[GAME_SHIP_MAX_LEN + 2] = { 0 };
+    uint64_t horizontal_next = ships;
+    uint64_t vertical_next = ships;
+    for (uint8_t len = 2; len <= GAME_SHIP_MAX_LEN + 1; len++) {
+        horizontal_next = (horizontal_next >> 1) & ~COLUMN_H;
+        vertical_next >>= GAME_WIDTH;
+
+        horizontal_runs &= horizontal_next;
+        vertical_runs &= vertical_next;
+
+        at_least[len] = __builtin_popcountll(horizontal_runs) + __builtin_popcountll(vertical_runs);
+    }
+
+    uint8_t invalid = __builtin_popcountll(ships & ~(horizontal | vertical)) != fleet[0];
+    for (uint8_t len = 2; len <= GAME_SHIP_MAX_LEN; len++) {
+        invalid |= at_least[len] - at_least[len + 1] != fleet[len - 1];
+    }
+
+    // Ship longer than the longest ship in the fleet
+    invalid |= at_least[GAME_SHIP_MAX_LEN + 1] != 0;
+
+    return invalid ? ERR_FLEET_INVALID : ERR_NONE;
+}
@@ -0,0 +1,122 @@
+#include "include/histogram.h"
+#include <stdint.h>
+#include <string.h>
+
+// Values smaller than 2 * HISTOGRAM_SUB_BUCKETS get a bucket each, every next
+// power of two range gets HISTOGRAM_SUB_BUCKETS buckets of the same width
+static uint32_t histogram_bucket(uint64_t value) {
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return value;
+    }
+
+    uint32_t exponent = 63 - __builtin_clzll(value);
+    uint32_t shift = exponent - HISTOGRAM_SUB_BUCKET_BITS;
+    return shift * HISTOGRAM_SUB_BUCKETS + (uint32_t)(value >> shift);
+}
+
+// Largest value that falls into the bucket
+static uint64_t histogram_bucket_max(uint32_t bucket) {
+    if (bucket < 2 * HISTOGRAM_SUB_BUCKETS) {
+        return bucket;
+    }
+
+    uint32_t shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+    uint64_t lowest = (uint64_t)(bucket % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS) << shift;
+    return lowest + ((uint64_t)1 << shift) - 1;
+}
+
+void histogram_init(histogram_t* histogram) {
+    memset(histogram, 0, sizeof(histogram_t));
+    histogram->min = UINT64_MAX;
+}
+
+void histogram_record(histogram_t* histogram, uint64_t value) {
+    histogram->counts[histogram_bucket(value)]++;
+    histogram->count++;
+    histogram->sum += value;
+
+    if (value < histogram->min) {
+        histogram->min = value;
+    }
+
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+}
+
+void histogram_merge(histogram_t* dst, const histogram_t* src) {
+    for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+
+    dst->count += src->count;
+    dst->sum += src->sum;
+
+    if (src->min < dst->min) {
+        dst->min = src->min;
+    }
+
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+void histogram_record_atomic(histogram_t* histogram, uint64_t value) {
+    __atomic_fetch_add(&histogram->counts[histogram_bucket(value)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->sum, value, __ATOMIC_RELAXED);
+
+    uint64_t min = __atomic_load_n(&histogram->min, __ATOMIC_RELAXED);
+    while (value < min &&
+           !__atomic_compare_exchange_n(&histogram->min, &min, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+
+    uint64_t max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+    while (value > max &&
+           !__atomic_compare_exchange_n(&histogram->max, &max, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+// Fields are read one by one so the merged histogram can be a bit off
+// (count updated but not the bucket yet), that is fine for reporting
+void histogram_merge_atomic(histogram_t* dst, const histogram_t* src) {
+    for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        dst->counts[i] += __atomic_load_n(&src->counts[i], __ATOMIC_RELAXED);
+    }
+
+    dst->count += __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+    dst->sum += __atomic_load_n(&src->sum, __ATOMIC_RELAXED);
+
+    uint64_t min = __atomic_load_n(&src->min, __ATOMIC_RELAXED);
+    if (min < dst->min) {
+        dst->min = min;
+    }
+
+    uint64_t max = __atomic_load_n(&src->max, __ATOMIC_RELAXED);
+    if (max > dst->max) {
+        dst->max = max;
+    }
+}
+
+uint64_t histogram_percentile(const histogram_t* histogram, double percentile) {
+    if (histogram->count == 0) {
+        return 0;
+    }
+
+    // Rank of the value, at least the first one
+    uint64_t rank = (uint64_t)(percentile / 100.0 * histogram->count + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            uint64_t value = histogram_bucket_max(i);
+            return value < histogram->max ? value : histogram->max;
+        }
+    }
+
+    return histogram->max;
+}
@@ -0,0 +1,346 @@
+#include "include/leaderboard.h"
+#include "include/errors.h"
+#include "include/game_results.h"
+#include "include/globals.h"
+#include "include/record_table.h"
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static leaderboard_node_t* leaderboard_node_new(uint8_t level) {
+    leaderboard_node_t* node = calloc(1, sizeof(leaderboard_node_t) + level * sizeof(leaderboard_link_t));
+    if (node != NULL) {
+        node->level = level;
+    }
+    return node;
+}
+
+// Every level above the first has 1/4 of the nodes of the level below
+static uint8_t leaderboard_random_level(leaderboard_t* leaderboard) {
+    // xorshift64
+    leaderboard->seed ^= leaderboard->seed << 13;
+    leaderboard->seed ^= leaderboard->seed >> 7;
+    leaderboard->seed ^= leaderboard->seed << 17;
+
+    uint64_t bits = leaderboard->seed;
+    uint8_t level = 1;
+    while (level < LEADERBOARD_MAX_LEVEL && (bits & 3) == 0) {
+        level++;
+        bits >>= 2;
+    }
+    return level;
+}
+
+// Returns 1 if the player with the counters is ranked before the node
+static uint8_t leaderboard_before(uint32_t user_id, uint32_t wins, uint32_t losses, const leaderboard_node_t* node) {
+    if (wins != node->wins) {
+        return wins > node->wins;
+    }
+    if (losses != node->losses) {
+        return losses < node->losses;
+    }
+    return user_id < node->user_id;
+}
+
+error_code leaderboard_init(leaderboard_t* leaderboard) {
+    leaderboard->head = leaderboard_node_new(LEADERBOARD_MAX_LEVEL);
+    if (leaderboard->head == NULL) {
+        return ERR_ALLOC;
+    }
+
+    leaderboard->len = 0;
+    leaderboard->level = 1;
+    leaderboard->seed = (uint64_t)time(NULL) | 1;
+    leaderboard->players = NULL;
+    leaderboard->players_cap = 0;
+    return ERR_NONE;
+}
+
+void leaderboard_deinit(leaderboard_t* leaderboard) {
+    leaderboard_node_t* node = leaderboard->head;
+    while (node != NULL) {
+        leaderboard_node_t* next = node->links[0].next;
+        free(node);
+        node = next;
+    }
+
+    free(leaderboard->players);
+    leaderboard->head = NULL;
+    leaderboard->players = NULL;
+    leaderboard->players_cap = 0;
+    leaderboard->len = 0;
+}
+
+// Fills the last node before the node on every level and how many players are before each of them
+static void leaderboard_find(const leaderboard_t* leaderboard, const leaderboard_node_t* target,
+                             leaderboard_node_t** update, uint32_t* rank) {
+    leaderboard_node_t* node = leaderboard->head;
+    uint32_t passed = 0;
+
+    for (int32_t i = leaderboard->level - 1; i >= 0; i--) {
+        while (node->links[i].next != NULL &&
+               leaderboard_before(node->links[i].next->user_id, node->links[i].next->wins,
+                                  node->links[i].next->losses, target)) {
+            passed += node->links[i].span;
+            node = node->links[i].next;
+        }
+
+        update[i] = node;
+        if (rank != NULL) {
+            rank[i] = passed;
+        }
+    }
+}
+
+static void leaderboard_link(leaderboard_t* leaderboard, leaderboard_node_t* node) {
+    leaderboard_node_t* update[LEADERBOARD_MAX_LEVEL];
+    uint32_t rank[LEADERBOARD_MAX_LEVEL];
+    leaderboard_find(leaderboard, node, update, rank);
+
+    // New levels start at the head and skip every player
+    for (uint8_t i = leaderboard->level; i < node->level; i++) {
+        update[i] = leaderboard->head;
+        rank[i] = 0;
+        leaderboard->head->links[i].span = leaderboard->len;
+    }
+    if (node->level > leaderboard->level) {
+        leaderboard->level = node->level;
+    }
+
+    for (uint8_t i = 0; i < node->level; i++) {
+        // Players between update[i] and the node on this level
+        uint32_t between = rank[0] - rank[i];
+
+        node->links[i].next = update[i]->links[i].next;
+        node->links[i].span = update[i]->links[i].span - between;
+        update[i]->links[i].next = node;
+        update[i]->links[i].span = between + 1;
+    }
+
+    // Higher links jump over the new node
+    for (uint8_t i = node->level; i < leaderboard->level; i++) {
+        update[i]->links[i].span++;
+    }
+
+    leaderboard->len++;
+}
+
+static void leaderboard_unlink(leaderboard_t* leaderboard, leaderboard_node_t* node) {
+    leaderboard_node_t* update[LEADERBOARD_MAX_LEVEL];
+    leaderboard_find(leaderboard, node, update, NULL);
+
+    for (uint8_t i = 0; i < leaderboard->level; i++) {
+        if (update[i]->links[i].next == node) {
+            update[i]->links[i].span += node->links[i].span - 1;
+            update[i]->links[i].next = node->links[i].next;
+        } else {
+            update[i]->links[i].span--;
+        }
+    }
+
+    while (leaderboard->level > 1 && leaderboard->head->links[leaderboard->level - 1].next == NULL) {
+        leaderboard->level--;
+    }
+
+    leaderboard->len--;
+}
+
+static error_code leaderboard_reserve(leaderboard_t* leaderboard, uint32_t user_id) {
+    if (user_id < leaderboard->players_cap) {
+        return ERR_NONE;
+    }
+
+    uint32_t cap = leaderboard->players_cap == 0 ? 64 : leaderboard->players_cap;
+    while (cap <= user_id) {
+        cap *= 2;
+    }
+
+    leaderboard_node_t** players = realloc(leaderboard->players, cap * sizeof(leaderboard_node_t*));
+    if (players == NULL) {
+        return ERR_ALLOC;
+    }
+
+    memset(players + leaderboard->players_cap, 0, (cap - leaderboard->players_cap) * sizeof(leaderboard_node_t*));
+    leaderboard->players = players;
+    leaderboard->players_cap = cap;
+    return ERR_NONE;
+}
+
+static const leaderboard_node_t* leaderboard_player(const leaderboard_t* leaderboard, uint32_t user_id) {
+    return user_id < leaderboard->players_cap ? leaderboard->players[user_id] : NULL;
+}
+
+error_code leaderboard_set(leaderboard_t* leaderboard, uint32_t user_id, uint32_t wins, uint32_t losses) {
+    error_code err = leaderboard_reserve(leaderboard, user_id);
+    if (err != ERR_NONE) {
+        return err;
+    }
+
+    // Node keeps its level, it's only moved to the new position
+    leaderboard_node_t* node = leaderboard->players[user_id];
+    if (node != NULL) {
+        leaderboard_unlink(leaderboard, node);
+    } else {
+        node = leaderboard_node_new(leaderboard_random_level(leaderboard));
+        if (node == NULL) {
+            return ERR_ALLOC;
+        }
+
+        node->user_id = user_id;
+        leaderboard->players[user_id] = node;
+    }
+
+    node->wins = wins;
+    node->losses = losses;
+    leaderboard_link(leaderboard, node);
+    return ERR_NONE;
+}
+
+error_code leaderboard_record(leaderboard_t* leaderboard, uint32_t winner_id, uint32_t loser_id) {
+    const leaderboard_node_t* winner = leaderboard_player(leaderboard, winner_id);
+    error_code err = leaderboard_set(leaderboard, winner_id, winner != NULL ? winner->wins + 1 : 1,
+                                     winner != NULL ? winner->losses : 0);
+    if (err != ERR_NONE) {
+        return err;
+    }
+
+    const leaderboard_node_t* loser = leaderboard_player(leaderboard, loser_id);
+    return leaderboard_set(leaderboard, loser_id, loser != NULL ? loser->wins : 0,
+                           loser != NULL ? loser->losses + 1 : 1);
+}
+
+uint32_t leaderboard_rank(const leaderboard_t* leaderboard, uint32_t user_id, leaderboard_entry_t* entry) {
+    const leaderboard_node_t* target = leaderboard_player(leaderboard, user_id);
+    if (target == NULL) {
+        return 0;
+    }
+
+    entry->user_id = user_id;
+    entry->wins = target->wins;
+    entry->losses = target->losses;
+
+    leaderboard_node_t* update[LEADERBOARD_MAX_LEVEL];
+    uint32_t rank[LEADERBOARD_MAX_LEVEL];
+    leaderboard_find(leaderboard, target, update, rank);
+
+    // Players before the target and the target itself
+    return rank[0] + 1;
+}
+
+uint32_t leaderboard_top(const leaderboard_t* leaderboard, leaderboard_entry_t* entries, uint32_t n) {
+    uint32_t count = 0;
+    for (const leaderboard_node_t* node = leaderboard->head->links[0].next; node != NULL && count < n;
+         node = node->links[0].next) {
+        entries[count].user_id = node->user_id;
+        entries[count].wins = node->wins;
+        entries[count].losses = node->losses;
+        count++;
+    }
+    return count;
+}
+
+typedef struct {
+    const record_table_t* results;
+    uint32_t start;
+    uint32_t end;
+    uint32_t users_len;
+    _Atomic uint32_t* wins;
+    _Atomic uint32_t* losses;
+} leaderboard_count_task_t;
+
+static void* leaderboard_count(void* params) {
+    leaderboard_count_task_t* task = params;
+
+    for (uint32_t i = task->start; i < task->end; i++) {
+        const game_results_t* result = record_table_at(task->results, i);
+        if (result->first_player_id >= task->users_len || result->second_player_id >= task->users_len) {
+            continue;
+        }
+
+        uint32_t winner = result->won == GAME_FIRST_WON ? result->first_player_id : result->second_player_id;
+        uint32_t loser = result->won == GAME_FIRST_WON ? result->second_player_id : result->first_player_id;
+        atomic_fetch_add_explicit(&task->wins[winner], 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&task->losses[loser], 1, memory_order_relaxed);
+    }
+
+    return NULL;
+}
+
+// Results are split between the threads, only the counting is parallel.
+// Players are linked by the calling thread once every result is counted.
+error_code leaderboard_rebuild(leaderboard_t* leaderboard, const record_table_t* results, uint32_t users_len,
+                               uint32_t threads) {
+    uint32_t results_len = record_table_len(results);
+    if (results_len == 0 || users_len == 0) {
+        return ERR_NONE;
+    }
+
+    if (threads == 0) {
+        threads = 1;
+    }
+    if (threads > results_len) {
+        threads = results_len;
+    }
+
+    _Atomic uint32_t* wins = calloc(users_len, sizeof(_Atomic uint32_t));
+    _Atomic uint32_t* losses = calloc(users_len, sizeof(_Atomic uint32_t));
+    leaderboard_count_task_t* tasks = calloc(threads, sizeof(leaderboard_count_task_t));
+    pthread_t* workers = calloc(threads, sizeof(pthread_t));
+    if (wins == NULL || losses == NULL || tasks == NULL || workers == NULL) {
+        free(wins);
+        free(losses);
+        free(tasks);
+        free(workers);
+        return ERR_ALLOC;
+    }
+
+    for (uint32_t i = 0; i < threads; i++) {
+        tasks[i].results = results;
+        tasks[i].start = (uint64_t)results_len * i / threads;
+        tasks[i].end = (uint64_t)results_len * (i + 1) / threads;
+        tasks[i].users_len = users_len;
+        tasks[i].wins = wins;
+        tasks[i].losses = losses;
+    }
+
+    // Keep signals on the main thread
+    sigset_t blocked, old;
+    sigfillset(&blocked);
+    pthread_sigmask(SIG_BLOCK, &blocked, &old);
+
+    // First task runs on this thread, so do the tasks whose thread couldn't be started
+    uint32_t started = 1;
+    while (started < threads && pthread_create(&workers[started], NULL, leaderboard_count, &tasks[started]) == 0) {
+        started++;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    leaderboard_count(&tasks[0]);
+    for (uint32_t i = started; i < threads; i++) {
+        leaderboard_count(&tasks[i]);
+    }
+    for (uint32_t i = 1; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    error_code err = leaderboard_reserve(leaderboard, users_len - 1);
+    for (uint32_t id = 0; id < users_len && err == ERR_NONE; id++) {
+        uint32_t user_wins = atomic_load_explicit(&wins[id], memory_order_relaxed);
+        uint32_t user_losses = atomic_load_explicit(&losses[id], memory_order_relaxed);
+        if (user_wins > 0 || user_losses > 0) {
+            err = leaderboard_set(leaderboard, id, user_wins, user_losses);
+        }
+    }
+
+    free(wins);
+    free(losses);
+    free(tasks);
+    free(workers);
+    return err;
+}
@@ -0,0 +1,633 @@
+#include "include/logger.h"
+#include "include/errors.h"
+#include "include/globals.h"
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Formatted records are collected and written with one write per stream
+#define LOGGER_OUT_BUFFER_SIZE (64 * 1024)
+// Longest formatted record, longer ones are cut
+#define LOGGER_LINE_MAX 1024
+#define LOGGER_SPEC_MAX 16
+
+// Conversion length modifiers
+#define LOGGER_LENGTH_NONE 0
+#define LOGGER_LENGTH_LONG 1
+#define LOGGER_LENGTH_LONG_LONG 2
+
+// Records of DEBUG and INFO go to stdout, WARN and ERROR to stderr
+#define LOGGER_STREAM_OUT 0
+#define LOGGER_STREAM_ERR 1
+
+typedef struct {
+    char text[LOGGER_SPEC_MAX];
+    char conversion;
+    uint8_t length;
+    uint8_t star_width;
+    uint8_t star_precision;
+    // Explicit precision (%.5s), -1 if there is none
+    int32_t precision;
+} logger_spec_t;
+
+typedef struct {
+    char data[LOGGER_OUT_BUFFER_SIZE];
+    uint32_t len;
+    int fd;
+    uint8_t color;
+} logger_stream_t;
+
+static struct {
+    pthread_once_t once;
+    pthread_key_t key;
+
+    // Protects the list of rings and the streams. Taken when a ring is added, while the rings
+    // are drained and by the threads that write synchronously.
+    pthread_mutex_t lock;
+    logger_ring_t* rings;
+
+    pthread_t thread;
+    atomic_bool running;
+
+    logger_stream_t streams[2];
+} logger = {
+    .once = PTHREAD_ONCE_INIT,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static __thread logger_ring_t* thread_ring = NULL;
+
+static const char* level_names[] = {
+    [LOG_LEVEL_DEBUG] = "DEBUG",
+    [LOG_LEVEL_INFO] = "INFO ",
+    [LOG_LEVEL_WARN] = "WARN ",
+    [LOG_LEVEL_ERROR] = "ERROR",
+};
+
+static const char* level_colors[] = {
+    [LOG_LEVEL_DEBUG] = BLUE,
+    [LOG_LEVEL_INFO] = "",
+    [LOG_LEVEL_WARN] = YELLOW,
+    [LOG_LEVEL_ERROR] = RED,
+};
+
+// Thread that owns the ring exited, logger thread frees it once it's drained
+static void logger_thread_exit(void* ring) {
+    atomic_store_explicit(&((logger_ring_t*)ring)->closed, 1, memory_order_release);
+}
+
+static void logger_init(void) {
+    pthread_key_create(&logger.key, logger_thread_exit);
+
+    logger.streams[LOGGER_STREAM_OUT].fd = STDOUT_FILENO;
+    logger.streams[LOGGER_STREAM_ERR].fd = STDERR_FILENO;
+    for (uint32_t i = 0; i < 2; i++) {
+        logger.streams[i].color = isatty(logger.streams[i].fd) && getenv("NO_COLOR") == NULL;
+    }
+}
+
+static logger_ring_t* logger_thread_ring(void) {
+    if (thread_ring != NULL) {
+        return thread_ring;
+    }
+
+    logger_ring_t* ring = calloc(1, sizeof(logger_ring_t));
+    if (ring == NULL) {
+        return NULL;
+    }
+
+    pthread_setspecific(logger.key, ring);
+
+    pthread_mutex_lock(&logger.lock);
+    ring->next = logger.rings;
+    logger.rings = ring;
+    pthread_mutex_unlock(&logger.lock);
+
+    thread_ring = ring;
+    return ring;
+}
+
+// Parses the conversion that starts at fmt (at the '%'), returns the first character after it
+// or NULL if the conversion isn't supported
+static const char* logger_parse_spec(const char* fmt, logger_spec_t* spec) {
+    memset(spec, 0, sizeof(logger_spec_t));
+    spec->precision = -1;
+
+    uint32_t len = 0;
+    spec->text[len++] = *fmt++;
+
+    while (*fmt != '\0' && len < LOGGER_SPEC_MAX - 1) {
+        char c = *fmt;
+        if (strchr("-+ #0123456789", c) != NULL) {
+            spec->text[len++] = c;
+        } else if (c == '*') {
+            spec->text[len++] = c;
+            if (spec->precision == -2) {
+                spec->star_precision = 1;
+            } else {
+                spec->star_width = 1;
+            }
+        } else if (c == '.') {
+            spec->text[len++] = c;
+            // Digits after the dot are parsed below
+            spec->precision = -2;
+            if (fmt[1] >= '0' && fmt[1] <= '9') {
+                spec->precision = atoi(fmt + 1);
+            }
+        } else if (c == 'l') {
+            spec->text[len++] = c;
+            spec->length++;
+        } else if (c == 'z') {
+            spec->text[len++] = c;
+            spec->length = LOGGER_LENGTH_LONG;
+        } else if (c == 'h') {
+            spec->text[len++] = c;
+        } else if (strchr("diuxXocspfFeEgG", c) != NULL) {
+            spec->text[len++] = c;
+            spec->conversion = c;
+            return fmt + 1;
+        } else {
+            return NULL;
+        }
+
+        fmt++;
+    }
+
+    return NULL;
+}
+
+static uint8_t logger_put(logger_record_t* record, const void* value, uint32_t len) {
+    if (record->args_len + len > LOGGER_ARGS_SIZE) {
+        record->truncated = 1;
+        return 0;
+    }
+
+    memcpy(record->args + record->args_len, value, len);
+    record->args_len += len;
+    return 1;
+}
+
+static uint8_t logger_put_string(logger_record_t* record, const char* s, int32_t precision) {
+    if (s == NULL) {
+        s = "(null)";
+    }
+
+    uint32_t space = LOGGER_ARGS_SIZE - record->args_len;
+    if (space <= sizeof(uint16_t)) {
+        record->truncated = 1;
+        return 0;
+    }
+
+    uint32_t max = space - sizeof(uint16_t);
+    if (precision >= 0 && (uint32_t)precision < max) {
+        max = precision;
+    }
+
+    uint16_t len = strnlen(s, max);
+    logger_put(record, &len, sizeof(len));
+    logger_put(record, s, len);
+    return 1;
+}
+
+// Copies every argument into the record, format tells the type of the arguments
+static void logger_encode(logger_record_t* record, const char* fmt, va_list args) {
+    while ((fmt = strchr(fmt, '%')) != NULL) {
+        if (fmt[1] == '%') {
+            fmt += 2;
+            continue;
+        }
+
+        logger_spec_t spec;
+        fmt = logger_parse_spec(fmt, &spec);
+        if (fmt == NULL) {
+            record->truncated = 1;
+            return;
+        }
+
+        if (spec.star_width) {
+            int32_t width = va_arg(args, int);
+            if (!logger_put(record, &width, sizeof(width))) {
+                return;
+            }
+        }
+
+        if (spec.star_precision) {
+            spec.precision = va_arg(args, int);
+            if (!logger_put(record, &spec.precision, sizeof(spec.precision))) {
+                return;
+            }
+        }
+
+        uint8_t ok = 1;
+        switch (spec.conversion) {
+        case 'd':
+        case 'i':
+        case 'c': {
+            int64_t value = spec.length == LOGGER_LENGTH_LONG_LONG ? va_arg(args, long long)
+                            : spec.length == LOGGER_LENGTH_LONG  ? va_arg(args, long)
+                                                                 : va_arg(args, int);
+            ok = logger_put(record, &value, sizeof(value));
+            break;
+        }
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o': {
+            uint64_t value = spec.length == LOGGER_LENGTH_LONG_LONG ? va_arg(args, unsigned long long)
+                             : spec.length == LOGGER_LENGTH_LONG  ? va_arg(args, unsigned long)
+                                                                  : va_arg(args, unsigned int);
+            ok = logger_put(record, &value, sizeof(value));
+            break;
+        }
+        case 'p': {
+            void* value = va_arg(args, void*);
+            ok = logger_put(record, &value, sizeof(value));
+            break;
+        }
+        case 's':
+            ok = logger_put_string(record, va_arg(args, const char*), spec.precision);
+            break;
+        default: {
+            double value = va_arg(args, double);
+            ok = logger_put(record, &value, sizeof(value));
+            break;
+        }
+        }
+
+        if (!ok) {
+            return;
+        }
+    }
+}
+
+static uint8_t logger_get(const logger_record_t* record, uint32_t* offset, void* value, uint32_t len) {
+    if (*offset + len > record->args_len) {
+        return 0;
+    }
+
+    memcpy(value, record->args + *offset, len);
+    *offset += len;
+    return 1;
+}
+
+// Formats one conversion with the arguments stored in the record, returns the number of
+// characters written or -1 if the record doesn't have the arguments (it was truncated)
+static int logger_format_spec(const logger_record_t* record, uint32_t* offset, const logger_spec_t* spec,
+                              char* out, uint32_t size) {
+    int32_t star[2];
+    uint32_t stars = 0;
+
+    if (spec->star_width && !logger_get(record, offset, &star[stars++], sizeof(int32_t))) {
+        return -1;
+    }
+
+    if (spec->star_precision && !logger_get(record, offset, &star[stars++], sizeof(int32_t))) {
+        return -1;
+    }
+
+// Star arguments go in front of the value
+#define LOGGER_SNPRINTF(value)                                                                  \
+    (stars == 0   ? snprintf(out, size, spec->text, value)                                     \
+     : stars == 1 ? snprintf(out, size, spec->text, star[0], value)                            \
+                  : snprintf(out, size, spec->text, star[0], star[1], value))
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#pragma GCC diagnostic ignored "-Wformat"
+    switch (spec->conversion) {
+    case 'd':
+    case 'i':
+    case 'c': {
+        int64_t value;
+        if (!logger_get(record, offset, &value, sizeof(value))) {
+            return -1;
+        }
+
+        if (spec->length == LOGGER_LENGTH_LONG_LONG) {
+            return LOGGER_SNPRINTF((long long)value);
+        }
+        if (spec->length == LOGGER_LENGTH_LONG) {
+            return LOGGER_SNPRINTF((long)value);
+        }
+        return LOGGER_SNPRINTF((int)value);
+    }
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o': {
+        uint64_t value;
+        if (!logger_get(record, offset, &value, sizeof(value))) {
+            return -1;
+        }
+
+        if (spec->length == LOGGER_LENGTH_LONG_LONG) {
+            return LOGGER_SNPRINTF((unsigned long long)value);
+        }
+        if (spec->length == LOGGER_LENGTH_LONG) {
+            return LOGGER_SNPRINTF((unsigned long)value);
+        }
+        return LOGGER_SNPRINTF((unsigned int)value);
+    }
+    case 'p': {
+        void* value;
+        if (!logger_get(record, offset, &value, sizeof(value))) {
+            return -1;
+        }
+        return LOGGER_SNPRINTF(value);
+    }
+    case 's': {
+        uint16_t len;
+        char value[LOGGER_ARGS_SIZE + 1];
+        if (!logger_get(record, offset, &len, sizeof(len)) || !logger_get(record, offset, value, len)) {
+            return -1;
+        }
+        value[len] = '\0';
+        return LOGGER_SNPRINTF(value);
+    }
+    default: {
+        double value;
+        if (!logger_get(record, offset, &value, sizeof(value))) {
+            return -1;
+        }
+        return LOGGER_SNPRINTF(value);
+    }
+    }
+#pragma GCC diagnostic pop
+#undef LOGGER_SNPRINTF
+}
+
+// Formats the message of the record without the trailing new line
+static uint32_t logger_format_message(const logger_record_t* record, char* out, uint32_t size) {
+    const char* fmt = record->fmt;
+    uint32_t offset = 0;
+    uint32_t len = 0;
+
+    while (*fmt != '\0' && len < size - 1) {
+        if (*fmt != '%') {
+            out[len++] = *fmt++;
+            continue;
+        }
+
+        if (fmt[1] == '%') {
+            out[len++] = '%';
+            fmt += 2;
+            continue;
+        }
+
+        logger_spec_t spec;
+        const char* next = logger_parse_spec(fmt, &spec);
+        int written = next == NULL ? -1 : logger_format_spec(record, &offset, &spec, out + len, size - len);
+        if (written < 0) {
+            // Arguments are missing, rest of the format is written as is
+            uint32_t rest = strnlen(fmt, size - 1 - len);
+            memcpy(out + len, fmt, rest);
+            len += rest;
+            break;
+        }
+
+        len += (uint32_t)written < size - len ? (uint32_t)written : size - 1 - len;
+        fmt = next;
+    }
+
+    while (len > 0 && out[len - 1] == '\n') {
+        len--;
+    }
+
+    out[len] = '\0';
+    return len;
+}
+
+static void logger_flush(logger_stream_t* stream) {
+    uint32_t done = 0;
+    while (done < stream->len) {
+        ssize_t written = write(stream->fd, stream->data + done, stream->len - done);
+        if (written <= 0) {
+            break;
+        }
+        done += written;
+    }
+
+    stream->len = 0;
+}
+
+static void logger_append(logger_stream_t* stream, const char* data, uint32_t len) {
+    if (stream->len + len > LOGGER_OUT_BUFFER_SIZE) {
+        logger_flush(stream);
+    }
+
+    memcpy(stream->data + stream->len, data, len);
+    stream->len += len;
+}
+
+// Appends "HH:MM:SS.uuuuuu LEVEL message\n" to the stream of the record's level
+static void logger_format_record(const logger_record_t* record) {
+    logger_stream_t* stream = &logger.streams[record->level >= LOG_LEVEL_WARN ? LOGGER_STREAM_ERR : LOGGER_STREAM_OUT];
+
+    char message[LOGGER_LINE_MAX];
+    logger_format_message(record, message, sizeof(message));
+
+    time_t seconds = record->timestamp / 1000000000ull;
+    struct tm tm;
+    localtime_r(&seconds, &tm);
+
+    const char* color = stream->color ? level_colors[record->level] : "";
+    const char* reset = stream->color && color[0] != '\0' ? RESET : "";
+
+    char line[LOGGER_LINE_MAX + 64];
+    int len = snprintf(line, sizeof(line), "%02d:%02d:%02d.%06lu %s%s %s%s\n", tm.tm_hour, tm.tm_min, tm.tm_sec,
+                       (unsigned long)(record->timestamp % 1000000000ull / 1000), color, level_names[record->level],
+                       message, reset);
+    if (len > (int)sizeof(line) - 1) {
+        len = sizeof(line) - 1;
+        line[len - 1] = '\n';
+    }
+
+    logger_append(stream, line, len);
+}
+
+static void logger_fill_record(logger_record_t* record, uint8_t level, const char* fmt, va_list args) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    record->timestamp = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    record->fmt = fmt;
+    record->level = level;
+    record->truncated = 0;
+    record->args_len = 0;
+    logger_encode(record, fmt, args);
+}
+
+// Ring of the thread with its writing flag set, NULL if the record has to be written synchronously.
+// Flag is set before running is checked again and logger_stop clears running before it checks
+// the flags, so either the writer sees the logger stopping or logger_stop waits for the record.
+static logger_ring_t* logger_enter_ring(void) {
+    if (!atomic_load(&logger.running)) {
+        return NULL;
+    }
+
+    logger_ring_t* ring = logger_thread_ring();
+    if (ring == NULL) {
+        return NULL;
+    }
+
+    atomic_store(&ring->writing, 1);
+    if (!atomic_load(&logger.running)) {
+        atomic_store_explicit(&ring->writing, 0, memory_order_release);
+        return NULL;
+    }
+
+    return ring;
+}
+
+void logger_write(uint8_t level, const char* fmt, ...) {
+    pthread_once(&logger.once, logger_init);
+
+    va_list args;
+    va_start(args, fmt);
+
+    logger_ring_t* ring = logger_enter_ring();
+    if (ring == NULL) {
+        // Logger thread isn't running, format the record right away
+        logger_record_t record;
+        logger_fill_record(&record, level, fmt, args);
+        va_end(args);
+
+        pthread_mutex_lock(&logger.lock);
+        logger_format_record(&record);
+        logger_flush(&logger.streams[LOGGER_STREAM_OUT]);
+        logger_flush(&logger.streams[LOGGER_STREAM_ERR]);
+        pthread_mutex_unlock(&logger.lock);
+        return;
+    }
+
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail >= LOGGER_RING_RECORDS) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        va_end(args);
+        atomic_store_explicit(&ring->writing, 0, memory_order_release);
+        return;
+    }
+
+    logger_fill_record(&ring->records[head % LOGGER_RING_RECORDS], level, fmt, args);
+    va_end(args);
+
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    atomic_store_explicit(&ring->writing, 0, memory_order_release);
+}
+
+// Formats everything that is in the ring, returns the number of formatted records
+static uint64_t logger_drain_ring(logger_ring_t* ring) {
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    for (uint64_t i = tail; i < head; i++) {
+        logger_format_record(&ring->records[i % LOGGER_RING_RECORDS]);
+    }
+
+    atomic_store_explicit(&ring->tail, head, memory_order_release);
+
+    uint64_t dropped = atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+    if (dropped > 0) {
+        char line[128];
+        int len = snprintf(line, sizeof(line), "WARNING: %lu log records dropped, log ring was full\n", dropped);
+        logger_append(&logger.streams[LOGGER_STREAM_ERR], line, len);
+    }
+
+    return head - tail;
+}
+
+// Drains every ring and frees rings of the threads that exited. Threads that write
+// synchronously while the logger is stopping use the same streams, so it's all under the lock.
+static uint64_t logger_drain(void) {
+    pthread_mutex_lock(&logger.lock);
+
+    uint64_t drained = 0;
+    logger_ring_t** link = &logger.rings;
+    while (*link != NULL) {
+        logger_ring_t* ring = *link;
+
+        // Owner doesn't write anymore once it's closed, the drain gets its last records
+        uint8_t closed = atomic_load_explicit(&ring->closed, memory_order_acquire);
+        drained += logger_drain_ring(ring);
+        if (closed) {
+            *link = ring->next;
+            free(ring);
+            continue;
+        }
+        link = &ring->next;
+    }
+
+    logger_flush(&logger.streams[LOGGER_STREAM_OUT]);
+    logger_flush(&logger.streams[LOGGER_STREAM_ERR]);
+
+    pthread_mutex_unlock(&logger.lock);
+    return drained;
+}
+
+static void* logger_thread(void* params) {
+    (void)params;
+
+    // Records written while the logger is stopping are drained by logger_stop
+    while (atomic_load_explicit(&logger.running, memory_order_acquire)) {
+        if (logger_drain() == 0) {
+            struct timespec idle = { .tv_sec = 0, .tv_nsec = LOGGER_IDLE_SLEEP_US * 1000 };
+            nanosleep(&idle, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+error_code logger_start(void) {
+    pthread_once(&logger.once, logger_init);
+
+    // Anything written with stdio before the logger started comes first
+    fflush(stdout);
+    fflush(stderr);
+
+    atomic_store_explicit(&logger.running, 1, memory_order_release);
+
+    // Keep signals on the main thread
+    sigset_t blocked, old;
+    sigfillset(&blocked);
+    pthread_sigmask(SIG_BLOCK, &blocked, &old);
+    int ret = pthread_create(&logger.thread, NULL, logger_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (ret != 0) {
+        atomic_store_explicit(&logger.running, 0, memory_order_release);
+        fprintf(stderr, RED "ERROR: Failed to start the logger thread\n" RESET);
+        return ERR_UNKNOWN;
+    }
+
+    return ERR_NONE;
+}
+
+void logger_stop(void) {
+    if (!atomic_exchange(&logger.running, 0)) {
+        return;
+    }
+
+    pthread_join(logger.thread, NULL);
+
+    // Writers that saw the logger running finish their records, the ones after them write synchronously
+    pthread_mutex_lock(&logger.lock);
+    for (logger_ring_t* ring = logger.rings; ring != NULL; ring = ring->next) {
+        while (atomic_load(&ring->writing)) {
+            sched_yield();
+        }
+    }
+    pthread_mutex_unlock(&logger.lock);
+
+    while (logger_drain() > 0) {
+    }
+}
@@ -0,0 +1,385 @@
+#include "include/matchmaker.h"
+#include "include/errors.h"
+#include "include/globals.h"
+#include "include/server_stats.h"
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+error_code matchmaker_queue_init(matchmaker_queue_t* queue, uint64_t cap) {
+    queue->cells = malloc(cap * sizeof(matchmaker_cell_t));
+    if (queue->cells == NULL) {
+        return ERR_ALLOC;
+    }
+
+    for (uint64_t i = 0; i < cap; i++) {
+        atomic_store_explicit(&queue->cells[i].sequence, i, memory_order_relaxed);
+    }
+
+    queue->mask = cap - 1;
+    atomic_store(&queue->enqueue_pos, 0);
+    atomic_store(&queue->dequeue_pos, 0);
+    return ERR_NONE;
+}
+
+void matchmaker_queue_deinit(matchmaker_queue_t* queue) {
+    free(queue->cells);
+    queue->cells = NULL;
+}
+
+// Every cell has a sequence number so producers and consumers claim a position with one
+// CAS and then only wait on the cell they claimed, never on each other
+uint8_t matchmaker_queue_push(matchmaker_queue_t* queue, const matchmaker_entry_t* entry) {
+    uint64_t pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+    matchmaker_cell_t* cell;
+
+    while (1) {
+        cell = &queue->cells[pos & queue->mask];
+        uint64_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        int64_t diff = (int64_t)sequence - (int64_t)pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->enqueue_pos, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Cell still has an entry from the previous lap
+            return 0;
+        } else {
+            pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    cell->entry = *entry;
+    atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+    return 1;
+}
+
+uint8_t matchmaker_queue_pop(matchmaker_queue_t* queue, matchmaker_entry_t* entry) {
+    uint64_t pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+    matchmaker_cell_t* cell;
+
+    while (1) {
+        cell = &queue->cells[pos & queue->mask];
+        uint64_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        int64_t diff = (int64_t)sequence - (int64_t)(pos + 1);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->dequeue_pos, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Nothing was pushed at this position yet
+            return 0;
+        } else {
+            pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+        }
+    }
+
+    *entry = cell->entry;
+    // Cell is free for the producer of the next lap
+    atomic_store_explicit(&cell->sequence, pos + queue->mask + 1, memory_order_release);
+    return 1;
+}
+
+uint64_t matchmaker_queue_len(matchmaker_queue_t* queue) {
+    uint64_t dequeue_pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+    uint64_t enqueue_pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+    return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+}
+
+static void matchmaker_record_match(matchmaker_t* matchmaker, const matchmaker_entry_t* first,
+                                    const matchmaker_entry_t* second) {
+    uint64_t now = server_stats_now_ns();
+    server_stats_record_match(matchmaker->stats, now - first->enqueued_at);
+    server_stats_record_match(matchmaker->stats, now - second->enqueued_at);
+}
+
+static int32_t matchmaker_bucket(uint32_t rating) {
+    uint32_t bucket = rating / MATCHMAKER_BUCKET_WIDTH;
+    return bucket < MATCHMAKER_BUCKETS ? (int32_t)bucket : MATCHMAKER_BUCKETS - 1;
+}
+
+static uint8_t matchmaker_occupied(const matchmaker_t* matchmaker, int32_t bucket) {
+    return (matchmaker->occupied[bucket / 64] >> (bucket % 64)) & 1;
+}
+
+static void matchmaker_set_waiting(matchmaker_t* matchmaker, int32_t bucket, const matchmaker_entry_t* entry) {
+    matchmaker->waiting[bucket] = *entry;
+    matchmaker->occupied[bucket / 64] |= 1ull << (bucket % 64);
+    if (matchmaker->waiting_len++ == 0 || entry->enqueued_at < matchmaker->oldest_waiting) {
+        matchmaker->oldest_waiting = entry->enqueued_at;
+    }
+}
+
+static void matchmaker_clear_waiting(matchmaker_t* matchmaker, int32_t bucket) {
+    matchmaker->occupied[bucket / 64] &= ~(1ull << (bucket % 64));
+    matchmaker->waiting_len--;
+}
+
+// First occupied bucket >= from, -1 if there is none
+static int32_t matchmaker_next_occupied(const matchmaker_t* matchmaker, int32_t from) {
+    if (from >= MATCHMAKER_BUCKETS) {
+        return -1;
+    }
+
+    int32_t word = from / 64;
+    uint64_t bits = matchmaker->occupied[word] & (~0ull << (from % 64));
+    while (bits == 0) {
+        if (++word == MATCHMAKER_BUCKET_WORDS) {
+            return -1;
+        }
+        bits = matchmaker->occupied[word];
+    }
+
+    return word * 64 + __builtin_ctzll(bits);
+}
+
+// Last occupied bucket <= from, -1 if there is none
+static int32_t matchmaker_prev_occupied(const matchmaker_t* matchmaker, int32_t from) {
+    if (from < 0) {
+        return -1;
+    }
+
+    int32_t word = from / 64;
+    uint64_t bits = matchmaker->occupied[word] & (~0ull >> (63 - from % 64));
+    while (bits == 0) {
+        if (--word < 0) {
+            return -1;
+        }
+        bits = matchmaker->occupied[word];
+    }
+
+    return word * 64 + 63 - __builtin_clzll(bits);
+}
+
+// Window is given by the client that waits longer, it's the one whose window grew
+static uint64_t matchmaker_window(uint64_t first_enqueued_at, uint64_t second_enqueued_at, uint64_t now) {
+    uint64_t oldest = first_enqueued_at < second_enqueued_at ? first_enqueued_at : second_enqueued_at;
+    return now > oldest ? (now - oldest) / MATCHMAKER_WIDEN_NS : 0;
+}
+
+// Closest occupied bucket other than the entry's own bucket that is inside the window, -1 if there is none
+static int32_t matchmaker_find_opponent(const matchmaker_t* matchmaker, int32_t bucket, uint64_t enqueued_at,
+                                        uint64_t now) {
+    // Buckets further than the widest window any waiting client can have are never checked
+    uint64_t max_distance = matchmaker_window(enqueued_at, matchmaker->oldest_waiting, now);
+    int32_t below = matchmaker_prev_occupied(matchmaker, bucket - 1);
+    int32_t above = matchmaker_next_occupied(matchmaker, bucket + 1);
+    if (below != -1 && (uint64_t)(bucket - below) > max_distance) {
+        below = -1;
+    }
+    if (above != -1 && (uint64_t)(above - bucket) > max_distance) {
+        above = -1;
+    }
+
+    while (below != -1 || above != -1) {
+        int32_t candidate;
+        if (above == -1 || (below != -1 && bucket - below <= above - bucket)) {
+            candidate = below;
+            below = matchmaker_prev_occupied(matchmaker, below - 1);
+            if (below != -1 && (uint64_t)(bucket - below) > max_distance) {
+                below = -1;
+            }
+        } else {
+            candidate = above;
+            above = matchmaker_next_occupied(matchmaker, above + 1);
+            if (above != -1 && (uint64_t)(above - bucket) > max_distance) {
+                above = -1;
+            }
+        }
+
+        uint32_t distance = candidate < bucket ? bucket - candidate : candidate - bucket;
+        if (distance <= matchmaker_window(enqueued_at, matchmaker->waiting[candidate].enqueued_at, now)) {
+            return candidate;
+        }
+    }
+
+    return -1;
+}
+
+// Client that joined first is passed first to the pair function
+static uint8_t matchmaker_pair(matchmaker_t* matchmaker, const matchmaker_entry_t* older,
+                               const matchmaker_entry_t* newer) {
+    uint8_t result = matchmaker->pair(matchmaker->params, older, newer);
+    if (result == MATCHMAKER_PAIRED) {
+        matchmaker_record_match(matchmaker, older, newer);
+    }
+    return result;
+}
+
+uint8_t matchmaker_match(matchmaker_t* matchmaker, const matchmaker_entry_t* entry, uint64_t now) {
+    int32_t bucket = matchmaker_bucket(entry->rating);
+
+    while (1) {
+        int32_t opponent = matchmaker_occupied(matchmaker, bucket)
+                               ? bucket
+                               : matchmaker_find_opponent(matchmaker, bucket, entry->enqueued_at, now);
+        if (opponent == -1) {
+            matchmaker_set_waiting(matchmaker, bucket, entry);
+            return 0;
+        }
+
+        // Waiting client is always older than the one that was just queued
+        uint8_t result = matchmaker_pair(matchmaker, &matchmaker->waiting[opponent], entry);
+        if (result == MATCHMAKER_SECOND_STALE) {
+            return 0;
+        }
+
+        matchmaker_clear_waiting(matchmaker, opponent);
+        if (result == MATCHMAKER_PAIRED) {
+            return 1;
+        }
+        if (result == MATCHMAKER_FAILED) {
+            return 0;
+        }
+    }
+}
+
+void matchmaker_widen(matchmaker_t* matchmaker, uint64_t now) {
+    uint64_t oldest = UINT64_MAX;
+
+    for (int32_t bucket = matchmaker_next_occupied(matchmaker, 0); bucket != -1;
+         bucket = matchmaker_next_occupied(matchmaker, bucket + 1)) {
+        while (matchmaker_occupied(matchmaker, bucket)) {
+            const matchmaker_entry_t* entry = &matchmaker->waiting[bucket];
+            int32_t opponent = matchmaker_find_opponent(matchmaker, bucket, entry->enqueued_at, now);
+            if (opponent == -1) {
+                break;
+            }
+
+            const matchmaker_entry_t* other = &matchmaker->waiting[opponent];
+            uint8_t entry_first = entry->enqueued_at <= other->enqueued_at;
+            uint8_t result = entry_first ? matchmaker_pair(matchmaker, entry, other)
+                                         : matchmaker_pair(matchmaker, other, entry);
+
+            if (result == MATCHMAKER_PAIRED || result == MATCHMAKER_FAILED) {
+                matchmaker_clear_waiting(matchmaker, bucket);
+                matchmaker_clear_waiting(matchmaker, opponent);
+            } else if ((result == MATCHMAKER_FIRST_STALE) == entry_first) {
+                matchmaker_clear_waiting(matchmaker, bucket);
+            } else {
+                matchmaker_clear_waiting(matchmaker, opponent);
+            }
+        }
+
+        if (matchmaker_occupied(matchmaker, bucket) && matchmaker->waiting[bucket].enqueued_at < oldest) {
+            oldest = matchmaker->waiting[bucket].enqueued_at;
+        }
+    }
+
+    // Every client that is still waiting was visited, pairing only takes clients out
+    if (matchmaker->waiting_len > 0) {
+        matchmaker->oldest_waiting = oldest;
+    }
+}
+
+static void matchmaker_wait(matchmaker_t* matchmaker) {
+    if (matchmaker->waiting_len == 0) {
+        while (sem_wait(&matchmaker->pending) == -1 && errno == EINTR) {
+        }
+        return;
+    }
+
+    // Clients are waiting, wake up in time to widen their windows
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += MATCHMAKER_TICK_MS * 1000000l;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000l;
+    deadline.tv_nsec %= 1000000000l;
+
+    while (sem_timedwait(&matchmaker->pending, &deadline) == -1 && errno == EINTR) {
+    }
+}
+
+static void* matchmaker_thread(void* params) {
+    matchmaker_t* matchmaker = params;
+
+    while (1) {
+        matchmaker_wait(matchmaker);
+
+        uint8_t running = atomic_load(&matchmaker->running);
+        uint64_t now = server_stats_now_ns();
+
+        matchmaker_entry_t entry;
+        uint32_t popped = 0;
+        while (popped < MATCHMAKER_BATCH && matchmaker_queue_pop(&matchmaker->queue, &entry)) {
+            popped++;
+            matchmaker_match(matchmaker, &entry, now);
+        }
+
+        matchmaker_widen(matchmaker, now);
+
+        server_stats_set_queue_depth(matchmaker->stats,
+                                     matchmaker_queue_len(&matchmaker->queue) + matchmaker->waiting_len);
+
+        if (!running) {
+            break;
+        }
+
+        // Batch was full, rest of the queue is paired without waiting for another post
+        if (popped == MATCHMAKER_BATCH) {
+            sem_post(&matchmaker->pending);
+        }
+    }
+
+    return NULL;
+}
+
+error_code matchmaker_start(matchmaker_t* matchmaker, server_stats_t* stats, matchmaker_pair_fn pair, void* params) {
+    error_code err = matchmaker_queue_init(&matchmaker->queue, MATCHMAKER_QUEUE_CAP);
+    if (err != ERR_NONE) {
+        return err;
+    }
+
+    matchmaker->pair = pair;
+    matchmaker->params = params;
+    matchmaker->stats = stats;
+    memset(matchmaker->occupied, 0, sizeof(matchmaker->occupied));
+    matchmaker->waiting_len = 0;
+    atomic_store(&matchmaker->running, 1);
+    sem_init(&matchmaker->pending, 0, 0);
+
+    // Keep signals on the main thread
+    sigset_t blocked, old;
+    sigfillset(&blocked);
+    pthread_sigmask(SIG_BLOCK, &blocked, &old);
+    int ret = pthread_create(&matchmaker->thread, NULL, matchmaker_thread, matchmaker);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (ret != 0) {
+        fprintf(stderr, RED "ERROR: Failed to start matchmaker\n" RESET);
+        sem_destroy(&matchmaker->pending);
+        matchmaker_queue_deinit(&matchmaker->queue);
+        return ERR_UNKNOWN;
+    }
+
+    return ERR_NONE;
+}
+
+void matchmaker_stop(matchmaker_t* matchmaker) {
+    atomic_store(&matchmaker->running, 0);
+    sem_post(&matchmaker->pending);
+    pthread_join(matchmaker->thread, NULL);
+
+    sem_destroy(&matchmaker->pending);
+    matchmaker_queue_deinit(&matchmaker->queue);
+}
+
+error_code matchmaker_push(matchmaker_t* matchmaker, const matchmaker_entry_t* entry) {
+    if (!matchmaker_queue_push(&matchmaker->queue, entry)) {
+        return ERR_QUEUE_FULL;
+    }
+
+    sem_post(&matchmaker->pending);
+    return ERR_NONE;
+}
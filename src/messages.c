@@ -1,18 +1,17 @@
 #include "include/messages.h"
+#include <arpa/inet.h>
 #include <asm-generic/errno-base.h>
 #include <errno.h>
 #include <include/errors.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/poll.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
-error_code send_message(int sock_fd, const void* message, uint32_t len) {
-    ssize_t sent = send(sock_fd, message, len, 0);
-    if ((uint32_t)sent == len) {
-        // fprintf(stderr, ">>>>> %d: Sent a message, len %ld\n", sock_fd, sent);
-        return ERR_NONE;
-    }
-
+static error_code send_error(void) {
     switch (errno) {
     case ENOTSOCK:
         // File descriptor passed is not socket
@@ -23,6 +22,10 @@ error_code send_message(int sock_fd, const void* message, uint32_t len) {
     case EBADF:
         // Socket is not a valid open fd
         return ERR_IFD;
+    case EPIPE:
+    case ECONNRESET:
+        // Peer closed the connection
+        return ERR_PEER_CLOSED;
     case ENOMEM:
         // No memory to send a message
         return ERR_SEND_NO_MEM;
@@ -31,19 +34,14 @@ error_code send_message(int sock_fd, const void* message, uint32_t len) {
     }
 }
 
-
-error_code read_message(int sock_fd, void* buffer, uint32_t len) {
-    ssize_t read = recv(sock_fd, buffer, len, 0);
-    if (read == 0) {
-        return ERR_PEER_CLOSED;
-    }
-    
-    if (read != -1 && (uint32_t)read <= len) {
-        // fprintf(stderr, "<<<<< %d: Read a message, len %ld\n", sock_fd, read);
-        return ERR_NONE;
-    }
-
+static error_code recv_error(void) {
     switch (errno) {
+    case EAGAIN:
+        // Non blocking socket doesn't have any data
+        return ERR_WOULD_BLOCK;
+    case ECONNRESET:
+        // Peer closed the connection without reading everything
+        return ERR_PEER_CLOSED;
     case EFAULT:
         // Buffer points out of process's memory address space
     case EINVAL:
@@ -62,3 +60,254 @@ error_code read_message(int sock_fd, void* buffer, uint32_t len) {
     }
 }
 
+// Sends the header and the message, send can write only a part of
+// the frame so keep sending until everything is written
+error_code send_message(int sock_fd, const void* message, uint32_t len) {
+    uint32_t header = htonl(len);
+
+    struct iovec iov[2] = {
+        { .iov_base = &header, .iov_len = MESSAGE_HEADER_LEN },
+        { .iov_base = (void*)message, .iov_len = len },
+    };
+
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = 2 };
+
+    while (msg.msg_iovlen > 0) {
+        ssize_t sent = sendmsg(sock_fd, &msg, MSG_NOSIGNAL);
+        if (sent == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno != EAGAIN) {
+                return send_error();
+            }
+
+            // Socket is non blocking and its send buffer is full, wait until the peer
+            // reads some data but don't wait forever for a peer that stopped reading
+            struct pollfd poll_fd = { .fd = sock_fd, .events = POLLOUT };
+            int ready = poll(&poll_fd, 1, MESSAGE_SEND_TIMEOUT_MS);
+            if (ready == 0) {
+                return ERR_SEND_TIMEOUT;
+            }
+
+            if (ready == -1 && errno != EINTR) {
+                return ERR_UNKNOWN;
+            }
+
+            continue;
+        }
+
+        // Skip everything that was sent
+        while (msg.msg_iovlen > 0 && (size_t)sent >= msg.msg_iov->iov_len) {
+            sent -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+
+        if (msg.msg_iovlen > 0) {
+            msg.msg_iov->iov_base = (char*)msg.msg_iov->iov_base + sent;
+            msg.msg_iov->iov_len -= sent;
+        }
+    }
+
+    return ERR_NONE;
+}
+
+error_code message_writer_push(message_writer_t* writer, const void* message, uint32_t len) {
+    uint32_t frame_len = MESSAGE_HEADER_LEN + len;
+    if (writer->len > 0 && writer->len + frame_len > MESSAGE_WRITER_MAX_LEN) {
+        return ERR_QUEUE_FULL;
+    }
+
+    if (writer->len + frame_len > writer->cap) {
+        uint32_t cap = writer->cap > 0 ? writer->cap : MESSAGE_READ_BUFFER_SIZE;
+        while (cap < writer->len + frame_len) {
+            cap *= 2;
+        }
+
+        char* data = realloc(writer->data, cap);
+        if (data == NULL) {
+            return ERR_ALLOC;
+        }
+
+        writer->data = data;
+        writer->cap = cap;
+    }
+
+    uint32_t header = htonl(len);
+    memcpy(writer->data + writer->len, &header, MESSAGE_HEADER_LEN);
+    memcpy(writer->data + writer->len + MESSAGE_HEADER_LEN, message, len);
+    writer->len += frame_len;
+    return ERR_NONE;
+}
+
+error_code message_writer_flush(int sock_fd, message_writer_t* writer) {
+    uint32_t done = 0;
+    while (done < writer->len) {
+        ssize_t sent = send(sock_fd, writer->data + done, writer->len - done, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno == EAGAIN) {
+                break;
+            }
+
+            return send_error();
+        }
+
+        done += sent;
+    }
+
+    // Frames that weren't sent are moved to the front
+    if (done > 0) {
+        memmove(writer->data, writer->data + done, writer->len - done);
+        writer->len -= done;
+    }
+    return writer->len > 0 ? ERR_WOULD_BLOCK : ERR_NONE;
+}
+
+void message_writer_deinit(message_writer_t* writer) {
+    free(writer->data);
+    writer->data = NULL;
+    writer->len = 0;
+    writer->cap = 0;
+}
+
+// Blocks until exactly len bytes are read
+static error_code read_exact(int sock_fd, void* buffer, uint32_t len) {
+    uint32_t done = 0;
+    while (done < len) {
+        ssize_t read = recv(sock_fd, (char*)buffer + done, len - done, MSG_WAITALL);
+        if (read == 0) {
+            return ERR_PEER_CLOSED;
+        }
+
+        if (read == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return recv_error();
+        }
+
+        done += read;
+    }
+
+    return ERR_NONE;
+}
+
+error_code read_message(int sock_fd, void* buffer, uint32_t len) {
+    uint32_t header;
+    error_code err = read_exact(sock_fd, &header, MESSAGE_HEADER_LEN);
+    if (err != ERR_NONE) {
+        return err;
+    }
+
+    uint32_t message_len = ntohl(header);
+    if (message_len > MESSAGE_READ_BUFFER_SIZE) {
+        return ERR_MESSAGE_TOO_LARGE;
+    }
+
+    uint32_t to_read = message_len < len ? message_len : len;
+    err = read_exact(sock_fd, buffer, to_read);
+    if (err != ERR_NONE) {
+        return err;
+    }
+
+    // Shorter messages (error responses, etc..) leave the rest of the buffer zeroed
+    memset((char*)buffer + to_read, 0, len - to_read);
+
+    // Message is larger than the buffer, drop the rest of it
+    char discard[IN_BUFFER_SIZE];
+    while (to_read < message_len) {
+        uint32_t chunk = message_len - to_read;
+        if (chunk > IN_BUFFER_SIZE) {
+            chunk = IN_BUFFER_SIZE;
+        }
+
+        err = read_exact(sock_fd, discard, chunk);
+        if (err != ERR_NONE) {
+            return err;
+        }
+
+        to_read += chunk;
+    }
+
+    return ERR_NONE;
+}
+
+error_code read_message_alloc(int sock_fd, void** buffer, uint32_t* len) {
+    uint32_t header;
+    error_code err = read_exact(sock_fd, &header, MESSAGE_HEADER_LEN);
+    if (err != ERR_NONE) {
+        return err;
+    }
+
+    uint32_t message_len = ntohl(header);
+    if (message_len > MESSAGE_ALLOC_MAX_LEN) {
+        return ERR_MESSAGE_TOO_LARGE;
+    }
+
+    // Empty message still gets a buffer so the caller can always free it
+    char* message = malloc(message_len > 0 ? message_len : 1);
+    if (message == NULL) {
+        return ERR_ALLOC;
+    }
+
+    err = read_exact(sock_fd, message, message_len);
+    if (err != ERR_NONE) {
+        free(message);
+        return err;
+    }
+
+    *buffer = message;
+    *len = message_len;
+    return ERR_NONE;
+}
+
+error_code read_messages(int sock_fd, message_reader_t* reader, message_handler_fn handler, void* params) {
+    // Partial frame from the previous read goes in front of the new data
+    char buffer[MESSAGE_READ_BUFFER_SIZE];
+    memcpy(buffer, reader->data, reader->len);
+
+    ssize_t read = recv(sock_fd, buffer + reader->len, MESSAGE_READ_BUFFER_SIZE - reader->len, 0);
+    if (read == 0) {
+        return ERR_PEER_CLOSED;
+    }
+
+    if (read == -1) {
+        if (errno == EINTR) {
+            return ERR_NONE;
+        }
+        return recv_error();
+    }
+
+    uint32_t end = reader->len + read;
+    uint32_t offset = 0;
+
+    while (end - offset >= MESSAGE_HEADER_LEN) {
+        uint32_t header;
+        memcpy(&header, buffer + offset, MESSAGE_HEADER_LEN);
+
+        uint32_t message_len = ntohl(header);
+        if (message_len > MESSAGE_MAX_LEN) {
+            // We can't find the start of the next frame anymore
+            reader->len = 0;
+            return ERR_MESSAGE_TOO_LARGE;
+        }
+
+        if (end - offset - MESSAGE_HEADER_LEN < message_len) {
+            break;
+        }
+
+        handler(params, buffer + offset + MESSAGE_HEADER_LEN, message_len);
+        offset += MESSAGE_HEADER_LEN + message_len;
+    }
+
+    reader->len = end - offset;
+    memcpy(reader->data, buffer + offset, reader->len);
+
+    return ERR_NONE;
+}
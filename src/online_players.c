@@ -0,0 +1,206 @@
+#include "include/online_players.h"
+#include "include/errors.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Reader slot of the current thread, picked the first time the thread reads the players
+static __thread int32_t thread_slot = -1;
+
+online_snapshot_t* online_snapshot_new(uint32_t len) {
+    online_snapshot_t* snapshot = malloc(sizeof(online_snapshot_t) + (size_t)len * sizeof(online_player_t));
+    if (snapshot == NULL) {
+        return NULL;
+    }
+
+    snapshot->next_retired = NULL;
+    snapshot->len = len;
+    return snapshot;
+}
+
+online_snapshot_t* online_snapshot_put(const online_snapshot_t* snapshot, const online_player_t* player) {
+    uint32_t i = online_snapshot_seek(snapshot, player->username, 0);
+    uint8_t replace = i < snapshot->len && strncmp(snapshot->players[i].username, player->username, USERNAME_MAX_LEN) == 0;
+
+    online_snapshot_t* out = online_snapshot_new(snapshot->len + !replace);
+    if (out == NULL) {
+        return NULL;
+    }
+
+    // Players before and after the position are copied as they are
+    memcpy(out->players, snapshot->players, (size_t)i * sizeof(online_player_t));
+    out->players[i] = *player;
+    uint32_t after = i + replace;
+    memcpy(&out->players[i + 1], &snapshot->players[after], (size_t)(snapshot->len - after) * sizeof(online_player_t));
+    return out;
+}
+
+online_snapshot_t* online_snapshot_remove(const online_snapshot_t* snapshot, const char* username) {
+    uint32_t i = online_snapshot_seek(snapshot, username, 0);
+    uint8_t found = i < snapshot->len && strncmp(snapshot->players[i].username, username, USERNAME_MAX_LEN) == 0;
+
+    online_snapshot_t* out = online_snapshot_new(snapshot->len - found);
+    if (out == NULL) {
+        return NULL;
+    }
+
+    memcpy(out->players, snapshot->players, (size_t)i * sizeof(online_player_t));
+    memcpy(&out->players[i], &snapshot->players[i + found], (size_t)(snapshot->len - i - found) * sizeof(online_player_t));
+    return out;
+}
+
+error_code online_players_init(online_players_t* online) {
+    online->readers = aligned_alloc(64, sizeof(online_players_reader_t) * ONLINE_PLAYERS_READER_SLOTS);
+    if (online->readers == NULL) {
+        return ERR_ALLOC;
+    }
+
+    online_snapshot_t* empty = online_snapshot_new(0);
+    if (empty == NULL) {
+        free(online->readers);
+        online->readers = NULL;
+        return ERR_ALLOC;
+    }
+
+    for (uint32_t i = 0; i < ONLINE_PLAYERS_READER_SLOTS; i++) {
+        atomic_init(&online->readers[i].active[0], 0);
+        atomic_init(&online->readers[i].active[1], 0);
+    }
+    atomic_init(&online->current, empty);
+    atomic_init(&online->epoch, 0);
+    atomic_init(&online->next_slot, 0);
+    online->pending = NULL;
+    online->retiring = NULL;
+    online->retiring_len = 0;
+    online->flips = 0;
+    pthread_mutex_init(&online->retire_lock, NULL);
+    return ERR_NONE;
+}
+
+static void free_retired(online_snapshot_t* snapshot) {
+    while (snapshot != NULL) {
+        online_snapshot_t* next = snapshot->next_retired;
+        free(snapshot);
+        snapshot = next;
+    }
+}
+
+void online_players_deinit(online_players_t* online) {
+    // Nobody reads anymore, retired snapshots are freed right away
+    free_retired(online->pending);
+    free_retired(online->retiring);
+    free(atomic_load(&online->current));
+    free(online->readers);
+    pthread_mutex_destroy(&online->retire_lock);
+    online->readers = NULL;
+}
+
+const online_snapshot_t* online_players_read(online_players_t* online, online_players_guard_t* guard) {
+    if (thread_slot == -1) {
+        thread_slot = atomic_fetch_add_explicit(&online->next_slot, 1, memory_order_relaxed) % ONLINE_PLAYERS_READER_SLOTS;
+    }
+
+    // Reader is counted before it loads the snapshot, a writer that doesn't see
+    // the count yet has already swapped the snapshot this reader will load
+    guard->slot = thread_slot;
+    guard->epoch = atomic_load(&online->epoch) & 1;
+    atomic_fetch_add(&online->readers[guard->slot].active[guard->epoch], 1);
+    return atomic_load(&online->current);
+}
+
+void online_players_read_end(online_players_t* online, const online_players_guard_t* guard) {
+    atomic_fetch_sub_explicit(&online->readers[guard->slot].active[guard->epoch], 1, memory_order_release);
+}
+
+const online_snapshot_t* online_players_current(online_players_t* online) {
+    return atomic_load(&online->current);
+}
+
+online_snapshot_t* online_players_publish(online_players_t* online, online_snapshot_t* snapshot) {
+    return atomic_exchange(&online->current, snapshot);
+}
+
+static uint8_t readers_gone(online_players_t* online, uint32_t epoch) {
+    for (uint32_t i = 0; i < ONLINE_PLAYERS_READER_SLOTS; i++) {
+        if (atomic_load(&online->readers[i].active[epoch]) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+uint32_t online_players_retire(online_players_t* online, online_snapshot_t* snapshot) {
+    pthread_mutex_lock(&online->retire_lock);
+
+    uint32_t pending_len = 0;
+    if (snapshot != NULL) {
+        snapshot->next_retired = online->pending;
+        online->pending = snapshot;
+    }
+    for (online_snapshot_t* s = online->pending; s != NULL; s = s->next_retired) {
+        pending_len++;
+    }
+
+    // Snapshots of a grace period were swapped out before it started. Reader that read
+    // the epoch just before the first flip can still count itself in the old epoch and
+    // load an old snapshot, after the second flip every reader of them is gone.
+    for (;;) {
+        if (online->retiring == NULL) {
+            if (online->pending == NULL) {
+                break;
+            }
+
+            online->retiring = online->pending;
+            online->retiring_len = pending_len;
+            online->pending = NULL;
+            pending_len = 0;
+            online->flips = 0;
+        }
+
+        // Epoch flipped away from is still read, one of the next writers tries again
+        if (online->flips > 0 && !readers_gone(online, (atomic_load(&online->epoch) & 1) ^ 1)) {
+            break;
+        }
+
+        if (online->flips == 2) {
+            free_retired(online->retiring);
+            online->retiring = NULL;
+            online->retiring_len = 0;
+            continue;
+        }
+
+        atomic_fetch_xor(&online->epoch, 1);
+        online->flips++;
+    }
+
+    uint32_t still_read = online->retiring_len + pending_len;
+    pthread_mutex_unlock(&online->retire_lock);
+    return still_read;
+}
+
+uint32_t online_snapshot_seek(const online_snapshot_t* snapshot, const char* username, uint8_t exclusive) {
+    uint32_t low = 0;
+    uint32_t high = snapshot->len;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        int cmp = strncmp(snapshot->players[mid].username, username, USERNAME_MAX_LEN);
+        if (cmp < 0 || (exclusive && cmp == 0)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+const online_player_t* online_snapshot_find(const online_snapshot_t* snapshot, const char* username) {
+    uint32_t i = online_snapshot_seek(snapshot, username, 0);
+    if (i == snapshot->len || strncmp(snapshot->players[i].username, username, USERNAME_MAX_LEN) != 0) {
+        return NULL;
+    }
+
+    return &snapshot->players[i];
+}
@@ -0,0 +1,16 @@
+#include "include/rating.h"
+#include <math.h>
+#include <stdint.h>
+
+void rating_update(uint32_t* winner, uint32_t* loser) {
+    // Chance the winner had to win the game
+    double expected = 1.0 / (1.0 + pow(10.0, ((double)*loser - (double)*winner) / 400.0));
+    uint32_t delta = (uint32_t)lround(RATING_K * (1.0 - expected));
+
+    if (delta > *loser) {
+        delta = *loser;
+    }
+
+    *winner += delta;
+    *loser -= delta;
+}
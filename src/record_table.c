@@ -0,0 +1,102 @@
+#include "include/record_table.h"
+#include "include/errors.h"
+#include "include/globals.h"
+#include "include/slot_pool.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+error_code record_table_create(record_table_t* table, uint32_t element_size) {
+    table->element_size = element_size;
+    table->map = NULL;
+    table->map_len = 0;
+    table->mapped = NULL;
+    table->mapped_len = 0;
+    return slot_pool_init(&table->tail, element_size);
+}
+
+void record_table_destroy(record_table_t* table) {
+    if (table->map != NULL) {
+        munmap(table->map, table->map_len);
+    }
+
+    table->map = NULL;
+    table->mapped = NULL;
+    table->mapped_len = 0;
+    slot_pool_deinit(&table->tail);
+}
+
+error_code record_table_map(record_table_t* table, int fd, uint64_t offset, uint32_t count) {
+    if (count == 0) {
+        return ERR_NONE;
+    }
+
+    // Mapping has to start at a page boundary, map from the start of the file
+    uint64_t len = offset + (uint64_t)count * table->element_size;
+    void* map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, RED "ERROR: Failed to map %u records, %s\n" RESET, count, strerror(errno));
+        return ERR_UNKNOWN;
+    }
+
+    table->map = map;
+    table->map_len = len;
+    table->mapped = (char*)map + offset;
+    table->mapped_len = count;
+
+    return ERR_NONE;
+}
+
+uint32_t record_table_len(const record_table_t* table) {
+    return table->mapped_len + slot_pool_len(&table->tail);
+}
+
+void* record_table_at(const record_table_t* table, uint32_t index) {
+    if (index < table->mapped_len) {
+        return table->mapped + (uint64_t)index * table->element_size;
+    }
+
+    return slot_pool_at(&table->tail, index - table->mapped_len);
+}
+
+void* record_table_push(record_table_t* table, void* element) {
+    return slot_pool_push(&table->tail, element);
+}
+
+void record_table_pop(record_table_t* table) {
+    slot_pool_pop(&table->tail);
+}
+
+error_code record_table_write(const record_table_t* table, FILE* file) {
+    if (table->mapped_len > 0 && fwrite(table->mapped, table->element_size, table->mapped_len, file) != table->mapped_len) {
+        return ERR_UNKNOWN;
+    }
+
+    // Tail is written a chunk at a time, records are only next to each other inside a chunk
+    uint32_t tail_len = slot_pool_len(&table->tail);
+    for (uint32_t i = 0; i < tail_len; i += SLOT_POOL_CHUNK_LEN) {
+        uint32_t count = tail_len - i < SLOT_POOL_CHUNK_LEN ? tail_len - i : SLOT_POOL_CHUNK_LEN;
+        if (fwrite(slot_pool_at(&table->tail, i), table->element_size, count, file) != count) {
+            return ERR_UNKNOWN;
+        }
+    }
+
+    return ERR_NONE;
+}
+
+void record_table_copy(const record_table_t* table, void* out) {
+    char* dst = out;
+    if (table->mapped_len > 0) {
+        memcpy(dst, table->mapped, (size_t)table->mapped_len * table->element_size);
+        dst += (size_t)table->mapped_len * table->element_size;
+    }
+
+    uint32_t tail_len = slot_pool_len(&table->tail);
+    for (uint32_t i = 0; i < tail_len; i += SLOT_POOL_CHUNK_LEN) {
+        uint32_t count = tail_len - i < SLOT_POOL_CHUNK_LEN ? tail_len - i : SLOT_POOL_CHUNK_LEN;
+        memcpy(dst, slot_pool_at(&table->tail, i), (size_t)count * table->element_size);
+        dst += (size_t)count * table->element_size;
+    }
+}
@@ -0,0 +1,283 @@
+#include "include/results_index.h"
+#include "include/errors.h"
+#include "include/game_results.h"
+#include "include/globals.h"
+#include "include/record_table.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static void results_index_clear_heads(results_index_t* index, uint32_t from) {
+    for (uint32_t i = from; i < index->heads_cap; i++) {
+        index->heads[i].last = RESULTS_INDEX_NONE;
+        index->heads[i].games = 0;
+    }
+}
+
+static error_code results_index_reserve(results_index_t* index, uint32_t user_id) {
+    if (user_id < index->heads_cap) {
+        return ERR_NONE;
+    }
+
+    uint32_t cap = index->heads_cap == 0 ? 64 : index->heads_cap;
+    while (cap <= user_id) {
+        cap *= 2;
+    }
+
+    results_index_head_t* heads = realloc(index->heads, cap * sizeof(results_index_head_t));
+    if (heads == NULL) {
+        return ERR_ALLOC;
+    }
+
+    uint32_t old_cap = index->heads_cap;
+    index->heads = heads;
+    index->heads_cap = cap;
+    results_index_clear_heads(index, old_cap);
+    return ERR_NONE;
+}
+
+// Players converted from legacy results without a user have no history
+static uint8_t results_index_known(uint32_t user_id) {
+    return user_id != GAME_RESULTS_UNKNOWN_USER;
+}
+
+static error_code results_index_update(results_index_t* index, const game_results_t* result, uint32_t result_id) {
+    // Both players are reserved before any head changes
+    uint32_t ids[2] = { result->first_player_id, result->second_player_id };
+    for (uint8_t i = 0; i < 2; i++) {
+        if (results_index_known(ids[i])) {
+            error_code err = results_index_reserve(index, ids[i]);
+            if (err != ERR_NONE) {
+                return err;
+            }
+        }
+    }
+
+    for (uint8_t i = 0; i < 2; i++) {
+        if (results_index_known(ids[i])) {
+            index->heads[ids[i]].last = result_id;
+            index->heads[ids[i]].games++;
+        }
+    }
+
+    return ERR_NONE;
+}
+
+// Returns the number of links the heads are up to date with, 0 if the heads can't be used
+static uint32_t results_index_load_heads(results_index_t* index, const char* heads_filepath, uint32_t links_len) {
+    FILE* file = fopen(heads_filepath, "r");
+    if (file == NULL) {
+        return 0;
+    }
+
+    results_index_heads_header_t header = { 0 };
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != RESULTS_INDEX_HEADS_MAGIC ||
+        header.version != RESULTS_INDEX_VERSION) {
+        fprintf(stderr, YELLOW "WARNING: Game results index heads are not valid, linking every result again\n" RESET);
+        fclose(file);
+        return 0;
+    }
+
+    // Index lost links the heads already point at
+    if (header.links_len > links_len) {
+        fprintf(stderr, YELLOW "WARNING: Game results index heads are newer than the index, linking every result again\n" RESET);
+        fclose(file);
+        return 0;
+    }
+
+    if (header.heads_len > 0 && results_index_reserve(index, header.heads_len - 1) != ERR_NONE) {
+        fclose(file);
+        return 0;
+    }
+
+    if (fread(index->heads, sizeof(results_index_head_t), header.heads_len, file) != header.heads_len) {
+        fprintf(stderr, YELLOW "WARNING: Game results index heads are cut, linking every result again\n" RESET);
+        results_index_clear_heads(index, 0);
+        fclose(file);
+        return 0;
+    }
+
+    fclose(file);
+    return header.links_len;
+}
+
+error_code results_index_load(results_index_t* index, const record_table_t* results, const char* filepath,
+                              const char* heads_filepath) {
+    error_code err = record_table_create(&index->links, sizeof(results_index_link_t));
+    if (err != ERR_NONE) {
+        return err;
+    }
+    index->heads = NULL;
+    index->heads_cap = 0;
+
+    int fd = open(filepath, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        return ERR_UNKNOWN;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return ERR_UNKNOWN;
+    }
+
+    uint64_t size = st.st_size;
+    results_index_header_t header = { .magic = RESULTS_INDEX_MAGIC, .version = RESULTS_INDEX_VERSION };
+    if (size == 0) {
+        if (write(fd, &header, sizeof(header)) != sizeof(header)) {
+            close(fd);
+            return ERR_UNKNOWN;
+        }
+        size = sizeof(header);
+    } else if (size < sizeof(header) || pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+               header.magic != RESULTS_INDEX_MAGIC || header.version != RESULTS_INDEX_VERSION) {
+        fprintf(stderr, RED "ERROR: Game results index file is not supported\n" RESET);
+        close(fd);
+        return ERR_UNKNOWN;
+    }
+
+    uint32_t results_len = record_table_len(results);
+    uint64_t links_len = (size - sizeof(header)) / sizeof(results_index_link_t);
+
+    // Results and links are written one after the other, a crash
+    // between the two writes leaves more links than results
+    if (links_len > results_len) {
+        fprintf(stderr, YELLOW "WARNING: Game results index has %lu links for %u results, dropping the extra links\n" RESET,
+                links_len, results_len);
+        links_len = results_len;
+    }
+
+    if (size != sizeof(header) + links_len * sizeof(results_index_link_t) &&
+        ftruncate(fd, sizeof(header) + links_len * sizeof(results_index_link_t)) == -1) {
+        close(fd);
+        return ERR_UNKNOWN;
+    }
+
+    if (links_len > 0) {
+        err = record_table_map(&index->links, fd, sizeof(header), links_len);
+        if (err != ERR_NONE) {
+            close(fd);
+            return err;
+        }
+    }
+
+    uint32_t replayed = 0;
+    for (uint32_t i = results_index_load_heads(index, heads_filepath, links_len); i < links_len; i++) {
+        err = results_index_update(index, record_table_at(results, i), i);
+        if (err != ERR_NONE) {
+            close(fd);
+            return err;
+        }
+        replayed++;
+    }
+
+    // Results the index file doesn't have yet, every result when the index file is new
+    FILE* file = fdopen(fd, "a");
+    if (file == NULL) {
+        close(fd);
+        return ERR_UNKNOWN;
+    }
+
+    for (uint32_t i = links_len; i < results_len; i++) {
+        results_index_link_t link;
+        err = results_index_add(index, record_table_at(results, i), &link);
+        if (err != ERR_NONE) {
+            fclose(file);
+            return err;
+        }
+        fwrite(&link, sizeof(link), 1, file);
+    }
+
+    if (ferror(file) || fflush(file) != 0 || fsync(fileno(file)) == -1) {
+        fclose(file);
+        return ERR_UNKNOWN;
+    }
+
+    fclose(file);
+
+    fprintf(stdout, "Loaded game results index, replayed %u links, linked %lu results\n", replayed,
+            results_len - links_len);
+    return ERR_NONE;
+}
+
+void results_index_deinit(results_index_t* index) {
+    record_table_destroy(&index->links);
+    free(index->heads);
+    index->heads = NULL;
+    index->heads_cap = 0;
+}
+
+// Same as users_save, heads are written to a temporary file that replaces the old one
+error_code results_index_save_heads(const results_index_t* index, const char* heads_filepath) {
+    char tmp_filepath[PATH_MAX];
+    if (snprintf(tmp_filepath, sizeof(tmp_filepath), "%s.tmp", heads_filepath) >= (int)sizeof(tmp_filepath)) {
+        return ERR_IARG;
+    }
+
+    FILE* file = fopen(tmp_filepath, "w");
+    if (file == NULL) {
+        return ERR_UNKNOWN;
+    }
+
+    results_index_heads_header_t header = {
+        .magic = RESULTS_INDEX_HEADS_MAGIC,
+        .version = RESULTS_INDEX_VERSION,
+        .links_len = record_table_len(&index->links),
+        .heads_len = index->heads_cap,
+    };
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(index->heads, sizeof(results_index_head_t), index->heads_cap, file);
+
+    if (ferror(file) || fflush(file) != 0 || fsync(fileno(file)) == -1) {
+        fclose(file);
+        unlink(tmp_filepath);
+        return ERR_UNKNOWN;
+    }
+
+    fclose(file);
+
+    if (rename(tmp_filepath, heads_filepath) == -1) {
+        unlink(tmp_filepath);
+        return ERR_UNKNOWN;
+    }
+
+    return ERR_NONE;
+}
+
+error_code results_index_add(results_index_t* index, const game_results_t* result, results_index_link_t* link) {
+    uint32_t result_id = record_table_len(&index->links);
+    link->first_prev = results_index_last(index, result->first_player_id);
+    link->second_prev = results_index_last(index, result->second_player_id);
+
+    // Link is added first so the heads never point at a result without a link
+    if (record_table_push(&index->links, link) == NULL) {
+        return ERR_ALLOC;
+    }
+
+    // Link stays even if the heads couldn't grow so every result keeps its link
+    return results_index_update(index, result, result_id);
+}
+
+uint32_t results_index_last(const results_index_t* index, uint32_t user_id) {
+    return user_id < index->heads_cap ? index->heads[user_id].last : RESULTS_INDEX_NONE;
+}
+
+uint32_t results_index_games(const results_index_t* index, uint32_t user_id) {
+    return user_id < index->heads_cap ? index->heads[user_id].games : 0;
+}
+
+uint32_t results_index_prev(const results_index_t* index, const record_table_t* results, uint32_t user_id,
+                            uint32_t result_id) {
+    if (result_id >= record_table_len(&index->links) || result_id >= record_table_len(results)) {
+        return RESULTS_INDEX_NONE;
+    }
+
+    const game_results_t* result = record_table_at(results, result_id);
+    const results_index_link_t* link = record_table_at(&index->links, result_id);
+    return result->first_player_id == user_id ? link->first_prev : link->second_prev;
+}
@@ -0,0 +1,241 @@
+#include "include/results_writer.h"
+#include "include/errors.h"
+#include "include/game_results.h"
+#include "include/globals.h"
+#include "include/logger.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void* results_writer_thread(void* params);
+
+static void results_writer_enqueue(results_writer_t* writer, results_writer_node_t* node) {
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    results_writer_node_t* prev = atomic_exchange_explicit(&writer->head, node, memory_order_acq_rel);
+    // Between the exchange and this store the writer can't see the node yet
+    atomic_store_explicit(&prev->next, node, memory_order_release);
+}
+
+// Only called by the writer thread. Returns NULL if the queue is empty
+// or if a producer is in the middle of a push, the push posts the semaphore after it's done
+static results_writer_node_t* results_writer_dequeue(results_writer_t* writer) {
+    results_writer_node_t* tail = writer->tail;
+    results_writer_node_t* next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+    if (tail == &writer->stub) {
+        if (next == NULL) {
+            return NULL;
+        }
+
+        writer->tail = next;
+        tail = next;
+        next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    }
+
+    if (next != NULL) {
+        writer->tail = next;
+        return tail;
+    }
+
+    if (tail != atomic_load_explicit(&writer->head, memory_order_acquire)) {
+        return NULL;
+    }
+
+    // Tail is the last node, put the stub behind it so it can be taken out
+    results_writer_enqueue(writer, &writer->stub);
+
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (next != NULL) {
+        writer->tail = next;
+        return tail;
+    }
+
+    return NULL;
+}
+
+error_code results_writer_start(results_writer_t* writer, const char* filepath, const char* index_filepath) {
+    writer->fd = open(filepath, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (writer->fd == -1) {
+        fprintf(stderr, RED "ERROR: Failed to open game results file, %s\n" RESET, strerror(errno));
+        return ERR_IFD;
+    }
+
+    writer->index_fd = open(index_filepath, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (writer->index_fd == -1) {
+        fprintf(stderr, RED "ERROR: Failed to open game results index file, %s\n" RESET, strerror(errno));
+        close(writer->fd);
+        return ERR_IFD;
+    }
+
+    off_t size = lseek(writer->fd, 0, SEEK_END);
+    off_t index_size = lseek(writer->index_fd, 0, SEEK_END);
+    if (size == -1 || index_size == -1) {
+        fprintf(stderr, RED "ERROR: Failed to find the end of game results files, %s\n" RESET, strerror(errno));
+        close(writer->fd);
+        close(writer->index_fd);
+        return ERR_IFD;
+    }
+    writer->size = size;
+    writer->index_size = index_size;
+    atomic_store(&writer->write_error, ERR_NONE);
+
+    atomic_store(&writer->stub.next, NULL);
+    atomic_store(&writer->head, &writer->stub);
+    writer->tail = &writer->stub;
+    atomic_store(&writer->running, 1);
+    sem_init(&writer->pending, 0, 0);
+
+    // Keep signals on the main thread
+    sigset_t blocked, old;
+    sigfillset(&blocked);
+    pthread_sigmask(SIG_BLOCK, &blocked, &old);
+    int ret = pthread_create(&writer->thread, NULL, results_writer_thread, writer);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (ret != 0) {
+        fprintf(stderr, RED "ERROR: Failed to start game results writer\n" RESET);
+        sem_destroy(&writer->pending);
+        close(writer->fd);
+        close(writer->index_fd);
+        return ERR_UNKNOWN;
+    }
+
+    return ERR_NONE;
+}
+
+void results_writer_stop(results_writer_t* writer) {
+    atomic_store(&writer->running, 0);
+    sem_post(&writer->pending);
+
+    pthread_join(writer->thread, NULL);
+
+    sem_destroy(&writer->pending);
+    close(writer->fd);
+    close(writer->index_fd);
+}
+
+error_code results_writer_push(results_writer_t* writer, const game_results_t* result, const results_index_link_t* link) {
+    error_code err = atomic_load(&writer->write_error);
+    if (err != ERR_NONE) {
+        return err;
+    }
+
+    results_writer_node_t* node = malloc(sizeof(results_writer_node_t));
+    if (node == NULL) {
+        return ERR_ALLOC;
+    }
+
+    node->result = *result;
+    node->link = *link;
+    results_writer_enqueue(writer, node);
+    sem_post(&writer->pending);
+
+    return ERR_NONE;
+}
+
+static error_code results_writer_write_all(int fd, const void* buffer, uint64_t len, const char* what) {
+    const char* data = buffer;
+    uint64_t left = len;
+
+    while (left > 0) {
+        ssize_t written = write(fd, data, left);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            LOG_ERROR("%s failed to write %s, %s", error_to_string(ERR_SYNC_FAILED), what, strerror(errno));
+            return ERR_SYNC_FAILED;
+        }
+
+        data += written;
+        left -= written;
+    }
+
+    if (fdatasync(fd) == -1) {
+        LOG_ERROR("%s failed to sync %s, %s", error_to_string(ERR_SYNC_FAILED), what, strerror(errno));
+        return ERR_SYNC_FAILED;
+    }
+
+    return ERR_NONE;
+}
+
+// Results go first, on load links without a result are dropped and results without a link are linked again.
+// A batch that fails is cut from both files, a partly written record would shift every record after it.
+static void results_writer_write(results_writer_t* writer, const game_results_t* results,
+                                 const results_index_link_t* links, uint32_t len) {
+    if (atomic_load(&writer->write_error) != ERR_NONE) {
+        return;
+    }
+
+    uint64_t results_len = (uint64_t)len * sizeof(game_results_t);
+    uint64_t links_len = (uint64_t)len * sizeof(results_index_link_t);
+    error_code err = results_writer_write_all(writer->fd, results, results_len, "game results");
+    if (err == ERR_NONE) {
+        err = results_writer_write_all(writer->index_fd, links, links_len, "game results index");
+    }
+
+    if (err == ERR_NONE) {
+        writer->size += results_len;
+        writer->index_size += links_len;
+        return;
+    }
+
+    if (ftruncate(writer->fd, writer->size) == -1 || ftruncate(writer->index_fd, writer->index_size) == -1) {
+        LOG_ERROR("%s failed to cut game results files back to the last batch, %s", error_to_string(err),
+                  strerror(errno));
+    }
+    LOG_ERROR("%s game results are no longer written, %u results of the batch were dropped", error_to_string(err), len);
+    atomic_store(&writer->write_error, err);
+}
+
+static void* results_writer_thread(void* params) {
+    results_writer_t* writer = params;
+    game_results_t batch[RESULTS_WRITER_BATCH];
+    results_index_link_t links[RESULTS_WRITER_BATCH];
+
+    while (1) {
+        while (sem_wait(&writer->pending) == -1 && errno == EINTR) {
+        }
+
+        // Everything queued while the last batch was written goes out together,
+        // one post can cover many results so the extra posts only wake us up for nothing
+        uint32_t len = 0;
+        results_writer_node_t* node;
+        while ((node = results_writer_dequeue(writer)) != NULL) {
+            batch[len] = node->result;
+            links[len] = node->link;
+            len++;
+            free(node);
+
+            if (len == RESULTS_WRITER_BATCH) {
+                results_writer_write(writer, batch, links, len);
+                len = 0;
+            }
+        }
+
+        if (len > 0) {
+            results_writer_write(writer, batch, links, len);
+        }
+
+        if (!atomic_load(&writer->running)) {
+            // Producers are stopped before the writer, if a push is still
+            // in progress its post wakes us up again
+            int value;
+            sem_getvalue(&writer->pending, &value);
+            if (value == 0) {
+                break;
+            }
+        }
+    }
+
+    return NULL;
+}
@@ -1,15 +1,24 @@
 #include "include/errors.h"
 #include "include/game.h"
+#include "include/game_board.h"
+#include "include/game_ship.h"
 #include "include/globals.h"
+#include "include/leaderboard.h"
+#include "include/results_index.h"
+#include "include/logger.h"
+#include "include/online_players.h"
+#include "include/rating.h"
 #include "include/server_utils.h"
+#include "include/shard_lock.h"
 #include "include/messages.h"
 #include "include/state.h"
 #include "include/users.h"
-#include "include/vector/vector.h"
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 static error_code handle_ask_other_player(server_client_t* client, server_client_t* other);
 
@@ -21,9 +30,9 @@ error_code handle_unknown_request(server_client_t* client) {
     res.status_code = STATUS_NOT_FOUND;
     sprintf(res.message, "Cannot process request, unknown message type");
 
-    error_code  err = send_message(client->sock_fd, &res, sizeof(res));
+    error_code  err = server_send_response(client, &res, sizeof(res));
     if (err != ERR_NONE) {
-        fprintf(stderr, RED "%s failed to send message %d - %s\n" RESET, error_to_string(err), res.status_code, res.message);
+        LOG_ERROR("%s failed to send message %d - %s", error_to_string(err), res.status_code, res.message);
     }
     return err;
 }
@@ -36,47 +45,76 @@ error_code handle_signup_request(server_client_t* client, const char* buffer) {
         res.error.status_code = STATUS_BAD_REQUEST;
         sprintf(res.error.message, "Cannot signup when already logged in");
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "%s failed to send message %d - %s\n" RESET, error_to_string(err), res.error.status_code, res.error.message);
+            LOG_ERROR("%s failed to send message %d - %s", error_to_string(err), res.error.status_code, res.error.message);
         }
         return err;
     }
 
     SignupRequestMessage req = *(SignupRequestMessage*)(buffer);
-   
-    server_user_t* user = server_find_user_by_username(client->server_state, req.username);
-    if (user != NULL) {
-        res.error.status_code = STATUS_CONFLICT;
-        sprintf(res.error.message, "Username %s already exists", req.username);
-        fprintf(stderr, RED "ERROR: CLIENT %d: User signup failed, %d - %s\n" RESET,
+
+    server_user_t new_user;
+    strncpy(new_user.username, req.username, USERNAME_MAX_LEN);
+    strncpy(new_user.password, req.password, PASSWORD_MAX_LEN);
+    new_user.rating = RATING_DEFAULT;
+
+    // Username check and insert are done under the same lock
+    // so two clients can't signup with the same username
+    server_user_t* user;
+    uint32_t user_id;
+    err = server_add_user(client->server_state, new_user, &user, &user_id);
+    if (err != ERR_NONE) {
+        if (err == ERR_USERNAME_EXISTS) {
+            res.error.status_code = STATUS_CONFLICT;
+            sprintf(res.error.message, "Username %s already exists", req.username);
+        } else {
+            res.error.status_code = STATUS_UNKNOWN_ERROR;
+            sprintf(res.error.message, "Failed to save user %s", req.username);
+        }
+        LOG_ERROR("CLIENT %d: User signup failed, %d - %s",
                 client->sock_fd, res.error.status_code, res.error.message);
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "%s failed to send message %d - %s\n" RESET, error_to_string(err), res.error.status_code, res.error.message);
+            LOG_ERROR("%s failed to send message %d - %s", error_to_string(err), res.error.status_code, res.error.message);
+        }
+        return err;
+    }
+
+    // New user can only be taken by a client that logged in right after the signup
+    err = server_add_session(client->server_state, client, user);
+    if (err != ERR_NONE) {
+        if (err == ERR_USERNAME_EXISTS) {
+            res.error.status_code = STATUS_CONFLICT;
+            sprintf(res.error.message, "Username %s already exists", req.username);
+        } else {
+            res.error.status_code = STATUS_UNKNOWN_ERROR;
+            sprintf(res.error.message, "Failed to log in user %s", req.username);
+        }
+
+        err = server_send_response(client, &res, sizeof(res));
+        if (err != ERR_NONE) {
+            LOG_ERROR("%s failed to send message %d - %s", error_to_string(err), res.error.status_code, res.error.message);
         }
         return err;
     }
-    
-    server_user_t new_user;
-    strncpy(new_user.username, req.username, USERNAME_MAX_LEN);
-    strncpy(new_user.password, req.password, PASSWORD_MAX_LEN);
 
-    client->user = server_add_user(client->server_state, new_user);
+    client->user = user;
+    client->user_id = user_id;
 
     generate_random_hex_string(client->api_key, API_KEY_LEN);
 
     client_set_logged_in(client);
 
-    fprintf(stderr, GREEN "CLIENT %d: User \"%s\" signed up\n" RESET, client->sock_fd,client->user->username);
+    LOG_INFO("CLIENT %d: User \"%s\" signed up", client->sock_fd,client->user->username);
    
     res.success.status_code = STATUS_OK;
     strncpy(res.success.api_key, client->api_key, API_KEY_LEN);
 
-    err = send_message(client->sock_fd, &res, sizeof(res));
+    err = server_send_response(client, &res, sizeof(res));
     if (err != ERR_NONE) {
-        fprintf(stderr, RED "%s failed to send message %d\n" RESET, error_to_string(err), res.success.status_code);
+        LOG_ERROR("%s failed to send message %d", error_to_string(err), res.success.status_code);
     }
     return err;
 }
@@ -89,45 +127,26 @@ error_code handle_login_request(server_client_t* client, const char* buffer) {
         res.error.status_code = STATUS_BAD_REQUEST;
         sprintf(res.error.message, "Cannot login when already logged in");
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "%s failed to send message %d - %s\n" RESET, error_to_string(err), res.error.status_code, res.error.message);
+            LOG_ERROR("%s failed to send message %d - %s", error_to_string(err), res.error.status_code, res.error.message);
         }
         return err;
     }
 
     LoginRequestMessage req = *(LoginRequestMessage*)(buffer);
   
-    // Check if there is a client that is logged in with current user
-    server_client_t* other = server_find_client_by_username(client->server_state, req.username);
-    if (other == client) {
-        // We already checked if we are logged in and because we are not logged in
-        // our user is currently NULL so this is unreachable
-        UNREACHABLE;
-    }
-
-    if (other != NULL) {
-        res.error.status_code = STATUS_BAD_REQUEST;
-        sprintf(res.error.message, "Cannot login because somebody else is already logged in");
-
-        err = send_message(client->sock_fd, &res, sizeof(res));
-        if (err != ERR_NONE) {
-            fprintf(stderr, RED "%s failed to send message %d - %s\n" RESET, error_to_string(err), res.error.status_code, res.error.message);
-        }
-        return err;
-    }
-
-    
-    server_user_t* user = server_find_user_by_username(client->server_state, req.username);
+    uint32_t user_id;
+    server_user_t* user = server_find_user_by_username(client->server_state, req.username, &user_id);
     if (user == NULL) {
         res.error.status_code = STATUS_NOT_FOUND;
         sprintf(res.error.message, "Failed to find user with username \"%s\"", req.username);
-        fprintf(stderr, RED "ERROR: CLIENT %d: User login failed, %d - %s\n" RESET,
+        LOG_ERROR("CLIENT %d: User login failed, %d - %s",
                 client->sock_fd, res.error.status_code, res.error.message);
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "%s failed to send message %d - %s\n" RESET, error_to_string(err), res.error.status_code, res.error.message);
+            LOG_ERROR("%s failed to send message %d - %s", error_to_string(err), res.error.status_code, res.error.message);
         }
         return err;
     }
@@ -135,28 +154,48 @@ error_code handle_login_request(server_client_t* client, const char* buffer) {
     if (strncmp(req.password, user->password, PASSWORD_MAX_LEN) != 0) {
         res.error.status_code = STATUS_UNAUTHORIZED;
         sprintf(res.error.message, "Invalid password");
-        fprintf(stderr, RED "ERROR: CLIENT %d: User login failed, %d - %s\n" RESET,
+        LOG_ERROR("CLIENT %d: User login failed, %d - %s",
                 client->sock_fd, res.error.status_code, res.error.message);
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "%s failed to send message %d - %s\n" RESET, error_to_string(err), res.error.status_code, res.error.message);
+            LOG_ERROR("%s failed to send message %d - %s", error_to_string(err), res.error.status_code, res.error.message);
+        }
+        return err;
+    }
+
+    // Check and insert are done under the same lock so
+    // two clients can't login with the same user at once
+    err = server_add_session(client->server_state, client, user);
+    if (err != ERR_NONE) {
+        if (err == ERR_USERNAME_EXISTS) {
+            res.error.status_code = STATUS_BAD_REQUEST;
+            sprintf(res.error.message, "Cannot login because somebody else is already logged in");
+        } else {
+            res.error.status_code = STATUS_UNKNOWN_ERROR;
+            sprintf(res.error.message, "Failed to log in");
+        }
+
+        err = server_send_response(client, &res, sizeof(res));
+        if (err != ERR_NONE) {
+            LOG_ERROR("%s failed to send message %d - %s", error_to_string(err), res.error.status_code, res.error.message);
         }
         return err;
     }
 
     client->user = user;
+    client->user_id = user_id;
     generate_random_hex_string(client->api_key, API_KEY_LEN);
     client_set_logged_in(client);
      
-    fprintf(stderr, GREEN "CLIENT %d: User \"%s\" logged in\n" RESET, client->sock_fd, user->username);
+    LOG_INFO("CLIENT %d: User \"%s\" logged in", client->sock_fd, user->username);
     
     res.success.status_code = STATUS_OK;
     strncpy(res.success.api_key, client->api_key, API_KEY_LEN);
 
-    err = send_message(client->sock_fd, &res, sizeof(res));
+    err = server_send_response(client, &res, sizeof(res));
     if (err != ERR_NONE) {
-        fprintf(stderr, RED "%s failed to send message %d\n" RESET, error_to_string(err), res.success.status_code);
+        LOG_ERROR("%s failed to send message %d", error_to_string(err), res.success.status_code);
     }
     return err;
 }
@@ -169,9 +208,9 @@ error_code handle_logout_request(server_client_t* client, const char* buffer) {
         res.error.status_code = STATUS_BAD_REQUEST;
         sprintf(res.error.message, "Cannot logout while not logged in");
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "%s failed to send message %d - %s\n" RESET, error_to_string(err), res.error.status_code, res.error.message);
+            LOG_ERROR("%s failed to send message %d - %s", error_to_string(err), res.error.status_code, res.error.message);
         }
         return err;
     }
@@ -181,24 +220,26 @@ error_code handle_logout_request(server_client_t* client, const char* buffer) {
         res.error.status_code = STATUS_UNAUTHORIZED;
         sprintf(res.error.message, "Invalid api token");
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "%s failed to send message %d - %s\n" RESET, error_to_string(err), res.error.status_code, res.error.message);
+            LOG_ERROR("%s failed to send message %d - %s", error_to_string(err), res.error.status_code, res.error.message);
         }
         return err;
     }
 
-    fprintf(stderr, GREEN "CLIENT %d: User \"%s\" logged out\n" RESET, client->sock_fd,client->user->username);
+    LOG_INFO("CLIENT %d: User \"%s\" logged out", client->sock_fd,client->user->username);
 
+    server_leave_queue(client);
+    server_remove_session(client->server_state, client);
     client->user = NULL;
     client_clear_logged_in(client);
     memset(client->api_key, 0, API_KEY_LEN);
 
     res.success.status_code = STATUS_OK;
 
-    err = send_message(client->sock_fd, &res, sizeof(res));
+    err = server_send_response(client, &res, sizeof(res));
     if (err != ERR_NONE) {
-        fprintf(stderr, RED "%s failed to send message %d\n" RESET, error_to_string(err), res.success.status_code);
+        LOG_ERROR("%s failed to send message %d", error_to_string(err), res.success.status_code);
     }
 
     return err;
@@ -223,9 +264,9 @@ error_code handle_list_users(server_client_t* client, const char* buffer) {
         res.error.status_code = STATUS_UNAUTHORIZED;
         sprintf(res.error.message, "Invalid api token");
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "%s CLIENT %d: failed to send message\n" RESET, error_to_string(err), client->sock_fd);
+            LOG_ERROR("%s CLIENT %d: failed to send message", error_to_string(err), client->sock_fd);
         }
         return err;
     }
@@ -235,78 +276,290 @@ error_code handle_list_users(server_client_t* client, const char* buffer) {
         res.error.status_code = STATUS_UNAUTHORIZED;
         sprintf(res.error.message, "Invalid api token");
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "%s CLIENT %d: failed to send message\n" RESET, error_to_string(err), client->sock_fd);
+            LOG_ERROR("%s CLIENT %d: failed to send message", error_to_string(err), client->sock_fd);
         }
         return err;
     }
 
-    res.success.status_code = STATUS_OK;
-    // We will send len - 1 users back because we are not sending this user
-    // that sent the request
-    res.success.count = 0;
+    server_state_t* state = client->server_state;
 
-    pthread_rwlock_rdlock(&client->server_state->clients_rwlock);
-   
-    // Count clients that are logged in and skip this client
-    for (uint32_t i = 0; i < client->server_state->clients.logical_length; i++) {
-        server_client_t* other= vector_at(&client->server_state->clients, i);
-        if (!client_logged_in(other)) {
-            continue; 
+    // Snapshot doesn't change while it's read, response is built from it without any lock
+    online_players_guard_t guard;
+    const online_snapshot_t* snapshot = online_players_read(&state->online, &guard);
+
+    char* message = malloc(sizeof(ListUsersSuccessResponseMessage) + snapshot->len * sizeof(ListUsersEntry));
+    if (message == NULL) {
+        online_players_read_end(&state->online, &guard);
+        res.error.status_code = STATUS_UNKNOWN_ERROR;
+        sprintf(res.error.message, "Failed to list users");
+
+        err = server_send_response(client, &res, sizeof(res));
+        if (err != ERR_NONE) {
+            LOG_ERROR("%s CLIENT %d: failed to send message", error_to_string(err), client->sock_fd);
         }
+        return err;
+    }
 
-        if (client == other) {
+    ListUsersSuccessResponseMessage* header = (ListUsersSuccessResponseMessage*)message;
+    ListUsersEntry* entries = (ListUsersEntry*)(message + sizeof(ListUsersSuccessResponseMessage));
+    memset(header, 0, sizeof(ListUsersSuccessResponseMessage));
+    header->status_code = STATUS_OK;
+
+    for (uint32_t i = 0; i < snapshot->len; i++) {
+        const online_player_t* player = &snapshot->players[i];
+
+        // Skip the user that sent the request
+        if (player->client_id == client->id) {
             continue;
         }
 
-        res.success.count++;
-    } 
+        ListUsersEntry* entry = &entries[header->count++];
+        entry->looking_for_game = player->looking_for_game;
+        memcpy(entry->username, player->username, USERNAME_MAX_LEN);
+    }
 
-    pthread_rwlock_unlock(&client->server_state->clients_rwlock);
+    online_players_read_end(&state->online, &guard);
 
-    err = send_message(client->sock_fd, &res, sizeof(res));
+    err = server_send_response(client, message,
+                               sizeof(ListUsersSuccessResponseMessage) + header->count * sizeof(ListUsersEntry));
+    free(message);
     if (err != ERR_NONE) {
-        fprintf(stderr, RED "%s CLIENT %d: Failed to send list users count\n" RESET, error_to_string(err), client->sock_fd);
+        LOG_ERROR("%s CLIENT %d: Failed to send list users", error_to_string(err), client->sock_fd);
+    }
+
+    return err;
+}
+
+error_code handle_leaderboard(server_client_t* client, const char* buffer) {
+    error_code err = ERR_NONE;
+    LeaderboardResponseMessage res = { 0 };
+
+    LeaderboardRequestMessage req = *(LeaderboardRequestMessage*)(buffer);
+    if (!client_logged_in(client) || strncmp(req.api_key, client->api_key, API_KEY_LEN) != 0) {
+        res.error.status_code = STATUS_UNAUTHORIZED;
+        sprintf(res.error.message, "Invalid api token");
+
+        err = server_send_response(client, &res, sizeof(res));
+        if (err != ERR_NONE) {
+            LOG_ERROR("%s CLIENT %d: failed to send message", error_to_string(err), client->sock_fd);
+        }
         return err;
     }
 
-    pthread_rwlock_rdlock(&client->server_state->clients_rwlock);
+    uint32_t limit = req.limit == 0 || req.limit > LEADERBOARD_TOP_MAX ? LEADERBOARD_TOP_MAX : req.limit;
+
+    char message[sizeof(LeaderboardSuccessResponseMessage) + LEADERBOARD_TOP_MAX * sizeof(LeaderboardEntry)];
+    LeaderboardSuccessResponseMessage* header = (LeaderboardSuccessResponseMessage*)message;
+    LeaderboardEntry* entries = (LeaderboardEntry*)(message + sizeof(LeaderboardSuccessResponseMessage));
+    memset(message, 0, sizeof(message));
+    header->status_code = STATUS_OK;
+
+    server_state_t* state = client->server_state;
+
+    leaderboard_entry_t top[LEADERBOARD_TOP_MAX];
+    leaderboard_entry_t own = { 0 };
+
+    pthread_rwlock_rdlock(&state->leaderboard_rwlock);
+    header->count = leaderboard_top(&state->leaderboard, top, limit);
+    header->rank = leaderboard_rank(&state->leaderboard, client->user_id, &own);
+    pthread_rwlock_unlock(&state->leaderboard_rwlock);
+
+    header->wins = own.wins;
+    header->losses = own.losses;
+
+    // Usernames and ratings are read from the users, the leaderboard only keeps the ids
+    uint64_t locked_at = shard_lock_read(&state->users_table_lock);
+    header->rating = ((server_user_t*)record_table_at(&state->users, client->user_id))->rating;
+    for (uint32_t i = 0; i < header->count; i++) {
+        const server_user_t* user = record_table_at(&state->users, top[i].user_id);
+        memcpy(entries[i].username, user->username, USERNAME_MAX_LEN);
+        entries[i].wins = top[i].wins;
+        entries[i].losses = top[i].losses;
+        entries[i].rating = user->rating;
+    }
+    shard_lock_unlock(&state->users_table_lock, locked_at);
+
+    err = server_send_response(client, message,
+                               sizeof(LeaderboardSuccessResponseMessage) + header->count * sizeof(LeaderboardEntry));
+    if (err != ERR_NONE) {
+        LOG_ERROR("%s CLIENT %d: Failed to send leaderboard", error_to_string(err), client->sock_fd);
+    }
+
+    return err;
+}
+
+// Ship fields of the board that were hit
+static uint8_t count_hits(const uint8_t* packed) {
+    uint8_t fields[GAME_WIDTH * GAME_HEIGHT];
+    game_results_unpack_board(packed, fields);
+
+    uint8_t hits = 0;
+    for (uint8_t i = 0; i < GAME_WIDTH * GAME_HEIGHT; i++) {
+        hits += fields[i] == GAME_FIELD_HIT;
+    }
+    return hits;
+}
+
+error_code handle_game_history(server_client_t* client, const char* buffer) {
+    error_code err = ERR_NONE;
+    GameHistoryResponseMessage res = { 0 };
 
-    for (uint32_t i = 0; i < client->server_state->clients.logical_length; i++) {
-        server_client_t* other = vector_at(&client->server_state->clients, i);
+    GameHistoryRequestMessage req = *(GameHistoryRequestMessage*)(buffer);
+    if (!client_logged_in(client) || strncmp(req.api_key, client->api_key, API_KEY_LEN) != 0) {
+        res.error.status_code = STATUS_UNAUTHORIZED;
+        sprintf(res.error.message, "Invalid api token");
 
-        // Skip clients that are not logged in
-        if (!client_logged_in(other)) {
-            continue; 
+        err = server_send_response(client, &res, sizeof(res));
+        if (err != ERR_NONE) {
+            LOG_ERROR("%s CLIENT %d: failed to send message", error_to_string(err), client->sock_fd);
         }
+        return err;
+    }
 
-        // Skip user that sent the request
-        if (client == other) {
-            continue;
+    uint32_t limit = req.limit == 0 || req.limit > GAME_HISTORY_PAGE_MAX ? GAME_HISTORY_PAGE_MAX : req.limit;
+
+    char message[sizeof(GameHistorySuccessResponseMessage) + GAME_HISTORY_PAGE_MAX * sizeof(GameHistoryEntry)];
+    GameHistorySuccessResponseMessage* header = (GameHistorySuccessResponseMessage*)message;
+    GameHistoryEntry* entries = (GameHistoryEntry*)(message + sizeof(GameHistorySuccessResponseMessage));
+    memset(message, 0, sizeof(message));
+    header->status_code = STATUS_OK;
+
+    server_state_t* state = client->server_state;
+    uint32_t user_id = client->user_id;
+    uint32_t opponents[GAME_HISTORY_PAGE_MAX];
+
+    pthread_rwlock_rdlock(&state->game_results_rwlock);
+
+    header->games = results_index_games(&state->results_index, user_id);
+
+    // Only linked results are walked, every one of them is also in the results
+    uint32_t links_len = record_table_len(&state->results_index.links);
+
+    // Cursor is the id of the next game plus one, it has to be one of the games of the player
+    uint32_t game_id = results_index_last(&state->results_index, user_id);
+    if (req.cursor != 0) {
+        game_id = RESULTS_INDEX_NONE;
+        if (req.cursor <= links_len && req.cursor <= record_table_len(&state->game_results)) {
+            const game_results_t* result = record_table_at(&state->game_results, req.cursor - 1);
+            if (result->first_player_id == user_id || result->second_player_id == user_id) {
+                game_id = req.cursor - 1;
+            }
         }
+    }
+
+    while (game_id < links_len && header->count < limit) {
+        const game_results_t* result = record_table_at(&state->game_results, game_id);
+        uint8_t first = result->first_player_id == user_id;
+
+        GameHistoryEntry* entry = &entries[header->count];
+        entry->game_id = game_id;
+        entry->won = result->won == (first ? GAME_FIRST_WON : GAME_SECOND_WON);
+        // Board of a player has the shots of the opponent
+        entry->hits = count_hits(first ? result->second_game_state : result->first_game_state);
+        entry->opponent_hits = count_hits(first ? result->first_game_state : result->second_game_state);
+        opponents[header->count] = first ? result->second_player_id : result->first_player_id;
+        header->count++;
 
-        uint8_t looking_for_game = 0;
-        if (client_looking_for_game(other)) {
-            looking_for_game = 1;
+        game_id = results_index_prev(&state->results_index, &state->game_results, user_id, game_id);
+    }
+
+    header->next_cursor = game_id < links_len ? game_id + 1 : 0;
+
+    pthread_rwlock_unlock(&state->game_results_rwlock);
+
+    uint64_t locked_at = shard_lock_read(&state->users_table_lock);
+    uint32_t users_len = record_table_len(&state->users);
+    for (uint32_t i = 0; i < header->count; i++) {
+        if (opponents[i] < users_len) {
+            const server_user_t* opponent = record_table_at(&state->users, opponents[i]);
+            memcpy(entries[i].opponent, opponent->username, USERNAME_MAX_LEN);
         }
+    }
+    shard_lock_unlock(&state->users_table_lock, locked_at);
+
+    err = server_send_response(client, message,
+                               sizeof(GameHistorySuccessResponseMessage) + header->count * sizeof(GameHistoryEntry));
+    if (err != ERR_NONE) {
+        LOG_ERROR("%s CLIENT %d: Failed to send game history", error_to_string(err), client->sock_fd);
+    }
+
+    return err;
+}
 
-        err = send_message(client->sock_fd, &looking_for_game, sizeof(looking_for_game));
+error_code handle_list_users_page(server_client_t* client, const char* buffer) {
+    error_code err = ERR_NONE;
+    ListUsersPageResponseMessage res = { 0 };
+
+    ListUsersPageRequestMessage req = *(ListUsersPageRequestMessage*)(buffer);
+    if (!client_logged_in(client) || strncmp(req.api_key, client->api_key, API_KEY_LEN) != 0) {
+        res.error.status_code = STATUS_UNAUTHORIZED;
+        sprintf(res.error.message, "Invalid api token");
+
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "%s CLIENT %d: Failed to send looking for game byte\n" RESET, error_to_string(err), client->sock_fd);
+            LOG_ERROR("%s CLIENT %d: failed to send message", error_to_string(err), client->sock_fd);
+        }
+        return err;
+    }
+
+    uint32_t limit = req.limit == 0 || req.limit > LIST_USERS_PAGE_MAX ? LIST_USERS_PAGE_MAX : req.limit;
+    uint32_t prefix_len = strnlen(req.prefix, USERNAME_MAX_LEN);
+
+    char message[sizeof(ListUsersPageSuccessResponseMessage) + LIST_USERS_PAGE_MAX * sizeof(ListUsersEntry)];
+    ListUsersPageSuccessResponseMessage* header = (ListUsersPageSuccessResponseMessage*)message;
+    ListUsersEntry* entries = (ListUsersEntry*)(message + sizeof(ListUsersPageSuccessResponseMessage));
+    memset(header, 0, sizeof(ListUsersPageSuccessResponseMessage));
+    header->status_code = STATUS_OK;
+
+    server_state_t* state = client->server_state;
+
+    online_players_guard_t guard;
+    const online_snapshot_t* snapshot = online_players_read(&state->online, &guard);
+
+    // Page starts after the cursor but never before the first username with the prefix
+    uint32_t i = req.cursor[0] != '\0' ? online_snapshot_seek(snapshot, req.cursor, 1) : 0;
+    if (prefix_len > 0 && i < snapshot->len && strncmp(snapshot->players[i].username, req.prefix, USERNAME_MAX_LEN) < 0) {
+        i = online_snapshot_seek(snapshot, req.prefix, 0);
+    }
+
+    for (; i < snapshot->len; i++) {
+        const online_player_t* player = &snapshot->players[i];
+
+        // Usernames with the prefix are next to each other, after the first one that doesn't match there are no more
+        if (strncmp(player->username, req.prefix, prefix_len) != 0) {
             break;
         }
 
-        err = send_message(client->sock_fd, other->user->username, USERNAME_MAX_LEN);
-        if (err != ERR_NONE) {
-            fprintf(stderr, RED "%s CLIENT %d: Failed to send username\n" RESET, error_to_string(err), client->sock_fd);
+        if (player->client_id == client->id) {
+            continue;
+        }
+
+        if ((req.filters & LIST_USERS_FILTER_LOOKING_FOR_GAME) && !player->looking_for_game) {
+            continue;
+        }
+
+        // Page is full and there is at least one more matching user
+        if (header->count == limit) {
+            header->more = 1;
             break;
         }
+
+        ListUsersEntry* entry = &entries[header->count++];
+        entry->looking_for_game = player->looking_for_game;
+        memcpy(entry->username, player->username, USERNAME_MAX_LEN);
     }
 
-    pthread_rwlock_unlock(&client->server_state->clients_rwlock);
+    online_players_read_end(&state->online, &guard);
 
-    return ERR_NONE;
+    err = server_send_response(client, message,
+                               sizeof(ListUsersPageSuccessResponseMessage) + header->count * sizeof(ListUsersEntry));
+    if (err != ERR_NONE) {
+        LOG_ERROR("%s CLIENT %d: Failed to send list users page", error_to_string(err), client->sock_fd);
+    }
+
+    return err;
 }
 
 error_code handle_look_for_game(server_client_t* client, const char* buffer) {
@@ -317,9 +570,9 @@ error_code handle_look_for_game(server_client_t* client, const char* buffer) {
         res.error.status_code = STATUS_UNAUTHORIZED;
         sprintf(res.error.message, "Invalid api token");
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "%s CLIENT %d: Failed to send message\n" RESET, error_to_string(err), client->sock_fd);
+            LOG_ERROR("%s CLIENT %d: Failed to send message", error_to_string(err), client->sock_fd);
         }
         return err;
     }
@@ -329,20 +582,20 @@ error_code handle_look_for_game(server_client_t* client, const char* buffer) {
         res.error.status_code = STATUS_UNAUTHORIZED;
         sprintf(res.error.message, "Invalid api token");
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "%s CLIENT %d: Failed to send message\n" RESET, error_to_string(err), client->sock_fd);
+            LOG_ERROR("%s CLIENT %d: Failed to send message", error_to_string(err), client->sock_fd);
         }
         return err;
     }
 
-    client_set_looking_for_game(client);
+    server_set_looking_for_game(client->server_state, client, 1);
 
     res.success.status_code = STATUS_OK;
 
-    err = send_message(client->sock_fd, &res, sizeof(res));
+    err = server_send_response(client, &res, sizeof(res));
     if (err != ERR_NONE) {
-        fprintf(stderr, RED "%s CLIENT %d: Failed to send message\n" RESET, error_to_string(err), client->sock_fd);
+        LOG_ERROR("%s CLIENT %d: Failed to send message", error_to_string(err), client->sock_fd);
         return err;
     }
 
@@ -357,9 +610,9 @@ error_code handle_cancel_look_for_game(server_client_t* client, const char* buff
         res.error.status_code = STATUS_UNAUTHORIZED;
         sprintf(res.error.message, "Client is not logged in");
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "%s CLIENT %d: Failed to send message\n" RESET, error_to_string(err), client->sock_fd);
+            LOG_ERROR("%s CLIENT %d: Failed to send message", error_to_string(err), client->sock_fd);
         }
         return err;
     }
@@ -369,26 +622,105 @@ error_code handle_cancel_look_for_game(server_client_t* client, const char* buff
         res.error.status_code = STATUS_UNAUTHORIZED;
         sprintf(res.error.message, "Invalid api token");
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "%s CLIENT %d: Failed to send message\n" RESET, error_to_string(err), client->sock_fd);
+            LOG_ERROR("%s CLIENT %d: Failed to send message", error_to_string(err), client->sock_fd);
         }
         return err;
     }
 
-    client_clear_looking_for_game(client);
+    server_set_looking_for_game(client->server_state, client, 0);
 
     res.success.status_code = STATUS_OK;
 
-    err = send_message(client->sock_fd, &res, sizeof(res));
+    err = server_send_response(client, &res, sizeof(res));
     if (err != ERR_NONE) {
-        fprintf(stderr, RED "%s CLIENT %d: Failed to send message\n" RESET, error_to_string(err), client->sock_fd);
+        LOG_ERROR("%s CLIENT %d: Failed to send message", error_to_string(err), client->sock_fd);
         return err;
     }
 
     return ERR_NONE;
 }
 
+error_code handle_join_queue(server_client_t* client, const char* buffer) {
+    error_code err = ERR_NONE;
+    JoinQueueResponseMessage res = { 0 };
+
+    JoinQueueRequestMessage req = *(JoinQueueRequestMessage*)(buffer);
+    if (!client_logged_in(client) || strncmp(req.api_key, client->api_key, API_KEY_LEN) != 0) {
+        res.error.status_code = STATUS_UNAUTHORIZED;
+        sprintf(res.error.message, "Invalid api token");
+
+        err = server_send_response(client, &res, sizeof(res));
+        if (err != ERR_NONE) {
+            LOG_ERROR("%s CLIENT %d: Failed to send message", error_to_string(err), client->sock_fd);
+        }
+        return err;
+    }
+
+    if (client_playing_game(client)) {
+        res.error.status_code = STATUS_BAD_REQUEST;
+        sprintf(res.error.message, "Cannot join the queue while playing a game");
+
+        err = server_send_response(client, &res, sizeof(res));
+        if (err != ERR_NONE) {
+            LOG_ERROR("%s CLIENT %d: Failed to send message", error_to_string(err), client->sock_fd);
+        }
+        return err;
+    }
+
+    err = server_join_queue(client->server_state, client);
+    if (err == ERR_IARG) {
+        res.error.status_code = STATUS_BAD_REQUEST;
+        sprintf(res.error.message, "Already in the queue");
+    } else if (err != ERR_NONE) {
+        LOG_ERROR("%s CLIENT %d: Failed to join the queue", error_to_string(err), client->sock_fd);
+        res.error.status_code = STATUS_UNKNOWN_ERROR;
+        sprintf(res.error.message, "Matchmaking queue is full");
+    } else {
+        res.success.status_code = STATUS_OK;
+    }
+
+    // Match found can be sent before this response, clients expect both in any order
+    err = server_send_response(client, &res, sizeof(res));
+    if (err != ERR_NONE) {
+        LOG_ERROR("%s CLIENT %d: Failed to send message", error_to_string(err), client->sock_fd);
+    }
+
+    return err;
+}
+
+error_code handle_leave_queue(server_client_t* client, const char* buffer) {
+    error_code err = ERR_NONE;
+    LeaveQueueResponseMessage res = { 0 };
+
+    LeaveQueueRequestMessage req = *(LeaveQueueRequestMessage*)(buffer);
+    if (!client_logged_in(client) || strncmp(req.api_key, client->api_key, API_KEY_LEN) != 0) {
+        res.error.status_code = STATUS_UNAUTHORIZED;
+        sprintf(res.error.message, "Invalid api token");
+
+        err = server_send_response(client, &res, sizeof(res));
+        if (err != ERR_NONE) {
+            LOG_ERROR("%s CLIENT %d: Failed to send message", error_to_string(err), client->sock_fd);
+        }
+        return err;
+    }
+
+    if (server_leave_queue(client)) {
+        res.success.status_code = STATUS_OK;
+    } else {
+        res.error.status_code = STATUS_NOT_FOUND;
+        sprintf(res.error.message, "Not in the queue");
+    }
+
+    err = server_send_response(client, &res, sizeof(res));
+    if (err != ERR_NONE) {
+        LOG_ERROR("%s CLIENT %d: Failed to send message", error_to_string(err), client->sock_fd);
+    }
+
+    return err;
+}
+
 error_code handle_challenge_player(server_client_t* client, const char* buffer) {
     error_code err = ERR_NONE;
     ChallengePlayerResponseMessage res = { 0 };
@@ -397,9 +729,9 @@ error_code handle_challenge_player(server_client_t* client, const char* buffer)
         res.error.status_code = STATUS_UNAUTHORIZED;
         sprintf(res.error.message, "Invalid api token");
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send list users count\n" RESET, client->sock_fd);
+            LOG_ERROR("CLIENT %d: Failed to send list users count", client->sock_fd);
         }
         return err;
     }
@@ -409,15 +741,25 @@ error_code handle_challenge_player(server_client_t* client, const char* buffer)
         res.error.status_code = STATUS_UNAUTHORIZED;
         sprintf(res.error.message, "Invalid api token");
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send list users count\n" RESET, client->sock_fd);
+            LOG_ERROR("CLIENT %d: Failed to send list users count", client->sock_fd);
         }
 
         return err;
     }
 
-    
+    // Matcher can pair a queued client at any time and would replace the challenge's game
+    if (client_in_queue(client)) {
+        res.error.status_code = STATUS_BAD_REQUEST;
+        sprintf(res.error.message, "Cannot challenge players while in the matchmaking queue");
+        err = server_send_response(client, &res, sizeof(res));
+        if (err != ERR_NONE) {
+            LOG_ERROR("%s CLIENT %d: Failed to send message %d", error_to_string(err), client->sock_fd, res.error.status_code);
+        }
+        return err;
+    }
+
     // Go through all connected clients and check if one of them matches the requested one and its looking for game
     server_client_t* other = server_find_client_by_username(client->server_state, req.target_username);
     if (client == other) {
@@ -429,9 +771,9 @@ error_code handle_challenge_player(server_client_t* client, const char* buffer)
     if (other == NULL) {
         res.error.status_code = STATUS_NOT_FOUND;
         sprintf(res.error.message, "Player \"%s\" doesn't exist", req.target_username);
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "%s CLIENT %d: Failed to send message %d\n" RESET, error_to_string(err), client->sock_fd, res.success.status_code);
+            LOG_ERROR("%s CLIENT %d: Failed to send message %d", error_to_string(err), client->sock_fd, res.success.status_code);
         }
         return err;
     }
@@ -439,9 +781,9 @@ error_code handle_challenge_player(server_client_t* client, const char* buffer)
     if (!client_logged_in(other)) {
         res.error.status_code = STATUS_PLAYER_IS_NOT_CONNECTED;
         sprintf(res.error.message, "Player \"%s\" is not connected", other->user->username);
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "%s CLIENT %d: Failed to send message %d\n" RESET, error_to_string(err), client->sock_fd, res.success.status_code);
+            LOG_ERROR("%s CLIENT %d: Failed to send message %d", error_to_string(err), client->sock_fd, res.success.status_code);
         }
         return err;
     }
@@ -449,42 +791,88 @@ error_code handle_challenge_player(server_client_t* client, const char* buffer)
     if (!client_looking_for_game(other)){
         res.error.status_code = STATUS_PLAYER_IS_NOT_LOOKING_FOR_GAME;
         sprintf(res.error.message, "Player \"%s\" is not looking a for game", other->user->username);
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "%s CLIENT %d: Failed to send message %d\n" RESET, error_to_string(err), client->sock_fd, res.success.status_code);
+            LOG_ERROR("%s CLIENT %d: Failed to send message %d", error_to_string(err), client->sock_fd, res.success.status_code);
         }
         return err;
     }
 
+    if (client_in_queue(other)) {
+        res.error.status_code = STATUS_PLAYER_IS_NOT_LOOKING_FOR_GAME;
+        sprintf(res.error.message, "Player \"%s\" is waiting in the matchmaking queue", other->user->username);
+        err = server_send_response(client, &res, sizeof(res));
+        if (err != ERR_NONE) {
+            LOG_ERROR("%s CLIENT %d: Failed to send message %d", error_to_string(err), client->sock_fd, res.error.status_code);
+        }
+        return err;
+    }
 
-    fprintf(stdout, "CLIENT %d: Asking other player does he want to play\n", client->sock_fd);
 
-    // Ask other player does he want to play
-    err = handle_ask_other_player(client, other);
-    if (err != ERR_NONE) {
-        res.error.status_code = STATUS_PLAYER_ERROR;
-        sprintf(res.error.message, "Player \"%s\" failed to respond successfully", other->user->username);
-        err = send_message(client->sock_fd, &res, sizeof(res));
+    // Game has to exist before the question is sent, other player's answer
+    // can be handled before this handler continues after the send
+    server_game_t* game = server_add_game(client->server_state, game_new(client, other));
+    if (game == NULL) {
+        res.error.status_code = STATUS_UNKNOWN_ERROR;
+        sprintf(res.error.message, "Failed to create the game");
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "%s CLIENT %d: Failed to send message %d\n" RESET, error_to_string(err), client->sock_fd, res.success.status_code);
+            LOG_ERROR("%s CLIENT %d: Failed to send message %d", error_to_string(err), client->sock_fd, res.error.status_code);
         }
         return err;
     }
 
-    // Send the message to the other player. When he responds we will get that requets in 
-    // handle_client function and should process it there because its only valid if we 
-    // read messages from one place to avoid race conditions.
-    //
-    // To achieve this, create new game with id and add both clients there
+    // Other player can join the queue and be matched, or be challenged by someone else, at any
+    // time. Whoever claims it first gets it, closing the game ends the claims it already has.
+    if (!client_claim_game(client, game)) {
+        server_close_game(client->server_state, game);
+
+        res.error.status_code = STATUS_BAD_REQUEST;
+        sprintf(res.error.message, "Cannot challenge players while playing a game");
+        err = server_send_response(client, &res, sizeof(res));
+        if (err != ERR_NONE) {
+            LOG_ERROR("%s CLIENT %d: Failed to send message %d", error_to_string(err), client->sock_fd, res.error.status_code);
+        }
+        return err;
+    }
+    if (!client_claim_game(other, game)) {
+        server_close_game(client->server_state, game);
+
+        res.error.status_code = STATUS_PLAYER_IS_NOT_LOOKING_FOR_GAME;
+        sprintf(res.error.message, "Player \"%s\" is already playing a game", other->user->username);
+        err = server_send_response(client, &res, sizeof(res));
+        if (err != ERR_NONE) {
+            LOG_ERROR("%s CLIENT %d: Failed to send message %d", error_to_string(err), client->sock_fd, res.error.status_code);
+        }
+        return err;
+    }
 
-    server_game_t* game = server_add_game(client->server_state, game_new(client, other));
-    
     client_join_game(client, game);
     client_join_game(other, game);
 
     // Client that started the challenge automatically acceptes the game
     game_accept(game, client);
 
+    LOG_DEBUG("CLIENT %d: Asking other player does he want to play", client->sock_fd);
+
+    // Ask other player does he want to play. When he responds we will get that request in
+    // handle_client function and process it there because its only valid if we
+    // read messages from one place to avoid race conditions.
+    err = handle_ask_other_player(client, other);
+    if (err != ERR_NONE) {
+        client->game = NULL;
+        other->game = NULL;
+        server_close_game(client->server_state, game);
+
+        res.error.status_code = STATUS_PLAYER_ERROR;
+        sprintf(res.error.message, "Player \"%s\" failed to respond successfully", other->user->username);
+        err = server_send_response(client, &res, sizeof(res));
+        if (err != ERR_NONE) {
+            LOG_ERROR("%s CLIENT %d: Failed to send message %d", error_to_string(err), client->sock_fd, res.success.status_code);
+        }
+        return err;
+    }
+
     return ERR_NONE;
 }
 
@@ -493,9 +881,9 @@ static error_code handle_ask_other_player(server_client_t* client, server_client
     req.type = MSG_CHALLENGE_QUESTION;
     strncpy(req.challenger_username, client->user->username, USERNAME_MAX_LEN);
 
-    error_code err = send_message(other->sock_fd, &req, sizeof(req));
+    error_code err = server_send_message(other, &req, sizeof(req));
     if (err != ERR_NONE) {
-        fprintf(stderr, RED "%s failed to send accept challenge request\n" RESET, error_to_string(err));
+        LOG_ERROR("%s failed to send accept challenge request", error_to_string(err));
         return err;
     }
 
@@ -510,9 +898,9 @@ error_code handle_challenge_answer(server_client_t* client, const char* buffer)
         res.error.status_code = STATUS_UNAUTHORIZED;
         sprintf(res.error.message, "Invalid api token");
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send list users count\n" RESET, client->sock_fd);
+            LOG_ERROR("CLIENT %d: Failed to send list users count", client->sock_fd);
         }
         return err;
     }
@@ -522,9 +910,9 @@ error_code handle_challenge_answer(server_client_t* client, const char* buffer)
         res.error.status_code = STATUS_UNAUTHORIZED;
         sprintf(res.error.message, "Invalid api token");
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send list users count\n" RESET, client->sock_fd);
+            LOG_ERROR("CLIENT %d: Failed to send list users count", client->sock_fd);
         }
 
         return err;
@@ -539,15 +927,15 @@ error_code handle_challenge_answer(server_client_t* client, const char* buffer)
     
         game_accept(game, client);
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "%s CLIENT %d: failed to send message\n" RESET, error_to_string(err), client->sock_fd);
+            LOG_ERROR("%s CLIENT %d: failed to send message", error_to_string(err), client->sock_fd);
             return err;
         }
 
-        err = send_message(other->sock_fd, &res, sizeof(res));
+        err = server_send_response(other, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "%s CLIENT %d: failed to send message\n" RESET, error_to_string(err), other->sock_fd);
+            LOG_ERROR("%s CLIENT %d: failed to send message", error_to_string(err), other->sock_fd);
             return err;
         }
 
@@ -557,9 +945,9 @@ error_code handle_challenge_answer(server_client_t* client, const char* buffer)
     res.error.status_code = STATUS_PLAYER_DECLINED;
     sprintf(res.error.message, "Player \"%s\" declined the challenge", client->user->username);
 
-    err = send_message(other->sock_fd, &res, sizeof(res));
+    err = server_send_response(other, &res, sizeof(res));
     if (err != ERR_NONE) {
-        fprintf(stderr, RED "%s CLIENT %d: failed to send message\n" RESET, error_to_string(err), other->sock_fd);
+        LOG_ERROR("%s CLIENT %d: failed to send message", error_to_string(err), other->sock_fd);
         return err;
     }
 
@@ -579,9 +967,9 @@ error_code handle_game_start(server_client_t* client, const char* buffer) {
         res.error.status_code = STATUS_UNAUTHORIZED;
         sprintf(res.error.message, "Invalid api token");
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send unauthorized response\n" RESET, client->sock_fd);
+            LOG_ERROR("CLIENT %d: Failed to send unauthorized response", client->sock_fd);
         }
         return err;
     }
@@ -591,9 +979,9 @@ error_code handle_game_start(server_client_t* client, const char* buffer) {
         res.error.status_code = STATUS_UNAUTHORIZED;
         sprintf(res.error.message, "Invalid api token");
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send unauthorized response\n" RESET, client->sock_fd);
+            LOG_ERROR("CLIENT %d: Failed to send unauthorized response", client->sock_fd);
         }
 
         return err;
@@ -603,9 +991,9 @@ error_code handle_game_start(server_client_t* client, const char* buffer) {
         res.error.status_code = STATUS_GAME_NOT_STARTED;
         sprintf(res.error.message, "Game hasn't started yet");
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send game not started response\n" RESET, client->sock_fd);
+            LOG_ERROR("CLIENT %d: Failed to send game not started response", client->sock_fd);
         }
 
         return err;
@@ -615,9 +1003,9 @@ error_code handle_game_start(server_client_t* client, const char* buffer) {
         res.error.status_code = STATUS_GAME_ABANDONED;
         sprintf(res.error.message, "Other player closed the connection so the game is abandoned");
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send game not started response\n" RESET, client->sock_fd);
+            LOG_ERROR("CLIENT %d: Failed to send game not started response", client->sock_fd);
         }
 
         return err;
@@ -627,9 +1015,26 @@ error_code handle_game_start(server_client_t* client, const char* buffer) {
         res.error.status_code = STATUS_GAME_NOT_STARTED;
         sprintf(res.error.message, "Game isn't accepted by both players");
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send game not started response\n" RESET, client->sock_fd);
+            LOG_ERROR("CLIENT %d: Failed to send game not started response", client->sock_fd);
+        }
+
+        return err;
+    }
+
+    // Board comes from the client so it has to be checked the same
+    // way the client checks it while the ships are placed
+    game_board_t board = game_board_from_fields(req.game_state);
+    err = board.hits | board.misses ? ERR_FLEET_INVALID : game_ship_validate_fleet(board.ships);
+    if (err != ERR_NONE) {
+        res.error.status_code = STATUS_GAME_INVALID_FLEET;
+        sprintf(res.error.message, "Invalid ship placement");
+        LOG_ERROR("CLIENT %d: GAME %d: %s", client->sock_fd, client->game->id, error_to_string(err));
+
+        err = server_send_response(client, &res, sizeof(res));
+        if (err != ERR_NONE) {
+            LOG_ERROR("CLIENT %d: Failed to send invalid fleet response", client->sock_fd);
         }
 
         return err;
@@ -637,14 +1042,14 @@ error_code handle_game_start(server_client_t* client, const char* buffer) {
 
     // If the game is running and both players accepted the game
     // read the clients data and update the his game state
-    game_set_clients_game_state(client->game, client, req.game_state);
+    game_set_clients_game_state(client->game, client, board);
     
-    fprintf(stdout, GREEN "CLIENT %d: GAME %d: Successfully set the game state\n" RESET, client->sock_fd, client->game->id);
+    LOG_INFO("CLIENT %d: GAME %d: Successfully set the game state", client->sock_fd, client->game->id);
 
     // If this was the second player setting his game state 
     // the game has started.
     if (game_started(client->game)) {
-        fprintf(stdout, GREEN "GAME %d: Game has started\n" RESET, client->game->id);
+        LOG_INFO("GAME %d: Game has started", client->game->id);
 
         // send response to both clients that game has started
         server_client_t* other = game_other_player(client->game, client);
@@ -654,9 +1059,9 @@ error_code handle_game_start(server_client_t* client, const char* buffer) {
         uint8_t my_turn = game_set_inital_turn(client->game, client);
         res.success.first_turn = my_turn;
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send game started response\n" RESET, client->sock_fd);
+            LOG_ERROR("CLIENT %d: Failed to send game started response", client->sock_fd);
         }
 
         if (my_turn == 1) {
@@ -665,9 +1070,9 @@ error_code handle_game_start(server_client_t* client, const char* buffer) {
             res.success.first_turn = 1;
         }
 
-        err = send_message(other->sock_fd, &res, sizeof(res));
+        err = server_send_response(other, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send game started response\n" RESET, other->sock_fd);
+            LOG_ERROR("CLIENT %d: Failed to send game started response", other->sock_fd);
         }
 
         return err;
@@ -684,9 +1089,9 @@ error_code handle_players_shot(server_client_t* client, const char* buffer) {
         res.error.status_code = STATUS_UNAUTHORIZED;
         sprintf(res.error.message, "Invalid api token");
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send unauthorized response\n" RESET, client->sock_fd);
+            LOG_ERROR("CLIENT %d: Failed to send unauthorized response", client->sock_fd);
         }
         return err;
     }
@@ -696,9 +1101,9 @@ error_code handle_players_shot(server_client_t* client, const char* buffer) {
         res.error.status_code = STATUS_UNAUTHORIZED;
         sprintf(res.error.message, "Invalid api token");
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send unauthorized response\n" RESET, client->sock_fd);
+            LOG_ERROR("CLIENT %d: Failed to send unauthorized response", client->sock_fd);
         }
 
         return err;
@@ -708,9 +1113,9 @@ error_code handle_players_shot(server_client_t* client, const char* buffer) {
         res.error.status_code = STATUS_GAME_NOT_STARTED;
         sprintf(res.error.message, "Game hasn't started yet");
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send game not started response\n" RESET, client->sock_fd);
+            LOG_ERROR("CLIENT %d: Failed to send game not started response", client->sock_fd);
         }
 
         return err;
@@ -720,132 +1125,329 @@ error_code handle_players_shot(server_client_t* client, const char* buffer) {
         res.error.status_code = STATUS_GAME_ABANDONED;
         sprintf(res.error.message, "Other player closed the connection so the game is abandoned");
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send game not started response\n" RESET, client->sock_fd);
+            LOG_ERROR("CLIENT %d: Failed to send game not started response", client->sock_fd);
         }
 
         return err;
     }
 
-    if (!game_started(client->game)) {
-        res.error.status_code = STATUS_GAME_NOT_STARTED;
-        sprintf(res.error.message, "Game hasn't started yet");
+    // Turn, shot, win and the next turn are decided together under the game lock
+    game_shot_t shot = game_apply_shot(client->game, client, req.target);
+    LOG_DEBUG("CLIENT %d: shot status %d | Turn %d", client->sock_fd, shot.status_code, shot.turn);
+
+    if (shot.status_code != STATUS_OK) {
+        res.error.status_code = shot.status_code;
+        switch (shot.status_code) {
+            case STATUS_GAME_NOT_STARTED:
+                sprintf(res.error.message, "Game hasn't started yet");
+                break;
+            case STATUS_GAME_NOT_MY_TURN:
+                sprintf(res.error.message, "It's not my turn to play");
+                break;
+            case STATUS_SHOT_INVALID_FIELD:
+                sprintf(res.error.message, "Invalid target field");
+                break;
+            case STATUS_SHOT_ALREADY_DESTROYED:
+                sprintf(res.error.message, "Shot at already destroyed field");
+                break;
+            default:
+                UNREACHABLE;
+        }
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send game not started response\n" RESET, client->sock_fd);
+            LOG_ERROR("CLIENT %d: Failed to send rejected shot response %d", client->sock_fd, shot.status_code);
         }
 
         return err;
     }
 
+    uint8_t hit = shot.hit;
+    uint8_t game_won = shot.won;
+    if (game_won) {
+        game_results_t res = game_create_result(client->game);
+        server_add_game_result(client->server_state, res);
+    }
 
-    fprintf(stdout, "CLIENT %d: my turn? %d | Turn %d\n", client->sock_fd, game_is_my_turn(client->game, client), client->game->turn);
-    server_client_t* other = game_other_player(client->game, client);
+    res.success.status_code = STATUS_OK;
+    res.success.hit = hit;
+    res.success.win = game_won;
 
-    fprintf(stdout, "OTHER %d: my turn? %d | Turn %d\n", other->sock_fd, game_is_my_turn(client->game, other), client->game->turn);
+    err = server_send_response(client, &res, sizeof(res));
+    if (err != ERR_NONE) {
+        LOG_ERROR("CLIENT %d: Failed to send player shot response", client->sock_fd);
+    }
 
+    server_client_t* other = shot.other;
 
-    if (!game_is_my_turn(client->game, client)) {
-        res.error.status_code = STATUS_GAME_NOT_MY_TURN;
-        sprintf(res.error.message, "It's not my turn to play");
+    RegisterShotRequestMessage register_shot;
+    register_shot.type = MSG_REGISTER_SHOT;
+    register_shot.hit = hit;
+    register_shot.target = req.target;
+    // other player won the game == we lost
+    register_shot.lose = game_won;
+   
+    err = server_send_message(other, &register_shot, sizeof(register_shot));
+    if (err != ERR_NONE) {
+        LOG_ERROR("CLIENT %d: Failed to send register shot request", other->sock_fd);
+    }
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
+    
+    return ERR_NONE;
+}
+
+error_code handle_stats(server_client_t* client, const char* buffer) {
+    error_code err = ERR_NONE;
+    StatsResponseMessage res = { 0 };
+
+    if (!client_logged_in(client)) {
+        res.error.status_code = STATUS_UNAUTHORIZED;
+        sprintf(res.error.message, "Invalid api token");
+
+        err = server_send_response(client, &res, sizeof(res));
         if (err != ERR_NONE) {
-            fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send not my turn response\n" RESET, client->sock_fd);
+            LOG_ERROR("CLIENT %d: Failed to send unauthorized response", client->sock_fd);
         }
-
         return err;
     }
 
+    StatsRequestMessage req = *(StatsRequestMessage*)(buffer);
+    if (strncmp(req.api_key, client->api_key, API_KEY_LEN) != 0) {
+        res.error.status_code = STATUS_UNAUTHORIZED;
+        sprintf(res.error.message, "Invalid api token");
+
+        err = server_send_response(client, &res, sizeof(res));
+        if (err != ERR_NONE) {
+            LOG_ERROR("CLIENT %d: Failed to send unauthorized response", client->sock_fd);
+        }
+        return err;
+    }
 
-    // Failed to process shot because target was invalid
-    uint8_t error = 0;
-    // If the field was empty or a ship then its a valid shot
-    uint8_t valid = 0;
-    // If the field was a ship that player can play again
-    uint8_t hit = 0; 
-    uint8_t field = game_register_shot(client->game, client, req.target);
-    switch (field) {
-        case GAME_FIELD_INVALID:
-            error = 1;
-            break;
-        case GAME_FIELD_SHIP:
-            valid = 1;
-            hit = 1;
-            break;
-        case GAME_FIELD_EMPTY:
-            valid = 1;
-            break;
-        case GAME_FIELD_MISS:
-            break;
-        case GAME_FIELD_HIT:
-            break;
-        default:
-            UNREACHABLE;
+    err = server_stats_collect(&client->server_state->stats, &res.success);
+    if (err != ERR_NONE) {
+        memset(&res, 0, sizeof(res));
+        res.error.status_code = STATUS_UNKNOWN_ERROR;
+        sprintf(res.error.message, "Failed to collect stats");
     }
 
-    if (error) {
-        res.error.status_code = STATUS_SHOT_INVALID_FIELD;
-        sprintf(res.error.message, "Invalid target field");
+    err = server_send_response(client, &res, sizeof(res));
+    if (err != ERR_NONE) {
+        LOG_ERROR("CLIENT %d: Failed to send stats response", client->sock_fd);
+    }
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
-        if (err != ERR_NONE) {
-            fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send shot at invalid field response\n" RESET, client->sock_fd);
-        }
+    return err;
+}
 
-        return err;
+void handle_client_message(void* params, const char* message, uint32_t len) {
+    server_client_t* client = params;
+    if (atomic_load(&client->closing)) {
+        // Nothing more can be sent to the client, it's disconnected once the reads end
+        return;
     }
 
-    if (!valid) {
-        res.error.status_code = STATUS_SHOT_ALREADY_DESTROYED;
-        sprintf(res.error.message, "Shot at already destroyed field");
+    // Handlers read the whole request struct so copy the message
+    // into a zeroed buffer in case the client sent a shorter message
+    char buffer[IN_BUFFER_SIZE] = { 0 };
+    memcpy(buffer, message, len);
+
+    // Handler time is recorded for every message type, responses
+    // to other clients and failed sends included
+    uint64_t started_at = server_stats_now_ns();
+
+    // Parse message type
+    uint8_t message_type = *((uint8_t*)(buffer));
+    switch (message_type) {
+        case MSG_SIGNUP: {
+            LOG_DEBUG("CLIENT %d: Received signup request", client->sock_fd);
+            error_code err = handle_signup_request(client, buffer);
+            if (err != ERR_NONE) {
+                LOG_ERROR("CLIENT %d: Failed to send signup response, %d - %s",
+                        client->sock_fd, err, error_to_string(err));
+            }
 
-        err = send_message(client->sock_fd, &res, sizeof(res));
-        if (err != ERR_NONE) {
-            fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send shot ate destroyed field response\n" RESET, client->sock_fd);
+            break;
         }
 
-        return err;
-    }
+        case MSG_LOGIN: {
+            LOG_DEBUG("CLIENT %d: Received login request", client->sock_fd);
+            error_code err = handle_login_request(client, buffer);
+            if (err != ERR_NONE) {
+                LOG_ERROR("CLIENT %d: Failed to send login response, %d - %s",
+                        client->sock_fd, err, error_to_string(err));
+            }
 
-    // It's not possible for my opponent to win the game on my turn
-    // that's why game_won can be 0 or a 1
-    uint8_t game_won = game_check_win(client->game, client);
-    if (game_won) {
-        game_finish(client->game, client);
-        game_results_t res = game_create_result(client->game);
-        server_add_game_result(client->server_state, res);
-    } else {
-        if (!hit) {
-            game_next_turn(client->game, client);
+            break;
         }
-    }
+        case MSG_LOGOUT: {
+            LOG_DEBUG("CLIENT %d: Received logout request", client->sock_fd);
+            error_code err = handle_logout_request(client, buffer);
+            if (err != ERR_NONE) {
+                LOG_ERROR("CLIENT %d: Failed to send login response, %d - %s",
+                        client->sock_fd, err, error_to_string(err));
+            }
 
-    res.success.status_code = STATUS_OK;
-    res.success.hit = hit;
-    res.success.win = game_won;
+            break;
+        }
+        case MSG_LIST_USERS: {
+            LOG_DEBUG("CLIENT %d: Received list users request", client->sock_fd);
+            error_code err = handle_list_users(client, buffer);
+            if (err != ERR_NONE) {
+                LOG_ERROR("CLIENT %d: Failed to send list users response, %d - %s",
+                        client->sock_fd, err, error_to_string(err));
+            }
 
-    err = send_message(client->sock_fd, &res, sizeof(res));
-    if (err != ERR_NONE) {
-        fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send player shot response\n" RESET, client->sock_fd);
+            break;
+        }
+        case MSG_LOOK_FOR_GAME: {
+            LOG_DEBUG("CLIENT %d: Received look for game request", client->sock_fd);
+            error_code err = handle_look_for_game(client, buffer);
+            if (err != ERR_NONE) {
+                LOG_ERROR("CLIENT %d: Failed to send look for game response, %d - %s",
+                        client->sock_fd, err, error_to_string(err));
+            }
+            break;
+        }
+        case MSG_CANCEL_LOOK_FOR_GAME: {
+            LOG_DEBUG("CLIENT %d: Received cancel look for game request", client->sock_fd);
+            error_code err = handle_cancel_look_for_game(client, buffer);
+            if (err != ERR_NONE) {
+                LOG_ERROR("CLIENT %d: Failed to send cancel look for game response, %d - %s",
+                        client->sock_fd, err, error_to_string(err));
+            }
+            break;
+        }
+        case MSG_CHALLENGE_PLAYER: {
+            LOG_DEBUG("CLIENT %d: Received challenge player request", client->sock_fd);
+            error_code err =  handle_challenge_player(client, buffer);
+            if (err != ERR_NONE) {
+                LOG_ERROR("CLIENT %d: Failed to send challenge player response, %d - %s",
+                        client->sock_fd, err, error_to_string(err));
+            }
+            break;
+        }
+        case MSG_CHALLENGE_ANSWER: {
+            LOG_DEBUG("CLIENT %d: Received challenge answer request", client->sock_fd);
+            error_code err = handle_challenge_answer(client, buffer);
+            if (err != ERR_NONE) {
+                LOG_ERROR("CLIENT %d: Failed to send challenge answer response, %d - %s",
+                        client->sock_fd, err, error_to_string(err));
+            }
+            break;
+        }
+        case MSG_GAME_START: {
+            LOG_DEBUG("CLIENT %d: Received game start request", client->sock_fd);
+            error_code err = handle_game_start(client, buffer);
+            if (err != ERR_NONE) {
+                LOG_ERROR("CLIENT %d: Failed to send game start response, %d - %s",
+                        client->sock_fd, err, error_to_string(err));
+            }
+            break;
+        }
+        case MSG_PLAYERS_SHOT: {
+            LOG_DEBUG("CLIENT %d: Received player shot request", client->sock_fd);
+            error_code err = handle_players_shot(client, buffer);
+            if (err != ERR_NONE) {
+                LOG_ERROR("CLIENT %d: Failed to send player shot response, %d - %s",
+                        client->sock_fd, err, error_to_string(err));
+            }
+            break;
+        }
+        case MSG_STATS: {
+            LOG_DEBUG("CLIENT %d: Received stats request", client->sock_fd);
+            error_code err = handle_stats(client, buffer);
+            if (err != ERR_NONE) {
+                LOG_ERROR("CLIENT %d: Failed to send stats response, %d - %s",
+                        client->sock_fd, err, error_to_string(err));
+            }
+            break;
+        }
+        case MSG_LIST_USERS_PAGE: {
+            LOG_DEBUG("CLIENT %d: Received list users page request", client->sock_fd);
+            error_code err = handle_list_users_page(client, buffer);
+            if (err != ERR_NONE) {
+                LOG_ERROR("CLIENT %d: Failed to send list users page response, %d - %s",
+                        client->sock_fd, err, error_to_string(err));
+            }
+            break;
+        }
+        case MSG_JOIN_QUEUE: {
+            LOG_DEBUG("CLIENT %d: Received join queue request", client->sock_fd);
+            error_code err = handle_join_queue(client, buffer);
+            if (err != ERR_NONE) {
+                LOG_ERROR("CLIENT %d: Failed to send join queue response, %d - %s",
+                        client->sock_fd, err, error_to_string(err));
+            }
+            break;
+        }
+        case MSG_LEAVE_QUEUE: {
+            LOG_DEBUG("CLIENT %d: Received leave queue request", client->sock_fd);
+            error_code err = handle_leave_queue(client, buffer);
+            if (err != ERR_NONE) {
+                LOG_ERROR("CLIENT %d: Failed to send leave queue response, %d - %s",
+                        client->sock_fd, err, error_to_string(err));
+            }
+            break;
+        }
+        case MSG_LEADERBOARD: {
+            LOG_DEBUG("CLIENT %d: Received leaderboard request", client->sock_fd);
+            error_code err = handle_leaderboard(client, buffer);
+            if (err != ERR_NONE) {
+                LOG_ERROR("CLIENT %d: Failed to send leaderboard response, %d - %s",
+                        client->sock_fd, err, error_to_string(err));
+            }
+            break;
+        }
+        case MSG_GAME_HISTORY: {
+            LOG_DEBUG("CLIENT %d: Received game history request", client->sock_fd);
+            error_code err = handle_game_history(client, buffer);
+            if (err != ERR_NONE) {
+                LOG_ERROR("CLIENT %d: Failed to send game history response, %d - %s",
+                        client->sock_fd, err, error_to_string(err));
+            }
+            break;
+        }
+        default: {
+            LOG_ERROR("CLIENT %d: Message type is unknown %u", client->sock_fd, message_type);
+            error_code err = handle_unknown_request(client);
+            if (err != ERR_NONE) {
+                LOG_ERROR("CLIENT %d: Failed to send message type unknown response, %d - %s",
+                        client->sock_fd, err, error_to_string(err));
+            }
+
+            // Unknown types are counted together
+            message_type = 0;
+        }
     }
 
-    other = game_other_player(client->game, client);
+    server_stats_record_request(&client->server_state->stats, message_type, server_stats_now_ns() - started_at);
+}
 
-    RegisterShotRequestMessage register_shot;
-    register_shot.type = MSG_REGISTER_SHOT;
-    register_shot.hit = hit;
-    register_shot.target = req.target;
-    // other player won the game == we lost
-    register_shot.lose = game_won;
-   
-    err = send_message(other->sock_fd, &register_shot, sizeof(register_shot));
-    if (err != ERR_NONE) {
-        fprintf(stderr, RED "ERROR: CLIENT %d: Failed to send register shot request\n" RESET, other->sock_fd);
+void handle_client_disconnect(server_client_t* client) {
+    // Frames still queued for the client are dropped. Socket is closed under the send lock
+    // so other handlers never send to its number once it's reused for a new client.
+    pthread_mutex_lock(&client->send_lock);
+    if (client->out_fd != -1) {
+        close(client->out_fd);
+        client->out_fd = -1;
     }
+    client->writer.len = 0;
+    atomic_store(&client->closing, 1);
+    close(client->sock_fd);
+    client->sock_fd = -1;
+    pthread_mutex_unlock(&client->send_lock);
+
+    server_leave_queue(client);
+    server_remove_session(client->server_state, client);
+    client->user = NULL;
+    client->flags = 0;
 
-    
-    return ERR_NONE;
+    if (client->game != NULL && client->game->state != GAME_STATE_CLOSED) {
+        // close the game, other client will get an error when he tries to 
+        // send some game events 
+        server_close_game(client->server_state, client->game); 
+    }
+
+    server_remove_client(client->server_state, client);
 }
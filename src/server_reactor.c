@@ -0,0 +1,208 @@
+#include "include/server_reactor.h"
+#include "include/errors.h"
+#include "include/globals.h"
+#include "include/logger.h"
+#include "include/messages.h"
+#include "include/server_handlers.h"
+#include "include/server_utils.h"
+#include "include/state.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#define REACTOR_CLIENT_EVENTS (EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT)
+// Set in the event's pointer when the client's socket is writable, clients are aligned
+#define REACTOR_WRITABLE ((uintptr_t)1)
+
+static void* reactor_worker(void* params);
+static void reactor_handle_client(server_reactor_t* reactor, server_client_t* client);
+
+error_code reactor_start(server_reactor_t* reactor, uint32_t workers_len) {
+    if (workers_len == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        workers_len = cores > 0 ? (uint32_t)cores : 1;
+    }
+
+    reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (reactor->epoll_fd == -1) {
+        fprintf(stderr, RED "ERROR: Failed to create epoll instance, %s\n" RESET, strerror(errno));
+        return ERR_UNKNOWN;
+    }
+
+    reactor->wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (reactor->wakeup_fd == -1) {
+        fprintf(stderr, RED "ERROR: Failed to create wakeup eventfd, %s\n" RESET, strerror(errno));
+        close(reactor->epoll_fd);
+        return ERR_UNKNOWN;
+    }
+
+    // Wakeup event is level triggered so every worker sees it once it's written to
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->wakeup_fd, &event) == -1) {
+        fprintf(stderr, RED "ERROR: Failed to register wakeup eventfd, %s\n" RESET, strerror(errno));
+        close(reactor->wakeup_fd);
+        close(reactor->epoll_fd);
+        return ERR_UNKNOWN;
+    }
+
+    reactor->workers = malloc(sizeof(pthread_t) * workers_len);
+    if (reactor->workers == NULL) {
+        close(reactor->wakeup_fd);
+        close(reactor->epoll_fd);
+        return ERR_ALLOC;
+    }
+
+    // Workers inherit the signal mask, block the signals so that
+    // SIGINT is always delivered to the main thread which is polling
+    sigset_t blocked, old;
+    sigfillset(&blocked);
+    pthread_sigmask(SIG_BLOCK, &blocked, &old);
+
+    reactor->workers_len = 0;
+    for (uint32_t i = 0; i < workers_len; i++) {
+        if (pthread_create(&reactor->workers[i], NULL, reactor_worker, reactor) != 0) {
+            fprintf(stderr, RED "ERROR: Failed to start reactor worker %u\n" RESET, i);
+            break;
+        }
+        reactor->workers_len++;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (reactor->workers_len == 0) {
+        free(reactor->workers);
+        close(reactor->wakeup_fd);
+        close(reactor->epoll_fd);
+        return ERR_UNKNOWN;
+    }
+
+    fprintf(stdout, "Started %u reactor workers\n", reactor->workers_len);
+    return ERR_NONE;
+}
+
+error_code reactor_add_client(server_reactor_t* reactor, server_client_t* client) {
+    int flags = fcntl(client->sock_fd, F_GETFL, 0);
+    if (flags == -1 || fcntl(client->sock_fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        return ERR_IFD;
+    }
+
+    // Duplicate waits for nothing until frames are queued for the client
+    client->out_fd = dup(client->sock_fd);
+    struct epoll_event out_event = { .events = EPOLLONESHOT, .data.ptr = (void*)((uintptr_t)client | REACTOR_WRITABLE) };
+    if (client->out_fd == -1 || epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, client->out_fd, &out_event) == -1) {
+        return ERR_IFD;
+    }
+
+    struct epoll_event event = { .events = REACTOR_CLIENT_EVENTS, .data.ptr = client };
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, client->sock_fd, &event) == -1) {
+        return ERR_IFD;
+    }
+
+    return ERR_NONE;
+}
+
+error_code reactor_wait_writable(int epoll_fd, server_client_t* client) {
+    struct epoll_event event = { .events = EPOLLOUT | EPOLLONESHOT, .data.ptr = (void*)((uintptr_t)client | REACTOR_WRITABLE) };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client->out_fd, &event) == -1) {
+        return ERR_IFD;
+    }
+
+    return ERR_NONE;
+}
+
+void reactor_stop(server_reactor_t* reactor) {
+    uint64_t one = 1;
+    if (write(reactor->wakeup_fd, &one, sizeof(one)) != sizeof(one)) {
+        fprintf(stderr, RED "ERROR: Failed to wake up reactor workers, %s\n" RESET, strerror(errno));
+    }
+
+    for (uint32_t i = 0; i < reactor->workers_len; i++) {
+        pthread_join(reactor->workers[i], NULL);
+    }
+
+    free(reactor->workers);
+    close(reactor->wakeup_fd);
+    close(reactor->epoll_fd);
+}
+
+static void* reactor_worker(void* params) {
+    server_reactor_t* reactor = params;
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+
+    while (1) {
+        int ready = epoll_wait(reactor->epoll_fd, events, REACTOR_MAX_EVENTS, -1);
+        if (ready == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            LOG_ERROR("Reactor worker failed to wait for events, %s", strerror(errno));
+            return NULL;
+        }
+
+        for (int i = 0; i < ready; i++) {
+            uintptr_t ptr = (uintptr_t)events[i].data.ptr;
+            if (ptr == 0) {
+                // Wakeup event, server is stopping
+                return NULL;
+            }
+
+            if (ptr & REACTOR_WRITABLE) {
+                server_flush_client((server_client_t*)(ptr & ~REACTOR_WRITABLE));
+                continue;
+            }
+
+            reactor_handle_client(reactor, (server_client_t*)ptr);
+        }
+    }
+
+    return NULL;
+}
+
+// Edge triggered epoll only reports new data once so read
+// until the socket would block and then rearm the client
+static void reactor_handle_client(server_reactor_t* reactor, server_client_t* client) {
+    uint8_t disconnected = 0;
+
+    while (1) {
+        error_code err = read_messages(client->sock_fd, &client->reader, handle_client_message, client);
+        if (err == ERR_NONE) {
+            continue;
+        }
+
+        if (err == ERR_WOULD_BLOCK) {
+            break;
+        }
+
+        if (err == ERR_PEER_CLOSED) {
+            LOG_INFO("CLIENT %d: Disconnected", client->sock_fd);
+        } else {
+            LOG_ERROR("CLIENT %d: Failed to read client message, closing connection, %d - %s",
+                    client->sock_fd, err, error_to_string(err));
+        }
+
+        disconnected = 1;
+        break;
+    }
+
+    if (disconnected) {
+        // Closing the socket also removes it from epoll
+        handle_client_disconnect(client);
+        return;
+    }
+
+    struct epoll_event event = { .events = REACTOR_CLIENT_EVENTS, .data.ptr = client };
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_MOD, client->sock_fd, &event) == -1) {
+        LOG_ERROR("CLIENT %d: Failed to rearm client, closing connection, %s",
+                client->sock_fd, strerror(errno));
+        handle_client_disconnect(client);
+    }
+}
@@ -0,0 +1,239 @@
+#include "include/server_stats.h"
+#include "include/errors.h"
+#include "include/globals.h"
+#include "include/histogram.h"
+#include "include/shard_lock.h"
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Slot of the current thread, picked the first time the thread records something
+static __thread int32_t thread_slot = -1;
+
+static const char* message_names[MSG_TYPES_LEN] = {
+    [0] = "unknown",
+    [MSG_SIGNUP] = "signup",
+    [MSG_LOGIN] = "login",
+    [MSG_LOGOUT] = "logout",
+    [MSG_LIST_USERS] = "list_users",
+    [MSG_LOOK_FOR_GAME] = "look_for_game",
+    [MSG_CANCEL_LOOK_FOR_GAME] = "cancel_look_for_game",
+    [MSG_CHALLENGE_PLAYER] = "challenge_player",
+    [MSG_CHALLENGE_ANSWER] = "challenge_answer",
+    [MSG_GAME_START] = "game_start",
+    [MSG_PLAYERS_SHOT] = "players_shot",
+    [MSG_STATS] = "stats",
+    [MSG_LIST_USERS_PAGE] = "list_users_page",
+    [MSG_JOIN_QUEUE] = "join_queue",
+    [MSG_LEAVE_QUEUE] = "leave_queue",
+    [MSG_LEADERBOARD] = "leaderboard",
+    [MSG_GAME_HISTORY] = "game_history",
+};
+
+error_code server_stats_init(server_stats_t* stats) {
+    // Slots are too large for the stack (every histogram has a few KB of buckets)
+    stats->slots = aligned_alloc(64, sizeof(server_stats_slot_t) * SERVER_STATS_SLOTS);
+    if (stats->slots == NULL) {
+        return ERR_ALLOC;
+    }
+
+    memset(stats->slots, 0, sizeof(server_stats_slot_t) * SERVER_STATS_SLOTS);
+    for (uint32_t i = 0; i < SERVER_STATS_SLOTS; i++) {
+        for (uint32_t type = 0; type < MSG_TYPES_LEN; type++) {
+            histogram_init(&stats->slots[i].latencies[type]);
+        }
+    }
+
+    stats->time_to_match = malloc(sizeof(histogram_t));
+    if (stats->time_to_match == NULL) {
+        free(stats->slots);
+        return ERR_ALLOC;
+    }
+    histogram_init(stats->time_to_match);
+
+    atomic_init(&stats->next_slot, 0);
+    atomic_init(&stats->queue_depth, 0);
+    stats->locks_len = 0;
+    stats->started_at = server_stats_now_ns();
+    return ERR_NONE;
+}
+
+void server_stats_deinit(server_stats_t* stats) {
+    free(stats->slots);
+    free(stats->time_to_match);
+    stats->slots = NULL;
+    stats->time_to_match = NULL;
+}
+
+uint64_t server_stats_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static server_stats_slot_t* server_stats_slot(server_stats_t* stats) {
+    if (thread_slot == -1) {
+        thread_slot = atomic_fetch_add_explicit(&stats->next_slot, 1, memory_order_relaxed) % SERVER_STATS_SLOTS;
+    }
+
+    return &stats->slots[thread_slot];
+}
+
+void server_stats_record_request(server_stats_t* stats, uint8_t type, uint64_t latency_ns) {
+    if (type >= MSG_TYPES_LEN) {
+        type = 0;
+    }
+
+    histogram_record_atomic(&server_stats_slot(stats)->latencies[type], latency_ns);
+}
+
+void server_stats_record_status(server_stats_t* stats, uint8_t status_code) {
+    if (status_code >= STATUS_CODES_LEN) {
+        status_code = 0;
+    }
+
+    __atomic_fetch_add(&server_stats_slot(stats)->statuses[status_code], 1, __ATOMIC_RELAXED);
+}
+
+void server_stats_record_match(server_stats_t* stats, uint64_t waited_ns) {
+    histogram_record_atomic(stats->time_to_match, waited_ns);
+}
+
+void server_stats_set_queue_depth(server_stats_t* stats, uint64_t depth) {
+    atomic_store_explicit(&stats->queue_depth, depth, memory_order_relaxed);
+}
+
+error_code server_stats_add_locks(server_stats_t* stats, const char* name, const shard_lock_t* locks, uint32_t count) {
+    if (stats->locks_len == SERVER_STATS_LOCK_TABLES) {
+        return ERR_IARG;
+    }
+
+    server_stats_locks_t* table = &stats->locks[stats->locks_len++];
+    table->name = name;
+    table->locks = locks;
+    table->count = count;
+    return ERR_NONE;
+}
+
+static void server_stats_latency(const histogram_t* histogram, StatsLatency* latency) {
+    latency->count = histogram->count;
+    latency->p50 = histogram_percentile(histogram, 50);
+    latency->p99 = histogram_percentile(histogram, 99);
+    latency->p999 = histogram_percentile(histogram, 99.9);
+    latency->max = histogram->max;
+}
+
+error_code server_stats_collect(server_stats_t* stats, StatsSuccessResponseMessage* out) {
+    histogram_t* total = malloc(sizeof(histogram_t));
+    if (total == NULL) {
+        return ERR_ALLOC;
+    }
+
+    memset(out, 0, sizeof(StatsSuccessResponseMessage));
+    out->status_code = STATUS_OK;
+    out->uptime_ms = (server_stats_now_ns() - stats->started_at) / 1000000;
+
+    for (uint32_t type = 0; type < MSG_TYPES_LEN; type++) {
+        histogram_init(total);
+        for (uint32_t i = 0; i < SERVER_STATS_SLOTS; i++) {
+            histogram_merge_atomic(total, &stats->slots[i].latencies[type]);
+        }
+
+        server_stats_latency(total, &out->requests[type]);
+    }
+
+    histogram_init(total);
+    histogram_merge_atomic(total, stats->time_to_match);
+    server_stats_latency(total, &out->time_to_match);
+    out->queue_depth = atomic_load_explicit(&stats->queue_depth, memory_order_relaxed);
+
+    for (uint32_t i = 0; i < SERVER_STATS_SLOTS; i++) {
+        for (uint32_t status = 0; status < STATUS_CODES_LEN; status++) {
+            out->statuses[status] += __atomic_load_n(&stats->slots[i].statuses[status], __ATOMIC_RELAXED);
+        }
+    }
+
+    free(total);
+    return ERR_NONE;
+}
+
+error_code server_stats_dump(server_stats_t* stats, const char* filepath) {
+    StatsSuccessResponseMessage collected;
+    error_code err = server_stats_collect(stats, &collected);
+    if (err != ERR_NONE) {
+        return err;
+    }
+
+    char tmp_filepath[PATH_MAX];
+    if (snprintf(tmp_filepath, sizeof(tmp_filepath), "%s.tmp", filepath) >= (int)sizeof(tmp_filepath)) {
+        return ERR_IARG;
+    }
+
+    FILE* file = fopen(tmp_filepath, "w");
+    if (file == NULL) {
+        return ERR_UNKNOWN;
+    }
+
+    fprintf(file, "uptime %lu ms\n\n", collected.uptime_ms);
+    fprintf(file, "%-22s %10s %10s %10s %10s %10s\n", "request", "count", "p50 us", "p99 us", "p999 us", "max us");
+    for (uint32_t type = 0; type < MSG_TYPES_LEN; type++) {
+        StatsLatency* latency = &collected.requests[type];
+        if (latency->count == 0) {
+            continue;
+        }
+
+        fprintf(file, "%-22s %10lu %10.1f %10.1f %10.1f %10.1f\n", message_names[type], latency->count,
+                latency->p50 / 1000.0, latency->p99 / 1000.0, latency->p999 / 1000.0, latency->max / 1000.0);
+    }
+
+    StatsLatency* matches = &collected.time_to_match;
+    fprintf(file, "\n%-22s %10s %10s %10s %10s %10s\n", "matchmaking", "matches", "p50 ms", "p99 ms", "p999 ms",
+            "max ms");
+    fprintf(file, "%-22s %10lu %10.1f %10.1f %10.1f %10.1f\n", "time_to_match", matches->count / 2,
+            matches->p50 / 1000000.0, matches->p99 / 1000000.0, matches->p999 / 1000000.0, matches->max / 1000000.0);
+    fprintf(file, "%-22s %10lu\n", "queue_depth", collected.queue_depth);
+
+    fprintf(file, "\n%-22s %10s\n", "status", "responses");
+    for (uint32_t status = 0; status < STATUS_CODES_LEN; status++) {
+        if (collected.statuses[status] == 0) {
+            continue;
+        }
+
+        if (status == 0) {
+            fprintf(file, "%-22s %10lu\n", "unknown", collected.statuses[status]);
+        } else {
+            fprintf(file, "%-22u %10lu\n", status, collected.statuses[status]);
+        }
+    }
+
+    if (stats->locks_len > 0) {
+        fprintf(file, "\n%-22s %6s %10s %10s %10s %10s %10s\n", "lock", "shard", "~reads", "writes", "contended",
+                "wait ms", "hold ms");
+    }
+    for (uint32_t i = 0; i < stats->locks_len; i++) {
+        const server_stats_locks_t* table = &stats->locks[i];
+        for (uint32_t shard = 0; shard < table->count; shard++) {
+            shard_lock_stats_t lock;
+            shard_lock_stats(&table->locks[shard], &lock);
+            fprintf(file, "%-22s %6u %10lu %10lu %10lu %10.1f %10.1f\n", table->name, shard, lock.reads, lock.writes,
+                    lock.contended, lock.wait_ns / 1000000.0, lock.hold_ns / 1000000.0);
+        }
+    }
+
+    if (ferror(file) || fclose(file) != 0) {
+        unlink(tmp_filepath);
+        return ERR_UNKNOWN;
+    }
+
+    if (rename(tmp_filepath, filepath) == -1) {
+        unlink(tmp_filepath);
+        return ERR_UNKNOWN;
+    }
+
+    return ERR_NONE;
+}
@@ -1,102 +1,318 @@
 #include "include/game.h"
+#include "include/leaderboard.h"
+#include "include/messages.h"
+#include "include/rating.h"
 #include "include/globals.h"
+#include "include/logger.h"
+#include "include/matchmaker.h"
+#include "include/online_players.h"
 #include "include/state.h"
+#include "include/results_writer.h"
+#include "include/server_reactor.h"
+#include "include/server_utils.h"
+#include "include/shard_lock.h"
+#include "include/slot_pool.h"
 #include "include/users.h"
-#include "include/vector/vector.h"
+#include "include/users_journal.h"
+#include "include/username_map.h"
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
 #include <string.h>
+#include <sys/socket.h>
 
-server_user_t* server_add_user(server_state_t* state, server_user_t user) {
-    pthread_rwlock_wrlock(&state->users_rwlock);
-    vector_push(&state->users, &user);
-    server_user_t* out = vector_at(&state->users, state->users.logical_length - 1);
-    pthread_rwlock_unlock(&state->users_rwlock);
-    return out;
+error_code server_shards_init(server_state_t* state) {
+    for (uint32_t i = 0; i < STATE_SHARDS; i++) {
+        error_code err = slot_pool_init(&state->clients[i], sizeof(server_client_t));
+        if (err == ERR_NONE) {
+            err = slot_pool_init(&state->games[i], sizeof(server_game_t));
+        }
+        if (err == ERR_NONE) {
+            err = username_map_init(&state->users_index[i], 0);
+        }
+        if (err != ERR_NONE) {
+            return err;
+        }
+
+        state->clients_free[i] = SLOT_NONE;
+        state->games_free[i] = SLOT_NONE;
+        shard_lock_init(&state->clients_locks[i]);
+        shard_lock_init(&state->games_locks[i]);
+        shard_lock_init(&state->users_locks[i]);
+    }
+
+    shard_lock_init(&state->users_table_lock);
+    return ERR_NONE;
 }
 
-server_user_t* server_find_user_by_username(server_state_t* state, char* username) {
-    pthread_rwlock_rdlock(&state->users_rwlock);
+void server_shards_deinit(server_state_t* state) {
+    for (uint32_t i = 0; i < STATE_SHARDS; i++) {
+        for (uint32_t slot = 0; slot < slot_pool_len(&state->clients[i]); slot++) {
+            server_client_t* client = slot_pool_at(&state->clients[i], slot);
+            message_writer_deinit(&client->writer);
+        }
+        slot_pool_deinit(&state->clients[i]);
+        slot_pool_deinit(&state->games[i]);
+        username_map_deinit(&state->users_index[i]);
+        shard_lock_destroy(&state->clients_locks[i]);
+        shard_lock_destroy(&state->games_locks[i]);
+        shard_lock_destroy(&state->users_locks[i]);
+    }
 
-    uint8_t found = 0;
-    server_user_t* user = NULL;
+    shard_lock_destroy(&state->users_table_lock);
+}
+
+error_code server_shards_index_users(server_state_t* state) {
+    uint32_t users_len = record_table_len(&state->users);
+    for (uint32_t i = 0; i < users_len; i++) {
+        server_user_t* user = record_table_at(&state->users, i);
+        uint32_t shard = STATE_USERS_SHARD(username_map_hash(user->username));
+
+        error_code err = username_map_put(&state->users_index[shard], user->username, i);
+        if (err != ERR_NONE) {
+            return err;
+        }
+    }
+
+    return ERR_NONE;
+}
+
+error_code server_add_user(server_state_t* state, server_user_t user, server_user_t** out, uint32_t* id) {
+    uint32_t shard = STATE_USERS_SHARD(username_map_hash(user.username));
+    uint64_t shard_locked_at = shard_lock_write(&state->users_locks[shard]);
+
+    error_code err = ERR_USERNAME_EXISTS;
+    uint64_t seq = 0;
+    uint32_t index;
+
+    // Taken usernames are turned down without waiting for the signups of other shards
+    if (!username_map_get(&state->users_index[shard], user.username, &index)) {
+        uint64_t table_locked_at = shard_lock_write(&state->users_table_lock);
+
+        index = record_table_len(&state->users);
+        err = username_map_put(&state->users_index[shard], user.username, index);
+        if (err == ERR_NONE) {
+            *out = record_table_push(&state->users, &user);
+            if (*out == NULL) {
+                username_map_remove(&state->users_index[shard], user.username);
+                err = ERR_ALLOC;
+            } else {
+                *id = index;
+
+                // User stays in memory even if the record isn't written, next compaction saves it
+                seq = users_journal_append(&state->users_journal, USERS_JOURNAL_ADD_USER, index, &user);
+            }
+        }
 
-    for (unsigned int i = 0; i < state->users.logical_length ; i++ ) {
-         user = vector_at(&state->users, i);
-         if (strncmp(username, user->username, USERNAME_MAX_LEN) == 0) {
-             found = 1;
-             break;
-         }
+        shard_lock_unlock(&state->users_table_lock, table_locked_at);
     }
 
-    if (!found) {
-        user = NULL;
+    shard_lock_unlock(&state->users_locks[shard], shard_locked_at);
+
+    // Wait for the fsync outside of the lock so other signups can join the same fsync
+    if (seq != 0) {
+        err = users_journal_sync(&state->users_journal, seq);
     }
 
-    pthread_rwlock_unlock(&state->users_rwlock);
+    return err;
+}
+
+server_user_t* server_find_user_by_username(server_state_t* state, char* username, uint32_t* id) {
+    uint32_t shard = STATE_USERS_SHARD(username_map_hash(username));
+    uint64_t locked_at = shard_lock_read(&state->users_locks[shard]);
+
+    server_user_t* user = NULL;
+
+    // User was added before it was put into the index so it can be read without the table lock
+    if (username_map_get(&state->users_index[shard], username, id)) {
+        user = record_table_at(&state->users, *id);
+    }
+
+    shard_lock_unlock(&state->users_locks[shard], locked_at);
     return user;
 }
 
+server_client_t* server_client_at(server_state_t* state, uint32_t id) {
+    uint32_t shard = STATE_SHARD(id);
+    uint64_t locked_at = shard_lock_read(&state->clients_locks[shard]);
+    server_client_t* client = slot_pool_at(&state->clients[shard], STATE_SHARD_SLOT(id));
+    shard_lock_unlock(&state->clients_locks[shard], locked_at);
+    return client;
+}
+
 server_client_t* server_find_client_by_username(server_state_t* state, char* username) {
-    pthread_rwlock_rdlock(&state->clients_rwlock);
+    online_players_guard_t guard;
+    const online_snapshot_t* snapshot = online_players_read(&state->online, &guard);
+    const online_player_t* player = online_snapshot_find(snapshot, username);
+    uint32_t id = player != NULL ? player->client_id : SLOT_NONE;
+    online_players_read_end(&state->online, &guard);
+
+    if (id == SLOT_NONE) {
+        return NULL;
+    }
 
-    uint8_t found = 0;
-    server_client_t* client= NULL;
+    // Client was added to its pool before it logged in and clients never move,
+    // the pool can be read without the shard lock
+    return slot_pool_at(&state->clients[STATE_SHARD(id)], STATE_SHARD_SLOT(id));
+}
+
+// Player of a logged in client as it's published to the online players
+static online_player_t server_online_player(server_client_t* client, server_user_t* user) {
+    online_player_t player = { 0 };
+    memcpy(player.username, user->username, USERNAME_MAX_LEN);
+    player.client_id = client->id;
+    player.looking_for_game = client_looking_for_game(client) ? 1 : 0;
+    return player;
+}
 
-    for (unsigned int i = 0; i < state->clients.logical_length ; i++ ) {
-         client = vector_at(&state->clients, i);
-         if (client->user == NULL) {
-             continue;
-         }
+error_code server_add_session(server_state_t* state, server_client_t* client, server_user_t* user) {
+    pthread_rwlock_wrlock(&state->sessions_rwlock);
+    error_code err = username_map_put(&state->sessions, user->username, client->id);
 
-         if (strncmp(username, client->user->username, USERNAME_MAX_LEN) == 0) {
-             found = 1;
-             break;
-         }
+    // Old snapshot is retired after the lock is released
+    online_snapshot_t* old = NULL;
+    if (err == ERR_NONE) {
+        online_player_t player = server_online_player(client, user);
+
+        online_snapshot_t* snapshot = online_snapshot_put(online_players_current(&state->online), &player);
+        if (snapshot != NULL) {
+            old = online_players_publish(&state->online, snapshot);
+        } else {
+            username_map_remove(&state->sessions, user->username);
+            err = ERR_ALLOC;
+        }
     }
 
-    if (!found) {
-        client = NULL;
+    pthread_rwlock_unlock(&state->sessions_rwlock);
+    online_players_retire(&state->online, old);
+
+    if (err != ERR_NONE && err != ERR_USERNAME_EXISTS) {
+        LOG_ERROR("%s CLIENT %d: Failed to add session", error_to_string(err), client->sock_fd);
     }
 
-    pthread_rwlock_unlock(&state->clients_rwlock);
-    return client;
+    return err;
 }
 
+void server_remove_session(server_state_t* state, server_client_t* client) {
+    if (client->user == NULL) {
+        return;
+    }
+
+    pthread_rwlock_wrlock(&state->sessions_rwlock);
 
-server_game_t* server_add_game(server_state_t* state, server_game_t game) {
-    pthread_rwlock_wrlock(&state->games_rwlock);
-    game.id = state->next_game_id;
-    state->next_game_id++;
+    // Only remove the session if it belongs to this client
+    uint32_t id;
+    online_snapshot_t* old = NULL;
+    if (username_map_get(&state->sessions, client->user->username, &id) && id == client->id) {
+        username_map_remove(&state->sessions, client->user->username);
 
-    // Try to find a free space in games vector to add the new game
-    server_game_t* out = NULL;
-    for (uint32_t i = 0; i < state->games.logical_length; i++) {
-        server_game_t* g = vector_at(&state->games, i);
-        if (g->state == GAME_STATE_CLOSED) {
-            out = g;
-            break;
+        online_snapshot_t* snapshot = online_snapshot_remove(online_players_current(&state->online), client->user->username);
+        if (snapshot != NULL) {
+            old = online_players_publish(&state->online, snapshot);
+        } else {
+            LOG_ERROR("%s CLIENT %d: Failed to remove %s from online players", error_to_string(ERR_ALLOC),
+                      client->sock_fd, client->user->username);
         }
     }
 
-    if (out == NULL) {
-        vector_push(&state->games, &game);
-        out = vector_at(&state->games, state->games.logical_length - 1);
+    pthread_rwlock_unlock(&state->sessions_rwlock);
+    online_players_retire(&state->online, old);
+}
+
+server_client_t* server_add_client(server_state_t* state, int sock_fd, struct sockaddr_in addr) {
+    uint32_t shard = STATE_SHARD(atomic_fetch_add_explicit(&state->next_clients_shard, 1, memory_order_relaxed));
+    slot_pool_t* pool = &state->clients[shard];
+    uint64_t locked_at = shard_lock_write(&state->clients_locks[shard]);
+
+    server_client_t* client = NULL;
+    if (state->clients_free[shard] != SLOT_NONE) {
+        client = slot_pool_at(pool, state->clients_free[shard]);
+        state->clients_free[shard] = client->next_free;
+        LOG_DEBUG("Found free space for client at index %d, shard %u len %d", client->id, shard, slot_pool_len(pool));
+
+        client->sock_fd = sock_fd;
+        client->server_state = state;
+        client->addr = addr;
+        client->flags = 0;
+        client->user = NULL;
+        client->game = NULL;
+        atomic_store(&client->game_claim, GAME_CLAIM_NONE);
+        client->reader.len = 0;
+        client->writer.len = 0;
+        client->out_fd = -1;
+        atomic_store(&client->closing, 0);
     } else {
+        server_client_t new_client = {
+            .sock_fd = sock_fd,
+            .server_state = state,
+            .id = (slot_pool_len(pool) << STATE_SHARDS_SHIFT) | shard,
+            .addr = addr,
+            .flags = 0,
+            .reader = { .len = 0 },
+            .send_lock = PTHREAD_MUTEX_INITIALIZER,
+            .writer = { .len = 0, .cap = 0, .data = NULL },
+            .out_fd = -1,
+            .closing = 0,
+            .game_claim = GAME_CLAIM_NONE,
+        };
+        client = slot_pool_push(pool, &new_client);
+    }
+
+    if (client != NULL) {
+        client->next_free = SLOT_NONE;
+    }
+
+    shard_lock_unlock(&state->clients_locks[shard], locked_at);
+    return client;
+}
+
+void server_remove_client(server_state_t* state, server_client_t* client) {
+    uint32_t shard = STATE_SHARD(client->id);
+    uint64_t locked_at = shard_lock_write(&state->clients_locks[shard]);
+
+    client->next_free = state->clients_free[shard];
+    state->clients_free[shard] = STATE_SHARD_SLOT(client->id);
+
+    shard_lock_unlock(&state->clients_locks[shard], locked_at);
+}
+
+server_game_t* server_add_game(server_state_t* state, server_game_t game) {
+    game.id = atomic_fetch_add_explicit(&state->next_game_id, 1, memory_order_relaxed);
+    game.next_free = SLOT_NONE;
+
+    uint32_t shard = STATE_SHARD(game.id);
+    slot_pool_t* pool = &state->games[shard];
+    uint64_t locked_at = shard_lock_write(&state->games_locks[shard]);
+
+    server_game_t* out = NULL;
+    if (state->games_free[shard] != SLOT_NONE) {
+        out = slot_pool_at(pool, state->games_free[shard]);
+        game.slot = state->games_free[shard];
+        state->games_free[shard] = out->next_free;
         *out = game;
+    } else {
+        game.slot = slot_pool_len(pool);
+        out = slot_pool_push(pool, &game);
     }
 
-    pthread_rwlock_unlock(&state->games_rwlock);
+    shard_lock_unlock(&state->games_locks[shard], locked_at);
     return out;
 }
 
 void server_close_game(server_state_t* state, server_game_t* game) {
-    pthread_rwlock_wrlock(&state->games_rwlock);
-  
-    game_close(game);
+    uint32_t shard = STATE_SHARD(game->id);
+    uint64_t locked_at = shard_lock_write(&state->games_locks[shard]);
 
-    pthread_rwlock_unlock(&state->games_rwlock);
+    // Both players can close the game, the slot is freed only once
+    if (game->state != GAME_STATE_CLOSED) {
+        game_close(game);
+        game->next_free = state->games_free[shard];
+        state->games_free[shard] = game->slot;
+    }
 
+    shard_lock_unlock(&state->games_locks[shard], locked_at);
 }
+
 uint8_t client_logged_in(server_client_t* client) {
     return client->flags & CLIENT_LOGGED_IN;
 }
@@ -113,12 +329,70 @@ uint8_t client_looking_for_game(server_client_t* client) {
     return client->flags & CLIENT_LOOKING_FOR_GAME;
 }
 
-void client_set_looking_for_game(server_client_t* client) {
-    client->flags |= CLIENT_LOOKING_FOR_GAME;
+uint8_t client_in_queue(server_client_t* client) {
+    return atomic_load(&client->queue_ticket) % 2 == 1;
+}
+
+static uint64_t game_claim(const server_game_t* game) {
+    return (uint64_t)game->id << 32 | game->slot;
+}
+
+static uint8_t game_claim_live(server_state_t* state, uint64_t claim) {
+    if (claim == GAME_CLAIM_NONE) {
+        return 0;
+    }
+
+    uint32_t id = claim >> 32;
+    uint32_t shard = STATE_SHARD(id);
+    uint64_t locked_at = shard_lock_read(&state->games_locks[shard]);
+    server_game_t* game = slot_pool_at(&state->games[shard], (uint32_t)claim);
+    // Slot of a closed game can already hold a game of other clients
+    uint8_t live = game->id == id && !game_closed(game) && !game_finished(game);
+    shard_lock_unlock(&state->games_locks[shard], locked_at);
+    return live;
+}
+
+uint8_t client_playing_game(server_client_t* client) {
+    return game_claim_live(client->server_state, atomic_load(&client->game_claim));
 }
 
-void client_clear_looking_for_game(server_client_t* client) {
-    client->flags &= ~CLIENT_LOOKING_FOR_GAME;
+uint8_t client_claim_game(server_client_t* client, server_game_t* game) {
+    uint64_t claim = atomic_load(&client->game_claim);
+    do {
+        if (game_claim_live(client->server_state, claim)) {
+            return 0;
+        }
+    } while (!atomic_compare_exchange_weak(&client->game_claim, &claim, game_claim(game)));
+
+    return 1;
+}
+
+void server_set_looking_for_game(server_state_t* state, server_client_t* client, uint8_t looking_for_game) {
+    // Flag is changed under the sessions lock so the snapshot published after it has it
+    pthread_rwlock_wrlock(&state->sessions_rwlock);
+
+    if (looking_for_game) {
+        client->flags |= CLIENT_LOOKING_FOR_GAME;
+    } else {
+        client->flags &= ~CLIENT_LOOKING_FOR_GAME;
+    }
+
+    // Only the client that holds the session is in the snapshot
+    online_snapshot_t* old = NULL;
+    const online_snapshot_t* current = online_players_current(&state->online);
+    const online_player_t* published = client->user != NULL ? online_snapshot_find(current, client->user->username) : NULL;
+    if (published != NULL && published->client_id == client->id) {
+        online_player_t player = server_online_player(client, client->user);
+        online_snapshot_t* snapshot = online_snapshot_put(current, &player);
+        if (snapshot != NULL) {
+            old = online_players_publish(&state->online, snapshot);
+        } else {
+            LOG_ERROR("%s CLIENT %d: Failed to publish looking for game", error_to_string(ERR_ALLOC), client->sock_fd);
+        }
+    }
+
+    pthread_rwlock_unlock(&state->sessions_rwlock);
+    online_players_retire(&state->online, old);
 }
 
 void client_join_game(server_client_t* client, server_game_t* game) {
@@ -127,9 +401,281 @@ void client_join_game(server_client_t* client, server_game_t* game) {
 
 game_results_t* server_add_game_result(server_state_t* state, game_results_t res) {
     pthread_rwlock_wrlock(&state->game_results_rwlock);
-    vector_push(&state->game_results, &res);
-    game_results_t* out = vector_at(&state->game_results, state->game_results.logical_length - 1);
+    game_results_t* out = record_table_push(&state->game_results, &res);
+
+    // Result that isn't in the table isn't linked or written, the links stay aligned with the results
+    error_code err = ERR_ALLOC;
+    if (out != NULL) {
+        results_index_link_t link;
+        err = results_index_add(&state->results_index, &res, &link);
+        if (err != ERR_NONE) {
+            LOG_ERROR("%s failed to add game result to the index", error_to_string(err));
+        }
+
+        // Result without a link is taken back out so the next result gets its id
+        if (record_table_len(&state->results_index.links) < record_table_len(&state->game_results)) {
+            record_table_pop(&state->game_results);
+            out = NULL;
+        } else {
+            // Written to the results file by the writer thread, queued under the lock
+            // so the results are written in the same order as they are in the table
+            err = results_writer_push(&state->results_writer, &res, &link);
+        }
+    }
     pthread_rwlock_unlock(&state->game_results_rwlock);
+    if (err != ERR_NONE) {
+        LOG_ERROR("%s failed to queue game result", error_to_string(err));
+    }
+
+    server_update_ratings(state, &res);
+
+    uint32_t winner = res.won == GAME_FIRST_WON ? res.first_player_id : res.second_player_id;
+    uint32_t loser = res.won == GAME_FIRST_WON ? res.second_player_id : res.first_player_id;
+    pthread_rwlock_wrlock(&state->leaderboard_rwlock);
+    err = leaderboard_record(&state->leaderboard, winner, loser);
+    pthread_rwlock_unlock(&state->leaderboard_rwlock);
+    if (err != ERR_NONE) {
+        LOG_ERROR("%s failed to add game result to the leaderboard", error_to_string(err));
+    }
+
     return out;
 }
 
+void server_update_ratings(server_state_t* state, const game_results_t* res) {
+    if (res->won != GAME_FIRST_WON && res->won != GAME_SECOND_WON) {
+        return;
+    }
+
+    // Write lock keeps the change and its journal record together while the journal copies the users
+    uint64_t locked_at = shard_lock_write(&state->users_table_lock);
+
+    server_user_t* first = record_table_at(&state->users, res->first_player_id);
+    server_user_t* second = record_table_at(&state->users, res->second_player_id);
+    if (res->won == GAME_FIRST_WON) {
+        rating_update(&first->rating, &second->rating);
+    } else {
+        rating_update(&second->rating, &first->rating);
+    }
+
+    // Nobody waits for the fsync of a rating, the flusher syncs it in the background
+    uint64_t first_seq = users_journal_append(&state->users_journal, USERS_JOURNAL_UPDATE_USER, res->first_player_id, first);
+    uint64_t second_seq = users_journal_append(&state->users_journal, USERS_JOURNAL_UPDATE_USER, res->second_player_id, second);
+    if (first_seq == 0 || second_seq == 0) {
+        LOG_ERROR("Failed to save ratings of users %u and %u", res->first_player_id, res->second_player_id);
+    }
+
+    shard_lock_unlock(&state->users_table_lock, locked_at);
+}
+
+uint32_t server_user_rating(server_state_t* state, uint32_t user_id) {
+    uint64_t locked_at = shard_lock_read(&state->users_table_lock);
+    uint32_t rating = ((server_user_t*)record_table_at(&state->users, user_id))->rating;
+    shard_lock_unlock(&state->users_table_lock, locked_at);
+    return rating;
+}
+
+// Reactor sees the closed socket and disconnects the client, requests it already sent aren't handled
+static void shutdown_client(server_client_t* client) {
+    client->writer.len = 0;
+    atomic_store(&client->closing, 1);
+    shutdown(client->sock_fd, SHUT_RDWR);
+}
+
+// Sends as much of the queued frames as the socket takes, caller holds the send lock.
+// Rest is sent by a reactor worker once the socket is writable again.
+static error_code flush_writer(server_client_t* client) {
+    error_code err = message_writer_flush(client->sock_fd, &client->writer);
+    if (err == ERR_WOULD_BLOCK) {
+        err = reactor_wait_writable(client->server_state->epoll_fd, client);
+    }
+
+    if (err != ERR_NONE) {
+        shutdown_client(client);
+    }
+
+    return err;
+}
+
+error_code server_send_message(server_client_t* client, const void* message, uint32_t len) {
+    pthread_mutex_lock(&client->send_lock);
+
+    // Client is disconnected or its socket was shut down, nothing reaches it anymore
+    if (client->sock_fd == -1 || atomic_load(&client->closing)) {
+        pthread_mutex_unlock(&client->send_lock);
+        return ERR_PEER_CLOSED;
+    }
+
+    error_code err;
+    if (client->server_state->mode == SERVER_MODE_THREADS) {
+        // Socket is blocking
+        err = send_message(client->sock_fd, message, len);
+        pthread_mutex_unlock(&client->send_lock);
+        return err;
+    }
+
+    // Frames already queued are waiting for the socket, new one goes behind them
+    uint8_t waiting = client->writer.len > 0;
+    err = message_writer_push(&client->writer, message, len);
+    if (err == ERR_QUEUE_FULL) {
+        LOG_ERROR("CLIENT %d: Client stopped reading messages, closing connection", client->sock_fd);
+        shutdown_client(client);
+    } else if (err == ERR_NONE && !waiting) {
+        err = flush_writer(client);
+    }
+
+    pthread_mutex_unlock(&client->send_lock);
+    return err;
+}
+
+void server_flush_client(server_client_t* client) {
+    pthread_mutex_lock(&client->send_lock);
+    // Client could have disconnected since its socket became writable
+    if (client->out_fd != -1 && !atomic_load(&client->closing) && client->writer.len > 0) {
+        error_code err = flush_writer(client);
+        if (err != ERR_NONE) {
+            LOG_ERROR("%s CLIENT %d: Failed to send queued messages", error_to_string(err), client->sock_fd);
+        }
+    }
+    pthread_mutex_unlock(&client->send_lock);
+}
+
+error_code server_send_response(server_client_t* client, const void* message, uint32_t len) {
+    // Every response starts with the status code
+    server_stats_record_status(&client->server_state->stats, *(const uint8_t*)message);
+    return server_send_message(client, message, len);
+}
+
+error_code server_join_queue(server_state_t* state, server_client_t* client) {
+    // Matcher can put the client back into the queue at the same time
+    uint32_t ticket = atomic_load(&client->queue_ticket);
+    if (ticket % 2 == 1 || !atomic_compare_exchange_strong(&client->queue_ticket, &ticket, ticket + 1)) {
+        return ERR_IARG;
+    }
+
+    matchmaker_entry_t entry = {
+        .client_id = client->id,
+        .ticket = ticket + 1,
+        .rating = server_user_rating(state, client->user_id),
+        .enqueued_at = server_stats_now_ns(),
+    };
+
+    error_code err = matchmaker_push(&state->matchmaker, &entry);
+    if (err != ERR_NONE) {
+        server_leave_queue(client);
+    }
+
+    return err;
+}
+
+uint8_t server_leave_queue(server_client_t* client) {
+    uint32_t ticket = atomic_load(&client->queue_ticket);
+    if (ticket % 2 == 0) {
+        return 0;
+    }
+
+    // Fails if the matcher claimed the client first
+    return atomic_compare_exchange_strong(&client->queue_ticket, &ticket, ticket + 1);
+}
+
+// Client is taken out of the queue only if it still has the ticket of the entry
+static uint8_t server_claim_queued_client(server_client_t* client, uint32_t ticket) {
+    return atomic_compare_exchange_strong(&client->queue_ticket, &ticket, ticket + 1);
+}
+
+// Puts the client back if the other client turned out to be stale. Tickets only move
+// forward so this fails if the client left or joined again in the meantime.
+static void server_unclaim_queued_client(server_client_t* client, uint32_t ticket) {
+    uint32_t claimed = ticket + 1;
+    atomic_compare_exchange_strong(&client->queue_ticket, &claimed, ticket);
+}
+
+static error_code server_send_match_found(server_client_t* client, const server_user_t* opponent, uint8_t status_code,
+                                          uint32_t game_id) {
+    MatchFoundMessage msg = { 0 };
+    msg.type = MSG_MATCH_FOUND;
+    msg.status_code = status_code;
+    msg.game_id = game_id;
+    memcpy(msg.opponent_username, opponent->username, USERNAME_MAX_LEN);
+
+    return server_send_message(client, &msg, sizeof(msg));
+}
+
+uint8_t server_match_clients(void* params, const matchmaker_entry_t* first, const matchmaker_entry_t* second) {
+    server_state_t* state = params;
+
+    server_client_t* a = server_client_at(state, first->client_id);
+    server_client_t* b = server_client_at(state, second->client_id);
+
+    if (!server_claim_queued_client(a, first->ticket)) {
+        return MATCHMAKER_FIRST_STALE;
+    }
+
+    if (!server_claim_queued_client(b, second->ticket)) {
+        server_unclaim_queued_client(a, first->ticket);
+        return MATCHMAKER_SECOND_STALE;
+    }
+
+    // Client can log out right after it was claimed, users themselves are never freed
+    server_user_t* a_user = a->user;
+    server_user_t* b_user = b->user;
+    if (a_user == NULL) {
+        server_unclaim_queued_client(b, second->ticket);
+        return MATCHMAKER_FIRST_STALE;
+    }
+    if (b_user == NULL) {
+        server_unclaim_queued_client(a, first->ticket);
+        return MATCHMAKER_SECOND_STALE;
+    }
+
+    // Both clients agreed to play anyone by joining the queue so the game is accepted right away
+    server_game_t* game = server_add_game(state, game_new(a, b));
+    if (game == NULL) {
+        // Both clients stay claimed out of the queue, they have to join it again
+        LOG_ERROR("Failed to add a game for \"%.*s\" and \"%.*s\"", USERNAME_MAX_LEN, a_user->username,
+                  USERNAME_MAX_LEN, b_user->username);
+
+        error_code err = server_send_match_found(a, b_user, STATUS_UNKNOWN_ERROR, 0);
+        if (err != ERR_NONE) {
+            LOG_ERROR("%s CLIENT %d: Failed to send match failed", error_to_string(err), a->sock_fd);
+        }
+
+        err = server_send_match_found(b, a_user, STATUS_UNKNOWN_ERROR, 0);
+        if (err != ERR_NONE) {
+            LOG_ERROR("%s CLIENT %d: Failed to send match failed", error_to_string(err), b->sock_fd);
+        }
+        return MATCHMAKER_FAILED;
+    }
+
+    // Client challenged right before it joined stays out of the queue, it plays the challenge's game.
+    // Closing the game ends the claim of the other client.
+    if (!client_claim_game(a, game)) {
+        server_close_game(state, game);
+        server_unclaim_queued_client(b, second->ticket);
+        return MATCHMAKER_FIRST_STALE;
+    }
+    if (!client_claim_game(b, game)) {
+        server_close_game(state, game);
+        server_unclaim_queued_client(a, first->ticket);
+        return MATCHMAKER_SECOND_STALE;
+    }
+
+    client_join_game(a, game);
+    client_join_game(b, game);
+    game_accept(game, a);
+    game_accept(game, b);
+
+    LOG_INFO("GAME %d: Matched \"%.*s\" and \"%.*s\"", game->id, USERNAME_MAX_LEN, a_user->username,
+             USERNAME_MAX_LEN, b_user->username);
+
+    error_code err = server_send_match_found(a, b_user, STATUS_OK, game->id);
+    if (err != ERR_NONE) {
+        LOG_ERROR("%s CLIENT %d: Failed to send match found", error_to_string(err), a->sock_fd);
+    }
+
+    err = server_send_match_found(b, a_user, STATUS_OK, game->id);
+    if (err != ERR_NONE) {
+        LOG_ERROR("%s CLIENT %d: Failed to send match found", error_to_string(err), b->sock_fd);
+    }
+
+    return MATCHMAKER_PAIRED;
+}
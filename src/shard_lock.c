@@ -0,0 +1,73 @@
+#include "include/shard_lock.h"
+#include "include/server_stats.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Reads the current thread has left until it adds a sample to the lock it takes
+static __thread uint32_t reads_until_sample = SHARD_LOCK_READ_SAMPLE;
+
+void shard_lock_init(shard_lock_t* lock) {
+    pthread_rwlock_init(&lock->lock, NULL);
+    atomic_init(&lock->reads, 0);
+    atomic_init(&lock->writes, 0);
+    atomic_init(&lock->contended, 0);
+    atomic_init(&lock->wait_ns, 0);
+    atomic_init(&lock->hold_ns, 0);
+}
+
+void shard_lock_destroy(shard_lock_t* lock) {
+    pthread_rwlock_destroy(&lock->lock);
+}
+
+// Wait is only timed when the lock is taken, uncontended locks read the clock once
+static uint64_t shard_lock_contended(shard_lock_t* lock, int (*lock_fn)(pthread_rwlock_t*)) {
+    uint64_t started_at = server_stats_now_ns();
+    lock_fn(&lock->lock);
+    uint64_t locked_at = server_stats_now_ns();
+
+    atomic_fetch_add_explicit(&lock->contended, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&lock->wait_ns, locked_at - started_at, memory_order_relaxed);
+    return locked_at;
+}
+
+uint64_t shard_lock_read(shard_lock_t* lock) {
+    if (--reads_until_sample == 0) {
+        reads_until_sample = SHARD_LOCK_READ_SAMPLE;
+        atomic_fetch_add_explicit(&lock->reads, SHARD_LOCK_READ_SAMPLE, memory_order_relaxed);
+    }
+    if (pthread_rwlock_tryrdlock(&lock->lock) == 0) {
+        return 0;
+    }
+
+    shard_lock_contended(lock, pthread_rwlock_rdlock);
+    return 0;
+}
+
+uint64_t shard_lock_write(shard_lock_t* lock) {
+    atomic_fetch_add_explicit(&lock->writes, 1, memory_order_relaxed);
+    if (pthread_rwlock_trywrlock(&lock->lock) == 0) {
+        return server_stats_now_ns();
+    }
+
+    return shard_lock_contended(lock, pthread_rwlock_wrlock);
+}
+
+void shard_lock_unlock(shard_lock_t* lock, uint64_t locked_at) {
+    if (locked_at == 0) {
+        pthread_rwlock_unlock(&lock->lock);
+        return;
+    }
+
+    uint64_t held = server_stats_now_ns() - locked_at;
+    pthread_rwlock_unlock(&lock->lock);
+    atomic_fetch_add_explicit(&lock->hold_ns, held, memory_order_relaxed);
+}
+
+void shard_lock_stats(const shard_lock_t* lock, shard_lock_stats_t* out) {
+    out->reads = atomic_load_explicit(&lock->reads, memory_order_relaxed);
+    out->writes = atomic_load_explicit(&lock->writes, memory_order_relaxed);
+    out->contended = atomic_load_explicit(&lock->contended, memory_order_relaxed);
+    out->wait_ns = atomic_load_explicit(&lock->wait_ns, memory_order_relaxed);
+    out->hold_ns = atomic_load_explicit(&lock->hold_ns, memory_order_relaxed);
+}
@@ -0,0 +1,63 @@
+#include "include/slot_pool.h"
+#include "include/errors.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+error_code slot_pool_init(slot_pool_t* pool, uint32_t element_size) {
+    pool->chunks = calloc(SLOT_POOL_MAX_CHUNKS, sizeof(char*));
+    if (pool->chunks == NULL) {
+        return ERR_ALLOC;
+    }
+
+    pool->element_size = element_size;
+    pool->len = 0;
+    return ERR_NONE;
+}
+
+void slot_pool_deinit(slot_pool_t* pool) {
+    if (pool->chunks == NULL) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < SLOT_POOL_MAX_CHUNKS && pool->chunks[i] != NULL; i++) {
+        free(pool->chunks[i]);
+    }
+
+    free(pool->chunks);
+    pool->chunks = NULL;
+    pool->len = 0;
+}
+
+uint32_t slot_pool_len(const slot_pool_t* pool) {
+    return pool->len;
+}
+
+void* slot_pool_at(const slot_pool_t* pool, uint32_t index) {
+    return pool->chunks[index >> SLOT_POOL_CHUNK_SHIFT] + (index & (SLOT_POOL_CHUNK_LEN - 1)) * pool->element_size;
+}
+
+void* slot_pool_push(slot_pool_t* pool, const void* element) {
+    uint32_t chunk = pool->len >> SLOT_POOL_CHUNK_SHIFT;
+    if (chunk >= SLOT_POOL_MAX_CHUNKS) {
+        return NULL;
+    }
+
+    if (pool->chunks[chunk] == NULL) {
+        pool->chunks[chunk] = malloc((uint64_t)SLOT_POOL_CHUNK_LEN * pool->element_size);
+        if (pool->chunks[chunk] == NULL) {
+            return NULL;
+        }
+    }
+
+    void* out = slot_pool_at(pool, pool->len);
+    memcpy(out, element, pool->element_size);
+    pool->len++;
+    return out;
+}
+
+void slot_pool_pop(slot_pool_t* pool) {
+    if (pool->len > 0) {
+        pool->len--;
+    }
+}
@@ -0,0 +1,176 @@
+#include "include/username_map.h"
+#include "include/errors.h"
+#include "include/globals.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+
+// FNV-1a of the username, usernames are not always null terminated
+// when they are USERNAME_MAX_LEN long so at most USERNAME_MAX_LEN bytes are hashed
+uint32_t username_map_hash(const char* key) {
+    uint32_t hash = FNV_OFFSET;
+    for (uint32_t i = 0; i < USERNAME_MAX_LEN && key[i] != '\0'; i++) {
+        hash ^= (uint8_t)key[i];
+        hash *= FNV_PRIME;
+    }
+
+    // Keep empty and tombstone markers free
+    if (hash <= USERNAME_MAP_TOMBSTONE) {
+        hash += USERNAME_MAP_TOMBSTONE + 1;
+    }
+
+    return hash;
+}
+
+static uint32_t round_up_pow2(uint32_t n) {
+    uint32_t cap = USERNAME_MAP_MIN_CAP;
+    while (cap < n) {
+        cap <<= 1;
+    }
+    return cap;
+}
+
+error_code username_map_init(username_map_t* map, uint32_t cap) {
+    // Keep the map under 75% full for the requested number of entries
+    map->cap = round_up_pow2(cap + cap / 3 + 1);
+    map->len = 0;
+    map->tombstones = 0;
+    map->entries = calloc(map->cap, sizeof(username_map_entry_t));
+    if (map->entries == NULL) {
+        return ERR_ALLOC;
+    }
+
+    return ERR_NONE;
+}
+
+void username_map_deinit(username_map_t* map) {
+    free(map->entries);
+    map->entries = NULL;
+    map->cap = 0;
+    map->len = 0;
+    map->tombstones = 0;
+}
+
+// Returns the index of the entry with the key or the index
+// of the first free entry where the key can be inserted
+static uint32_t username_map_find(const username_map_t* map, const char* key, uint32_t hash, uint8_t* found) {
+    uint32_t mask = map->cap - 1;
+    uint32_t index = hash & mask;
+    uint32_t first_free = UINT32_MAX;
+
+    while (1) {
+        const username_map_entry_t* entry = &map->entries[index];
+        if (entry->hash == USERNAME_MAP_EMPTY) {
+            *found = 0;
+            return first_free != UINT32_MAX ? first_free : index;
+        }
+
+        if (entry->hash == USERNAME_MAP_TOMBSTONE) {
+            if (first_free == UINT32_MAX) {
+                first_free = index;
+            }
+        } else if (entry->hash == hash && strncmp(entry->key, key, USERNAME_MAX_LEN) == 0) {
+            *found = 1;
+            return index;
+        }
+
+        index = (index + 1) & mask;
+    }
+}
+
+static error_code username_map_grow(username_map_t* map) {
+    username_map_t grown;
+
+    // If most of the used entries are tombstones rehash into the same size
+    uint32_t cap = map->len * 2 >= map->cap / 2 ? map->cap * 2 : map->cap;
+
+    grown.cap = cap;
+    grown.len = 0;
+    grown.tombstones = 0;
+    grown.entries = calloc(cap, sizeof(username_map_entry_t));
+    if (grown.entries == NULL) {
+        return ERR_ALLOC;
+    }
+
+    for (uint32_t i = 0; i < map->cap; i++) {
+        username_map_entry_t* entry = &map->entries[i];
+        if (entry->hash <= USERNAME_MAP_TOMBSTONE) {
+            continue;
+        }
+
+        uint8_t found;
+        uint32_t index = username_map_find(&grown, entry->key, entry->hash, &found);
+        grown.entries[index] = *entry;
+        grown.len++;
+    }
+
+    free(map->entries);
+    *map = grown;
+    return ERR_NONE;
+}
+
+error_code username_map_put(username_map_t* map, const char* key, uint32_t value) {
+    if ((map->len + map->tombstones + 1) * 4 >= map->cap * 3) {
+        error_code err = username_map_grow(map);
+        if (err != ERR_NONE) {
+            return err;
+        }
+    }
+
+    uint32_t hash = username_map_hash(key);
+    uint8_t found;
+    uint32_t index = username_map_find(map, key, hash, &found);
+    if (found) {
+        return ERR_USERNAME_EXISTS;
+    }
+
+    username_map_entry_t* entry = &map->entries[index];
+    if (entry->hash == USERNAME_MAP_TOMBSTONE) {
+        map->tombstones--;
+    }
+
+    entry->hash = hash;
+    entry->value = value;
+    // Keys fill the whole field, they're only NUL terminated when they're shorter
+    size_t key_len = strnlen(key, USERNAME_MAX_LEN);
+    memcpy(entry->key, key, key_len);
+    memset(entry->key + key_len, 0, USERNAME_MAX_LEN - key_len);
+    map->len++;
+
+    return ERR_NONE;
+}
+
+uint8_t username_map_get(const username_map_t* map, const char* key, uint32_t* value) {
+    if (map->len == 0) {
+        return 0;
+    }
+
+    uint8_t found;
+    uint32_t index = username_map_find(map, key, username_map_hash(key), &found);
+    if (found) {
+        *value = map->entries[index].value;
+    }
+
+    return found;
+}
+
+uint8_t username_map_remove(username_map_t* map, const char* key) {
+    if (map->len == 0) {
+        return 0;
+    }
+
+    uint8_t found;
+    uint32_t index = username_map_find(map, key, username_map_hash(key), &found);
+    if (!found) {
+        return 0;
+    }
+
+    map->entries[index].hash = USERNAME_MAP_TOMBSTONE;
+    map->len--;
+    map->tombstones++;
+
+    return 1;
+}
@@ -1,102 +1,228 @@
 #include <include/users.h>
 #include "include/errors.h"
 #include "include/globals.h"
-#include "include/vector/vector.h"
+#include "include/rating.h"
+#include "include/record_table.h"
+#include <fcntl.h>
+#include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 
-error_code users_load(Vector* users, const char* filepath) {
-    FILE* file = fopen(filepath, "ab+");;
-    if (file == NULL) {
+static error_code users_build_index(record_table_t* users, username_map_t* index);
+
+// Users file without a header is an array of server_user_legacy_t, every
+// user gets the default rating and is written into a new file that replaces the legacy one
+static error_code users_convert_legacy(int fd, uint64_t size, const char* filepath) {
+    if (size % sizeof(server_user_legacy_t) != 0) {
+        fprintf(stderr, RED "ERROR: Users file has no header and isn't a legacy users file\n" RESET);
         return ERR_UNKNOWN;
     }
 
-    fseek(file, 0, SEEK_END);
-    int64_t isize = ftell(file);
-    if (isize == -1) {
-        fclose(file);
+    char tmp_filepath[PATH_MAX];
+    if (snprintf(tmp_filepath, sizeof(tmp_filepath), "%s.tmp", filepath) >= (int)sizeof(tmp_filepath)) {
+        return ERR_IARG;
+    }
+
+    FILE* converted = fopen(tmp_filepath, "w");
+    if (converted == NULL) {
         return ERR_UNKNOWN;
     }
-    
-    uint64_t size = (uint64_t)isize; 
 
-    fseek(file, 0, SEEK_SET);
+    users_header_t header = { .magic = USERS_MAGIC, .version = USERS_VERSION };
+    fwrite(&header, sizeof(header), 1, converted);
 
-    // Check if fseek failed
-    isize = ftell(file);
-    if (isize == -1) {
-        fclose(file);
+    uint64_t user_count = size / sizeof(server_user_legacy_t);
+    server_user_legacy_t legacy;
+
+    for (uint64_t i = 0; i < user_count; i++) {
+        if (pread(fd, &legacy, sizeof(legacy), i * sizeof(legacy)) != sizeof(legacy)) {
+            fprintf(stderr, RED "ERROR: Failed to read legacy user %lu\n" RESET, i);
+            fclose(converted);
+            unlink(tmp_filepath);
+            return ERR_UNKNOWN;
+        }
+
+        server_user_t user = { 0 };
+        memcpy(user.username, legacy.username, USERNAME_MAX_LEN);
+        memcpy(user.password, legacy.password, PASSWORD_MAX_LEN);
+        user.rating = RATING_DEFAULT;
+
+        fwrite(&user, sizeof(user), 1, converted);
+    }
+
+    if (ferror(converted) || fflush(converted) != 0 || fsync(fileno(converted)) == -1) {
+        fclose(converted);
+        unlink(tmp_filepath);
         return ERR_UNKNOWN;
     }
 
-    if (isize != 0) {
-        fprintf(stderr, RED "ERROR: After calling fseek to set cursor at the beginning ftell returned %ld\n" RESET, isize);
-        fclose(file);
+    fclose(converted);
+
+    if (rename(tmp_filepath, filepath) == -1) {
+        unlink(tmp_filepath);
+        return ERR_UNKNOWN;
+    }
+
+    fprintf(stdout, "Converted %lu legacy users, %lu -> %lu bytes\n", user_count, size,
+            sizeof(users_header_t) + user_count * sizeof(server_user_t));
+    return ERR_NONE;
+}
+
+// Opens the users file, legacy files are converted first. Returns the size of the file without the header
+static error_code users_open(const char* filepath, int* out_fd, uint64_t* out_size) {
+    int fd = open(filepath, O_RDONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        return ERR_UNKNOWN;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return ERR_UNKNOWN;
+    }
+
+    uint64_t size = st.st_size;
+    if (size == 0) {
+        // New file, header is written with the first snapshot
+        *out_fd = fd;
+        *out_size = 0;
+        return ERR_NONE;
+    }
+
+    users_header_t header = { 0 };
+    if (size < sizeof(header) || pread(fd, &header, sizeof(header), 0) != sizeof(header) || header.magic != USERS_MAGIC) {
+        error_code err = users_convert_legacy(fd, size, filepath);
+        close(fd);
+        if (err != ERR_NONE) {
+            return err;
+        }
+
+        return users_open(filepath, out_fd, out_size);
+    }
+
+    if (header.version != USERS_VERSION) {
+        fprintf(stderr, RED "ERROR: Users file version %u is not supported\n" RESET, header.version);
+        close(fd);
         return ERR_UNKNOWN;
     }
 
+    *out_fd = fd;
+    *out_size = size - sizeof(header);
+    return ERR_NONE;
+}
+
+// Users are not read into memory, the file is mapped and the
+// users are read from the page cache when they are used
+error_code users_load(record_table_t* users, username_map_t* index, const char* filepath) {
+    error_code err = record_table_create(users, sizeof(server_user_t));
+    if (err != ERR_NONE) {
+        return err;
+    }
+
+    int fd;
+    uint64_t size;
+    err = users_open(filepath, &fd, &size);
+    if (err != ERR_NONE) {
+        return err;
+    }
+
     uint64_t user_count = size / sizeof(server_user_t);
+
+    if (size % sizeof(server_user_t) != 0) {
+        fprintf(stderr, YELLOW "WARNING: Users file size %lu is not a multiple of the user size, ignoring the last %lu bytes\n" RESET,
+                size, size % sizeof(server_user_t));
+    }
+
     if (user_count == 0) {
         fprintf(stdout, "No users to load, skipping...\n");
-        vector_create(users, sizeof(server_user_t));
-        fclose(file);
-        return ERR_NONE;
+        close(fd);
+        return users_build_index(users, index);
     }
 
-    // allocate memory for all users
-    users->elements = malloc(sizeof(server_user_t) * user_count);
-    if (users->elements == NULL) {
-        fclose(file);
-        return ERR_ALLOC;
+    // Mapping stays valid after the file is closed
+    err = record_table_map(users, fd, sizeof(users_header_t), user_count);
+    close(fd);
+    if (err != ERR_NONE) {
+        return err;
     }
 
-    users->element_size = sizeof(server_user_t); 
-    users->logical_length = user_count;
-    users->actual_length = user_count;
+    fprintf(stdout, "Loaded all %lu users, total file size %lu\n" RESET, user_count, size + sizeof(users_header_t));
+    return users_build_index(users, index);
+}
 
-    uint64_t count = fread(users->elements, sizeof(server_user_t), user_count, file);
-    if (ferror(file)) {
-        fprintf(stderr, RED "ERROR: Failed to read all users: expected %lu, read %lu\n" RESET, user_count, count);
-        fclose(file);
-        return ERR_UNKNOWN;
+static error_code users_build_index(record_table_t* users, username_map_t* index) {
+    uint32_t users_len = record_table_len(users);
+    error_code err = username_map_init(index, users_len);
+    if (err != ERR_NONE) {
+        return err;
     }
 
-    if (count == user_count) {
-        fprintf(stdout, "Loaded all %lu users, total file size %lu\n" RESET, user_count, size);
-        fclose(file);
-        return ERR_NONE;
+    for (uint32_t i = 0; i < users_len; i++) {
+        server_user_t* user = record_table_at(users, i);
+        err = username_map_put(index, user->username, i);
+        if (err == ERR_USERNAME_EXISTS) {
+            // Keep the first user, same as the linear search did
+            fprintf(stderr, YELLOW "WARNING: User \"%.*s\" is saved more than once\n" RESET, USERNAME_MAX_LEN, user->username);
+            continue;
+        }
+
+        if (err != ERR_NONE) {
+            return err;
+        }
     }
 
-    // We didn't reach the end of file 
-    fprintf(stderr, RED "ERROR: Didn't reach the end of file, users to read: expected %lu, read %lu\n" RESET, user_count, count);
-    fclose(file);
-    return ERR_UNKNOWN;
+    return ERR_NONE;
 }
 
-error_code users_save(Vector* users, const char* filepath) {
-    FILE* file = fopen(filepath, "w");;
+// Users are written to a temporary file which replaces the old file
+// only once it's on disk, so a crash never leaves a partially written file.
+// Users come from the table or from the array if there is no table.
+static error_code users_write(const record_table_t* table, const server_user_t* users, uint32_t len, const char* filepath) {
+    char tmp_filepath[PATH_MAX];
+    if (snprintf(tmp_filepath, sizeof(tmp_filepath), "%s.tmp", filepath) >= (int)sizeof(tmp_filepath)) {
+        return ERR_IARG;
+    }
+
+    FILE* file = fopen(tmp_filepath, "w");
     if (file == NULL) {
         return ERR_UNKNOWN;
     }
 
-    fseek(file, 0, SEEK_SET);
-    int64_t isize = ftell(file);
-    if (isize == -1) {
+    users_header_t header = { .magic = USERS_MAGIC, .version = USERS_VERSION };
+    error_code err = fwrite(&header, sizeof(header), 1, file) == 1 ? ERR_NONE : ERR_UNKNOWN;
+    if (err == ERR_NONE) {
+        if (table != NULL) {
+            err = record_table_write(table, file);
+        } else if (len > 0 && fwrite(users, sizeof(server_user_t), len, file) != len) {
+            err = ERR_UNKNOWN;
+        }
+    }
+    if (err != ERR_NONE || fflush(file) != 0 || fsync(fileno(file)) == -1) {
         fclose(file);
+        unlink(tmp_filepath);
         return ERR_UNKNOWN;
     }
 
-    fwrite(users->elements, sizeof(server_user_t), users->logical_length, file);
-    if (ferror(file)) {
-        fclose(file);
+    fclose(file);
+
+    if (rename(tmp_filepath, filepath) == -1) {
+        unlink(tmp_filepath);
         return ERR_UNKNOWN;
     }
 
-    fprintf(stdout, "Saved %u users\n" RESET, users->logical_length);
-
-    fclose(file);
+    fprintf(stdout, "Saved %u users\n" RESET, table != NULL ? record_table_len(table) : len);
     return ERR_NONE;
 }
+
+error_code users_save(record_table_t* users, const char* filepath) {
+    return users_write(users, NULL, 0, filepath);
+}
+
+error_code users_save_array(const server_user_t* users, uint32_t len, const char* filepath) {
+    return users_write(NULL, users, len, filepath);
+}
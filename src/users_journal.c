@@ -0,0 +1,470 @@
+#include "include/users_journal.h"
+#include "include/checksum.h"
+#include "include/errors.h"
+#include "include/globals.h"
+#include "include/rating.h"
+#include "include/username_map.h"
+#include "include/users.h"
+#include "include/record_table.h"
+#include "include/shard_lock.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static void* users_journal_flusher(void* params);
+
+static uint32_t users_journal_checksum(const users_journal_record_t* record) {
+    return checksum_crc32(0, (const char*)record + sizeof(record->checksum),
+                          sizeof(users_journal_record_t) - sizeof(record->checksum));
+}
+
+static uint32_t users_journal_legacy_checksum(const users_journal_legacy_record_t* record) {
+    return checksum_crc32(0, (const char*)record + sizeof(record->checksum),
+                          sizeof(users_journal_legacy_record_t) - sizeof(record->checksum));
+}
+
+// Legacy logs have shorter records, the first record tells which kind of log it is
+static uint8_t users_journal_is_legacy(int fd) {
+    users_journal_record_t record;
+    if (pread(fd, &record, sizeof(record), 0) == sizeof(record) && users_journal_checksum(&record) == record.checksum) {
+        return 0;
+    }
+
+    users_journal_legacy_record_t legacy;
+    return pread(fd, &legacy, sizeof(legacy), 0) == sizeof(legacy) && users_journal_legacy_checksum(&legacy) == legacy.checksum;
+}
+
+// Reads the record at the offset, legacy records are converted. Returns the number of bytes
+// read like pread, valid is set only if the whole record was read and the checksum matches
+static ssize_t users_journal_read(int fd, uint8_t legacy, off_t offset, users_journal_record_t* record, uint8_t* valid) {
+    if (!legacy) {
+        ssize_t read = pread(fd, record, sizeof(*record), offset);
+        *valid = read == sizeof(*record) && users_journal_checksum(record) == record->checksum;
+        return read;
+    }
+
+    users_journal_legacy_record_t legacy_record;
+    ssize_t read = pread(fd, &legacy_record, sizeof(legacy_record), offset);
+    *valid = read == sizeof(legacy_record) && users_journal_legacy_checksum(&legacy_record) == legacy_record.checksum;
+    if (!*valid) {
+        return read;
+    }
+
+    memset(record, 0, sizeof(*record));
+    record->type = legacy_record.type;
+    record->index = legacy_record.index;
+    memcpy(record->user.username, legacy_record.user.username, USERNAME_MAX_LEN);
+    memcpy(record->user.password, legacy_record.user.password, PASSWORD_MAX_LEN);
+    record->user.rating = RATING_DEFAULT;
+    return read;
+}
+
+// Applies every valid record from the log. Log ends at the first cut or
+// corrupted record, everything after it is truncated so new records follow valid ones
+static error_code users_journal_replay(users_journal_t* journal, int fd, record_table_t* users, username_map_t* index) {
+    users_journal_record_t record;
+    off_t offset = 0;
+    uint8_t legacy = users_journal_is_legacy(fd);
+    off_t record_len = legacy ? sizeof(users_journal_legacy_record_t) : sizeof(users_journal_record_t);
+
+    while (1) {
+        uint8_t valid;
+        ssize_t read = users_journal_read(fd, legacy, offset, &record, &valid);
+        if (read == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            fprintf(stderr, RED "ERROR: Failed to read users log, %s\n" RESET, strerror(errno));
+            return ERR_UNKNOWN;
+        }
+
+        if (read == 0) {
+            break;
+        }
+
+        if (!valid) {
+            fprintf(stderr, YELLOW "WARNING: Users log has an incomplete record at offset %ld, dropping the rest of the log\n" RESET, offset);
+            break;
+        }
+
+        uint32_t users_len = record_table_len(users);
+        uint8_t applies = (record.type == USERS_JOURNAL_ADD_USER && record.index <= users_len) ||
+                          (record.type == USERS_JOURNAL_UPDATE_USER && record.index < users_len);
+        if (!applies) {
+            fprintf(stderr, YELLOW "WARNING: Users log has an invalid record at offset %ld, dropping the rest of the log\n" RESET, offset);
+            break;
+        }
+
+        if (record.type == USERS_JOURNAL_UPDATE_USER) {
+            // Mapping is private, the users file doesn't change until the next snapshot
+            server_user_t* user = record_table_at(users, record.index);
+            *user = record.user;
+        } else if (record.index == users_len) {
+            // Users before the snapshot was written are already loaded, these
+            // records are left if the server stopped in the middle of a compaction
+            if (username_map_put(index, record.user.username, record.index) == ERR_USERNAME_EXISTS) {
+                fprintf(stderr, YELLOW "WARNING: User \"%.*s\" is saved more than once\n" RESET, USERNAME_MAX_LEN, record.user.username);
+            }
+            record_table_push(users, &record.user);
+        }
+
+        offset += record_len;
+        journal->log_records++;
+    }
+
+    // New records can't follow legacy ones, everything is saved into a snapshot and the log starts empty
+    if (legacy && offset > 0) {
+        error_code err = users_save(users, journal->snapshot_path);
+        if (err != ERR_NONE) {
+            fprintf(stderr, RED "ERROR: Failed to save users converted from the legacy users log\n" RESET);
+            return err;
+        }
+
+        fprintf(stdout, "Converted %u legacy users log records\n", journal->log_records);
+        offset = 0;
+    }
+
+    if (ftruncate(fd, offset) == -1) {
+        fprintf(stderr, RED "ERROR: Failed to truncate users log, %s\n" RESET, strerror(errno));
+        return ERR_UNKNOWN;
+    }
+
+    fprintf(stdout, "Replayed %u users log records\n", journal->log_records);
+    return ERR_NONE;
+}
+
+error_code users_journal_open(users_journal_t* journal, const char* snapshot_path, const char* log_path,
+                              record_table_t* users, username_map_t* index, shard_lock_t* users_lock) {
+    journal->snapshot_path = snapshot_path;
+    journal->log_path = log_path;
+    journal->users = users;
+    journal->users_lock = users_lock;
+    journal->written = 0;
+    journal->synced = 0;
+    journal->sync_error = ERR_NONE;
+    journal->log_records = 0;
+    journal->running = 1;
+    journal->compact_requested = 0;
+    journal->compacting = 0;
+    journal->compactions = 0;
+    journal->compact_error = ERR_NONE;
+    journal->old_log = 0;
+    if (snprintf(journal->old_log_path, sizeof(journal->old_log_path), "%s.old", log_path) >= (int)sizeof(journal->old_log_path)) {
+        return ERR_IARG;
+    }
+
+    // Server stopped after a compaction swapped the logs and before its snapshot was written
+    error_code err;
+    int old_fd = open(journal->old_log_path, O_RDWR | O_CLOEXEC);
+    if (old_fd != -1) {
+        err = users_journal_replay(journal, old_fd, users, index);
+        close(old_fd);
+        if (err != ERR_NONE) {
+            return err;
+        }
+        journal->old_log = 1;
+    } else if (errno != ENOENT) {
+        fprintf(stderr, RED "ERROR: Failed to open old users log, %s\n" RESET, strerror(errno));
+        return ERR_IFD;
+    }
+
+    journal->fd = open(log_path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (journal->fd == -1) {
+        fprintf(stderr, RED "ERROR: Failed to open users log, %s\n" RESET, strerror(errno));
+        return ERR_IFD;
+    }
+
+    err = users_journal_replay(journal, journal->fd, users, index);
+    if (err != ERR_NONE) {
+        close(journal->fd);
+        return err;
+    }
+
+    // Snapshot covers both logs now. Log is kept, replaying it over the snapshot changes nothing.
+    if (journal->old_log) {
+        err = users_save(users, snapshot_path);
+        if (err != ERR_NONE) {
+            fprintf(stderr, RED "ERROR: Failed to save users replayed from the old users log\n" RESET);
+            close(journal->fd);
+            return err;
+        }
+
+        if (unlink(journal->old_log_path) == 0) {
+            journal->old_log = 0;
+        }
+    }
+
+    pthread_mutex_init(&journal->lock, NULL);
+    pthread_cond_init(&journal->pending, NULL);
+    pthread_cond_init(&journal->synced_cond, NULL);
+
+    // Keep signals on the main thread
+    sigset_t blocked, old;
+    sigfillset(&blocked);
+    pthread_sigmask(SIG_BLOCK, &blocked, &old);
+    int ret = pthread_create(&journal->flusher, NULL, users_journal_flusher, journal);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (ret != 0) {
+        fprintf(stderr, RED "ERROR: Failed to start users log flusher\n" RESET);
+        pthread_cond_destroy(&journal->synced_cond);
+        pthread_cond_destroy(&journal->pending);
+        pthread_mutex_destroy(&journal->lock);
+        close(journal->fd);
+        return ERR_UNKNOWN;
+    }
+
+    return ERR_NONE;
+}
+
+void users_journal_close(users_journal_t* journal) {
+    pthread_mutex_lock(&journal->lock);
+    journal->running = 0;
+    pthread_cond_signal(&journal->pending);
+    pthread_mutex_unlock(&journal->lock);
+
+    // Flusher syncs all written records before it stops
+    pthread_join(journal->flusher, NULL);
+
+    close(journal->fd);
+    pthread_cond_destroy(&journal->synced_cond);
+    pthread_cond_destroy(&journal->pending);
+    pthread_mutex_destroy(&journal->lock);
+}
+
+uint64_t users_journal_append(users_journal_t* journal, uint32_t type, uint32_t index, const server_user_t* user) {
+    users_journal_record_t record = { 0 };
+    record.type = type;
+    record.index = index;
+    record.user = *user;
+    record.checksum = users_journal_checksum(&record);
+
+    pthread_mutex_lock(&journal->lock);
+
+    ssize_t written = write(journal->fd, &record, sizeof(record));
+    if (written != sizeof(record)) {
+        fprintf(stderr, RED "ERROR: Failed to write users log record, %s\n" RESET, written == -1 ? strerror(errno) : "short write");
+
+        // Replay stops at a cut record so remove it, otherwise every record after it is lost
+        struct stat st;
+        if (written > 0 && fstat(journal->fd, &st) == 0 && ftruncate(journal->fd, st.st_size - written) == -1) {
+            fprintf(stderr, RED "ERROR: Failed to remove cut users log record, %s\n" RESET, strerror(errno));
+        }
+
+        pthread_mutex_unlock(&journal->lock);
+        return 0;
+    }
+
+    uint64_t seq = ++journal->written;
+    journal->log_records++;
+    pthread_cond_signal(&journal->pending);
+
+    pthread_mutex_unlock(&journal->lock);
+    return seq;
+}
+
+error_code users_journal_sync(users_journal_t* journal, uint64_t seq) {
+    pthread_mutex_lock(&journal->lock);
+    while (journal->synced < seq && journal->sync_error == ERR_NONE) {
+        pthread_cond_wait(&journal->synced_cond, &journal->lock);
+    }
+    error_code err = journal->synced >= seq ? ERR_NONE : journal->sync_error;
+    pthread_mutex_unlock(&journal->lock);
+    return err;
+}
+
+error_code users_journal_compact(users_journal_t* journal) {
+    pthread_mutex_lock(&journal->lock);
+
+    // Compaction that is already running could have copied the users before the caller changed them
+    uint32_t target = journal->compactions + (journal->compacting ? 2 : 1);
+    journal->compact_requested = 1;
+    pthread_cond_signal(&journal->pending);
+    while (journal->compactions < target) {
+        pthread_cond_wait(&journal->synced_cond, &journal->lock);
+    }
+    error_code err = journal->compact_error;
+
+    pthread_mutex_unlock(&journal->lock);
+    return err;
+}
+
+// New log is only found after a crash once the directory is on disk
+static int users_journal_sync_dir(const char* path) {
+    char dir[PATH_MAX] = ".";
+    const char* slash = strrchr(path, '/');
+    if (slash != NULL) {
+        size_t len = slash == path ? 1 : (size_t)(slash - path);
+        if (len >= sizeof(dir)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        memcpy(dir, path, len);
+        dir[len] = '\0';
+    }
+
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+
+    int ret = fsync(fd);
+    close(fd);
+    return ret;
+}
+
+// Runs on the flusher, the only thread that swaps the log. Appends wait only for the copy
+// of the users and the swap of the logs, never for the snapshot or an fsync.
+static error_code users_journal_rotate(users_journal_t* journal) {
+    // Records are written under the users write lock so
+    // the log can't change while the users are copied
+    uint64_t locked_at = shard_lock_read(journal->users_lock);
+
+    uint32_t len = record_table_len(journal->users);
+    server_user_t* users = malloc((size_t)(len > 0 ? len : 1) * sizeof(server_user_t));
+    if (users == NULL) {
+        shard_lock_unlock(journal->users_lock, locked_at);
+        return ERR_ALLOC;
+    }
+    record_table_copy(journal->users, users);
+
+    // Old log of a compaction whose snapshot failed is still needed, the log isn't swapped again
+    // until it's gone. Snapshot covers the log then as well, replaying it over the snapshot changes nothing.
+    int old_fd = -1;
+    int rotate_errno = 0;
+    pthread_mutex_lock(&journal->lock);
+    uint64_t rotated = journal->written;
+    if (!journal->old_log) {
+        if (rename(journal->log_path, journal->old_log_path) == 0) {
+            int fd = open(journal->log_path, O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+            if (fd != -1) {
+                old_fd = journal->fd;
+                journal->fd = fd;
+                journal->old_log = 1;
+                journal->log_records = 0;
+            } else {
+                rotate_errno = errno;
+                rename(journal->old_log_path, journal->log_path);
+            }
+        } else {
+            rotate_errno = errno;
+        }
+    }
+    uint8_t old_log = journal->old_log;
+    pthread_mutex_unlock(&journal->lock);
+    shard_lock_unlock(journal->users_lock, locked_at);
+
+    if (!old_log) {
+        fprintf(stderr, RED "ERROR: Failed to swap users log, %s\n" RESET, strerror(rotate_errno));
+        free(users);
+        return ERR_UNKNOWN;
+    }
+
+    if (old_fd != -1) {
+        // Records of the old log the flusher didn't sync yet
+        int ret = fdatasync(old_fd);
+        close(old_fd);
+        if (ret == 0) {
+            ret = users_journal_sync_dir(journal->log_path);
+        }
+        if (ret == -1) {
+            fprintf(stderr, RED "ERROR: Failed to sync swapped users log, %s\n" RESET, strerror(errno));
+        }
+
+        pthread_mutex_lock(&journal->lock);
+        if (ret == -1) {
+            journal->sync_error = ERR_SYNC_FAILED;
+        } else if (journal->synced < rotated) {
+            journal->synced = rotated;
+        }
+        pthread_cond_broadcast(&journal->synced_cond);
+        pthread_mutex_unlock(&journal->lock);
+
+        if (ret == -1) {
+            free(users);
+            return ERR_SYNC_FAILED;
+        }
+    }
+
+    error_code err = users_save_array(users, len, journal->snapshot_path);
+    free(users);
+    if (err == ERR_NONE && unlink(journal->old_log_path) == 0) {
+        journal->old_log = 0;
+    }
+
+    return err;
+}
+
+static void* users_journal_flusher(void* params) {
+    users_journal_t* journal = params;
+
+    pthread_mutex_lock(&journal->lock);
+
+    while (1) {
+        // Nothing is synced anymore after a failed fsync
+        while (journal->running && !journal->compact_requested &&
+               (journal->synced == journal->written || journal->sync_error != ERR_NONE)) {
+            pthread_cond_wait(&journal->pending, &journal->lock);
+        }
+
+        uint8_t unsynced = journal->synced < journal->written && journal->sync_error == ERR_NONE;
+        if (!unsynced && !journal->compact_requested) {
+            // Closing and everything is synced or can't be anymore
+            break;
+        }
+
+        if (unsynced) {
+            // Every record written until now is synced with the same fsync
+            uint64_t target = journal->written;
+            int fd = journal->fd;
+            pthread_mutex_unlock(&journal->lock);
+
+            int ret = fdatasync(fd);
+            if (ret == -1) {
+                fprintf(stderr, RED "ERROR: Failed to sync users log, %s\n" RESET, strerror(errno));
+            }
+
+            pthread_mutex_lock(&journal->lock);
+            if (ret == -1) {
+                // Waiting records fail, so does every record written from now on
+                journal->sync_error = ERR_SYNC_FAILED;
+            } else if (journal->synced < target) {
+                journal->synced = target;
+            }
+            pthread_cond_broadcast(&journal->synced_cond);
+        }
+
+        if (journal->compact_requested ||
+            (journal->sync_error == ERR_NONE && journal->log_records >= USERS_JOURNAL_COMPACT_RECORDS)) {
+            journal->compact_requested = 0;
+            journal->compacting = 1;
+            // Log isn't swapped after a failed fsync, the records that failed are only in it
+            error_code err = journal->sync_error;
+            pthread_mutex_unlock(&journal->lock);
+
+            if (err == ERR_NONE) {
+                err = users_journal_rotate(journal);
+            }
+            if (err != ERR_NONE) {
+                fprintf(stderr, RED "%s failed to compact users log\n" RESET, error_to_string(err));
+            }
+
+            pthread_mutex_lock(&journal->lock);
+            journal->compacting = 0;
+            journal->compact_error = err;
+            journal->compactions++;
+            pthread_cond_broadcast(&journal->synced_cond);
+        }
+    }
+
+    pthread_mutex_unlock(&journal->lock);
+    return NULL;
+}
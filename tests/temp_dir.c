@@ -0,0 +1,37 @@
+#include "tests/temp_dir.h"
+#include <dirent.h>
+#include <include/criterion/criterion.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+void temp_dir_create(temp_dir_t* dir, const char* name) {
+    int len = snprintf(dir->path, sizeof(dir->path), "/tmp/%s_XXXXXX", name);
+    cr_assert_lt(len, (int)sizeof(dir->path));
+    cr_assert_not_null(mkdtemp(dir->path));
+}
+
+void temp_dir_file(const temp_dir_t* dir, const char* filename, char* out, size_t out_len) {
+    int len = snprintf(out, out_len, "%s/%s", dir->path, filename);
+    cr_assert_lt(len, (int)out_len);
+}
+
+void temp_dir_remove(temp_dir_t* dir) {
+    DIR* entries = opendir(dir->path);
+    cr_assert_not_null(entries);
+
+    struct dirent* entry;
+    while ((entry = readdir(entries)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+
+        char filepath[128];
+        temp_dir_file(dir, entry->d_name, filepath, sizeof(filepath));
+        unlink(filepath);
+    }
+
+    closedir(entries);
+    cr_assert_eq(rmdir(dir->path), 0);
+}
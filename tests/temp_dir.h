@@ -0,0 +1,18 @@
+#ifndef TESTS_TEMP_DIR_H
+#define TESTS_TEMP_DIR_H
+
+#include <stddef.h>
+
+// Directory of a test under /tmp, files of the test go in it and are removed together with it
+typedef struct {
+    char path[64];
+} temp_dir_t;
+
+// Directory is named /tmp/<name>_XXXXXX
+void temp_dir_create(temp_dir_t* dir, const char* name);
+// Path of the file in the directory, the file isn't created
+void temp_dir_file(const temp_dir_t* dir, const char* filename, char* out, size_t out_len);
+// Removes every file in the directory and the directory
+void temp_dir_remove(temp_dir_t* dir);
+
+#endif
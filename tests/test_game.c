@@ -0,0 +1,76 @@
+#include "include/game.h"
+#include "include/game_board.h"
+#include "include/globals.h"
+#include "include/state.h"
+#include <include/criterion/criterion.h>
+#include <include/criterion/logging.h>
+#include <pthread.h>
+#include <string.h>
+
+// Both players have two ships at fields 10 and 11
+static server_game_t started_game(server_client_t* first, server_client_t* second) {
+    uint8_t fields[GAME_WIDTH * GAME_HEIGHT] = { 0 };
+    fields[10] = GAME_FIELD_SHIP;
+    fields[11] = GAME_FIELD_SHIP;
+
+    server_game_t game = game_new(first, second);
+    game.first_board = game_board_from_fields(fields);
+    game.second_board = game_board_from_fields(fields);
+    game.state = GAME_STATE_STARTED;
+    game.turn = GAME_FIRSTS_TURN;
+    return game;
+}
+
+Test(game, apply_shot_checks_turn) {
+    server_client_t first = { 0 };
+    server_client_t second = { 0 };
+    server_game_t game = started_game(&first, &second);
+
+    Coordinate miss = { .x = 0, .y = 0 };
+    Coordinate ship = { .x = 2, .y = 1 };
+    Coordinate outside = { .x = GAME_WIDTH, .y = 0 };
+
+    cr_assert_eq(game_apply_shot(&game, &second, miss).status_code, STATUS_GAME_NOT_MY_TURN);
+    cr_assert_eq(game_apply_shot(&game, &first, outside).status_code, STATUS_SHOT_INVALID_FIELD);
+
+    // Hit keeps the turn
+    game_shot_t shot = game_apply_shot(&game, &first, ship);
+    cr_assert_eq(shot.status_code, STATUS_OK);
+    cr_assert_eq(shot.hit, 1);
+    cr_assert_eq(shot.won, 0);
+    cr_assert_eq(shot.turn, GAME_FIRSTS_TURN);
+    cr_assert_eq(shot.other, &second);
+    cr_assert_eq(game_apply_shot(&game, &first, ship).status_code, STATUS_SHOT_ALREADY_DESTROYED);
+
+    // Miss passes it to the other player
+    shot = game_apply_shot(&game, &first, miss);
+    cr_assert_eq(shot.status_code, STATUS_OK);
+    cr_assert_eq(shot.hit, 0);
+    cr_assert_eq(shot.turn, GAME_SECONDS_TURN);
+    cr_assert_eq(game_apply_shot(&game, &first, ship).status_code, STATUS_GAME_NOT_MY_TURN);
+    cr_assert_eq(game_apply_shot(&game, &second, miss).status_code, STATUS_OK);
+
+    pthread_mutex_destroy(&game.lock);
+}
+
+Test(game, apply_shot_finishes_game) {
+    server_client_t first = { 0 };
+    server_client_t second = { 0 };
+    server_game_t game = started_game(&first, &second);
+
+    // First misses, second sinks both ships
+    cr_assert_eq(game_apply_shot(&game, &first, (Coordinate){ .x = 0, .y = 0 }).status_code, STATUS_OK);
+    cr_assert_eq(game_apply_shot(&game, &second, (Coordinate){ .x = 2, .y = 1 }).won, 0);
+
+    game_shot_t shot = game_apply_shot(&game, &second, (Coordinate){ .x = 3, .y = 1 });
+    cr_assert_eq(shot.status_code, STATUS_OK);
+    cr_assert_eq(shot.hit, 1);
+    cr_assert_eq(shot.won, 1);
+    cr_assert_eq(game.state, GAME_STATE_FINISHED);
+    cr_assert_eq(game.won, GAME_SECOND_WON);
+
+    // Nobody shoots after the game is finished
+    cr_assert_eq(game_apply_shot(&game, &first, (Coordinate){ .x = 1, .y = 0 }).status_code, STATUS_GAME_NOT_STARTED);
+
+    pthread_mutex_destroy(&game.lock);
+}
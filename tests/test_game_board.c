@@ -0,0 +1,38 @@
+#include "include/game_board.h"
+#include "include/globals.h"
+#include <include/criterion/criterion.h>
+#include <include/criterion/logging.h>
+#include <string.h>
+
+Test(game_board, fields_round_trip) {
+    uint8_t fields[GAME_WIDTH * GAME_HEIGHT] = { 0 };
+    fields[0] = GAME_FIELD_SHIP;
+    fields[9] = GAME_FIELD_HIT;
+    fields[63] = GAME_FIELD_MISS;
+
+    game_board_t board = game_board_from_fields(fields);
+    cr_assert_eq(board.ships, GAME_BOARD_BIT(0) | GAME_BOARD_BIT(9));
+    cr_assert_eq(board.hits, GAME_BOARD_BIT(9));
+    cr_assert_eq(board.misses, GAME_BOARD_BIT(63));
+
+    uint8_t out[GAME_WIDTH * GAME_HEIGHT];
+    game_board_to_fields(&board, out);
+    cr_assert_eq(memcmp(fields, out, sizeof(fields)), 0);
+}
+
+Test(game_board, shoot_until_sunk) {
+    uint8_t fields[GAME_WIDTH * GAME_HEIGHT] = { 0 };
+    fields[10] = GAME_FIELD_SHIP;
+    fields[11] = GAME_FIELD_SHIP;
+
+    game_board_t board = game_board_from_fields(fields);
+
+    cr_assert_eq(game_board_shoot(&board, 12), GAME_FIELD_EMPTY);
+    cr_assert_eq(game_board_shoot(&board, 12), GAME_FIELD_MISS);
+    cr_assert_eq(game_board_shoot(&board, 10), GAME_FIELD_SHIP);
+    cr_assert_eq(game_board_shoot(&board, 10), GAME_FIELD_HIT);
+    cr_assert_not(game_board_all_sunk(&board));
+
+    cr_assert_eq(game_board_shoot(&board, 11), GAME_FIELD_SHIP);
+    cr_assert(game_board_all_sunk(&board));
+}
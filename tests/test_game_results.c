@@ -0,0 +1,116 @@
+#include "include/errors.h"
+#include "include/game_results.h"
+#include "include/globals.h"
+#include "include/username_map.h"
+#include <include/criterion/criterion.h>
+#include <include/criterion/logging.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static void fill_fields(uint8_t* fields, uint8_t seed) {
+    for (uint8_t i = 0; i < GAME_WIDTH * GAME_HEIGHT; i++) {
+        fields[i] = (i * 7 + seed) % 4;
+    }
+}
+
+static void temp_filepath(char* filepath) {
+    strcpy(filepath, "/tmp/game_results_XXXXXX");
+    int fd = mkstemp(filepath);
+    cr_assert_neq(fd, -1);
+    close(fd);
+}
+
+Test(game_results, pack_board_round_trip) {
+    uint8_t fields[GAME_WIDTH * GAME_HEIGHT];
+    fill_fields(fields, 3);
+
+    uint8_t packed[GAME_RESULTS_BOARD_SIZE];
+    game_results_pack_board(fields, packed);
+
+    uint8_t unpacked[GAME_WIDTH * GAME_HEIGHT];
+    game_results_unpack_board(packed, unpacked);
+    cr_assert_eq(memcmp(fields, unpacked, sizeof(fields)), 0);
+}
+
+Test(game_results, convert_legacy_file) {
+    char filepath[32];
+    temp_filepath(filepath);
+
+    game_results_legacy_t legacy[2] = { 0 };
+    strcpy(legacy[0].first_player_username, "alice");
+    strcpy(legacy[0].second_player_username, "bob");
+    legacy[0].won = GAME_SECOND_WON;
+    fill_fields(legacy[0].first_game_state, 1);
+    fill_fields(legacy[0].second_game_state, 2);
+    strcpy(legacy[1].first_player_username, "bob");
+    strcpy(legacy[1].second_player_username, "deleted");
+    legacy[1].won = GAME_FIRST_WON;
+
+    FILE* file = fopen(filepath, "w");
+    cr_assert_not_null(file);
+    cr_assert_eq(fwrite(legacy, sizeof(legacy), 1, file), 1);
+    fclose(file);
+
+    username_map_t users_index;
+    cr_assert_eq(username_map_init(&users_index, 0), ERR_NONE);
+    cr_assert_eq(username_map_put(&users_index, "alice", 0), ERR_NONE);
+    cr_assert_eq(username_map_put(&users_index, "bob", 1), ERR_NONE);
+
+    record_table_t results;
+    cr_assert_eq(game_results_load(&results, filepath, &users_index), ERR_NONE);
+    cr_assert_eq(record_table_len(&results), 2);
+
+    game_results_t* result = record_table_at(&results, 0);
+    cr_assert_eq(result->first_player_id, 0);
+    cr_assert_eq(result->second_player_id, 1);
+    cr_assert_eq(result->won, GAME_SECOND_WON);
+
+    uint8_t fields[GAME_WIDTH * GAME_HEIGHT];
+    game_results_unpack_board(result->second_game_state, fields);
+    cr_assert_eq(memcmp(fields, legacy[0].second_game_state, sizeof(fields)), 0);
+
+    result = record_table_at(&results, 1);
+    cr_assert_eq(result->second_player_id, GAME_RESULTS_UNKNOWN_USER);
+    record_table_destroy(&results);
+
+    // File is rewritten in the new format
+    struct stat st;
+    cr_assert_eq(stat(filepath, &st), 0);
+    cr_assert_eq(st.st_size, sizeof(game_results_header_t) + 2 * sizeof(game_results_t));
+
+    cr_assert_eq(game_results_load(&results, filepath, NULL), ERR_NONE);
+    cr_assert_eq(record_table_len(&results), 2);
+    record_table_destroy(&results);
+
+    username_map_deinit(&users_index);
+    unlink(filepath);
+}
+
+Test(game_results, cut_result_is_dropped) {
+    char filepath[32];
+    temp_filepath(filepath);
+
+    record_table_t results;
+    cr_assert_eq(game_results_load(&results, filepath, NULL), ERR_NONE);
+    game_results_t result = { .first_player_id = 4, .second_player_id = 5, .won = GAME_FIRST_WON };
+    record_table_push(&results, &result);
+    cr_assert_eq(game_results_save(&results, filepath), ERR_NONE);
+    record_table_destroy(&results);
+
+    FILE* file = fopen(filepath, "a");
+    cr_assert_not_null(file);
+    cr_assert_eq(fwrite(&result, sizeof(result) / 2, 1, file), 1);
+    fclose(file);
+
+    cr_assert_eq(game_results_load(&results, filepath, NULL), ERR_NONE);
+    cr_assert_eq(record_table_len(&results), 1);
+    record_table_destroy(&results);
+
+    struct stat st;
+    cr_assert_eq(stat(filepath, &st), 0);
+    cr_assert_eq(st.st_size, sizeof(game_results_header_t) + sizeof(game_results_t));
+
+    unlink(filepath);
+}
@@ -1,5 +1,6 @@
 #include "include/errors.h"
 #include "include/game_ship.h"
+#include "include/globals.h"
 #include <include/criterion/criterion.h>
 #include <include/criterion/logging.h>
 #include <sys/socket.h>
@@ -128,3 +129,53 @@ Test(ships, ship_validate_coordinates) {
         cr_assert_eq(err, c.err, "%d invalid error", i);
     }
 }
+
+static uint64_t board_from_rows(const char* rows[GAME_HEIGHT]) {
+    uint64_t ships = 0;
+    for (uint8_t y = 0; y < GAME_HEIGHT; y++) {
+        for (uint8_t x = 0; x < GAME_WIDTH; x++) {
+            if (rows[y][x] == 'X') {
+                ships |= (uint64_t)1 << (x + y * GAME_WIDTH);
+            }
+        }
+    }
+    return ships;
+}
+
+Test(ships, ship_validate_fleet) {
+    typedef struct {
+        const char* rows[GAME_HEIGHT];
+        error_code err;
+    } TestCase;
+
+    TestCase cases[] = {
+        // Standard fleet
+        { .rows = { "XXXX....", "........", "XXX.XXX.", "........", "XX.XX.XX", "........", "X.X.X.X.", "........" }, .err = ERR_NONE },
+        // Vertical ships and corners touching
+        { .rows = { "X.X.X.X.", "X.X.X.X.", "X.X.X...", "X....X.X", ".X.....X", "..XX.X..", "......X.", "........" }, .err = ERR_NONE },
+        // Ships at the end of a row and the start of the next one are not neighbours
+        { .rows = { ".......X", "X.XXXX..", "........", "XXX.XXX.", "........", "XX.XX.XX", "........", "..X...X." }, .err = ERR_NONE },
+        // Bend
+        { .rows = { "XXXX....", "...X....", "XXX.XXX.", "........", "XX.XX.X.", "........", "X.X.X.X.", "........" }, .err = ERR_SHIP_COORDINATE_OCCUPIED },
+        // Ships side by side
+        { .rows = { "XXXX....", "XXX.....", "......X.", "XXX...X.", "........", "XX.XX.XX", "........", "X.X.X.X." }, .err = ERR_SHIP_COORDINATE_OCCUPIED },
+        // Two ships in the same line without an empty field between them
+        { .rows = { "XXXXX...", "........", "XXX.XXX.", "........", "XX.XX.X.", "........", "X.X.X.X.", "........" }, .err = ERR_FLEET_INVALID },
+        // Missing a ship
+        { .rows = { "XXXX....", "........", "XXX.XXX.", "........", "XX.XX.XX", "........", "X.X.X...", "........" }, .err = ERR_FLEET_INVALID },
+        // Extra ship
+        { .rows = { "XXXX...X", "........", "XXX.XXX.", "........", "XX.XX.XX", "........", "X.X.X.X.", "........" }, .err = ERR_FLEET_INVALID },
+        // Wrong lengths
+        { .rows = { "XXXX....", "......XX", "XXX.XX..", "........", "XX.XX.XX", "........", "X.X.X.X.", "........" }, .err = ERR_FLEET_INVALID },
+        // Empty board
+        { .rows = { "........", "........", "........", "........", "........", "........", "........", "........" }, .err = ERR_FLEET_INVALID },
+    };
+
+    int len = sizeof(cases) / sizeof(TestCase);
+
+    for (int i = 0; i < len; i++) {
+        TestCase c = cases[i];
+        error_code err = game_ship_validate_fleet(board_from_rows(c.rows));
+        cr_assert_eq(err, c.err, "%d invalid error", i);
+    }
+}
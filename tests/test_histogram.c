@@ -0,0 +1,69 @@
+#include "include/histogram.h"
+#include <include/criterion/criterion.h>
+#include <include/criterion/logging.h>
+#include <stdint.h>
+
+static histogram_t histogram;
+
+Test(histogram, empty) {
+    histogram_init(&histogram);
+    cr_assert_eq(histogram.count, 0);
+    cr_assert_eq(histogram_percentile(&histogram, 50), 0);
+    cr_assert_eq(histogram_percentile(&histogram, 99.9), 0);
+}
+
+Test(histogram, small_values_are_exact) {
+    histogram_init(&histogram);
+    for (uint64_t i = 1; i <= 50; i++) {
+        histogram_record(&histogram, i);
+    }
+
+    cr_assert_eq(histogram.min, 1);
+    cr_assert_eq(histogram.max, 50);
+    cr_assert_eq(histogram_percentile(&histogram, 50), 25);
+    cr_assert_eq(histogram_percentile(&histogram, 100), 50);
+    cr_assert_eq(histogram_percentile(&histogram, 0), 1);
+}
+
+Test(histogram, percentiles_are_within_precision) {
+    histogram_init(&histogram);
+    for (uint64_t i = 1; i <= 1000000; i++) {
+        histogram_record(&histogram, i * 1000);
+    }
+
+    double percentiles[] = { 50, 90, 99, 99.9 };
+    for (uint32_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+        double expected = percentiles[i] * 10000000;
+        double value = histogram_percentile(&histogram, percentiles[i]);
+        cr_assert(value >= expected && value <= expected * (1 + 1.0 / HISTOGRAM_SUB_BUCKETS),
+                  "p%.1f is %.0f, expected %.0f", percentiles[i], value, expected);
+    }
+
+    cr_assert_eq(histogram_percentile(&histogram, 100), 1000000000);
+}
+
+Test(histogram, largest_value) {
+    histogram_init(&histogram);
+    histogram_record(&histogram, UINT64_MAX);
+    histogram_record(&histogram, 0);
+
+    cr_assert_eq(histogram_percentile(&histogram, 100), UINT64_MAX);
+    cr_assert_eq(histogram_percentile(&histogram, 50), 0);
+}
+
+Test(histogram, merge) {
+    histogram_t other;
+    histogram_init(&histogram);
+    histogram_init(&other);
+
+    for (uint64_t i = 0; i < 100; i++) {
+        histogram_record(i % 2 == 0 ? &histogram : &other, i < 50 ? 10 : 5000);
+    }
+
+    histogram_merge(&histogram, &other);
+    cr_assert_eq(histogram.count, 100);
+    cr_assert_eq(histogram.min, 10);
+    cr_assert_eq(histogram.max, 5000);
+    cr_assert_eq(histogram_percentile(&histogram, 50), 10);
+    cr_assert_eq(histogram_percentile(&histogram, 51), 5000);
+}
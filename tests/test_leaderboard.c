@@ -0,0 +1,146 @@
+#include "include/errors.h"
+#include "include/game_results.h"
+#include "include/globals.h"
+#include "include/leaderboard.h"
+#include "include/record_table.h"
+#include <include/criterion/criterion.h>
+#include <include/criterion/logging.h>
+#include <stdint.h>
+#include <string.h>
+
+#define PLAYERS 300
+#define GAMES 5000
+
+typedef struct {
+    uint32_t wins;
+    uint32_t losses;
+} Counters;
+
+// Rank by counting every player that is ranked before
+static uint32_t brute_rank(const Counters* counters, uint32_t user_id) {
+    const Counters* me = &counters[user_id];
+    if (me->wins == 0 && me->losses == 0) {
+        return 0;
+    }
+
+    uint32_t rank = 1;
+    for (uint32_t i = 0; i < PLAYERS; i++) {
+        const Counters* other = &counters[i];
+        if (i == user_id || (other->wins == 0 && other->losses == 0)) {
+            continue;
+        }
+
+        if (other->wins > me->wins || (other->wins == me->wins && other->losses < me->losses) ||
+            (other->wins == me->wins && other->losses == me->losses && i < user_id)) {
+            rank++;
+        }
+    }
+    return rank;
+}
+
+static void assert_matches(const leaderboard_t* leaderboard, const Counters* counters) {
+    for (uint32_t id = 0; id < PLAYERS; id++) {
+        leaderboard_entry_t entry = { 0 };
+        uint32_t rank = leaderboard_rank(leaderboard, id, &entry);
+        cr_assert_eq(rank, brute_rank(counters, id), "Player %u has rank %u", id, rank);
+        if (rank != 0) {
+            cr_assert_eq(entry.wins, counters[id].wins);
+            cr_assert_eq(entry.losses, counters[id].losses);
+        }
+    }
+
+    // Top players are in rank order
+    leaderboard_entry_t top[10];
+    uint32_t count = leaderboard_top(leaderboard, top, 10);
+    for (uint32_t i = 0; i < count; i++) {
+        cr_assert_eq(brute_rank(counters, top[i].user_id), i + 1);
+    }
+}
+
+static uint32_t next_random(uint64_t* seed) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 7;
+    *seed ^= *seed << 17;
+    return (uint32_t)*seed;
+}
+
+Test(leaderboard, ranks_follow_results) {
+    leaderboard_t leaderboard;
+    cr_assert_eq(leaderboard_init(&leaderboard), ERR_NONE);
+
+    Counters counters[PLAYERS];
+    memset(counters, 0, sizeof(counters));
+
+    leaderboard_entry_t entry;
+    cr_assert_eq(leaderboard_rank(&leaderboard, 7, &entry), 0);
+    cr_assert_eq(leaderboard_top(&leaderboard, &entry, 1), 0);
+
+    uint64_t seed = 42;
+    for (uint32_t game = 0; game < GAMES; game++) {
+        // Lower ids win more often so the counters spread out
+        uint32_t winner = next_random(&seed) % PLAYERS;
+        uint32_t loser = next_random(&seed) % PLAYERS;
+        if (winner == loser) {
+            continue;
+        }
+        if (winner > loser && next_random(&seed) % 2 == 0) {
+            uint32_t tmp = winner;
+            winner = loser;
+            loser = tmp;
+        }
+
+        cr_assert_eq(leaderboard_record(&leaderboard, winner, loser), ERR_NONE);
+        counters[winner].wins++;
+        counters[loser].losses++;
+
+        if (game % 1000 == 0) {
+            assert_matches(&leaderboard, counters);
+        }
+    }
+
+    assert_matches(&leaderboard, counters);
+    leaderboard_deinit(&leaderboard);
+}
+
+Test(leaderboard, rebuild_from_results) {
+    record_table_t results;
+    cr_assert_eq(record_table_create(&results, sizeof(game_results_t)), ERR_NONE);
+
+    Counters counters[PLAYERS];
+    memset(counters, 0, sizeof(counters));
+
+    uint64_t seed = 7;
+    for (uint32_t game = 0; game < GAMES; game++) {
+        game_results_t result = { 0 };
+        result.first_player_id = next_random(&seed) % PLAYERS;
+        result.second_player_id = (result.first_player_id + 1 + next_random(&seed) % (PLAYERS - 1)) % PLAYERS;
+        result.won = next_random(&seed) % 3 == 0 ? GAME_SECOND_WON : GAME_FIRST_WON;
+
+        // Legacy results of unknown players are skipped
+        if (game % 100 == 0) {
+            result.second_player_id = GAME_RESULTS_UNKNOWN_USER;
+        } else if (result.won == GAME_FIRST_WON) {
+            counters[result.first_player_id].wins++;
+            counters[result.second_player_id].losses++;
+        } else {
+            counters[result.second_player_id].wins++;
+            counters[result.first_player_id].losses++;
+        }
+
+        record_table_push(&results, &result);
+    }
+
+    leaderboard_t leaderboard;
+    cr_assert_eq(leaderboard_init(&leaderboard), ERR_NONE);
+    cr_assert_eq(leaderboard_rebuild(&leaderboard, &results, PLAYERS, 4), ERR_NONE);
+    assert_matches(&leaderboard, counters);
+
+    // Leaderboard keeps counting after the rebuild
+    cr_assert_eq(leaderboard_record(&leaderboard, PLAYERS - 1, 0), ERR_NONE);
+    counters[PLAYERS - 1].wins++;
+    counters[0].losses++;
+    assert_matches(&leaderboard, counters);
+
+    leaderboard_deinit(&leaderboard);
+    record_table_destroy(&results);
+}
@@ -0,0 +1,145 @@
+#include "include/errors.h"
+#include "include/logger.h"
+#include <include/criterion/criterion.h>
+#include <include/criterion/logging.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define THREADS 8
+#define RECORDS_PER_THREAD 5000
+#define OUTPUT_MAX (4 * 1024 * 1024)
+
+static FILE* output;
+static char output_data[OUTPUT_MAX];
+
+// Logger writes to stdout and stderr, both go into one temporary file
+static void redirect_output(void) {
+    output = tmpfile();
+    cr_assert_not_null(output);
+    dup2(fileno(output), STDOUT_FILENO);
+    dup2(fileno(output), STDERR_FILENO);
+}
+
+static const char* read_output(void) {
+    size_t len = pread(fileno(output), output_data, OUTPUT_MAX - 1, 0);
+    output_data[len] = '\0';
+    return output_data;
+}
+
+static uint64_t count_lines(const char* data, const char* needle) {
+    uint64_t count = 0;
+    while ((data = strstr(data, needle)) != NULL) {
+        count++;
+        data++;
+    }
+    return count;
+}
+
+Test(logger, formats_arguments) {
+    redirect_output();
+    cr_assert_eq(logger_start(), ERR_NONE);
+
+    LOG_INFO("CLIENT %d: User \"%s\" logged in", 7, "alice");
+    LOG_ERROR("%u %ld %llu %zu %x %c %5.2f %.3s %-4s| %*d 100%%", 1u, -2l, 3ull, (size_t)4, 255, 'z', 3.14159,
+              "truncated", "ab", 3, 5);
+    LOG_DEBUG("compiled out %d", 1);
+    logger_stop();
+
+    const char* data = read_output();
+    cr_assert(strstr(data, " INFO  CLIENT 7: User \"alice\" logged in\n") != NULL, "%s", data);
+    cr_assert(strstr(data, " ERROR 1 -2 3 4 ff z  3.14 tru ab  |   5 100%\n") != NULL, "%s", data);
+    cr_assert(strstr(data, "compiled out") == NULL, "%s", data);
+}
+
+Test(logger, long_strings_are_cut) {
+    redirect_output();
+
+    char username[1024];
+    memset(username, 'a', sizeof(username) - 1);
+    username[sizeof(username) - 1] = '\0';
+
+    cr_assert_eq(logger_start(), ERR_NONE);
+    LOG_INFO("User %s has id %d", username, 12);
+    logger_stop();
+
+    const char* data = read_output();
+    // String filled the record so the rest of the format is written without arguments
+    cr_assert(strstr(data, "aaaa has id %d\n") != NULL, "%s", data);
+    cr_assert(strlen(data) < LOGGER_RECORD_SIZE + 64);
+}
+
+Test(logger, writes_synchronously_when_stopped) {
+    redirect_output();
+
+    LOG_WARN("Logger is not running %d", 1);
+
+    // Written before the call returns
+    cr_assert(strstr(read_output(), " WARN  Logger is not running 1\n") != NULL);
+}
+
+static void* write_records(void* params) {
+    uint64_t id = (uint64_t)params;
+    for (uint32_t i = 0; i < RECORDS_PER_THREAD; i++) {
+        LOG_INFO("THREAD %lu: record %u", id, i);
+    }
+
+    return NULL;
+}
+
+// Records are either written or counted as dropped, nothing is lost silently
+Test(logger, concurrent_writers) {
+    redirect_output();
+    cr_assert_eq(logger_start(), ERR_NONE);
+
+    pthread_t threads[THREADS];
+    for (uint64_t i = 0; i < THREADS; i++) {
+        cr_assert_eq(pthread_create(&threads[i], NULL, write_records, (void*)i), 0);
+    }
+
+    for (uint32_t i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    logger_stop();
+
+    const char* data = read_output();
+    uint64_t written = count_lines(data, ": record ");
+
+    uint64_t dropped = 0;
+    for (const char* line = data; (line = strstr(line, "WARNING: ")) != NULL; line++) {
+        dropped += strtoull(line + strlen("WARNING: "), NULL, 10);
+    }
+
+    cr_assert_eq(written + dropped, THREADS * RECORDS_PER_THREAD, "written %lu dropped %lu", written, dropped);
+    cr_assert(written >= LOGGER_RING_RECORDS);
+}
+
+// Writers keep logging while the logger stops, their records are written from the rings or synchronously
+Test(logger, stop_while_writing) {
+    redirect_output();
+    cr_assert_eq(logger_start(), ERR_NONE);
+
+    pthread_t threads[THREADS];
+    for (uint64_t i = 0; i < THREADS; i++) {
+        cr_assert_eq(pthread_create(&threads[i], NULL, write_records, (void*)i), 0);
+    }
+
+    logger_stop();
+    for (uint32_t i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    const char* data = read_output();
+    uint64_t written = count_lines(data, ": record ");
+
+    uint64_t dropped = 0;
+    for (const char* line = data; (line = strstr(line, "WARNING: ")) != NULL; line++) {
+        dropped += strtoull(line + strlen("WARNING: "), NULL, 10);
+    }
+
+    cr_assert_eq(written + dropped, THREADS * RECORDS_PER_THREAD, "written %lu dropped %lu", written, dropped);
+}
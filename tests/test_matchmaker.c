@@ -0,0 +1,234 @@
+#include "include/errors.h"
+#include "include/matchmaker.h"
+#include "include/server_stats.h"
+#include <include/criterion/criterion.h>
+#include <include/criterion/logging.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PRODUCERS 4
+#define CONSUMERS 4
+#define ENTRIES_PER_PRODUCER 100000
+
+Test(matchmaker, queue_fifo_and_full) {
+    matchmaker_queue_t queue;
+    cr_assert_eq(matchmaker_queue_init(&queue, 8), ERR_NONE);
+
+    matchmaker_entry_t entry = { 0 };
+    cr_assert_eq(matchmaker_queue_pop(&queue, &entry), 0);
+
+    // A few laps around the cells
+    for (uint32_t lap = 0; lap < 3; lap++) {
+        for (uint32_t i = 0; i < 8; i++) {
+            entry.client_id = lap * 8 + i;
+            cr_assert_eq(matchmaker_queue_push(&queue, &entry), 1);
+        }
+
+        cr_assert_eq(matchmaker_queue_push(&queue, &entry), 0, "Queue should be full");
+        cr_assert_eq(matchmaker_queue_len(&queue), 8);
+
+        for (uint32_t i = 0; i < 8; i++) {
+            cr_assert_eq(matchmaker_queue_pop(&queue, &entry), 1);
+            cr_assert_eq(entry.client_id, lap * 8 + i);
+        }
+
+        cr_assert_eq(matchmaker_queue_pop(&queue, &entry), 0);
+    }
+
+    matchmaker_queue_deinit(&queue);
+}
+
+static matchmaker_queue_t shared_queue;
+static atomic_uint_fast64_t popped_sum;
+static atomic_uint_fast64_t popped_count;
+static atomic_uint_fast8_t producing;
+
+static void* produce(void* params) {
+    uint32_t producer = (uint32_t)(uintptr_t)params;
+    for (uint32_t i = 0; i < ENTRIES_PER_PRODUCER; i++) {
+        matchmaker_entry_t entry = { .client_id = producer * ENTRIES_PER_PRODUCER + i };
+        while (!matchmaker_queue_push(&shared_queue, &entry)) {
+        }
+    }
+
+    return NULL;
+}
+
+static void* consume(void* params) {
+    (void)params;
+    matchmaker_entry_t entry;
+    while (1) {
+        if (matchmaker_queue_pop(&shared_queue, &entry)) {
+            atomic_fetch_add(&popped_sum, entry.client_id);
+            atomic_fetch_add(&popped_count, 1);
+        } else if (!atomic_load(&producing) && matchmaker_queue_len(&shared_queue) == 0) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+// Every pushed entry is popped exactly once
+Test(matchmaker, queue_concurrent) {
+    cr_assert_eq(matchmaker_queue_init(&shared_queue, 1024), ERR_NONE);
+    atomic_store(&producing, 1);
+
+    pthread_t producers[PRODUCERS];
+    pthread_t consumers[CONSUMERS];
+    for (uintptr_t i = 0; i < CONSUMERS; i++) {
+        cr_assert_eq(pthread_create(&consumers[i], NULL, consume, NULL), 0);
+    }
+    for (uintptr_t i = 0; i < PRODUCERS; i++) {
+        cr_assert_eq(pthread_create(&producers[i], NULL, produce, (void*)i), 0);
+    }
+
+    for (uint32_t i = 0; i < PRODUCERS; i++) {
+        pthread_join(producers[i], NULL);
+    }
+    atomic_store(&producing, 0);
+    for (uint32_t i = 0; i < CONSUMERS; i++) {
+        pthread_join(consumers[i], NULL);
+    }
+
+    uint64_t n = (uint64_t)PRODUCERS * ENTRIES_PER_PRODUCER;
+    cr_assert_eq(atomic_load(&popped_count), n);
+    cr_assert_eq(atomic_load(&popped_sum), n * (n - 1) / 2);
+
+    matchmaker_queue_deinit(&shared_queue);
+}
+
+typedef struct {
+    uint32_t pairs[16][2];
+    atomic_uint len;
+} Pairs;
+
+// Clients with ids >= 100 already left the queue, there's no room for the game of clients with ids >= 200
+static uint8_t record_pair(void* params, const matchmaker_entry_t* first, const matchmaker_entry_t* second) {
+    Pairs* pairs = params;
+    if (first->client_id >= 200 || second->client_id >= 200) {
+        return MATCHMAKER_FAILED;
+    }
+    if (first->client_id >= 100) {
+        return MATCHMAKER_FIRST_STALE;
+    }
+    if (second->client_id >= 100) {
+        return MATCHMAKER_SECOND_STALE;
+    }
+
+    uint32_t len = atomic_load(&pairs->len);
+    pairs->pairs[len][0] = first->client_id;
+    pairs->pairs[len][1] = second->client_id;
+    atomic_store(&pairs->len, len + 1);
+    return MATCHMAKER_PAIRED;
+}
+
+Test(matchmaker, pairs_in_order_and_skips_stale) {
+    server_stats_t stats;
+    cr_assert_eq(server_stats_init(&stats), ERR_NONE);
+
+    Pairs pairs = { 0 };
+    matchmaker_t matchmaker;
+    cr_assert_eq(matchmaker_start(&matchmaker, &stats, record_pair, &pairs), ERR_NONE);
+
+    uint32_t ids[] = { 1, 100, 2, 3, 101, 4, 5 };
+    for (uint32_t i = 0; i < sizeof(ids) / sizeof(ids[0]); i++) {
+        matchmaker_entry_t entry = { .client_id = ids[i], .enqueued_at = server_stats_now_ns() };
+        cr_assert_eq(matchmaker_push(&matchmaker, &entry), ERR_NONE);
+    }
+
+    for (uint32_t i = 0; i < 1000 && atomic_load(&pairs.len) < 2; i++) {
+        usleep(1000);
+    }
+    matchmaker_stop(&matchmaker);
+
+    cr_assert_eq(atomic_load(&pairs.len), 2);
+    cr_assert_eq(pairs.pairs[0][0], 1);
+    cr_assert_eq(pairs.pairs[0][1], 2);
+    cr_assert_eq(pairs.pairs[1][0], 3);
+    cr_assert_eq(pairs.pairs[1][1], 4);
+
+    StatsSuccessResponseMessage collected;
+    cr_assert_eq(server_stats_collect(&stats, &collected), ERR_NONE);
+    cr_assert_eq(collected.time_to_match.count, 4);
+    // Client 5 is still waiting
+    cr_assert_eq(collected.queue_depth, 1);
+
+    server_stats_deinit(&stats);
+}
+
+// Clients are paired inside their bucket right away and with clients
+// from other buckets once the window of the older one grew enough
+Test(matchmaker, rating_buckets_and_widening_window) {
+    server_stats_t stats;
+    cr_assert_eq(server_stats_init(&stats), ERR_NONE);
+
+    Pairs pairs = { 0 };
+    matchmaker_t matchmaker;
+    memset(&matchmaker, 0, sizeof(matchmaker));
+    matchmaker.pair = record_pair;
+    matchmaker.params = &pairs;
+    matchmaker.stats = &stats;
+
+    uint64_t second = MATCHMAKER_WIDEN_NS;
+    matchmaker_entry_t entries[] = {
+        { .client_id = 1, .rating = 1200, .enqueued_at = 0 },
+        // 3 buckets away
+        { .client_id = 2, .rating = 1290, .enqueued_at = 0 },
+        // Same bucket as 1
+        { .client_id = 3, .rating = 1210, .enqueued_at = second },
+    };
+
+    cr_assert_eq(matchmaker_match(&matchmaker, &entries[0], 0), 0);
+    cr_assert_eq(matchmaker_match(&matchmaker, &entries[1], 0), 0);
+    cr_assert_eq(matchmaker_match(&matchmaker, &entries[2], second), 1);
+    cr_assert_eq(pairs.pairs[0][0], 1);
+    cr_assert_eq(pairs.pairs[0][1], 3);
+
+    // Client 2 is alone again, client 4 is 2 buckets below it
+    matchmaker_entry_t fourth = { .client_id = 4, .rating = 1240, .enqueued_at = second };
+    cr_assert_eq(matchmaker_match(&matchmaker, &fourth, second), 0);
+    matchmaker_widen(&matchmaker, second);
+    cr_assert_eq(atomic_load(&pairs.len), 1);
+
+    matchmaker_widen(&matchmaker, 2 * second);
+    cr_assert_eq(atomic_load(&pairs.len), 2);
+    cr_assert_eq(pairs.pairs[1][0], 2);
+    cr_assert_eq(pairs.pairs[1][1], 4);
+    cr_assert_eq(matchmaker.waiting_len, 0);
+
+    // Closest bucket wins, ties go to the lower rating
+    matchmaker_entry_t spread[] = {
+        { .client_id = 5, .rating = 1000, .enqueued_at = 0 },
+        { .client_id = 6, .rating = 1100, .enqueued_at = 0 },
+        { .client_id = 7, .rating = 1600, .enqueued_at = 0 },
+        { .client_id = 8, .rating = 1050, .enqueued_at = 10 * second },
+    };
+    for (uint32_t i = 0; i < 3; i++) {
+        cr_assert_eq(matchmaker_match(&matchmaker, &spread[i], 0), 0);
+    }
+    cr_assert_eq(matchmaker_match(&matchmaker, &spread[3], 10 * second), 1);
+    cr_assert_eq(pairs.pairs[2][0], 5);
+    cr_assert_eq(pairs.pairs[2][1], 8);
+
+    // Stale client is dropped, the waiting one stays
+    matchmaker_entry_t stale = { .client_id = 100, .rating = 1100, .enqueued_at = 10 * second };
+    cr_assert_eq(matchmaker_match(&matchmaker, &stale, 10 * second), 0);
+    cr_assert_eq(matchmaker.waiting_len, 2);
+
+    // Failed pair drops both clients and isn't counted as a match
+    StatsSuccessResponseMessage collected;
+    cr_assert_eq(server_stats_collect(&stats, &collected), ERR_NONE);
+    uint64_t matched = collected.time_to_match.count;
+    matchmaker_entry_t failed = { .client_id = 200, .rating = 1100, .enqueued_at = 10 * second };
+    cr_assert_eq(matchmaker_match(&matchmaker, &failed, 10 * second), 0);
+    cr_assert_eq(matchmaker.waiting_len, 1);
+    cr_assert_eq(atomic_load(&pairs.len), 3);
+    cr_assert_eq(server_stats_collect(&stats, &collected), ERR_NONE);
+    cr_assert_eq(collected.time_to_match.count, matched);
+
+    server_stats_deinit(&stats);
+}
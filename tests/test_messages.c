@@ -0,0 +1,199 @@
+#include "include/errors.h"
+#include "include/messages.h"
+#include <arpa/inet.h>
+#include <include/criterion/criterion.h>
+#include <include/criterion/logging.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+typedef struct {
+    uint32_t count;
+    uint32_t lens[16];
+    char first[16];
+} ReceivedMessages;
+
+static void collect_message(void* params, const char* message, uint32_t len) {
+    ReceivedMessages* received = params;
+    received->lens[received->count] = len;
+    received->first[received->count] = len > 0 ? message[0] : 0;
+    received->count++;
+}
+
+Test(messages, read_messages_many_frames_in_one_read) {
+    int fds[2];
+    cr_assert_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    for (char i = 0; i < 5; i++) {
+        char message[10];
+        memset(message, 'a' + i, sizeof(message));
+        cr_assert_eq(send_message(fds[0], message, 1 + i), ERR_NONE);
+    }
+
+    message_reader_t reader = { 0 };
+    ReceivedMessages received = { 0 };
+    cr_assert_eq(read_messages(fds[1], &reader, collect_message, &received), ERR_NONE);
+
+    cr_assert_eq(received.count, 5);
+    for (uint32_t i = 0; i < 5; i++) {
+        cr_assert_eq(received.lens[i], 1 + i, "Message %u has invalid length", i);
+        cr_assert_eq(received.first[i], 'a' + (char)i, "Message %u has invalid data", i);
+    }
+    cr_assert_eq(reader.len, 0);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+Test(messages, read_messages_partial_frame) {
+    int fds[2];
+    cr_assert_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    char frame[MESSAGE_HEADER_LEN + 8];
+    uint32_t header = htonl(8);
+    memcpy(frame, &header, MESSAGE_HEADER_LEN);
+    memset(frame + MESSAGE_HEADER_LEN, 'x', 8);
+
+    message_reader_t reader = { 0 };
+    ReceivedMessages received = { 0 };
+
+    // Header is split in half
+    cr_assert_eq(write(fds[0], frame, 2), 2);
+    cr_assert_eq(read_messages(fds[1], &reader, collect_message, &received), ERR_NONE);
+    cr_assert_eq(received.count, 0);
+    cr_assert_eq(reader.len, 2);
+
+    cr_assert_eq(write(fds[0], frame + 2, 5), 5);
+    cr_assert_eq(read_messages(fds[1], &reader, collect_message, &received), ERR_NONE);
+    cr_assert_eq(received.count, 0);
+
+    cr_assert_eq(write(fds[0], frame + 7, sizeof(frame) - 7), (ssize_t)(sizeof(frame) - 7));
+    cr_assert_eq(read_messages(fds[1], &reader, collect_message, &received), ERR_NONE);
+    cr_assert_eq(received.count, 1);
+    cr_assert_eq(received.lens[0], 8);
+    cr_assert_eq(received.first[0], 'x');
+    cr_assert_eq(reader.len, 0);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+Test(messages, read_messages_too_large) {
+    int fds[2];
+    cr_assert_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    uint32_t header = htonl(MESSAGE_MAX_LEN + 1);
+    cr_assert_eq(write(fds[0], &header, sizeof(header)), (ssize_t)sizeof(header));
+
+    message_reader_t reader = { 0 };
+    ReceivedMessages received = { 0 };
+    cr_assert_eq(read_messages(fds[1], &reader, collect_message, &received), ERR_MESSAGE_TOO_LARGE);
+    cr_assert_eq(received.count, 0);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+Test(messages, read_message_shorter_and_longer) {
+    int fds[2];
+    cr_assert_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    char data[16];
+    memset(data, 'z', sizeof(data));
+    cr_assert_eq(send_message(fds[0], data, 4), ERR_NONE);
+    cr_assert_eq(send_message(fds[0], data, 16), ERR_NONE);
+    cr_assert_eq(send_message(fds[0], "ok", 2), ERR_NONE);
+
+    // Shorter message leaves rest of the buffer zeroed
+    char buffer[8];
+    memset(buffer, 1, sizeof(buffer));
+    cr_assert_eq(read_message(fds[1], buffer, sizeof(buffer)), ERR_NONE);
+    cr_assert_eq(buffer[3], 'z');
+    cr_assert_eq(buffer[4], 0);
+
+    // Longer message is cut and the rest is dropped
+    cr_assert_eq(read_message(fds[1], buffer, sizeof(buffer)), ERR_NONE);
+    cr_assert_eq(buffer[7], 'z');
+
+    cr_assert_eq(read_message(fds[1], buffer, 2), ERR_NONE);
+    cr_assert_eq(strncmp(buffer, "ok", 2), 0);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+Test(messages, read_message_alloc_list_users) {
+    int fds[2];
+    cr_assert_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    // Larger than the buffer read_message accepts
+    uint32_t count = 2100;
+    uint32_t len = sizeof(ListUsersSuccessResponseMessage) + count * sizeof(ListUsersEntry);
+    char* sent = calloc(1, len);
+    ListUsersSuccessResponseMessage* header = (ListUsersSuccessResponseMessage*)sent;
+    ListUsersEntry* entries = (ListUsersEntry*)(sent + sizeof(ListUsersSuccessResponseMessage));
+    header->status_code = STATUS_OK;
+    header->count = count;
+    for (uint32_t i = 0; i < count; i++) {
+        entries[i].looking_for_game = i % 2;
+        snprintf(entries[i].username, USERNAME_MAX_LEN, "user%u", i);
+    }
+
+    int sender = fork();
+    cr_assert_neq(sender, -1);
+    if (sender == 0) {
+        send_message(fds[0], sent, len);
+        _exit(0);
+    }
+
+    void* buffer;
+    uint32_t read_len;
+    cr_assert_eq(read_message_alloc(fds[1], &buffer, &read_len), ERR_NONE);
+    cr_assert_eq(read_len, len);
+    cr_assert_eq(memcmp(buffer, sent, len), 0);
+
+    free(buffer);
+    free(sent);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// Peer that doesn't read never blocks the writer, frames wait in the writer until it reads again
+Test(messages, message_writer_peer_not_reading) {
+    int fds[2];
+    cr_assert_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    static char message[MESSAGE_MAX_LEN];
+    message_writer_t writer = { 0 };
+    uint32_t pushed = 0;
+    error_code err = ERR_NONE;
+    while (err == ERR_NONE) {
+        memset(message, 'a' + pushed % 26, sizeof(message));
+        err = message_writer_push(&writer, message, sizeof(message));
+        if (err == ERR_NONE) {
+            pushed++;
+            error_code flushed = message_writer_flush(fds[0], &writer);
+            cr_assert(flushed == ERR_NONE || flushed == ERR_WOULD_BLOCK);
+        }
+    }
+    cr_assert_eq(err, ERR_QUEUE_FULL);
+    cr_assert_gt(writer.len, 0);
+    cr_assert_leq(writer.len, MESSAGE_WRITER_MAX_LEN);
+
+    // Every frame arrives in order once the peer reads
+    for (uint32_t i = 0; i < pushed; i++) {
+        err = message_writer_flush(fds[0], &writer);
+        cr_assert(err == ERR_NONE || err == ERR_WOULD_BLOCK);
+
+        cr_assert_eq(read_message(fds[1], message, sizeof(message)), ERR_NONE);
+        cr_assert_eq(message[0], 'a' + (char)(i % 26), "Message %u has invalid data", i);
+        cr_assert_eq(message[sizeof(message) - 1], 'a' + (char)(i % 26), "Message %u has invalid data", i);
+    }
+    cr_assert_eq(writer.len, 0);
+
+    message_writer_deinit(&writer);
+    close(fds[0]);
+    close(fds[1]);
+}
@@ -0,0 +1,81 @@
+#include "include/errors.h"
+#include "include/globals.h"
+#include "include/online_players.h"
+#include <include/criterion/criterion.h>
+#include <include/criterion/logging.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PLAYERS 100
+
+static online_snapshot_t* make_snapshot(uint32_t len) {
+    online_snapshot_t* snapshot = online_snapshot_new(len);
+    cr_assert_not_null(snapshot);
+
+    // Every other username so there are gaps to seek into
+    for (uint32_t i = 0; i < len; i++) {
+        memset(snapshot->players[i].username, 0, USERNAME_MAX_LEN);
+        snprintf(snapshot->players[i].username, USERNAME_MAX_LEN, "user%03u", i * 2);
+        snapshot->players[i].client_id = i;
+        snapshot->players[i].looking_for_game = i % 2;
+    }
+    return snapshot;
+}
+
+Test(online_players, seek_and_find) {
+    online_players_t online;
+    cr_assert_eq(online_players_init(&online), ERR_NONE);
+
+    online_players_guard_t guard;
+    const online_snapshot_t* snapshot = online_players_read(&online, &guard);
+    cr_assert_eq(snapshot->len, 0);
+    cr_assert_null(online_snapshot_find(snapshot, "user000"));
+    online_players_read_end(&online, &guard);
+
+    online_players_retire(&online, online_players_publish(&online, make_snapshot(PLAYERS)));
+
+    snapshot = online_players_read(&online, &guard);
+    cr_assert_eq(snapshot->len, PLAYERS);
+
+    const online_player_t* player = online_snapshot_find(snapshot, "user042");
+    cr_assert_not_null(player);
+    cr_assert_eq(player->client_id, 21);
+    cr_assert_eq(player->looking_for_game, 1);
+    cr_assert_null(online_snapshot_find(snapshot, "user043"));
+
+    cr_assert_eq(online_snapshot_seek(snapshot, "user042", 0), 21);
+    cr_assert_eq(online_snapshot_seek(snapshot, "user042", 1), 22);
+    cr_assert_eq(online_snapshot_seek(snapshot, "user043", 0), 22);
+    cr_assert_eq(online_snapshot_seek(snapshot, "a", 0), 0);
+    cr_assert_eq(online_snapshot_seek(snapshot, "user198", 1), PLAYERS);
+    online_players_read_end(&online, &guard);
+
+    online_players_deinit(&online);
+}
+
+// Old snapshot isn't freed while a reader that loaded it is still reading
+Test(online_players, retire_waits_for_readers) {
+    online_players_t online;
+    cr_assert_eq(online_players_init(&online), ERR_NONE);
+    cr_assert_eq(online_players_retire(&online, online_players_publish(&online, make_snapshot(PLAYERS))), 0);
+
+    online_players_guard_t guard;
+    const online_snapshot_t* snapshot = online_players_read(&online, &guard);
+
+    online_snapshot_t* old = online_players_publish(&online, make_snapshot(1));
+    cr_assert_eq(old, snapshot);
+    cr_assert_eq(online_players_retire(&online, old), 1);
+    cr_assert_eq(snapshot->len, PLAYERS);
+
+    // New readers see the new snapshot while the old one is still read, they don't hold it back
+    online_players_guard_t other;
+    cr_assert_eq(online_players_read(&online, &other)->len, 1);
+    online_players_read_end(&online, &other);
+    cr_assert_eq(online_players_retire(&online, NULL), 1);
+
+    // Next writer frees it once the reader is gone
+    online_players_read_end(&online, &guard);
+    cr_assert_eq(online_players_retire(&online, online_players_publish(&online, make_snapshot(2))), 0);
+
+    online_players_deinit(&online);
+}
@@ -0,0 +1,34 @@
+#include "include/rating.h"
+#include <include/criterion/criterion.h>
+#include <include/criterion/logging.h>
+#include <stdint.h>
+
+Test(rating, equal_ratings) {
+    uint32_t winner = RATING_DEFAULT;
+    uint32_t loser = RATING_DEFAULT;
+    rating_update(&winner, &loser);
+
+    cr_assert_eq(winner, RATING_DEFAULT + RATING_K / 2);
+    cr_assert_eq(loser, RATING_DEFAULT - RATING_K / 2);
+}
+
+Test(rating, upset_moves_more_than_expected_win) {
+    uint32_t favourite = 1600;
+    uint32_t underdog = 1200;
+    rating_update(&favourite, &underdog);
+    cr_assert_eq(favourite, 1603);
+    cr_assert_eq(underdog, 1197);
+
+    favourite = 1600;
+    underdog = 1200;
+    rating_update(&underdog, &favourite);
+    cr_assert_eq(underdog, 1229);
+    cr_assert_eq(favourite, 1571);
+
+    // Loser never goes below 0
+    uint32_t winner = 0;
+    uint32_t loser = 5;
+    rating_update(&winner, &loser);
+    cr_assert_eq(winner, 5);
+    cr_assert_eq(loser, 0);
+}
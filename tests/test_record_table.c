@@ -0,0 +1,93 @@
+#include "include/errors.h"
+#include "include/record_table.h"
+#include <fcntl.h>
+#include <include/criterion/criterion.h>
+#include <include/criterion/logging.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define RECORDS 1000
+#define HEADER_LEN 8
+
+static int write_records(char* filepath) {
+    int fd = mkstemp(filepath);
+    cr_assert_neq(fd, -1);
+
+    uint64_t header = 0xffffffffffffffff;
+    cr_assert_eq(write(fd, &header, HEADER_LEN), HEADER_LEN);
+    for (uint32_t i = 0; i < RECORDS; i++) {
+        cr_assert_eq(write(fd, &i, sizeof(i)), (ssize_t)sizeof(i));
+    }
+
+    return fd;
+}
+
+Test(record_table, mapped_and_tail_records) {
+    char filepath[] = "/tmp/record_table_XXXXXX";
+    int fd = write_records(filepath);
+
+    record_table_t table;
+    cr_assert_eq(record_table_create(&table, sizeof(uint32_t)), ERR_NONE);
+    cr_assert_eq(record_table_map(&table, fd, HEADER_LEN, RECORDS), ERR_NONE);
+    close(fd);
+
+    // Tail spans a few chunks, the first record of the tail doesn't move while it grows
+    uint32_t len = RECORDS + 3 * SLOT_POOL_CHUNK_LEN + 10;
+    uint32_t* first = NULL;
+    for (uint32_t i = RECORDS; i < len; i++) {
+        uint32_t* pushed = record_table_push(&table, &i);
+        cr_assert_not_null(pushed);
+        first = first == NULL ? pushed : first;
+    }
+
+    cr_assert_eq(record_table_len(&table), len);
+    cr_assert_eq(record_table_at(&table, RECORDS), first);
+    for (uint32_t i = 0; i < len; i++) {
+        cr_assert_eq(*(uint32_t*)record_table_at(&table, i), i, "Record %u has invalid value", i);
+    }
+
+    FILE* file = tmpfile();
+    cr_assert_eq(record_table_write(&table, file), ERR_NONE);
+    cr_assert_eq(ftell(file), (long)(len * sizeof(uint32_t)));
+    fseek(file, 0, SEEK_SET);
+    for (uint32_t i = 0; i < len; i++) {
+        uint32_t value;
+        cr_assert_eq(fread(&value, sizeof(value), 1, file), 1);
+        cr_assert_eq(value, i, "Written record %u has invalid value", i);
+    }
+    fclose(file);
+
+    record_table_destroy(&table);
+    unlink(filepath);
+}
+
+Test(record_table, changes_are_not_written_to_file) {
+    char filepath[] = "/tmp/record_table_XXXXXX";
+    int fd = write_records(filepath);
+
+    record_table_t table;
+    cr_assert_eq(record_table_create(&table, sizeof(uint32_t)), ERR_NONE);
+    cr_assert_eq(record_table_map(&table, fd, HEADER_LEN, RECORDS), ERR_NONE);
+
+    *(uint32_t*)record_table_at(&table, 5) = 42;
+    cr_assert_eq(*(uint32_t*)record_table_at(&table, 5), 42);
+
+    uint32_t value;
+    cr_assert_eq(pread(fd, &value, sizeof(value), HEADER_LEN + 5 * sizeof(value)), (ssize_t)sizeof(value));
+    cr_assert_eq(value, 5);
+    close(fd);
+
+    // Written table has the change
+    FILE* file = tmpfile();
+    cr_assert_eq(record_table_write(&table, file), ERR_NONE);
+    cr_assert_eq(ftell(file), RECORDS * sizeof(uint32_t));
+    fseek(file, 5 * sizeof(value), SEEK_SET);
+    cr_assert_eq(fread(&value, sizeof(value), 1, file), 1);
+    cr_assert_eq(value, 42);
+    fclose(file);
+
+    record_table_destroy(&table);
+    unlink(filepath);
+}
@@ -0,0 +1,153 @@
+#include "include/errors.h"
+#include "include/game_results.h"
+#include "include/results_index.h"
+#include "include/results_writer.h"
+#include "tests/temp_dir.h"
+#include <include/criterion/criterion.h>
+#include <include/criterion/logging.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PLAYERS 12
+
+typedef struct {
+    temp_dir_t dir;
+    char results_path[128];
+    char index_path[128];
+    char heads_path[128];
+    record_table_t results;
+    results_index_t index;
+    results_writer_t writer;
+} IndexFixture;
+
+static void fixture_open(IndexFixture* f) {
+    cr_assert_eq(game_results_load(&f->results, f->results_path, NULL), ERR_NONE);
+    cr_assert_eq(results_index_load(&f->index, &f->results, f->index_path, f->heads_path), ERR_NONE);
+    cr_assert_eq(results_writer_start(&f->writer, f->results_path, f->index_path), ERR_NONE);
+}
+
+// Heads are only saved when the server stops, without them the links are replayed
+static void fixture_close(IndexFixture* f, uint8_t save_heads) {
+    results_writer_stop(&f->writer);
+    if (save_heads) {
+        cr_assert_eq(results_index_save_heads(&f->index, f->heads_path), ERR_NONE);
+    }
+    results_index_deinit(&f->index);
+    record_table_destroy(&f->results);
+}
+
+static void fixture_init(IndexFixture* f) {
+    temp_dir_create(&f->dir, "results_index");
+    temp_dir_file(&f->dir, "results.db", f->results_path, sizeof(f->results_path));
+    temp_dir_file(&f->dir, "results.idx", f->index_path, sizeof(f->index_path));
+    temp_dir_file(&f->dir, "results.idx.heads", f->heads_path, sizeof(f->heads_path));
+    fixture_open(f);
+}
+
+static void add_results(IndexFixture* f, uint32_t count, uint32_t seed) {
+    for (uint32_t i = 0; i < count; i++) {
+        game_results_t result = { 0 };
+        result.first_player_id = (i * 7 + seed) % PLAYERS;
+        result.second_player_id = (result.first_player_id + 1 + (i + seed) % (PLAYERS - 1)) % PLAYERS;
+        result.won = i % 3 == 0 ? GAME_SECOND_WON : GAME_FIRST_WON;
+        // Player from a legacy result that isn't a registered user
+        if (i % 11 == 5) {
+            result.second_player_id = GAME_RESULTS_UNKNOWN_USER;
+        }
+
+        record_table_push(&f->results, &result);
+        results_index_link_t link;
+        cr_assert_eq(results_index_add(&f->index, &result, &link), ERR_NONE);
+        cr_assert_eq(results_writer_push(&f->writer, &result, &link), ERR_NONE);
+    }
+}
+
+// Walks the history of every player and compares it with a scan of every result
+static void assert_history(IndexFixture* f) {
+    for (uint32_t player = 0; player < PLAYERS; player++) {
+        uint32_t game_id = results_index_last(&f->index, player);
+        uint32_t games = 0;
+
+        for (uint32_t i = record_table_len(&f->results); i-- > 0;) {
+            const game_results_t* result = record_table_at(&f->results, i);
+            if (result->first_player_id != player && result->second_player_id != player) {
+                continue;
+            }
+
+            cr_assert_eq(game_id, i, "player %u expected game %u, got %u", player, i, game_id);
+            game_id = results_index_prev(&f->index, &f->results, player, game_id);
+            games++;
+        }
+
+        cr_assert_eq(game_id, RESULTS_INDEX_NONE);
+        cr_assert_eq(results_index_games(&f->index, player), games);
+    }
+
+    cr_assert_eq(results_index_last(&f->index, PLAYERS + 100), RESULTS_INDEX_NONE);
+    // Result without a link has no game before it
+    cr_assert_eq(results_index_prev(&f->index, &f->results, 0, record_table_len(&f->index.links)), RESULTS_INDEX_NONE);
+}
+
+Test(results_index, history_survives_restart) {
+    IndexFixture f;
+    fixture_init(&f);
+
+    add_results(&f, 300, 1);
+    assert_history(&f);
+    fixture_close(&f, 1);
+
+    // Everything comes from the heads
+    fixture_open(&f);
+    assert_history(&f);
+    add_results(&f, 200, 2);
+    fixture_close(&f, 0);
+
+    // Links added after the heads were saved are replayed
+    fixture_open(&f);
+    cr_assert_eq(record_table_len(&f.results), 500);
+    assert_history(&f);
+    add_results(&f, 50, 3);
+    fixture_close(&f, 1);
+
+    fixture_open(&f);
+    assert_history(&f);
+    fixture_close(&f, 0);
+
+    temp_dir_remove(&f.dir);
+}
+
+Test(results_index, missing_or_extra_links_are_fixed) {
+    IndexFixture f;
+    fixture_init(&f);
+
+    add_results(&f, 120, 4);
+    fixture_close(&f, 1);
+
+    // Results written before the index existed are all linked on load
+    unlink(f.index_path);
+    unlink(f.heads_path);
+    fixture_open(&f);
+    assert_history(&f);
+    fixture_close(&f, 1);
+
+    // Crash after the links were written but before the results
+    FILE* index_file = fopen(f.index_path, "a");
+    cr_assert_not_null(index_file);
+    results_index_link_t extra = { 0, 0 };
+    cr_assert_eq(fwrite(&extra, sizeof(extra), 1, index_file), 1);
+    fclose(index_file);
+
+    fixture_open(&f);
+    assert_history(&f);
+    add_results(&f, 30, 5);
+    fixture_close(&f, 0);
+
+    fixture_open(&f);
+    cr_assert_eq(record_table_len(&f.results), 150);
+    assert_history(&f);
+    fixture_close(&f, 0);
+
+    temp_dir_remove(&f.dir);
+}
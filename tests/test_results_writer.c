@@ -0,0 +1,151 @@
+#include "include/errors.h"
+#include "include/game_results.h"
+#include "include/results_writer.h"
+#include "tests/temp_dir.h"
+#include <include/criterion/criterion.h>
+#include <include/criterion/logging.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PRODUCERS 4
+#define RESULTS_PER_PRODUCER 2000
+
+typedef struct {
+    results_writer_t* writer;
+    uint32_t id;
+} Producer;
+
+static void* produce(void* params) {
+    Producer* producer = params;
+    for (uint32_t i = 0; i < RESULTS_PER_PRODUCER; i++) {
+        game_results_t result = { 0 };
+        result.first_player_id = producer->id;
+        result.second_player_id = i;
+        result.won = GAME_FIRST_WON;
+        results_index_link_t link = { .first_prev = producer->id, .second_prev = i };
+        cr_assert_eq(results_writer_push(producer->writer, &result, &link), ERR_NONE);
+    }
+    return NULL;
+}
+
+Test(results_writer, every_result_is_written_once) {
+    temp_dir_t dir;
+    temp_dir_create(&dir, "results_writer");
+    char filepath[128];
+    char index_filepath[128];
+    temp_dir_file(&dir, "results.db", filepath, sizeof(filepath));
+    temp_dir_file(&dir, "results.idx", index_filepath, sizeof(index_filepath));
+
+    // Creates the results header
+    record_table_t results;
+    cr_assert_eq(game_results_load(&results, filepath, NULL), ERR_NONE);
+    record_table_destroy(&results);
+
+    results_writer_t writer;
+    cr_assert_eq(results_writer_start(&writer, filepath, index_filepath), ERR_NONE);
+
+    pthread_t threads[PRODUCERS];
+    Producer producers[PRODUCERS];
+    for (uint32_t i = 0; i < PRODUCERS; i++) {
+        producers[i] = (Producer){ .writer = &writer, .id = i };
+        cr_assert_eq(pthread_create(&threads[i], NULL, produce, &producers[i]), 0);
+    }
+
+    for (uint32_t i = 0; i < PRODUCERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    results_writer_stop(&writer);
+
+    cr_assert_eq(game_results_load(&results, filepath, NULL), ERR_NONE);
+    cr_assert_eq(record_table_len(&results), PRODUCERS * RESULTS_PER_PRODUCER);
+
+    // Links are written in the same order as the results
+    FILE* index_file = fopen(index_filepath, "r");
+    cr_assert_not_null(index_file);
+    results_index_link_t* links = malloc(PRODUCERS * RESULTS_PER_PRODUCER * sizeof(results_index_link_t));
+    cr_assert_eq(fread(links, sizeof(results_index_link_t), PRODUCERS * RESULTS_PER_PRODUCER, index_file),
+                 PRODUCERS * RESULTS_PER_PRODUCER);
+    cr_assert_eq(fgetc(index_file), EOF);
+    fclose(index_file);
+
+    // Results of one producer are written in the order they were pushed
+    uint32_t next[PRODUCERS] = { 0 };
+    for (uint32_t i = 0; i < record_table_len(&results); i++) {
+        game_results_t* result = record_table_at(&results, i);
+        uint32_t producer = result->first_player_id;
+        cr_assert_lt(producer, PRODUCERS);
+        cr_assert_eq(result->second_player_id, next[producer]);
+        cr_assert_eq(links[i].first_prev, producer);
+        cr_assert_eq(links[i].second_prev, next[producer]);
+        next[producer]++;
+    }
+
+    free(links);
+    record_table_destroy(&results);
+    temp_dir_remove(&dir);
+}
+
+static off_t file_size(const char* filepath) {
+    struct stat st;
+    cr_assert_eq(stat(filepath, &st), 0);
+    return st.st_size;
+}
+
+Test(results_writer, failed_batch_is_cut_from_both_files) {
+    temp_dir_t dir;
+    temp_dir_create(&dir, "results_writer");
+    char filepath[128];
+    char index_filepath[128];
+    temp_dir_file(&dir, "results.db", filepath, sizeof(filepath));
+    temp_dir_file(&dir, "results.idx", index_filepath, sizeof(index_filepath));
+
+    record_table_t results;
+    cr_assert_eq(game_results_load(&results, filepath, NULL), ERR_NONE);
+    record_table_destroy(&results);
+
+    game_results_t result = { .first_player_id = 1, .second_player_id = 2, .won = GAME_FIRST_WON };
+    results_index_link_t link = { .first_prev = 3, .second_prev = 4 };
+
+    results_writer_t writer;
+    cr_assert_eq(results_writer_start(&writer, filepath, index_filepath), ERR_NONE);
+    cr_assert_eq(results_writer_push(&writer, &result, &link), ERR_NONE);
+    results_writer_stop(&writer);
+
+    off_t size = file_size(filepath);
+    off_t index_size = file_size(index_filepath);
+
+    // Only half of the next result fits, the write after it fails instead of raising SIGXFSZ
+    signal(SIGXFSZ, SIG_IGN);
+    struct rlimit limit = { .rlim_cur = size + sizeof(game_results_t) / 2, .rlim_max = RLIM_INFINITY };
+    cr_assert_eq(setrlimit(RLIMIT_FSIZE, &limit), 0);
+
+    cr_assert_eq(results_writer_start(&writer, filepath, index_filepath), ERR_NONE);
+    cr_assert_eq(results_writer_push(&writer, &result, &link), ERR_NONE);
+    for (uint32_t i = 0; i < 1000 && atomic_load(&writer.write_error) == ERR_NONE; i++) {
+        usleep(1000);
+    }
+
+    // Error sticks, later results aren't queued
+    cr_assert_eq(atomic_load(&writer.write_error), ERR_SYNC_FAILED);
+    cr_assert_eq(results_writer_push(&writer, &result, &link), ERR_SYNC_FAILED);
+    results_writer_stop(&writer);
+
+    limit.rlim_cur = RLIM_INFINITY;
+    cr_assert_eq(setrlimit(RLIMIT_FSIZE, &limit), 0);
+
+    cr_assert_eq(file_size(filepath), size);
+    cr_assert_eq(file_size(index_filepath), index_size);
+
+    cr_assert_eq(game_results_load(&results, filepath, NULL), ERR_NONE);
+    cr_assert_eq(record_table_len(&results), 1);
+    record_table_destroy(&results);
+
+    temp_dir_remove(&dir);
+}
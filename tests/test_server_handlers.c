@@ -0,0 +1,145 @@
+#include "include/errors.h"
+#include "include/game.h"
+#include "include/globals.h"
+#include "include/matchmaker.h"
+#include "include/messages.h"
+#include "include/online_players.h"
+#include "include/server_handlers.h"
+#include "include/server_stats.h"
+#include "include/server_utils.h"
+#include "include/state.h"
+#include "include/username_map.h"
+#include <include/criterion/criterion.h>
+#include <include/criterion/logging.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static server_state_t* state;
+static server_user_t users[2];
+// Client of every user and the other end of its socket
+static server_client_t* clients[2];
+static int peers[2];
+
+static void setup(void) {
+    state = calloc(1, sizeof(server_state_t));
+    cr_assert_not_null(state);
+    cr_assert_eq(server_shards_init(state), ERR_NONE);
+    cr_assert_eq(username_map_init(&state->sessions, 0), ERR_NONE);
+    cr_assert_eq(online_players_init(&state->online), ERR_NONE);
+    cr_assert_eq(server_stats_init(&state->stats), ERR_NONE);
+    pthread_rwlock_init(&state->sessions_rwlock, NULL);
+    // No reactor, messages are sent right away
+    state->mode = SERVER_MODE_THREADS;
+
+    struct sockaddr_in addr = { 0 };
+    for (uint32_t i = 0; i < 2; i++) {
+        int fds[2];
+        cr_assert_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+        peers[i] = fds[1];
+
+        memset(&users[i], 0, sizeof(server_user_t));
+        snprintf(users[i].username, USERNAME_MAX_LEN, "player%u", i);
+        clients[i] = server_add_client(state, fds[0], addr);
+        cr_assert_not_null(clients[i]);
+        clients[i]->user = &users[i];
+        snprintf(clients[i]->api_key, API_KEY_LEN, "key%u", i);
+        client_set_logged_in(clients[i]);
+        cr_assert_eq(server_add_session(state, clients[i], &users[i]), ERR_NONE);
+        server_set_looking_for_game(state, clients[i], 1);
+    }
+}
+
+static void teardown(void) {
+    for (uint32_t i = 0; i < 2; i++) {
+        close(clients[i]->sock_fd);
+        close(peers[i]);
+    }
+
+    pthread_rwlock_destroy(&state->sessions_rwlock);
+    server_stats_deinit(&state->stats);
+    online_players_deinit(&state->online);
+    username_map_deinit(&state->sessions);
+    server_shards_deinit(state);
+    free(state);
+}
+
+static uint8_t challenge(server_client_t* client, int peer, server_client_t* target) {
+    ChallengePlayerRequestMessage req = { 0 };
+    req.type = MSG_CHALLENGE_PLAYER;
+    memcpy(req.api_key, client->api_key, API_KEY_LEN);
+    memcpy(req.target_username, target->user->username, USERNAME_MAX_LEN);
+
+    char buffer[IN_BUFFER_SIZE] = { 0 };
+    memcpy(buffer, &req, sizeof(req));
+    cr_assert_eq(handle_challenge_player(client, buffer), ERR_NONE);
+
+    ChallengePlayerResponseMessage res;
+    cr_assert_eq(read_message(peer, &res, sizeof(res)), ERR_NONE);
+    return res.error.status_code;
+}
+
+// Matcher would pair the queued client and replace the game of the challenge
+Test(server_handlers, queued_client_cant_be_challenged, .init = setup, .fini = teardown) {
+    atomic_store(&clients[1]->queue_ticket, 1);
+
+    cr_assert_eq(challenge(clients[0], peers[0], clients[1]), STATUS_PLAYER_IS_NOT_LOOKING_FOR_GAME);
+    cr_assert_null(clients[0]->game);
+    cr_assert_null(clients[1]->game);
+}
+
+Test(server_handlers, queued_client_cant_challenge, .init = setup, .fini = teardown) {
+    atomic_store(&clients[0]->queue_ticket, 1);
+
+    cr_assert_eq(challenge(clients[0], peers[0], clients[1]), STATUS_BAD_REQUEST);
+    cr_assert_null(clients[0]->game);
+    cr_assert_null(clients[1]->game);
+}
+
+// Other player's handler can still send to a client that just disconnected
+Test(server_handlers, nothing_is_sent_after_disconnect, .init = setup, .fini = teardown) {
+    char message = STATUS_OK;
+    cr_assert_eq(server_send_message(clients[1], &message, sizeof(message)), ERR_NONE);
+
+    handle_client_disconnect(clients[1]);
+    cr_assert_eq(clients[1]->sock_fd, -1);
+    cr_assert_eq(server_send_message(clients[1], &message, sizeof(message)), ERR_PEER_CLOSED);
+}
+
+// Claimed for a game by the matcher or another challenge, before that game was joined
+Test(server_handlers, claimed_client_cant_be_challenged, .init = setup, .fini = teardown) {
+    server_game_t* game = server_add_game(state, game_new(clients[1], clients[1]));
+    cr_assert_not_null(game);
+    cr_assert_eq(client_claim_game(clients[1], game), 1);
+
+    cr_assert_eq(challenge(clients[0], peers[0], clients[1]), STATUS_PLAYER_IS_NOT_LOOKING_FOR_GAME);
+    cr_assert_null(clients[0]->game);
+    cr_assert_null(clients[1]->game);
+    cr_assert_eq(client_playing_game(clients[0]), 0);
+}
+
+// Client challenged right after it joined the queue isn't matched, the other one goes back to the queue
+Test(server_handlers, challenged_client_isnt_matched, .init = setup, .fini = teardown) {
+    atomic_store(&clients[0]->queue_ticket, 1);
+    atomic_store(&clients[1]->queue_ticket, 1);
+    server_game_t* game = server_add_game(state, game_new(clients[1], clients[1]));
+    cr_assert_not_null(game);
+    cr_assert_eq(client_claim_game(clients[1], game), 1);
+    cr_assert_eq(client_claim_game(clients[1], game), 0);
+
+    matchmaker_entry_t first = { .client_id = clients[0]->id, .ticket = 1 };
+    matchmaker_entry_t second = { .client_id = clients[1]->id, .ticket = 1 };
+    cr_assert_eq(server_match_clients(state, &first, &second), MATCHMAKER_SECOND_STALE);
+    cr_assert_eq(client_in_queue(clients[0]), 1);
+    cr_assert_eq(client_playing_game(clients[0]), 0);
+    cr_assert_null(clients[0]->game);
+
+    // Claim ends with the game
+    server_close_game(state, game);
+    cr_assert_eq(client_playing_game(clients[1]), 0);
+}
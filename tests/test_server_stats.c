@@ -0,0 +1,82 @@
+#include "include/errors.h"
+#include "include/globals.h"
+#include "include/messages.h"
+#include "include/server_stats.h"
+#include <include/criterion/criterion.h>
+#include <include/criterion/logging.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define THREADS 32
+#define REQUESTS_PER_THREAD 10000
+
+static server_stats_t stats;
+
+static void* record_requests(void* params) {
+    (void)params;
+    for (uint32_t i = 0; i < REQUESTS_PER_THREAD; i++) {
+        server_stats_record_request(&stats, MSG_PLAYERS_SHOT, 1000 + i % 100);
+        server_stats_record_status(&stats, i % 10 == 0 ? STATUS_GAME_NOT_MY_TURN : STATUS_OK);
+    }
+
+    return NULL;
+}
+
+// More threads than slots so some slots are shared
+Test(server_stats, concurrent_records) {
+    cr_assert_eq(server_stats_init(&stats), ERR_NONE);
+
+    pthread_t threads[THREADS];
+    for (uint32_t i = 0; i < THREADS; i++) {
+        cr_assert_eq(pthread_create(&threads[i], NULL, record_requests, NULL), 0);
+    }
+
+    for (uint32_t i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    StatsSuccessResponseMessage collected;
+    cr_assert_eq(server_stats_collect(&stats, &collected), ERR_NONE);
+
+    StatsLatency* shots = &collected.requests[MSG_PLAYERS_SHOT];
+    cr_assert_eq(shots->count, THREADS * REQUESTS_PER_THREAD);
+    cr_assert(shots->p50 >= 1049 && shots->p50 <= 1050 + 1050 / HISTOGRAM_SUB_BUCKETS, "p50 is %lu", shots->p50);
+    cr_assert_eq(shots->max, 1099);
+    cr_assert_eq(collected.requests[MSG_LOGIN].count, 0);
+
+    cr_assert_eq(collected.statuses[STATUS_OK], THREADS * REQUESTS_PER_THREAD / 10 * 9);
+    cr_assert_eq(collected.statuses[STATUS_GAME_NOT_MY_TURN], THREADS * REQUESTS_PER_THREAD / 10);
+
+    server_stats_deinit(&stats);
+}
+
+Test(server_stats, unknown_types_and_statuses) {
+    cr_assert_eq(server_stats_init(&stats), ERR_NONE);
+
+    server_stats_record_request(&stats, 200, 10);
+    server_stats_record_status(&stats, STATUS_UNKNOWN_ERROR);
+
+    StatsSuccessResponseMessage collected;
+    cr_assert_eq(server_stats_collect(&stats, &collected), ERR_NONE);
+    cr_assert_eq(collected.requests[0].count, 1);
+    cr_assert_eq(collected.statuses[0], 1);
+
+    char filepath[] = "/tmp/server_stats_XXXXXX";
+    int fd = mkstemp(filepath);
+    cr_assert_neq(fd, -1);
+    close(fd);
+
+    cr_assert_eq(server_stats_dump(&stats, filepath), ERR_NONE);
+    FILE* file = fopen(filepath, "r");
+    cr_assert_not_null(file);
+    char line[128];
+    cr_assert_not_null(fgets(line, sizeof(line), file));
+    cr_assert_eq(strncmp(line, "uptime", 6), 0);
+    fclose(file);
+    unlink(filepath);
+
+    server_stats_deinit(&stats);
+}
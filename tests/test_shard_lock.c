@@ -0,0 +1,69 @@
+#include "include/shard_lock.h"
+#include <include/criterion/criterion.h>
+#include <include/criterion/logging.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+
+static void* read_samples(void* params) {
+    shard_lock_t* lock = params;
+    for (uint32_t i = 0; i < 3 * SHARD_LOCK_READ_SAMPLE + SHARD_LOCK_READ_SAMPLE / 2; i++) {
+        uint64_t locked_at = shard_lock_read(lock);
+        cr_assert_eq(locked_at, 0);
+        shard_lock_unlock(lock, locked_at);
+    }
+    return NULL;
+}
+
+Test(shard_lock, counts_reads_and_writes) {
+    shard_lock_t lock;
+    shard_lock_init(&lock);
+
+    // A new thread starts counting from zero, reads short of a full sample aren't added yet
+    pthread_t reader;
+    cr_assert_eq(pthread_create(&reader, NULL, read_samples, &lock), 0);
+    pthread_join(reader, NULL);
+
+    uint64_t locked_at = shard_lock_write(&lock);
+    cr_assert_neq(locked_at, 0);
+    usleep(2000);
+    shard_lock_unlock(&lock, locked_at);
+
+    shard_lock_stats_t stats;
+    shard_lock_stats(&lock, &stats);
+    cr_assert_eq(stats.reads, 3 * SHARD_LOCK_READ_SAMPLE);
+    cr_assert_eq(stats.writes, 1);
+    cr_assert_eq(stats.contended, 0);
+    cr_assert_eq(stats.wait_ns, 0);
+    cr_assert_geq(stats.hold_ns, 2000000);
+
+    shard_lock_destroy(&lock);
+}
+
+static void* read_once(void* params) {
+    shard_lock_t* lock = params;
+    shard_lock_unlock(lock, shard_lock_read(lock));
+    return NULL;
+}
+
+Test(shard_lock, counts_waits_for_held_lock) {
+    shard_lock_t lock;
+    shard_lock_init(&lock);
+
+    uint64_t locked_at = shard_lock_write(&lock);
+
+    pthread_t reader;
+    cr_assert_eq(pthread_create(&reader, NULL, read_once, &lock), 0);
+    usleep(10000);
+    shard_lock_unlock(&lock, locked_at);
+    pthread_join(reader, NULL);
+
+    // Reader found the lock taken and waited until it was released
+    shard_lock_stats_t stats;
+    shard_lock_stats(&lock, &stats);
+    cr_assert_eq(stats.contended, 1);
+    cr_assert_gt(stats.wait_ns, 0);
+    cr_assert_geq(stats.hold_ns, 10000000);
+
+    shard_lock_destroy(&lock);
+}
@@ -0,0 +1,58 @@
+#include "include/errors.h"
+#include "include/slot_pool.h"
+#include <include/criterion/criterion.h>
+#include <include/criterion/logging.h>
+#include <stdint.h>
+
+Test(slot_pool, elements_keep_their_address) {
+    slot_pool_t pool;
+    cr_assert_eq(slot_pool_init(&pool, sizeof(uint64_t)), ERR_NONE);
+
+    uint64_t value = 0;
+    uint64_t* first = slot_pool_push(&pool, &value);
+    cr_assert_not_null(first);
+
+    uint64_t* middle = NULL;
+    for (value = 1; value < 10 * SLOT_POOL_CHUNK_LEN; value++) {
+        uint64_t* pushed = slot_pool_push(&pool, &value);
+        cr_assert_not_null(pushed);
+        if (value == 5 * SLOT_POOL_CHUNK_LEN / 2) {
+            middle = pushed;
+        }
+    }
+
+    // Growing only added chunks, earlier elements weren't copied
+    cr_assert_eq(slot_pool_len(&pool), 10 * SLOT_POOL_CHUNK_LEN);
+    cr_assert_eq(slot_pool_at(&pool, 0), first);
+    cr_assert_eq(slot_pool_at(&pool, 5 * SLOT_POOL_CHUNK_LEN / 2), middle);
+
+    for (uint32_t i = 0; i < slot_pool_len(&pool); i++) {
+        cr_assert_eq(*(uint64_t*)slot_pool_at(&pool, i), i);
+    }
+
+    slot_pool_deinit(&pool);
+}
+
+Test(slot_pool, full_pool_returns_null) {
+    slot_pool_t pool;
+    cr_assert_eq(slot_pool_init(&pool, 1), ERR_NONE);
+
+    uint8_t value = 7;
+    for (uint32_t i = 0; i < SLOT_POOL_MAX_CHUNKS * SLOT_POOL_CHUNK_LEN; i++) {
+        cr_assert_not_null(slot_pool_push(&pool, &value));
+    }
+
+    cr_assert_null(slot_pool_push(&pool, &value));
+    cr_assert_eq(slot_pool_len(&pool), SLOT_POOL_MAX_CHUNKS * SLOT_POOL_CHUNK_LEN);
+    cr_assert_eq(*(uint8_t*)slot_pool_at(&pool, slot_pool_len(&pool) - 1), 7);
+
+    // Popped element makes room again in the chunk it was in
+    uint8_t* last = slot_pool_at(&pool, slot_pool_len(&pool) - 1);
+    slot_pool_pop(&pool);
+    cr_assert_eq(slot_pool_len(&pool), SLOT_POOL_MAX_CHUNKS * SLOT_POOL_CHUNK_LEN - 1);
+    value = 9;
+    cr_assert_eq(slot_pool_push(&pool, &value), last);
+    cr_assert_eq(*last, 9);
+
+    slot_pool_deinit(&pool);
+}
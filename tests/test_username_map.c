@@ -0,0 +1,73 @@
+#include "include/errors.h"
+#include "include/globals.h"
+#include "include/username_map.h"
+#include <include/criterion/criterion.h>
+#include <include/criterion/logging.h>
+#include <stdio.h>
+
+Test(username_map, put_get_remove) {
+    username_map_t map;
+    cr_assert_eq(username_map_init(&map, 0), ERR_NONE);
+
+    char username[USERNAME_MAX_LEN];
+    // Enough users to grow the map a few times
+    for (uint32_t i = 0; i < 1000; i++) {
+        snprintf(username, USERNAME_MAX_LEN, "user%u", i);
+        cr_assert_eq(username_map_put(&map, username, i), ERR_NONE, "Failed to put %s", username);
+    }
+
+    cr_assert_eq(map.len, 1000);
+    cr_assert_eq(username_map_put(&map, "user7", 7), ERR_USERNAME_EXISTS);
+
+    for (uint32_t i = 0; i < 1000; i++) {
+        snprintf(username, USERNAME_MAX_LEN, "user%u", i);
+        uint32_t value = UINT32_MAX;
+        cr_assert_eq(username_map_get(&map, username, &value), 1, "%s not found", username);
+        cr_assert_eq(value, i);
+    }
+
+    uint32_t value;
+    cr_assert_eq(username_map_get(&map, "missing", &value), 0);
+
+    // Remove every other user and make sure the rest are still reachable
+    for (uint32_t i = 0; i < 1000; i += 2) {
+        snprintf(username, USERNAME_MAX_LEN, "user%u", i);
+        cr_assert_eq(username_map_remove(&map, username), 1);
+    }
+
+    cr_assert_eq(username_map_remove(&map, "user0"), 0);
+    cr_assert_eq(map.len, 500);
+
+    for (uint32_t i = 0; i < 1000; i++) {
+        snprintf(username, USERNAME_MAX_LEN, "user%u", i);
+        cr_assert_eq(username_map_get(&map, username, &value), i % 2, "%s lookup is invalid", username);
+    }
+
+    // Removed keys can be added again
+    cr_assert_eq(username_map_put(&map, "user0", 42), ERR_NONE);
+    cr_assert_eq(username_map_get(&map, "user0", &value), 1);
+    cr_assert_eq(value, 42);
+
+    username_map_deinit(&map);
+}
+
+Test(username_map, full_length_username) {
+    username_map_t map;
+    cr_assert_eq(username_map_init(&map, 4), ERR_NONE);
+
+    // Usernames of USERNAME_MAX_LEN characters are not null terminated
+    char first[USERNAME_MAX_LEN];
+    char second[USERNAME_MAX_LEN];
+    memset(first, 'a', USERNAME_MAX_LEN);
+    memset(second, 'a', USERNAME_MAX_LEN);
+    second[USERNAME_MAX_LEN - 1] = 'b';
+
+    cr_assert_eq(username_map_put(&map, first, 1), ERR_NONE);
+    cr_assert_eq(username_map_put(&map, second, 2), ERR_NONE);
+
+    uint32_t value;
+    cr_assert_eq(username_map_get(&map, second, &value), 1);
+    cr_assert_eq(value, 2);
+
+    username_map_deinit(&map);
+}
@@ -0,0 +1,325 @@
+#include "include/checksum.h"
+#include "include/errors.h"
+#include "include/rating.h"
+#include "include/shard_lock.h"
+#include "include/username_map.h"
+#include "include/users.h"
+#include "include/users_journal.h"
+#include "tests/temp_dir.h"
+#include <fcntl.h>
+#include <include/criterion/criterion.h>
+#include <include/criterion/logging.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct {
+    temp_dir_t dir;
+    char snapshot_path[128];
+    char log_path[128];
+    record_table_t users;
+    username_map_t index;
+    shard_lock_t lock;
+    users_journal_t journal;
+} JournalFixture;
+
+static void fixture_open(JournalFixture* f) {
+    cr_assert_eq(users_load(&f->users, &f->index, f->snapshot_path), ERR_NONE);
+    shard_lock_init(&f->lock);
+    cr_assert_eq(users_journal_open(&f->journal, f->snapshot_path, f->log_path, &f->users, &f->index, &f->lock), ERR_NONE);
+}
+
+static void fixture_close(JournalFixture* f) {
+    users_journal_close(&f->journal);
+    shard_lock_destroy(&f->lock);
+    username_map_deinit(&f->index);
+    record_table_destroy(&f->users);
+}
+
+// Paths of the files in a new directory, nothing is opened yet
+static void fixture_create(JournalFixture* f) {
+    temp_dir_create(&f->dir, "users_journal");
+    temp_dir_file(&f->dir, "users.db", f->snapshot_path, sizeof(f->snapshot_path));
+    temp_dir_file(&f->dir, "users.db.log", f->log_path, sizeof(f->log_path));
+}
+
+static void fixture_init(JournalFixture* f) {
+    fixture_create(f);
+    fixture_open(f);
+}
+
+static void fixture_remove(JournalFixture* f) {
+    temp_dir_remove(&f->dir);
+}
+
+static void add_user(JournalFixture* f, const char* username) {
+    server_user_t user = { 0 };
+    strncpy(user.username, username, USERNAME_MAX_LEN);
+    strncpy(user.password, "password", PASSWORD_MAX_LEN);
+
+    uint64_t locked_at = shard_lock_write(&f->lock);
+    uint32_t index = record_table_len(&f->users);
+    cr_assert_eq(username_map_put(&f->index, user.username, index), ERR_NONE);
+    record_table_push(&f->users, &user);
+    uint64_t seq = users_journal_append(&f->journal, USERS_JOURNAL_ADD_USER, index, &user);
+    shard_lock_unlock(&f->lock, locked_at);
+
+    cr_assert_neq(seq, 0);
+    cr_assert_eq(users_journal_sync(&f->journal, seq), ERR_NONE);
+}
+
+static void set_rating(JournalFixture* f, uint32_t index, uint32_t rating) {
+    uint64_t locked_at = shard_lock_write(&f->lock);
+    server_user_t* user = record_table_at(&f->users, index);
+    user->rating = rating;
+    uint64_t seq = users_journal_append(&f->journal, USERS_JOURNAL_UPDATE_USER, index, user);
+    shard_lock_unlock(&f->lock, locked_at);
+
+    cr_assert_neq(seq, 0);
+    cr_assert_eq(users_journal_sync(&f->journal, seq), ERR_NONE);
+}
+
+static off_t file_size(const char* path) {
+    struct stat st;
+    cr_assert_eq(stat(path, &st), 0);
+    return st.st_size;
+}
+
+Test(users_journal, replay_after_restart) {
+    JournalFixture f;
+    fixture_init(&f);
+
+    add_user(&f, "first");
+    add_user(&f, "second");
+    add_user(&f, "third");
+    fixture_close(&f);
+
+    // Nothing was written to the snapshot, everything comes from the log
+    cr_assert_eq(file_size(f.snapshot_path), 0);
+
+    fixture_open(&f);
+    cr_assert_eq(record_table_len(&f.users), 3);
+
+    uint32_t index;
+    cr_assert(username_map_get(&f.index, "second", &index));
+    cr_assert_eq(index, 1);
+    server_user_t* user = record_table_at(&f.users, 2);
+    cr_assert_str_eq(user->username, "third");
+
+    fixture_close(&f);
+    fixture_remove(&f);
+}
+
+Test(users_journal, cut_record_is_dropped) {
+    JournalFixture f;
+    fixture_init(&f);
+
+    add_user(&f, "first");
+    add_user(&f, "second");
+    fixture_close(&f);
+
+    // Crash in the middle of writing the third record
+    int fd = open(f.log_path, O_WRONLY | O_APPEND);
+    cr_assert_neq(fd, -1);
+    char partial[sizeof(users_journal_record_t) / 2];
+    memset(partial, 'x', sizeof(partial));
+    cr_assert_eq(write(fd, partial, sizeof(partial)), (ssize_t)sizeof(partial));
+    close(fd);
+
+    fixture_open(&f);
+    cr_assert_eq(record_table_len(&f.users), 2);
+
+    // Records written after the cut one still get replayed
+    add_user(&f, "third");
+    fixture_close(&f);
+
+    fixture_open(&f);
+    cr_assert_eq(record_table_len(&f.users), 3);
+    cr_assert_eq(file_size(f.log_path), 3 * sizeof(users_journal_record_t));
+
+    fixture_close(&f);
+    fixture_remove(&f);
+}
+
+Test(users_journal, compact_moves_log_to_snapshot) {
+    JournalFixture f;
+    fixture_init(&f);
+
+    add_user(&f, "first");
+    add_user(&f, "second");
+    cr_assert_eq(users_journal_compact(&f.journal), ERR_NONE);
+
+    cr_assert_eq(file_size(f.log_path), 0);
+    cr_assert_eq(file_size(f.snapshot_path), sizeof(users_header_t) + 2 * sizeof(server_user_t));
+
+    add_user(&f, "third");
+    fixture_close(&f);
+
+    fixture_open(&f);
+    cr_assert_eq(record_table_len(&f.users), 3);
+    uint32_t index;
+    cr_assert(username_map_get(&f.index, "third", &index));
+    cr_assert_eq(index, 2);
+
+    fixture_close(&f);
+    fixture_remove(&f);
+}
+
+// Updates of users from the snapshot change the private mapping, not the file
+Test(users_journal, update_replayed_over_snapshot) {
+    JournalFixture f;
+    fixture_init(&f);
+
+    add_user(&f, "first");
+    add_user(&f, "second");
+    cr_assert_eq(users_journal_compact(&f.journal), ERR_NONE);
+    fixture_close(&f);
+
+    fixture_open(&f);
+    set_rating(&f, 0, 1216);
+    set_rating(&f, 1, 1184);
+    set_rating(&f, 0, 1230);
+    fixture_close(&f);
+
+    fixture_open(&f);
+    cr_assert_eq(((server_user_t*)record_table_at(&f.users, 0))->rating, 1230);
+    cr_assert_eq(((server_user_t*)record_table_at(&f.users, 1))->rating, 1184);
+
+    // Snapshot keeps the ratings after the log is emptied
+    cr_assert_eq(users_journal_compact(&f.journal), ERR_NONE);
+    fixture_close(&f);
+
+    fixture_open(&f);
+    cr_assert_eq(((server_user_t*)record_table_at(&f.users, 0))->rating, 1230);
+    cr_assert_eq(file_size(f.log_path), 0);
+
+    fixture_close(&f);
+    fixture_remove(&f);
+}
+
+static uint32_t user_rating(JournalFixture* f, uint32_t index) {
+    return ((server_user_t*)record_table_at(&f->users, index))->rating;
+}
+
+// Server stopped after a compaction swapped the logs, before or after the snapshot was written
+Test(users_journal, old_log_replayed_before_log) {
+    JournalFixture f;
+    fixture_init(&f);
+
+    add_user(&f, "first");
+    add_user(&f, "second");
+    set_rating(&f, 0, 1216);
+    fixture_close(&f);
+
+    // Snapshot wasn't written, the old log has everything
+    cr_assert_eq(rename(f.log_path, f.journal.old_log_path), 0);
+    fixture_open(&f);
+    cr_assert_eq(record_table_len(&f.users), 2);
+    cr_assert_eq(user_rating(&f, 0), 1216);
+    cr_assert_eq(access(f.journal.old_log_path, F_OK), -1);
+    cr_assert_eq(file_size(f.snapshot_path), sizeof(users_header_t) + 2 * sizeof(server_user_t));
+
+    // Snapshot was written but the old log wasn't removed, its records are older than the snapshot
+    set_rating(&f, 0, 1230);
+    set_rating(&f, 0, 1250);
+    int fd = open(f.log_path, O_RDONLY);
+    cr_assert_neq(fd, -1);
+    users_journal_record_t records[2];
+    cr_assert_eq(read(fd, records, sizeof(records)), (ssize_t)sizeof(records));
+    close(fd);
+
+    cr_assert_eq(users_journal_compact(&f.journal), ERR_NONE);
+    cr_assert_eq(access(f.journal.old_log_path, F_OK), -1);
+    add_user(&f, "third");
+    set_rating(&f, 0, 1270);
+    set_rating(&f, 1, 1190);
+    fixture_close(&f);
+
+    fd = open(f.journal.old_log_path, O_WRONLY | O_CREAT, 0644);
+    cr_assert_neq(fd, -1);
+    cr_assert_eq(write(fd, records, sizeof(records)), (ssize_t)sizeof(records));
+    close(fd);
+
+    fixture_open(&f);
+    cr_assert_eq(record_table_len(&f.users), 3);
+    cr_assert_eq(user_rating(&f, 0), 1270);
+    cr_assert_eq(user_rating(&f, 1), 1190);
+    uint32_t index;
+    cr_assert(username_map_get(&f.index, "third", &index));
+    cr_assert_eq(index, 2);
+
+    fixture_close(&f);
+    fixture_remove(&f);
+}
+
+Test(users_journal, legacy_files_converted) {
+    JournalFixture f;
+    fixture_create(&f);
+
+    FILE* snapshot = fopen(f.snapshot_path, "w");
+    cr_assert_not_null(snapshot);
+    server_user_legacy_t legacy_users[2] = { { "first", "password" }, { "second", "password" } };
+    cr_assert_eq(fwrite(legacy_users, sizeof(legacy_users), 1, snapshot), 1);
+    fclose(snapshot);
+
+    users_journal_legacy_record_t record = { .type = USERS_JOURNAL_ADD_USER, .index = 2, .user = { "third", "password" } };
+    record.checksum = checksum_crc32(0, (const char*)&record + sizeof(record.checksum), sizeof(record) - sizeof(record.checksum));
+    FILE* log = fopen(f.log_path, "w");
+    cr_assert_not_null(log);
+    cr_assert_eq(fwrite(&record, sizeof(record), 1, log), 1);
+    fclose(log);
+
+    fixture_open(&f);
+    cr_assert_eq(record_table_len(&f.users), 3);
+    for (uint32_t i = 0; i < 3; i++) {
+        cr_assert_eq(((server_user_t*)record_table_at(&f.users, i))->rating, RATING_DEFAULT);
+    }
+
+    // Legacy log is replaced by a new snapshot so new records can be appended
+    cr_assert_eq(file_size(f.log_path), 0);
+    cr_assert_eq(file_size(f.snapshot_path), sizeof(users_header_t) + 3 * sizeof(server_user_t));
+
+    add_user(&f, "fourth");
+    fixture_close(&f);
+
+    fixture_open(&f);
+    cr_assert_eq(record_table_len(&f.users), 4);
+    uint32_t index;
+    cr_assert(username_map_get(&f.index, "third", &index));
+    cr_assert_eq(index, 2);
+
+    fixture_close(&f);
+    fixture_remove(&f);
+}
+
+// Failed fsync isn't reported as synced, neither are the records written after it
+Test(users_journal, failed_sync_is_reported) {
+    JournalFixture f;
+    fixture_init(&f);
+    add_user(&f, "first");
+
+    // Records still get written to a pipe but it can't be synced
+    int fds[2];
+    cr_assert_eq(pipe(fds), 0);
+    cr_assert_neq(dup2(fds[1], f.journal.fd), -1);
+    close(fds[1]);
+
+    server_user_t user = { 0 };
+    strncpy(user.username, "second", USERNAME_MAX_LEN);
+    uint64_t seq = users_journal_append(&f.journal, USERS_JOURNAL_ADD_USER, 1, &user);
+    cr_assert_neq(seq, 0);
+    cr_assert_eq(users_journal_sync(&f.journal, seq), ERR_SYNC_FAILED);
+
+    seq = users_journal_append(&f.journal, USERS_JOURNAL_ADD_USER, 2, &user);
+    cr_assert_neq(seq, 0);
+    cr_assert_eq(users_journal_sync(&f.journal, seq), ERR_SYNC_FAILED);
+
+    // Records synced before the failure stay synced
+    cr_assert_eq(users_journal_sync(&f.journal, 1), ERR_NONE);
+
+    fixture_close(&f);
+    close(fds[0]);
+    fixture_remove(&f);
+}